@@ -0,0 +1,94 @@
+/*
+ * Bay.h - 洗车位（一块ESP32-S3控制多个洗车位）
+ *
+ * 功能：
+ * - 每个洗车位一套：MFRC522读卡器（共用SPI总线，各自片选/复位，见 NfcBusLock）、脉冲输出、
+ *   OK/SELECT按钮，以及状态机会话（状态、超时、套餐、卡片、网络请求、提示页）和视图模型
+ * - 引脚见 config.h 的 BAY_PINS；启用的洗车位数和各洗车位的机器ID存在NVS（ConfigManager）
+ * - 状态处理函数都以洗车位为参数，loop()按轮转顺序依次执行各洗车位（见 GoldSky_Lite.ino）
+ * - 只有 display=true 的洗车位把视图模型发布给OLED渲染任务并驱动状态LED，
+ *   其余洗车位的视图模型只在串口 bays 中显示（按钮和蜂鸣器反馈）
+ *
+ * 线程安全：只在 loop() 中使用（读卡器在启动任务中初始化，完成后才进入loop）
+ *
+ * 版本: v1.0
+ */
+
+#ifndef BAY_H
+#define BAY_H
+
+#include <Arduino.h>
+#include <MFRC522.h>
+#include "config.h"
+#include "NfcReader.h"
+#include "PulseEngine.h"
+
+#define BAY_BTN_OK 0
+#define BAY_BTN_SELECT 1
+
+extern NfcBusLock nfcBus;  // 各洗车位的读卡器共用SPI总线（GoldSky_Lite.ino）
+
+class Bay {
+public:
+  const uint8_t index;
+  const BayPins& pins;
+
+  // 硬件（成员按声明顺序构造：rfid 必须在 nfcBackend 之前）
+  MFRC522 rfid;
+  Mfrc522NfcBackend nfcBackend;
+  NfcReader nfc;                    // 读卡频率按本洗车位的状态调整
+  EspTimerPulseBackend pulseBackend;
+  PulseEngine pulse;                // 本洗车位的脉冲输出
+
+  // 状态机
+  SystemState state = STATE_WELCOME;
+  unsigned long stateStartTime = 0;
+  unsigned long stateTimeoutMs = 0;            // 当前状态的超时（进入时从表中读取，提示页可覆盖）
+  SystemState stateTimeoutTarget = STATE_WELCOME;
+  char messageText[40] = "";                   // STATE_MESSAGE 显示的文字
+  bool messageIsError = false;
+
+  // 会话
+  int selectedPackage = 0;
+  CardInfo cardInfo;
+  unsigned long processingStartTime = 0;
+  uint32_t pendingNetTicket = 0;   // 当前等待的网络请求（0=无）
+  uint32_t cardTapUs = 0;          // 本次会话刷卡的检测时间（micros，0=无，耗时统计用）
+  int consecutiveErrors = 0;
+  int lastLoggedPulses = 0;
+
+  // 先刷卡：欢迎页/选套餐页刷的卡片和后台查询结果（查询请求为 pendingNetTicket）
+  CardUid prefetchUid = {};        // 空 = 本次会话还没有提前刷卡
+  CardInfo prefetchInfo;           // 查询结果（prefetchReady 时有效）
+  bool prefetchReady = false;
+  unsigned long prefetchAtMs = 0;  // 查询结果返回的时间（判断是否过期）
+
+  // 读卡
+  bool nfcWorking = false;
+  int nfcReadFailCount = 0;        // 连续读卡失败次数（显示"Adjust Card"提示）
+  CardUid pendingCardUID = {};     // 本次loop读到的卡片，由刷卡状态取走
+  uint32_t pendingCardTapUs = 0;   // 该卡片检测开始的时间（micros）
+
+  // 按钮消抖（BAY_BTN_OK / BAY_BTN_SELECT）
+  unsigned long lastDebounceTime[2] = {0, 0};
+  bool lastButtonState[2] = {false, false};
+  bool buttonPressed[2] = {false, false};
+
+  ViewModel view = {};             // 本洗车位正在编辑的视图模型
+
+  Bay(uint8_t bayIndex)
+    : index(bayIndex), pins(BAY_PINS[bayIndex]), rfid(pins.nfcCs, pins.nfcRst),
+      nfcBackend(rfid, pins.nfcCs, pins.nfcRst, pins.nfcIrq, &nfcBus), pulseBackend(pins.pulse) {
+    cardInfo.clear();
+    prefetchInfo.clear();
+  }
+
+  int number() const { return index + 1; }  // 日志/串口中的编号（从1开始）
+  bool hasDisplay() const { return pins.display; }
+
+  int buttonPin(int button) const {
+    return button == BAY_BTN_OK ? pins.btnOk : pins.btnSelect;
+  }
+};
+
+#endif // BAY_H
@@ -0,0 +1,153 @@
+/*
+ * BootProfile.h - 启动各阶段耗时记录
+ *
+ * 功能：
+ * - 记录启动各阶段（串口/日志、OLED、NFC、配置、离线日志/缓存、网络任务、界面、WiFi）
+ *   的开始时刻和耗时，OLED/NFC在各自的初始化任务中并行执行，WiFi在后台连接
+ * - 记录进入欢迎界面（可以刷卡）的时刻
+ * - 随启动后第一条健康度日志上传（boot_report，见 supabase/006_health_boot_report.sql），
+ *   串口命令 boot 查看
+ *
+ * 线程安全：初始化任务和loop()都会记录，用自旋锁保护
+ *
+ * 版本: v1.0
+ */
+
+#ifndef BOOT_PROFILE_H
+#define BOOT_PROFILE_H
+
+#include <Arduino.h>
+
+// =================== 阶段 ===================
+enum BootStage {
+  BOOT_STAGE_CORE,      // 串口、日志任务、GPIO、声光定时器
+  BOOT_STAGE_OLED,      // I2C + OLED（初始化任务）
+  BOOT_STAGE_NFC,       // SPI + 各洗车位的MFRC522（每个读卡器一个初始化任务，全部完成才结束）
+  BOOT_STAGE_CONFIG,    // NVS + 配置管理器 + 洗车位按钮/脉冲输出
+  BOOT_STAGE_STORAGE,   // 离线交易日志、卡片缓存、健康度分钟记录
+  BOOT_STAGE_NET,       // Supabase客户端 + 网络任务
+  BOOT_STAGE_UI,        // 界面资源 + 渲染任务
+  BOOT_STAGE_WIFI,      // WiFi.begin → 获取IP（后台）
+  BOOT_STAGE_COUNT
+};
+
+#define BOOT_REPORT_JSON_MAX 320
+
+enum BootStageStatus {
+  BOOT_STATUS_NONE,
+  BOOT_STATUS_RUNNING,
+  BOOT_STATUS_OK,
+  BOOT_STATUS_FAILED
+};
+
+class BootProfile {
+private:
+  struct Stage {
+    uint32_t startMs;
+    uint32_t endMs;
+    uint8_t status;
+  };
+
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+  Stage stages[BOOT_STAGE_COUNT];
+  uint32_t readyMs = 0;
+
+  static const char* stageName(int stage) {
+    static const char* NAMES[BOOT_STAGE_COUNT] = {
+      "core", "oled", "nfc", "config", "storage", "net", "ui", "wifi"
+    };
+    return stage >= 0 && stage < BOOT_STAGE_COUNT ? NAMES[stage] : "unknown";
+  }
+
+  void snapshot(Stage* copy, uint32_t& ready) {
+    portENTER_CRITICAL(&mux);
+    memcpy(copy, stages, sizeof(stages));
+    ready = readyMs;
+    portEXIT_CRITICAL(&mux);
+  }
+
+public:
+  BootProfile() {
+    memset(stages, 0, sizeof(stages));
+  }
+
+  void start(BootStage stage) {
+    uint32_t now = millis();
+    portENTER_CRITICAL(&mux);
+    stages[stage].startMs = now;
+    stages[stage].endMs = 0;
+    stages[stage].status = BOOT_STATUS_RUNNING;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // 只记录第一次完成（WiFi之后的重连不计）
+  void finish(BootStage stage, bool ok = true) {
+    uint32_t now = millis();
+    portENTER_CRITICAL(&mux);
+    if (stages[stage].status == BOOT_STATUS_RUNNING) {
+      stages[stage].endMs = now;
+      stages[stage].status = ok ? BOOT_STATUS_OK : BOOT_STATUS_FAILED;
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // 进入欢迎界面
+  void markReady() {
+    uint32_t now = millis();
+    portENTER_CRITICAL(&mux);
+    if (readyMs == 0) readyMs = now;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  uint32_t getReadyMs() const { return readyMs; }
+
+  // {"ready_ms":820,"stages":{"core":[0,35,1],"oled":[36,240,1],...}}
+  // 每个阶段：[开始ms, 耗时ms, 状态]，状态 1=成功 0=失败 -1=未完成（耗时为截至现在）
+  size_t toJson(char* out, size_t size) {
+    Stage copy[BOOT_STAGE_COUNT];
+    uint32_t ready;
+    snapshot(copy, ready);
+    uint32_t now = millis();
+
+    size_t length = snprintf(out, size, "{\"ready_ms\":%lu,\"stages\":{", (unsigned long)ready);
+    bool any = false;
+    for (int i = 0; i < BOOT_STAGE_COUNT && length < size; i++) {
+      const Stage& s = copy[i];
+      if (s.status == BOOT_STATUS_NONE) continue;
+      bool done = s.status != BOOT_STATUS_RUNNING;
+      length += snprintf(out + length, size - length, "%s\"%s\":[%lu,%lu,%d]", any ? "," : "",
+                         stageName(i), (unsigned long)s.startMs,
+                         (unsigned long)((done ? s.endMs : now) - s.startMs),
+                         done ? (s.status == BOOT_STATUS_OK ? 1 : 0) : -1);
+      any = true;
+    }
+    if (length < size) length += snprintf(out + length, size - length, "}}");
+    if (length >= size) {
+      out[0] = '\0';  // 缓冲区不足：不上传截断的JSON
+      return 0;
+    }
+    return length;
+  }
+
+  void printStatus() {
+    Stage copy[BOOT_STAGE_COUNT];
+    uint32_t ready;
+    snapshot(copy, ready);
+    uint32_t now = millis();
+
+    Serial.println("\n=== 启动耗时 ===");
+    Serial.printf("进入欢迎界面: %lu ms\n", (unsigned long)ready);
+    Serial.println("阶段        开始(ms)  耗时(ms)  结果");
+    for (int i = 0; i < BOOT_STAGE_COUNT; i++) {
+      const Stage& s = copy[i];
+      if (s.status == BOOT_STATUS_NONE) continue;
+      bool done = s.status != BOOT_STATUS_RUNNING;
+      Serial.printf("%-10s %9lu %9lu  %s\n", stageName(i), (unsigned long)s.startMs,
+                    (unsigned long)((done ? s.endMs : now) - s.startMs),
+                    !done ? "进行中" : (s.status == BOOT_STATUS_OK ? "成功" : "失败"));
+    }
+    Serial.println("================\n");
+  }
+};
+
+#endif // BOOT_PROFILE_H
@@ -0,0 +1,354 @@
+/*
+ * CardCache.h - 本地卡片缓存 + 离线授权
+ *
+ * 功能：
+ * - 按二进制UID缓存卡片余额、状态、会员类型和最后更新日期
+ * - LRU淘汰（有未结清离线扣费的记录不淘汰），在线时超过TTL的记录需重新向服务器查询
+ * - 快照保存到NVS（独立命名空间），重启后可用于离线授权；断网授权后立即保存
+ * - 离线消费策略：断网期间每张卡累计扣费不超过上限（可配置，0=禁止离线消费）
+ * - 离线累计在服务器结清（离线日志重放扣费）后才扣除，刷新服务器余额时保留未结清的离线扣费
+ *
+ * 授权流程：
+ * - 在线 + 缓存新鲜 + 余额充足 → 立即授权，网络任务在后台刷新余额并扣费
+ * - 离线 + 缓存命中 + 策略允许 → 扣本地余额，交易写入离线日志
+ * - 其他情况 → 联网查询（原流程）
+ *
+ * 线程安全：loop()和网络任务都会访问，内部使用互斥锁
+ *
+ * 版本: v1.0
+ */
+
+#ifndef CARD_CACHE_H
+#define CARD_CACHE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "config.h"
+
+// =================== 缓存配置 ===================
+#define CARD_CACHE_SIZE 64                         // 最多缓存64张卡（约5KB）
+#define CARD_CACHE_TTL_MS (24UL * 3600 * 1000)     // 在线授权允许的最大缓存时间：24小时
+#define CARD_CACHE_SAVE_INTERVAL_MS 60000          // 快照最短保存间隔
+#define CARD_CACHE_NAMESPACE "cardcache"
+#define CARD_CACHE_VERSION 2                      // v2：二进制UID（4/7/10字节）
+
+// =================== 缓存记录（固定大小，直接保存为快照）===================
+struct CardCacheEntry {
+  CardUid uid;                 // 卡片UID（size=0为空槽位）
+  float balance;               // 余额（含本地扣费）
+  float offlineSpent;          // 断网授权、服务器尚未结清的累计扣费
+  uint32_t lastUsed;           // LRU计数
+  uint32_t fetchedAt;          // 最后一次从服务器刷新的时间 millis()
+  uint8_t synced;              // 1=本次开机已从服务器刷新（快照加载的记录为0）
+  uint8_t isActive;
+  uint8_t memberType;
+  uint8_t reserved;
+  char displayCardNumber[20];
+  char userName[24];
+  char updatedAt[12];          // YYYY-MM-DD
+};
+
+// 授权结果
+enum CardCacheResult {
+  CARD_CACHE_MISS,              // 需要联网查询
+  CARD_CACHE_APPROVED,          // 已授权并扣除本地余额
+  CARD_CACHE_DECLINED_INACTIVE, // 离线：卡片已停用
+  CARD_CACHE_DECLINED_BALANCE,  // 离线：余额不足
+  CARD_CACHE_DECLINED_LIMIT     // 离线：超过离线消费上限
+};
+
+// =================== 卡片缓存 ===================
+class CardCache {
+private:
+  CardCacheEntry entries[CARD_CACHE_SIZE];
+  SemaphoreHandle_t mutex = NULL;
+  Preferences snapshot;
+
+  uint32_t useCounter = 0;
+  bool dirty = false;
+  unsigned long lastSaveTime = 0;
+
+  // 统计
+  uint32_t hitCount = 0;
+  uint32_t missCount = 0;
+  uint32_t offlineApprovedCount = 0;
+  uint32_t offlineDeclinedCount = 0;
+  uint32_t evictCount = 0;
+
+  void lock() { xSemaphoreTake(mutex, portMAX_DELAY); }
+  void unlock() { xSemaphoreGive(mutex); }
+
+  CardCacheEntry* find(const CardUid& uid) {
+    if (uid.isEmpty()) return NULL;
+    for (int i = 0; i < CARD_CACHE_SIZE; i++) {
+      if (entries[i].uid == uid) return &entries[i];
+    }
+    return NULL;
+  }
+
+  // 找到空槽位，没有则淘汰最久未使用的记录
+  // 有未结清离线扣费的记录不淘汰（离线消费上限和重放结清依赖它），全部如此时返回NULL
+  CardCacheEntry* allocate(const CardUid& uid) {
+    CardCacheEntry* victim = NULL;
+    for (int i = 0; i < CARD_CACHE_SIZE; i++) {
+      if (entries[i].uid.isEmpty()) {
+        victim = &entries[i];
+        break;
+      }
+      if (entries[i].offlineSpent > 0) continue;
+      if (victim == NULL || entries[i].lastUsed < victim->lastUsed) victim = &entries[i];
+    }
+
+    if (victim == NULL) return NULL;
+    if (!victim->uid.isEmpty()) evictCount++;
+    memset(victim, 0, sizeof(CardCacheEntry));
+    victim->uid = uid;
+    return victim;
+  }
+
+  void touch(CardCacheEntry* e) {
+    e->lastUsed = ++useCounter;
+  }
+
+  bool isFresh(const CardCacheEntry* e) {
+    return e->synced && (millis() - e->fetchedAt) < CARD_CACHE_TTL_MS;
+  }
+
+  // 写入NVS快照（调用者持有锁）
+  void saveLocked() {
+    snapshot.putBytes("entries", entries, sizeof(entries));
+    snapshot.putUChar("version", CARD_CACHE_VERSION);
+    dirty = false;
+    lastSaveTime = millis();
+  }
+
+  static void toCardInfo(const CardCacheEntry* e, CardInfo& info) {
+    info.clear();
+    info.uid = e->uid;
+    info.setDisplayCardNumber(e->displayCardNumber);
+    info.balance = e->balance;
+    info.isValid = true;
+    info.isActive = e->isActive;
+    strlcpy(info.userName, e->userName, sizeof(info.userName));
+    info.memberType = e->memberType;
+    info.cardType = e->memberType <= 7 ? MEMBER_TYPES[e->memberType] : "Unknown";
+    strlcpy(info.lastTransactionDate, e->updatedAt, sizeof(info.lastTransactionDate));
+  }
+
+public:
+
+  // 创建互斥锁并加载快照
+  void begin() {
+    mutex = xSemaphoreCreateMutex();
+    memset(entries, 0, sizeof(entries));
+
+    snapshot.begin(CARD_CACHE_NAMESPACE, false);
+    if (snapshot.getUChar("version", 0) == CARD_CACHE_VERSION &&
+        snapshot.getBytesLength("entries") == sizeof(entries)) {
+      snapshot.getBytes("entries", entries, sizeof(entries));
+    }
+
+    // 快照中的记录只能用于离线授权，在线时需重新查询
+    int loaded = 0;
+    for (int i = 0; i < CARD_CACHE_SIZE; i++) {
+      entries[i].synced = 0;
+      if (!entries[i].uid.isEmpty()) {
+        loaded++;
+        if (entries[i].lastUsed > useCounter) useCounter = entries[i].lastUsed;
+      }
+    }
+
+    if (loaded > 0) {
+      Serial.printf("💳 卡片缓存快照: %d 张\n", loaded);
+    }
+  }
+
+  // 刷卡授权（loop()调用，不访问网络）
+  // 授权成功时info为扣费前的卡片信息
+  CardCacheResult authorize(const CardUid& uid, float amount, bool online,
+                            float offlineCap, CardInfo& info) {
+    CardCacheResult result = CARD_CACHE_MISS;
+
+    lock();
+    CardCacheEntry* e = find(uid);
+    if (e == NULL) {
+      missCount++;
+    } else if (online) {
+      // 在线：只有新鲜且明确可用的记录才直接授权，其余交给服务器判断
+      if (isFresh(e) && e->isActive && e->balance >= amount) {
+        toCardInfo(e, info);
+        e->balance -= amount;
+        result = CARD_CACHE_APPROVED;
+        hitCount++;
+        dirty = true;
+      } else {
+        missCount++;
+      }
+      touch(e);
+    } else {
+      if (!e->isActive) {
+        result = CARD_CACHE_DECLINED_INACTIVE;
+      } else if (e->balance < amount) {
+        result = CARD_CACHE_DECLINED_BALANCE;
+      } else if (e->offlineSpent + amount > offlineCap) {
+        result = CARD_CACHE_DECLINED_LIMIT;
+      } else {
+        toCardInfo(e, info);
+        e->balance -= amount;
+        e->offlineSpent += amount;
+        result = CARD_CACHE_APPROVED;
+        // 立即保存：断网期间重启不会丢失离线累计（否则重启后可再次用满离线消费上限）
+        saveLocked();
+      }
+
+      if (result == CARD_CACHE_APPROVED) {
+        offlineApprovedCount++;
+      } else {
+        offlineDeclinedCount++;
+      }
+      touch(e);
+    }
+    unlock();
+
+    return result;
+  }
+
+  // 撤销授权（后台扣费提交失败时）
+  void refund(const CardUid& uid, float amount, bool offline) {
+    lock();
+    CardCacheEntry* e = find(uid);
+    if (e != NULL) {
+      e->balance += amount;
+      if (offline) {
+        e->offlineSpent -= amount;
+        if (e->offlineSpent < 0) e->offlineSpent = 0;
+      }
+    }
+    unlock();
+  }
+
+  bool contains(const CardUid& uid) {
+    lock();
+    bool found = find(uid) != NULL;
+    unlock();
+    return found;
+  }
+
+  // 只读查询（离线时显示VIP信息）
+  bool peek(const CardUid& uid, CardInfo& info) {
+    lock();
+    CardCacheEntry* e = find(uid);
+    if (e != NULL) {
+      toCardInfo(e, info);
+      touch(e);
+    }
+    unlock();
+    return e != NULL;
+  }
+
+  // 服务器查询结果写入缓存（网络任务调用）
+  // 服务器余额还不含未结清的离线扣费，本地余额按两者之差计算
+  void store(const CardInfo& info) {
+    if (info.uid.isEmpty() || !info.isValid) return;
+
+    lock();
+    CardCacheEntry* e = find(info.uid);
+    if (e == NULL) e = allocate(info.uid);
+    if (e == NULL) {
+      unlock();
+      return;
+    }
+
+    e->balance = info.balance - e->offlineSpent;
+    e->fetchedAt = millis();
+    e->synced = 1;
+    e->isActive = info.isActive ? 1 : 0;
+    e->memberType = (uint8_t)info.memberType;
+    strlcpy(e->displayCardNumber, info.displayCardNumber, sizeof(e->displayCardNumber));
+    strlcpy(e->userName, info.userName, sizeof(e->userName));
+    strlcpy(e->updatedAt, info.lastTransactionDate, sizeof(e->updatedAt));
+    touch(e);
+    dirty = true;
+    unlock();
+  }
+
+  // 服务器扣费成功后更新余额（网络任务调用）
+  // settledOffline：本次扣费是断网授权的，从离线累计中扣除
+  void applyServerBalance(const CardUid& uid, float balance, float settledOffline = 0) {
+    lock();
+    CardCacheEntry* e = find(uid);
+    if (e != NULL) {
+      e->offlineSpent -= settledOffline;
+      if (e->offlineSpent < 0) e->offlineSpent = 0;
+      e->balance = balance - e->offlineSpent;
+      e->fetchedAt = millis();
+      e->synced = 1;
+      dirty = true;
+    }
+    unlock();
+  }
+
+  // 断网授权的扣费已结清但没有可用的服务器余额（重复请求/服务器拒绝扣费）：只扣除离线累计
+  void settleOffline(const CardUid& uid, float amount) {
+    lock();
+    CardCacheEntry* e = find(uid);
+    if (e != NULL) {
+      e->offlineSpent -= amount;
+      if (e->offlineSpent < 0) e->offlineSpent = 0;
+      dirty = true;
+    }
+    unlock();
+  }
+
+  // 服务器拒绝了缓存授权的扣费（卡片停用/余额不足）：在线时不再凭缓存授权，下次刷卡重新查询
+  void expire(const CardUid& uid) {
+    lock();
+    CardCacheEntry* e = find(uid);
+    if (e != NULL) {
+      e->synced = 0;
+      dirty = true;
+    }
+    unlock();
+  }
+
+  // 保存快照（loop()空闲时调用，有变化且超过最短间隔才写NVS）
+  void saveIfDue() {
+    if (!dirty || millis() - lastSaveTime < CARD_CACHE_SAVE_INTERVAL_MS) return;
+
+    lock();
+    saveLocked();
+    unlock();
+  }
+
+  void clear() {
+    lock();
+    memset(entries, 0, sizeof(entries));
+    snapshot.clear();
+    dirty = false;
+    unlock();
+  }
+
+  void printStatus() {
+    int used = 0, fresh = 0;
+    float offlineTotal = 0;
+
+    lock();
+    for (int i = 0; i < CARD_CACHE_SIZE; i++) {
+      if (entries[i].uid.isEmpty()) continue;
+      used++;
+      if (isFresh(&entries[i])) fresh++;
+      offlineTotal += entries[i].offlineSpent;
+    }
+    unlock();
+
+    Serial.println("\n=== 卡片缓存 ===");
+    Serial.printf("缓存卡片: %d/%d (新鲜 %d)\n", used, CARD_CACHE_SIZE, fresh);
+    Serial.printf("命中: %u, 未命中: %u, 淘汰: %u\n", hitCount, missCount, evictCount);
+    Serial.printf("离线授权: %u, 离线拒绝: %u, 未结清离线扣费: $%.2f\n",
+                  offlineApprovedCount, offlineDeclinedCount, offlineTotal);
+    Serial.printf("快照: %s\n", dirty ? "待保存" : "已保存");
+    Serial.println("================\n");
+  }
+};
+
+#endif // CARD_CACHE_H
@@ -0,0 +1,125 @@
+/*
+ * CardUid.h - 卡片UID（固定大小二进制值）
+ *
+ * 功能：
+ * - 保存4/7/10字节UID（单倍/双倍/三倍长度），按值复制，不分配堆内存
+ * - 格式化为十六进制或十进制，写入调用方提供的缓冲区
+ * - 十进制按大端解释（与服务器 card_uid 一致：4字节卡 = 原来的 hexUIDToDecimal 结果）
+ *
+ * 说明：
+ * - 十进制转换每轮除以10000（base-256逐字节长除法，只用32位运算），
+ *   10字节UID（最多25位）也不会溢出
+ * - 服务器 card_uid 为 NUMERIC(25,0)（supabase/002_debit_card_rpc.sql），4/7/10字节UID都可以存储
+ *
+ * 版本: v1.0
+ */
+
+#ifndef CARD_UID_H
+#define CARD_UID_H
+
+#include <Arduino.h>
+
+#define CARD_UID_MAX_BYTES 10
+#define CARD_UID_HEX_LEN (CARD_UID_MAX_BYTES * 2 + 1)   // 20位 + 结束符
+#define CARD_UID_DEC_LEN 26                             // 10字节最多25位 + 结束符
+
+struct CardUid {
+  uint8_t size;                       // 0 = 空
+  uint8_t bytes[CARD_UID_MAX_BYTES];
+
+  void clear() {
+    memset(this, 0, sizeof(*this));
+  }
+
+  bool isEmpty() const { return size == 0; }
+
+  bool operator==(const CardUid& other) const {
+    return size == other.size && memcmp(bytes, other.bytes, size) == 0;
+  }
+
+  bool operator!=(const CardUid& other) const { return !(*this == other); }
+
+  static CardUid fromBytes(const uint8_t* data, uint8_t length) {
+    CardUid uid;
+    uid.clear();
+    uid.size = min(length, (uint8_t)CARD_UID_MAX_BYTES);
+    memcpy(uid.bytes, data, uid.size);
+    return uid;
+  }
+
+  // 解析十进制UID（旧版离线记录/NVS队列）：不超过32位按4字节，否则按7字节
+  static bool parseDecimal(const char* text, CardUid& out) {
+    out.clear();
+    uint64_t value = 0;
+    if (text == NULL || *text == '\0') return false;
+    for (const char* p = text; *p != '\0'; p++) {
+      if (*p < '0' || *p > '9') return false;
+      value = value * 10 + (*p - '0');
+      if (value >> 56) return false;
+    }
+
+    out.size = value > 0xFFFFFFFFULL ? 7 : 4;
+    for (int i = out.size - 1; i >= 0; i--) {
+      out.bytes[i] = (uint8_t)value;
+      value >>= 8;
+    }
+    return true;
+  }
+
+  // 大写十六进制，返回长度（缓冲区不足时返回0）
+  size_t toHex(char* out, size_t outSize) const {
+    static const char HEX_DIGITS[] = "0123456789ABCDEF";
+    size_t length = size * 2;
+    if (outSize <= length) {
+      if (outSize > 0) out[0] = '\0';
+      return 0;
+    }
+    for (uint8_t i = 0; i < size; i++) {
+      out[i * 2] = HEX_DIGITS[bytes[i] >> 4];
+      out[i * 2 + 1] = HEX_DIGITS[bytes[i] & 0x0F];
+    }
+    out[length] = '\0';
+    return length;
+  }
+
+  // 十进制（大端），返回长度（缓冲区不足时返回0）
+  size_t toDecimal(char* out, size_t outSize) const {
+    uint8_t work[CARD_UID_MAX_BYTES];
+    char digits[CARD_UID_DEC_LEN];
+    size_t count = 0;
+
+    memcpy(work, bytes, size);
+    int start = 0;
+    while (start < size && work[start] == 0) start++;
+
+    // 每轮得到最低4位十进制数字
+    while (start < size) {
+      uint32_t rem = 0;
+      for (int i = start; i < size; i++) {
+        uint32_t cur = (rem << 8) | work[i];
+        work[i] = (uint8_t)(cur / 10000);
+        rem = cur % 10000;
+      }
+      while (start < size && work[start] == 0) start++;
+
+      for (int k = 0; k < 4; k++) {
+        digits[count++] = '0' + rem % 10;
+        rem /= 10;
+        if (start >= size && rem == 0) break;   // 最高一组不补零
+      }
+    }
+    if (count == 0) digits[count++] = '0';
+
+    if (outSize <= count) {
+      if (outSize > 0) out[0] = '\0';
+      return 0;
+    }
+    for (size_t i = 0; i < count; i++) {
+      out[i] = digits[count - 1 - i];
+    }
+    out[count] = '\0';
+    return count;
+  }
+};
+
+#endif // CARD_UID_H
@@ -5,6 +5,8 @@
  * 功能:
  * - WiFi凭证管理
  * - API密钥管理
+ * - 离线消费上限管理
+ * - 洗车位数和各洗车位的机器ID（多洗车位，见 Bay.h）
  * - 首次启动时从config.h加载默认值
  * - 支持运行时更新配置
  */
@@ -14,6 +16,7 @@
 
 #include <Preferences.h>
 #include <Arduino.h>
+#include "config.h"
 
 class ConfigManager {
 private:
@@ -24,8 +27,16 @@ private:
   String supabaseURL;
   String supabaseKey;
   String machineID;
+  float offlineSpendCap = OFFLINE_SPEND_CAP_DEFAULT;
+  int bayCount = BAY_COUNT_DEFAULT;
+  bool tapFirst = TAP_FIRST_DEFAULT;
+  String bayMachineIDs[MAX_BAYS];   // 空 = 由机器ID派生
   bool initialized = false;
 
+  static String bayIdKey(int bay) {
+    return "bay_id" + String(bay);
+  }
+
 public:
   ConfigManager(Preferences* p) : prefs(p) {}
 
@@ -54,12 +65,22 @@ public:
     supabaseURL = prefs->getString("supa_url", defaultURL);
     supabaseKey = prefs->getString("supa_key", defaultKey);
     machineID = prefs->getString("machine_id", defaultMachineID);
+    offlineSpendCap = prefs->getFloat("offline_cap", OFFLINE_SPEND_CAP_DEFAULT);
+    bayCount = constrain(prefs->getInt("bays", BAY_COUNT_DEFAULT), 1, MAX_BAYS);
+    tapFirst = prefs->getBool("tap_first", TAP_FIRST_DEFAULT);
+    for (int i = 0; i < MAX_BAYS; i++) {
+      bayMachineIDs[i] = i < bayCount && prefs->isKey(bayIdKey(i).c_str())
+                           ? prefs->getString(bayIdKey(i).c_str(), "") : "";
+    }
 
     initialized = true;
 
     Serial.println("✅ 配置已加载:");
     Serial.println("   WiFi SSID: " + wifiSSID);
     Serial.println("   Machine ID: " + machineID);
+    Serial.println("   洗车位: " + String(bayCount));
+    Serial.println("   流程: " + String(tapFirst ? "先刷卡" : "先选套餐"));
+    Serial.println("   离线消费上限: $" + String(offlineSpendCap, 2));
     Serial.println("   Supabase URL: " + supabaseURL.substring(0, 30) + "...");
   }
 
@@ -69,6 +90,16 @@ public:
   String getSupabaseURL() { return supabaseURL; }
   String getSupabaseKey() { return supabaseKey; }
   String getMachineID() { return machineID; }
+  float getOfflineSpendCap() { return offlineSpendCap; }
+  int getBayCount() { return bayCount; }
+  bool getTapFirst() { return tapFirst; }
+
+  // 洗车位的机器ID（交易记录用）：洗车位1沿用机器ID，其余为 <机器ID>-<编号>，可单独设置
+  String getBayMachineID(int bay) {
+    if (bay < 0 || bay >= MAX_BAYS) bay = 0;
+    if (bayMachineIDs[bay].length() > 0) return bayMachineIDs[bay];
+    return bay == 0 ? machineID : machineID + "-" + String(bay + 1);
+  }
 
   // Setter方法（运行时更新）
   void setWiFiCredentials(const String& ssid, const String& pass) {
@@ -93,6 +124,38 @@ public:
     Serial.println("✅ 机器ID已更新: " + id);
   }
 
+  void setOfflineSpendCap(float cap) {
+    offlineSpendCap = cap < 0 ? 0 : cap;
+    prefs->putFloat("offline_cap", offlineSpendCap);
+    Serial.println("✅ 离线消费上限已更新: $" + String(offlineSpendCap, 2));
+  }
+
+  // 启用的洗车位数（读卡器/脉冲在启动时初始化，重启后生效）
+  void setBayCount(int count) {
+    bayCount = constrain(count, 1, MAX_BAYS);
+    prefs->putInt("bays", bayCount);
+    Serial.println("✅ 洗车位数已更新: " + String(bayCount) + "（重启后生效）");
+  }
+
+  // id为空时恢复默认（由机器ID派生）
+  void setBayMachineID(int bay, const String& id) {
+    if (bay < 0 || bay >= MAX_BAYS) return;
+    bayMachineIDs[bay] = id;
+    if (id.length() > 0) {
+      prefs->putString(bayIdKey(bay).c_str(), id);
+    } else {
+      prefs->remove(bayIdKey(bay).c_str());
+    }
+    Serial.println("✅ 洗车位" + String(bay + 1) + "机器ID: " + getBayMachineID(bay));
+  }
+
+  // 先刷卡（true）/先选套餐（false），立即生效
+  void setTapFirst(bool enabled) {
+    tapFirst = enabled;
+    prefs->putBool("tap_first", enabled);
+    Serial.println("✅ 流程已更新: " + String(enabled ? "先刷卡（选套餐期间后台查询卡片）" : "先选套餐"));
+  }
+
   // 重置为默认配置
   void resetToDefaults(const String& defaultSSID, const String& defaultPass,
                        const String& defaultURL, const String& defaultKey,
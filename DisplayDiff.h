@@ -0,0 +1,160 @@
+/*
+ * DisplayDiff.h - OLED帧差分局部刷新
+ *
+ * 功能：
+ * - 保存上一帧已发送的缓冲区，逐个8x8图块（1页×8列 = 8字节）比较
+ * - 只通过 updateDisplayArea() 发送变化的图块，同一行相邻的脏图块合并为一次发送
+ * - 画面没有变化时不访问I2C；脏图块超过阈值时整屏发送（减少定位命令开销）
+ * - 统计每帧发送字节数和I2C耗时
+ *
+ * 说明：
+ * - 比较的是U8g2内部缓冲区（显示器原生方向），图块坐标与updateDisplayArea一致，
+ *   不受U8G2_R2旋转影响
+ * - 绕过本类直接 sendBuffer() 后需调用 invalidate()，下一帧会整屏发送
+ *
+ * 版本: v1.0
+ */
+
+#ifndef DISPLAY_DIFF_H
+#define DISPLAY_DIFF_H
+
+#include <Arduino.h>
+#include <U8g2lib.h>
+
+#define DISPLAY_DIFF_MAX_BYTES 1024        // 128x64 单色全缓冲
+#define DISPLAY_DIFF_FULL_PERCENT 75       // 脏图块超过该比例时整屏发送
+
+struct DisplayDiffStats {
+  uint32_t frames;          // present() 调用次数
+  uint32_t skipped;         // 无变化，未访问I2C
+  uint32_t fullFrames;      // 整屏发送
+  uint32_t partialFrames;   // 局部发送
+  uint32_t lastBytes;       // 最近一帧发送的图块数据字节
+  uint32_t lastUs;          // 最近一帧I2C耗时
+  uint32_t maxUs;
+  uint64_t totalBytes;
+  uint64_t totalUs;
+};
+
+class DisplayDiff {
+private:
+  uint8_t shadow[DISPLAY_DIFF_MAX_BYTES];
+  bool valid = false;
+  DisplayDiffStats stats;
+
+public:
+  DisplayDiff() {
+    memset(&stats, 0, sizeof(stats));
+  }
+
+  // 下一帧整屏发送（显示器重新初始化或绕过本类发送后调用）
+  void invalidate() {
+    valid = false;
+  }
+
+  // 发送当前缓冲区中变化的部分，返回发送的数据字节数
+  uint32_t present(U8G2& display) {
+    uint8_t* buffer = display.getBufferPtr();
+    uint8_t tileWidth = display.getBufferTileWidth();
+    uint8_t tileHeight = display.getBufferTileHeight();
+    uint32_t rowBytes = (uint32_t)tileWidth * 8;
+    uint32_t size = rowBytes * tileHeight;
+
+    stats.frames++;
+
+    if (size > DISPLAY_DIFF_MAX_BYTES) {
+      // 缓冲区超出预期（页缓冲/其他型号），退回整屏发送
+      uint32_t start = micros();
+      display.sendBuffer();
+      recordFrame(size, micros() - start, true);
+      return size;
+    }
+
+    // 统计脏图块
+    int dirtyTiles = 0;
+    if (valid) {
+      for (uint8_t ty = 0; ty < tileHeight; ty++) {
+        const uint8_t* row = buffer + ty * rowBytes;
+        const uint8_t* prev = shadow + ty * rowBytes;
+        for (uint8_t tx = 0; tx < tileWidth; tx++) {
+          if (memcmp(row + tx * 8, prev + tx * 8, 8) != 0) dirtyTiles++;
+        }
+      }
+
+      if (dirtyTiles == 0) {
+        stats.skipped++;
+        stats.lastBytes = 0;
+        stats.lastUs = 0;
+        return 0;
+      }
+    }
+
+    int totalTiles = tileWidth * tileHeight;
+    uint32_t start = micros();
+    uint32_t bytes;
+    bool full = !valid || dirtyTiles * 100 >= totalTiles * DISPLAY_DIFF_FULL_PERCENT;
+
+    if (full) {
+      display.updateDisplay();
+      bytes = size;
+    } else {
+      bytes = 0;
+      for (uint8_t ty = 0; ty < tileHeight; ty++) {
+        const uint8_t* row = buffer + ty * rowBytes;
+        const uint8_t* prev = shadow + ty * rowBytes;
+        uint8_t tx = 0;
+        while (tx < tileWidth) {
+          if (memcmp(row + tx * 8, prev + tx * 8, 8) == 0) {
+            tx++;
+            continue;
+          }
+          // 合并同一行连续的脏图块
+          uint8_t runStart = tx;
+          while (tx < tileWidth && memcmp(row + tx * 8, prev + tx * 8, 8) != 0) tx++;
+          display.updateDisplayArea(runStart, ty, tx - runStart, 1);
+          bytes += (uint32_t)(tx - runStart) * 8;
+        }
+      }
+    }
+
+    memcpy(shadow, buffer, size);
+    valid = true;
+    recordFrame(bytes, micros() - start, full);
+    return bytes;
+  }
+
+  const DisplayDiffStats& getStats() { return stats; }
+
+  void resetStats() {
+    memset(&stats, 0, sizeof(stats));
+  }
+
+  void printStats() {
+    uint32_t sent = stats.fullFrames + stats.partialFrames;
+    Serial.println("\n=== 显示刷新统计 ===");
+    Serial.printf("帧数: %u (整屏 %u, 局部 %u, 无变化跳过 %u)\n",
+                  stats.frames, stats.fullFrames, stats.partialFrames, stats.skipped);
+    if (sent > 0) {
+      Serial.printf("平均每帧: %lu 字节, %lu us\n",
+                    (unsigned long)(stats.totalBytes / sent), (unsigned long)(stats.totalUs / sent));
+    }
+    Serial.printf("最近一帧: %u 字节, %u us; 最长 %u us\n", stats.lastBytes, stats.lastUs, stats.maxUs);
+    Serial.println("===================\n");
+  }
+
+private:
+  void recordFrame(uint32_t bytes, uint32_t us, bool full) {
+    if (full) {
+      stats.fullFrames++;
+    } else {
+      stats.partialFrames++;
+    }
+    stats.lastBytes = bytes;
+    stats.lastUs = us;
+    if (us > stats.maxUs) stats.maxUs = us;
+    stats.totalBytes += bytes;
+    stats.totalUs += us;
+  }
+};
+
+#endif // DISPLAY_DIFF_H
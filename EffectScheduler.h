@@ -0,0 +1,319 @@
+/*
+ * EffectScheduler.h - 蜂鸣器和状态LED效果调度器
+ *
+ * 功能：
+ * - 声音效果用音调表描述（频率+时长），由LEDC输出，调用方入队后立即返回
+ * - 4个状态LED各自独立的闪烁相位（模式变化时才重置）
+ * - 临时LED效果（如错误时STATUS快闪）按优先级覆盖状态机设置的基础模式
+ * - 10ms定时器驱动，loop()阻塞不会影响声音/闪烁节奏
+ *
+ * 优先级：
+ * - 声音：高优先级打断正在播放的低优先级效果，同级或更低的排队（最多4个）
+ * - LED：临时效果优先级 >= 当前临时效果时才能覆盖
+ *
+ * 线程安全：定时回调在esp_timer任务中执行，共享状态用自旋锁保护，
+ *           LEDC/GPIO写操作在锁外执行
+ *
+ * 版本: v1.0
+ */
+
+#ifndef EFFECT_SCHEDULER_H
+#define EFFECT_SCHEDULER_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <esp_arduino_version.h>
+#include "config.h"
+
+// =================== 调度配置 ===================
+#define EFFECT_TICK_MS 10
+#define EFFECT_SOUND_QUEUE_SIZE 4
+#define EFFECT_BLINK_SLOW_MS 500     // 慢闪半周期
+#define EFFECT_BLINK_FAST_MS 100     // 快闪半周期
+
+#define BUZZER_TONE_HZ 2700          // 提示音频率（有源蜂鸣器也可用方波驱动）
+#define BUZZER_ERROR_HZ 2000         // 错误音频率
+#define BUZZER_LEDC_CHANNEL 0        // Arduino-ESP32 2.x 需要指定通道
+#define BUZZER_LEDC_RESOLUTION 8
+
+enum EffectPriority {
+  EFFECT_PRIORITY_LOW = 0,     // 按键音
+  EFFECT_PRIORITY_NORMAL = 1,  // 成功/完成提示
+  EFFECT_PRIORITY_ALERT = 2    // 错误/故障
+};
+
+// =================== 声音效果（音调表）===================
+struct ToneStep {
+  uint16_t freqHz;      // 0 = 静音
+  uint16_t durationMs;
+};
+
+struct SoundEffect {
+  const ToneStep* steps;
+  uint8_t stepCount;
+  uint8_t priority;
+};
+
+#define EFFECT_STEPS(table) (uint8_t)(sizeof(table) / sizeof(table[0]))
+
+static const ToneStep TONES_SHORT[] = {
+  {BUZZER_TONE_HZ, 100}
+};
+
+static const ToneStep TONES_SUCCESS[] = {
+  {BUZZER_TONE_HZ, 100}, {0, 100},
+  {BUZZER_TONE_HZ, 100}, {0, 100}
+};
+
+// 洗车完成：两次成功音，中间停顿200ms
+static const ToneStep TONES_COMPLETE[] = {
+  {BUZZER_TONE_HZ, 100}, {0, 100},
+  {BUZZER_TONE_HZ, 100}, {0, 300},
+  {BUZZER_TONE_HZ, 100}, {0, 100},
+  {BUZZER_TONE_HZ, 100}, {0, 100}
+};
+
+static const ToneStep TONES_ERROR[] = {
+  {BUZZER_ERROR_HZ, 150}, {0, 100},
+  {BUZZER_ERROR_HZ, 150}, {0, 100},
+  {BUZZER_ERROR_HZ, 150}, {0, 100}
+};
+
+static const SoundEffect SOUND_SHORT = {TONES_SHORT, EFFECT_STEPS(TONES_SHORT), EFFECT_PRIORITY_LOW};
+static const SoundEffect SOUND_SUCCESS = {TONES_SUCCESS, EFFECT_STEPS(TONES_SUCCESS), EFFECT_PRIORITY_NORMAL};
+static const SoundEffect SOUND_COMPLETE = {TONES_COMPLETE, EFFECT_STEPS(TONES_COMPLETE), EFFECT_PRIORITY_NORMAL};
+static const SoundEffect SOUND_ERROR = {TONES_ERROR, EFFECT_STEPS(TONES_ERROR), EFFECT_PRIORITY_ALERT};
+
+// =================== LED通道 ===================
+enum EffectLED {
+  EFFECT_LED_POWER,
+  EFFECT_LED_NETWORK,
+  EFFECT_LED_PROGRESS,
+  EFFECT_LED_STATUS,
+  EFFECT_LED_COUNT
+};
+
+struct LEDChannel {
+  uint8_t pin;
+  LEDStatus mode;              // 基础模式（状态机设置）
+  uint32_t phaseStart;         // 基础模式的闪烁起点
+  bool overlayActive;          // 临时效果
+  LEDStatus overlayMode;
+  uint8_t overlayPriority;
+  uint32_t overlayStart;
+  uint32_t overlayUntil;
+  int8_t lastLevel;            // 上次输出电平（-1=未输出）
+};
+
+// =================== 效果调度器 ===================
+class EffectScheduler {
+private:
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+  esp_timer_handle_t timer = NULL;
+
+  // 声音
+  SoundEffect current;
+  bool playing = false;
+  uint8_t stepIndex = 0;
+  uint32_t stepEnd = 0;
+  SoundEffect queue[EFFECT_SOUND_QUEUE_SIZE];
+  uint8_t queueHead = 0;
+  uint8_t queueCount = 0;
+  uint16_t outputFreq = 0;
+
+  // LED
+  LEDChannel leds[EFFECT_LED_COUNT];
+
+  // 统计
+  uint32_t playedCount = 0;
+  uint32_t preemptedCount = 0;
+  uint32_t droppedCount = 0;
+
+  static void onTimer(void* arg) {
+    static_cast<EffectScheduler*>(arg)->tick();
+  }
+
+  static bool blinkLevel(LEDStatus mode, uint32_t elapsed) {
+    switch (mode) {
+      case LED_ON: return true;
+      case LED_BLINK_SLOW: return (elapsed / EFFECT_BLINK_SLOW_MS) % 2 == 0;
+      case LED_BLINK_FAST: return (elapsed / EFFECT_BLINK_FAST_MS) % 2 == 0;
+      default: return false;
+    }
+  }
+
+  static void writeLED(uint8_t pin, bool on) {
+    #if LED_COMMON_ANODE
+      digitalWrite(pin, on ? LOW : HIGH);  // 共阳极: 反相输出
+    #else
+      digitalWrite(pin, on ? HIGH : LOW);  // 共阴极: 直接输出
+    #endif
+  }
+
+  static void writeTone(uint16_t freq) {
+    #if ESP_ARDUINO_VERSION_MAJOR >= 3
+      ledcWriteTone(BUZZER, freq);
+    #else
+      ledcWriteTone(BUZZER_LEDC_CHANNEL, freq);
+    #endif
+  }
+
+  // 调用方需持有锁
+  void startSound(const SoundEffect& fx, uint32_t now) {
+    current = fx;
+    playing = true;
+    stepIndex = 0;
+    stepEnd = now + fx.steps[0].durationMs;
+    playedCount++;
+  }
+
+  void tick() {
+    uint32_t now = millis();
+    uint16_t freq = 0;
+    bool changedTone = false;
+    int8_t levels[EFFECT_LED_COUNT];
+
+    portENTER_CRITICAL(&mux);
+
+    // 推进声音
+    while (playing && (int32_t)(now - stepEnd) >= 0) {
+      stepIndex++;
+      if (stepIndex < current.stepCount) {
+        stepEnd += current.steps[stepIndex].durationMs;
+      } else if (queueCount > 0) {
+        SoundEffect next = queue[queueHead];
+        queueHead = (queueHead + 1) % EFFECT_SOUND_QUEUE_SIZE;
+        queueCount--;
+        startSound(next, now);
+      } else {
+        playing = false;
+      }
+    }
+    freq = playing ? current.steps[stepIndex].freqHz : 0;
+    if (freq != outputFreq) {
+      outputFreq = freq;
+      changedTone = true;
+    }
+
+    // 计算LED电平（只输出变化的）
+    for (int i = 0; i < EFFECT_LED_COUNT; i++) {
+      LEDChannel& led = leds[i];
+      if (led.overlayActive && (int32_t)(now - led.overlayUntil) >= 0) {
+        led.overlayActive = false;
+      }
+
+      bool on = led.overlayActive
+        ? blinkLevel(led.overlayMode, now - led.overlayStart)
+        : blinkLevel(led.mode, now - led.phaseStart);
+
+      levels[i] = -1;
+      if (led.lastLevel != (on ? 1 : 0)) {
+        led.lastLevel = on ? 1 : 0;
+        levels[i] = led.lastLevel;
+      }
+    }
+
+    portEXIT_CRITICAL(&mux);
+
+    if (changedTone) writeTone(freq);
+    for (int i = 0; i < EFFECT_LED_COUNT; i++) {
+      if (levels[i] >= 0) writeLED(leds[i].pin, levels[i] == 1);
+    }
+  }
+
+public:
+  EffectScheduler() {
+    const uint8_t pins[EFFECT_LED_COUNT] = {LED_POWER, LED_NETWORK, LED_PROGRESS, LED_STATUS};
+    for (int i = 0; i < EFFECT_LED_COUNT; i++) {
+      memset(&leds[i], 0, sizeof(LEDChannel));
+      leds[i].pin = pins[i];
+      leds[i].mode = LED_OFF;
+      leds[i].lastLevel = -1;
+    }
+  }
+
+  // 配置LEDC并启动10ms定时器（在LED自检之后调用）
+  bool begin() {
+    #if ESP_ARDUINO_VERSION_MAJOR >= 3
+      ledcAttach(BUZZER, BUZZER_TONE_HZ, BUZZER_LEDC_RESOLUTION);
+    #else
+      ledcSetup(BUZZER_LEDC_CHANNEL, BUZZER_TONE_HZ, BUZZER_LEDC_RESOLUTION);
+      ledcAttachPin(BUZZER, BUZZER_LEDC_CHANNEL);
+    #endif
+    writeTone(0);
+
+    esp_timer_create_args_t args = {};
+    args.callback = onTimer;
+    args.arg = this;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "effects";
+    if (esp_timer_create(&args, &timer) != ESP_OK) return false;
+    return esp_timer_start_periodic(timer, EFFECT_TICK_MS * 1000) == ESP_OK;
+  }
+
+  // 播放声音（立即返回）
+  void playSound(const SoundEffect& fx) {
+    if (fx.stepCount == 0) return;
+
+    portENTER_CRITICAL(&mux);
+    if (!playing) {
+      startSound(fx, millis());
+    } else if (fx.priority > current.priority) {
+      startSound(fx, millis());
+      preemptedCount++;
+    } else if (queueCount < EFFECT_SOUND_QUEUE_SIZE) {
+      queue[(queueHead + queueCount) % EFFECT_SOUND_QUEUE_SIZE] = fx;
+      queueCount++;
+    } else {
+      droppedCount++;
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // 设置LED基础模式（模式不变时保持相位）
+  void setLED(EffectLED index, LEDStatus mode) {
+    portENTER_CRITICAL(&mux);
+    LEDChannel& led = leds[index];
+    if (led.mode != mode) {
+      led.mode = mode;
+      led.phaseStart = millis();
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // 临时LED效果：durationMs内覆盖基础模式
+  bool flashLED(EffectLED index, LEDStatus mode, uint16_t durationMs, uint8_t priority) {
+    bool accepted = false;
+    uint32_t now = millis();
+
+    portENTER_CRITICAL(&mux);
+    LEDChannel& led = leds[index];
+    if (!led.overlayActive || priority >= led.overlayPriority) {
+      led.overlayActive = true;
+      led.overlayMode = mode;
+      led.overlayPriority = priority;
+      led.overlayStart = now;
+      led.overlayUntil = now + durationMs;
+      accepted = true;
+    }
+    portEXIT_CRITICAL(&mux);
+
+    return accepted;
+  }
+
+  bool isPlaying() { return playing; }
+
+  void printStatus() {
+    Serial.println("\n=== 声光效果 ===");
+    Serial.printf("声音: %s, 队列 %u/%d\n", playing ? "播放中" : "空闲", queueCount, EFFECT_SOUND_QUEUE_SIZE);
+    Serial.printf("已播放: %u, 被打断: %u, 丢弃: %u\n", playedCount, preemptedCount, droppedCount);
+    const char* names[EFFECT_LED_COUNT] = {"POWER", "NETWORK", "PROGRESS", "STATUS"};
+    for (int i = 0; i < EFFECT_LED_COUNT; i++) {
+      Serial.printf("%-8s 模式 %d%s\n", names[i], leds[i].mode,
+                    leds[i].overlayActive ? " (临时效果)" : "");
+    }
+    Serial.println("================\n");
+  }
+};
+
+#endif // EFFECT_SCHEDULER_H
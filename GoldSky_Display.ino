@@ -2,13 +2,22 @@
  * GoldSky_Display.ino
  * 显示函数集合 - 优化2.42"长方形屏幕
  *
- * 包含所有OLED屏幕显示函数（居中+横向布局）
+ * 包含所有OLED屏幕显示函数（居中+横向布局）和渲染任务
+ *
+ * 渲染任务：
+ * - loop()通过 viewShow*() 填写洗车位的视图模型并发布，不直接访问OLED；
+ *   只有带显示屏的洗车位（BAY_PINS 的 display）发布给渲染任务
+ * - 渲染任务按 RENDER_FRAME_MS 固定帧率读取最新发布的视图模型并绘制
+ * - 双缓冲：U8g2缓冲区为后台帧，DisplayDiff保存的上一帧为前台帧（与屏幕内容一致），
+ *   绘制完成后只发送两帧之间变化的图块
  */
 
-// 外部变量声明（来自 GoldSky_Utils.ino）
-extern int nfcReadFailCount;  // NFC连续读卡失败次数
-
 // =================== 辅助函数 ===================
+// 发送当前帧：只发送与上一帧相比变化的8x8图块（见 DisplayDiff.h）
+void presentFrame() {
+  displayDiff.present(display);
+}
+
 // 计算实际显示区域（考虑遮挡罩子）
 // DisplayArea 结构体定义在 config.h 中
 
@@ -31,6 +40,60 @@ int getCenterX(const char* text) {
   return area.x + (area.width - textWidth) / 2;
 }
 
+// =================== 界面资源（见 UiAssets.h）===================
+// 滚动广告（VIP推广文案）
+const char* WELCOME_AD_TEXT = "More Cash, More Savings! VIP Top-Up Bonus: $50=$60 | $100=$125 | $200=$240 PLUS Free Tires Change! ";
+
+TextWidthCache textWidthCache;
+ScrollStrip welcomeAdStrip;
+PackageLabel packageLabels[PACKAGE_COUNT];
+const uint8_t* currentFont = NULL;
+
+// 设置字体并记录，供宽度缓存作为键
+void uiSetFont(const uint8_t* font) {
+  display.setFont(font);
+  currentFont = font;
+}
+
+// 常量字符串宽度（缓存）
+int getStaticStrWidth(const char* text) {
+  return textWidthCache.measure(display, currentFont, text);
+}
+
+// 常量字符串居中X坐标（缓存宽度）；sprintf生成的文字仍用 getCenterX()
+int getCenterXStatic(const char* text) {
+  DisplayArea area = getDisplayArea();
+  return area.x + (area.width - getStaticStrWidth(text)) / 2;
+}
+
+// 启动时生成界面资源（在渲染任务启动前调用，会清空U8g2缓冲区）
+void buildUiAssets() {
+  if (!sysStatus.displayWorking) return;
+
+  uint32_t start = micros();
+
+  if (!welcomeAdStrip.build(display, WELCOME_AD_TEXT, u8g2_font_helvB08_tf)) {
+    logWarn("⚠️ 广告横幅预渲染失败，改为逐帧绘制文字");
+  }
+
+  uiSetFont(u8g2_font_helvB08_tf);
+  for (int i = 0; i < PACKAGE_COUNT; i++) {
+    PackageLabel& label = packageLabels[i];
+    if (packages[i].isQuery) {
+      strlcpy(label.line1, "VIP", sizeof(label.line1));
+      strlcpy(label.line2, "Info", sizeof(label.line2));
+    } else {
+      snprintf(label.line1, sizeof(label.line1), "$%.0f", packages[i].price);
+      snprintf(label.line2, sizeof(label.line2), "%dmin", packages[i].minutes);  // "数值+min"
+    }
+    label.width1 = display.getStrWidth(label.line1);
+    label.width2 = display.getStrWidth(label.line2);
+  }
+
+  logInfo("🎨 界面资源已生成 (横幅 " + String(welcomeAdStrip.getWidth()) + "px, " +
+          String(micros() - start) + "us)");
+}
+
 // 绘制边框
 void drawBorder() {
   if (BORDER_STYLE == 0) return;  // 0 = 无边框
@@ -52,7 +115,152 @@ void drawBorder() {
   }
 }
 
+// =================== 视图模型发布（loop()调用）===================
+ViewModel publishedView;                               // 最近一次发布的视图模型
+portMUX_TYPE viewMux = portMUX_INITIALIZER_UNLOCKED;
+
+void viewPublish(Bay& bay) {
+  ViewModel& vm = bay.view;
+  vm.state = bay.state;
+  vm.selectedPackage = bay.selectedPackage;
+  vm.nfcStruggling = bay.nfcReadFailCount >= 10;
+  vm.cardTapped = !bay.prefetchUid.isEmpty();
+  vm.version++;
+
+  if (!bay.hasDisplay()) return;
+  portENTER_CRITICAL(&viewMux);
+  publishedView = vm;
+  portEXIT_CRITICAL(&viewMux);
+}
+
+void viewShow(Bay& bay, ScreenId screen) {
+  bay.view.screen = screen;
+  viewPublish(bay);
+}
+
+void viewShowProgress(Bay& bay, const char* message, float progress) {
+  strlcpy(bay.view.message, message, sizeof(bay.view.message));
+  bay.view.progress = progress;
+  viewShow(bay, SCREEN_PROGRESS);
+}
+
+// 没有屏幕（或OLED故障）时错误信息只能写日志
+void viewShowError(Bay& bay, const char* message) {
+  if (!sysStatus.displayWorking || !bay.hasDisplay()) {
+    LOG_E("洗车位%d: %s", bay.number(), message);
+  }
+  strlcpy(bay.view.message, message, sizeof(bay.view.message));
+  viewShow(bay, SCREEN_ERROR);
+}
+
+void viewShowWash(Bay& bay, int current, int total, int remainingMin, int remainingSec) {
+  bay.view.pulsesSent = current;
+  bay.view.pulsesTotal = total;
+  bay.view.remainingMin = remainingMin;
+  bay.view.remainingSec = remainingSec;
+  viewShow(bay, SCREEN_WASH);
+}
+
+// VIP信息页/完成页的卡片信息
+void viewShowCard(Bay& bay, ScreenId screen, const CardInfo& info) {
+  strlcpy(bay.view.cardNumber, info.displayCardNumber, sizeof(bay.view.cardNumber));
+  bay.view.balance = info.balance;
+  bay.view.cardActive = info.isActive;
+  viewShow(bay, screen);
+}
+
+// =================== 渲染任务 ===================
+TaskHandle_t renderTaskHandle = NULL;
+
+// 渲染统计（渲染任务写，串口命令读）
+uint32_t renderFrameCount = 0;
+uint32_t renderDroppedFrames = 0;   // 绘制+发送超过一帧时间而跳过的帧
+uint32_t renderLastFrameUs = 0;
+uint32_t renderMaxFrameUs = 0;
+uint64_t renderTotalFrameUs = 0;
+
+void renderView(const ViewModel& vm) {
+  switch (vm.screen) {
+    case SCREEN_WELCOME:   displayWelcome(); break;
+    case SCREEN_PACKAGES:  displayPackageSelection(vm.selectedPackage, vm.cardTapped); break;
+    case SCREEN_CARD_SCAN: displayCardScan(vm.selectedPackage, vm.nfcStruggling); break;
+    case SCREEN_VIP_SCAN:  displayVIPQueryScan(); break;
+    case SCREEN_VIP_INFO:  displayVIPInfo(vm.cardNumber, vm.balance, vm.cardActive); break;
+    case SCREEN_PROGRESS:  displayProcessing(vm.message, vm.progress); break;
+    case SCREEN_WASH:
+      displayWashProgress(vm.pulsesSent, vm.pulsesTotal, vm.remainingMin, vm.remainingSec);
+      break;
+    case SCREEN_COMPLETE:  displayComplete(vm.balance); break;
+    case SCREEN_ERROR:     displayError(vm.message); break;
+    default: break;
+  }
+}
+
+void renderTaskLoop(void* param) {
+  const TickType_t period = pdMS_TO_TICKS(RENDER_FRAME_MS);
+  TickType_t lastWake = xTaskGetTickCount();
+  ViewModel vm;
+
+  for (;;) {
+    portENTER_CRITICAL(&viewMux);
+    vm = publishedView;
+    portEXIT_CRITICAL(&viewMux);
+
+    uint32_t start = micros();
+    renderView(vm);
+    uint32_t frameUs = micros() - start;
+
+    renderFrameCount++;
+    renderLastFrameUs = frameUs;
+    renderTotalFrameUs += frameUs;
+    if (frameUs > renderMaxFrameUs) renderMaxFrameUs = frameUs;
+
+    // 超时的帧不补画，从当前时间重新对齐
+    TickType_t now = xTaskGetTickCount();
+    if (now - lastWake >= period) {
+      renderDroppedFrames += (now - lastWake) / period;
+      lastWake = now;
+    }
+    vTaskDelayUntil(&lastWake, period);
+  }
+}
+
+void startRenderTask() {
+  if (!sysStatus.displayWorking) {
+    logWarn("⚠️ OLED不可用，渲染任务未启动");
+    return;
+  }
+
+  xTaskCreatePinnedToCore(renderTaskLoop, "render", RENDER_TASK_STACK_SIZE, NULL,
+                          RENDER_TASK_PRIORITY, &renderTaskHandle, RENDER_TASK_CORE);
+
+  logInfo("🖥️ 渲染任务已启动 (核心" + String(RENDER_TASK_CORE) + ", " +
+          String(1000 / RENDER_FRAME_MS) + "fps)");
+}
+
+void resetRenderStats() {
+  renderFrameCount = 0;
+  renderDroppedFrames = 0;
+  renderLastFrameUs = 0;
+  renderMaxFrameUs = 0;
+  renderTotalFrameUs = 0;
+}
+
+void printRenderStats() {
+  Serial.println("\n=== 渲染任务 ===");
+  Serial.printf("状态: %s, 目标帧时间 %d ms\n", renderTaskHandle ? "运行中" : "未启动", RENDER_FRAME_MS);
+  Serial.printf("帧数: %u, 丢帧: %u\n", renderFrameCount, renderDroppedFrames);
+  if (renderFrameCount > 0) {
+    Serial.printf("帧耗时: 最近 %u us, 平均 %lu us, 最长 %u us\n", renderLastFrameUs,
+                  (unsigned long)(renderTotalFrameUs / renderFrameCount), renderMaxFrameUs);
+  }
+  Serial.printf("视图版本: %u\n", publishedView.version);
+  textWidthCache.printStats();
+  Serial.println("================");
+}
+
 // =================== 显示函数 ===================
+// 以下函数只在渲染任务中调用（启动画面除外）
 void displayWelcome() {
   if (!sysStatus.displayWorking) return;
 
@@ -60,19 +268,18 @@ void displayWelcome() {
   display.clearBuffer();
 
   // 顶部标题
-  display.setFont(u8g2_font_helvB10_tf);  // Bold 10pt
+  uiSetFont(u8g2_font_helvB10_tf);  // Bold 10pt
   const char* title = "EAGLSON WASH";
   int titleY = area.y + 11;
-  display.drawStr(getCenterX(title), titleY, title);
+  display.drawStr(getCenterXStatic(title), titleY, title);
 
   // 滚动广告文本 (在屏幕中间)
   static unsigned long lastScroll = 0;
   static int scrollPos = 0;
 
-  // VIP推广滚动广告 (吸引人的文案)
-  const char* vipAd = "More Cash, More Savings! VIP Top-Up Bonus: $50=$60 | $100=$125 | $200=$240 PLUS Free Tires Change! ";
-  display.setFont(u8g2_font_helvB08_tf);  // Bold 8pt
-  int adWidth = display.getStrWidth(vipAd);
+  // VIP推广滚动广告（启动时已预渲染）
+  uiSetFont(u8g2_font_helvB08_tf);  // Bold 8pt
+  int adWidth = getStaticStrWidth(WELCOME_AD_TEXT);
 
   // 滚动速度控制
   if (millis() - lastScroll > 60) {  // 更快的滚动
@@ -90,28 +297,36 @@ void displayWelcome() {
 
   // 绘制主滚动文字
   int textX = area.x + area.width - scrollPos;
-  display.drawStr(textX, scrollY, vipAd);
+  bool secondCopy = scrollPos > area.width;  // 文字即将离开屏幕，在右侧补充一次显示（无缝循环）
 
-  // 如果文字即将离开屏幕，在右侧补充一次显示（无缝循环）
-  if (scrollPos > area.width) {
-    display.drawStr(textX + adWidth, scrollY, vipAd);
+  if (welcomeAdStrip.isReady()) {
+    int screenWidth = display.getDisplayWidth();
+    welcomeAdStrip.draw(display, textX, scrollY, 0, screenWidth);
+    if (secondCopy) {
+      welcomeAdStrip.draw(display, textX + adWidth, scrollY, 0, screenWidth);
+    }
+  } else {
+    display.drawStr(textX, scrollY, WELCOME_AD_TEXT);
+    if (secondCopy) {
+      display.drawStr(textX + adWidth, scrollY, WELCOME_AD_TEXT);
+    }
   }
 
   // 欢迎文字 (底部)
-  display.setFont(u8g2_font_6x10_tf);
+  uiSetFont(u8g2_font_6x10_tf);
   const char* welcome = "Welcome    ";
-  display.drawStr(getCenterX(welcome), scrollY + 12, welcome);
+  display.drawStr(getCenterXStatic(welcome), scrollY + 12, welcome);
 
   // 右下角提示
   const char* prompt = "Press OK";
-  int promptX = area.x + area.width - display.getStrWidth(prompt) - 2;
+  int promptX = area.x + area.width - getStaticStrWidth(prompt) - 2;
   int promptY = area.y + area.height - 2;
   display.drawStr(promptX, promptY, prompt);
 
-  display.sendBuffer();
+  presentFrame();
 }
 
-void displayPackageSelection() {
+void displayPackageSelection(int selected, bool cardTapped) {
   if (!sysStatus.displayWorking) return;
 
   DisplayArea area = getDisplayArea();
@@ -134,7 +349,7 @@ void displayPackageSelection() {
   int row2StartX = area.x + (area.width - (cellWidth * 2 + gapX)) / 2;
   int row2Y = row1Y + cellHeight + gapY;
 
-  display.setFont(u8g2_font_helvB08_tf);  // Bold 8pt
+  uiSetFont(u8g2_font_helvB08_tf);  // Bold 8pt
 
   for (int i = 0; i < PACKAGE_COUNT; i++) {
     int x, y;
@@ -151,7 +366,7 @@ void displayPackageSelection() {
     }
 
     // 绘制格子
-    if (i == selectedPackage) {
+    if (i == selected) {
       // 选中：实心背景 + 白色文字（反色）
       display.drawBox(x, y, cellWidth, cellHeight);
       display.setDrawColor(0);  // 白色文字
@@ -161,30 +376,28 @@ void displayPackageSelection() {
       display.setDrawColor(1);  // 黑色文字
     }
 
-    // 套餐文字
-    char line1[16], line2[16];
-    if (packages[i].isQuery) {
-      sprintf(line1, "VIP");
-      sprintf(line2, "Info");
-    } else {
-      sprintf(line1, "$%.0f", packages[i].price);
-      sprintf(line2, "%dmin", packages[i].minutes);  // 改为 "数值+min"
-    }
+    // 套餐文字（启动时已生成并测量，见 buildUiAssets）
+    const PackageLabel& label = packageLabels[i];
 
     // 居中显示文字（调整垂直位置适应20px高度）
-    int text1Width = display.getStrWidth(line1);
-    int text2Width = display.getStrWidth(line2);
-
-    display.drawStr(x + (cellWidth - text1Width) / 2, y + 9, line1);   // 从10→9
-    display.drawStr(x + (cellWidth - text2Width) / 2, y + 18, line2);  // 从20→18
+    display.drawStr(x + (cellWidth - label.width1) / 2, y + 9, label.line1);   // 从10→9
+    display.drawStr(x + (cellWidth - label.width2) / 2, y + 18, label.line2);  // 从20→18
 
     display.setDrawColor(1);  // 恢复黑色
   }
 
-  display.sendBuffer();
+  // 先刷卡：第二行左侧的卡片图标表示已刷卡，确认套餐即可支付
+  if (cardTapped) {
+    int iconX = area.x + 4;
+    int iconY = row2Y + 6;
+    display.drawRFrame(iconX, iconY, 12, 8, 1);
+    display.drawBox(iconX + 2, iconY + 2, 3, 3);  // 芯片
+  }
+
+  presentFrame();
 }
 
-void displayCardScan() {
+void displayCardScan(int packageIndex, bool nfcStruggling) {
   if (!sysStatus.displayWorking) return;
 
   // 限制刷新率：只在动画需要更新时刷新（400ms一次）
@@ -206,10 +419,10 @@ void displayCardScan() {
   display.clearBuffer();
 
   // 套餐信息（顶部居中）
-  const Package& pkg = packages[selectedPackage];
+  const Package& pkg = packages[packageIndex];
   char buffer[32];
   sprintf(buffer, "$%.0f-%dmin", pkg.price, pkg.minutes);
-  display.setFont(u8g2_font_helvB08_tf);
+  uiSetFont(u8g2_font_helvB08_tf);
   int titleY = area.y + 9;
   display.drawStr(getCenterX(buffer), titleY, buffer);
 
@@ -250,16 +463,16 @@ void displayCardScan() {
   display.drawLine(handX + 8, handY - 8, handX + 8, handY - 12);
 
   // 提示文字（右下角，向中间偏移避免遮挡）
-  display.setFont(u8g2_font_helvB08_tf);
+  uiSetFont(u8g2_font_helvB08_tf);
 
   // ✅ 优化：根据NFC失败次数显示不同提示
   const char* prompt;
-  if (nfcReadFailCount >= 10) {
+  if (nfcStruggling) {
     // 连续失败10次以上，提示用户调整卡片
     prompt = "Adjust Card";
     // 闪烁提示（每500ms切换）
     if ((millis() / 500) % 2 == 0) {
-      display.setFont(u8g2_font_helvB10_tf);  // 加粗字体
+      uiSetFont(u8g2_font_helvB10_tf);  // 加粗字体
     }
   } else {
     prompt = "Tap to Pay";  // ✅ 更友好的提示
@@ -269,7 +482,7 @@ void displayCardScan() {
   int promptY = area.y + area.height - 3;  // 底部Y坐标
   display.drawStr(promptX, promptY, prompt);
 
-  display.sendBuffer();
+  presentFrame();
 }
 
 void displayVIPQueryScan() {
@@ -279,10 +492,10 @@ void displayVIPQueryScan() {
   display.clearBuffer();
 
   // 标题
-  display.setFont(u8g2_font_helvB10_tf);
+  uiSetFont(u8g2_font_helvB10_tf);
   const char* title = "VIP INFO";
   int titleY = area.y + 11;
-  display.drawStr(getCenterX(title), titleY, title);
+  display.drawStr(getCenterXStatic(title), titleY, title);
 
   // NFC感应图标动画
   unsigned long now = millis();
@@ -325,55 +538,53 @@ void displayVIPQueryScan() {
   display.drawLine(handX + 8, handY - 8, handX + 8, handY - 12);
 
   // 提示文字（底部）
-  display.setFont(u8g2_font_helvB08_tf);
+  uiSetFont(u8g2_font_helvB08_tf);
   const char* prompt = "Tap VIP Card";
-  display.drawStr(getCenterX(prompt), area.y + area.height - 4, prompt);
+  display.drawStr(getCenterXStatic(prompt), area.y + area.height - 4, prompt);
 
-  display.sendBuffer();
+  presentFrame();
 }
 
-void displayVIPInfo() {
+void displayVIPInfo(const char* cardNumber, float balance, bool active) {
   if (!sysStatus.displayWorking) return;
 
   DisplayArea area = getDisplayArea();
   display.clearBuffer();
 
   // 标题
-  display.setFont(u8g2_font_helvB10_tf);  // Bold 10pt
+  uiSetFont(u8g2_font_helvB10_tf);  // Bold 10pt
   const char* title = "VIP INFO";
   int titleY = area.y + 11;
-  display.drawStr(getCenterX(title), titleY, title);
+  display.drawStr(getCenterXStatic(title), titleY, title);
 
   // 横向布局：卡号 | 余额
   int centerY = area.y + area.height / 2 + 4;
 
   // 左侧：卡号标签 + 卡号
-  display.setFont(u8g2_font_helvB08_tf);  // Bold 8pt
+  uiSetFont(u8g2_font_helvB08_tf);  // Bold 8pt
   const char* cardLabel = "Card:";
   int labelX = area.x + 5;
   display.drawStr(labelX, centerY, cardLabel);
 
   // 卡号值（紧跟标签）
-  display.setFont(u8g2_font_helvR08_tf);  // Regular 8pt
-  char cardNum[20];
-  snprintf(cardNum, sizeof(cardNum), "%s", currentCardInfo.displayCardNumber.c_str());
-  int cardNumX = labelX + display.getStrWidth(cardLabel) + 3;
-  display.drawStr(cardNumX, centerY, cardNum);
+  uiSetFont(u8g2_font_helvR08_tf);  // Regular 8pt
+  int cardNumX = labelX + getStaticStrWidth(cardLabel) + 3;
+  display.drawStr(cardNumX, centerY, cardNumber);
 
   // 右侧：余额（大号显示）
-  display.setFont(u8g2_font_helvB10_tf);  // Bold 10pt
-  char balance[16];
-  snprintf(balance, sizeof(balance), "$%.2f", currentCardInfo.balance);
-  int balanceX = area.x + area.width - display.getStrWidth(balance) - 5;
-  display.drawStr(balanceX, centerY, balance);
+  uiSetFont(u8g2_font_helvB10_tf);  // Bold 10pt
+  char balanceText[16];
+  snprintf(balanceText, sizeof(balanceText), "$%.2f", balance);
+  int balanceX = area.x + area.width - display.getStrWidth(balanceText) - 5;
+  display.drawStr(balanceX, centerY, balanceText);
 
   // 底部状态（居中）
-  display.setFont(u8g2_font_helvR08_tf);
+  uiSetFont(u8g2_font_helvR08_tf);
   char status[16];
-  snprintf(status, sizeof(status), "%s", currentCardInfo.isActive ? "Active" : "Inactive");
+  snprintf(status, sizeof(status), "%s", active ? "Active" : "Inactive");
   display.drawStr(getCenterX(status), area.y + area.height - 4, status);
 
-  display.sendBuffer();
+  presentFrame();
 }
 
 void displayProcessing(const char* message, float progress) {
@@ -384,7 +595,7 @@ void displayProcessing(const char* message, float progress) {
   // 不画边框，节省空间
 
   // 消息居中显示 - 使用较大字体
-  display.setFont(u8g2_font_helvB10_tf);  // Bold 10pt
+  uiSetFont(u8g2_font_helvB10_tf);  // Bold 10pt
   int titleY = area.y + 11;
   display.drawStr(getCenterX(message), titleY, message);
 
@@ -401,12 +612,12 @@ void displayProcessing(const char* message, float progress) {
   }
 
   // 进度百分比（居中）- 使用较大字体
-  display.setFont(u8g2_font_helvB08_tf);  // Bold 8pt
+  uiSetFont(u8g2_font_helvB08_tf);  // Bold 8pt
   char percentBuffer[8];
   sprintf(percentBuffer, "%d%%", (int)(progress * 100));
   display.drawStr(getCenterX(percentBuffer), barY + 20, percentBuffer);
 
-  display.sendBuffer();
+  presentFrame();
 }
 
 void displayWashProgress(int current, int total, int remainingMin, int remainingSec) {
@@ -416,9 +627,9 @@ void displayWashProgress(int current, int total, int remainingMin, int remaining
   display.clearBuffer();
 
   // 标题居中
-  display.setFont(u8g2_font_helvB10_tf);
+  uiSetFont(u8g2_font_helvB10_tf);
   int titleY = area.y + 9;
-  display.drawStr(getCenterX(TEXT_PROCESSING[currentLanguage]), titleY, TEXT_PROCESSING[currentLanguage]);
+  display.drawStr(getCenterXStatic(TEXT_PROCESSING[currentLanguage]), titleY, TEXT_PROCESSING[currentLanguage]);
 
   // 齿轮动画区域 (屏幕中心，放大)
   int centerX = area.x + area.width / 2;
@@ -426,9 +637,9 @@ void displayWashProgress(int current, int total, int remainingMin, int remaining
 
   // 齿轮旋转动画
   static unsigned long lastGearUpdate = 0;
-  static int gearAngle = 0;
+  static int gearStep = 0;  // 每步45°
   if (millis() - lastGearUpdate > 150) {  // 更快的旋转
-    gearAngle = (gearAngle + 45) % 360;
+    gearStep = (gearStep + 1) % GEAR_ANGLE_STEPS;
     lastGearUpdate = millis();
   }
 
@@ -442,14 +653,13 @@ void displayWashProgress(int current, int total, int remainingMin, int remaining
   display.drawCircle(gearX, gearY, gearRadius - 1);
   display.drawCircle(gearX, gearY, gearRadius - 4);
 
-  // 齿轮齿 (8个齿，加粗)
+  // 齿轮齿 (8个齿，加粗；端点查表，见 UiAssets.h)
   for (int i = 0; i < 8; i++) {
-    int angle = (i * 45 + gearAngle) % 360;
-    float rad = angle * 3.14159 / 180.0;
-    int x1 = gearX + (gearRadius - 2) * cos(rad);
-    int y1 = gearY + (gearRadius - 2) * sin(rad);
-    int x2 = gearX + (gearRadius + 4) * cos(rad);
-    int y2 = gearY + (gearRadius + 4) * sin(rad);
+    const GearTooth& tooth = GEAR_TEETH[(i + gearStep) % GEAR_ANGLE_STEPS];
+    int x1 = gearX + tooth.x1;
+    int y1 = gearY + tooth.y1;
+    int x2 = gearX + tooth.x2;
+    int y2 = gearY + tooth.y2;
 
     // 加粗齿（绘制两条线）
     display.drawLine(x1, y1, x2, y2);
@@ -468,7 +678,7 @@ void displayWashProgress(int current, int total, int remainingMin, int remaining
   }
 
   // 绘制大号数字信号流
-  display.setFont(u8g2_font_helvB08_tf);  // 大字体
+  uiSetFont(u8g2_font_helvB08_tf);  // 大字体
   for (int i = 0; i < 4; i++) {
     int digitX = area.x + 5 + pulsePos + (i * 25);
     if (digitX < gearX - 25) {
@@ -491,25 +701,25 @@ void displayWashProgress(int current, int total, int remainingMin, int remaining
   display.drawLine(arrowX + 15, centerY, arrowX + 10, centerY + 3);
 
   // 脉冲计数 (底部居中，从1开始)
-  display.setFont(u8g2_font_helvB08_tf);
+  uiSetFont(u8g2_font_helvB08_tf);
   char buffer[16];
   sprintf(buffer, "%d/%d", current + 1, total);  // current+1 使计数从1开始
   display.drawStr(getCenterX(buffer), area.y + area.height - 3, buffer);
 
-  display.sendBuffer();
+  presentFrame();
 }
 
-void displayComplete() {
+void displayComplete(float balance) {
   if (!sysStatus.displayWorking) return;
 
   DisplayArea area = getDisplayArea();
   display.clearBuffer();
 
   // 标题文字居中
-  display.setFont(u8g2_font_helvB10_tf);  // Bold 10pt
+  uiSetFont(u8g2_font_helvB10_tf);  // Bold 10pt
   int titleY = area.y + 9;
   const char* complete = "Enjoy Wash!";  // 洗车愉快
-  display.drawStr(getCenterX(complete), titleY, complete);
+  display.drawStr(getCenterXStatic(complete), titleY, complete);
 
   // 对勾图标（居中）
   int centerX = area.x + area.width / 2;
@@ -521,30 +731,27 @@ void displayComplete() {
   display.drawLine(centerX - 4, centerY + 9, centerX + 10, centerY - 5);
 
   // 剩余余额显示
-  display.setFont(u8g2_font_helvB10_tf);  // Bold 10pt
+  uiSetFont(u8g2_font_helvB10_tf);  // Bold 10pt
   char balanceText[20];
-  sprintf(balanceText, "Remain $%.2f", currentCardInfo.balance);
+  sprintf(balanceText, "Remain $%.2f", balance);
   int balanceY = centerY + 18;
   display.drawStr(getCenterX(balanceText), balanceY, balanceText);
 
-  display.sendBuffer();
+  presentFrame();
 }
 
 void displayError(const char* message) {
-  if (!sysStatus.displayWorking) {
-    logError(String(message));
-    return;
-  }
+  if (!sysStatus.displayWorking) return;
 
   DisplayArea area = getDisplayArea();
   display.clearBuffer();
   // 不画边框，节省空间
 
   // 错误标题居中 - 使用较大字体
-  display.setFont(u8g2_font_helvB10_tf);  // Bold 10pt
+  uiSetFont(u8g2_font_helvB10_tf);  // Bold 10pt
   const char* errorTitle = "ERROR!";
   int titleY = area.y + 11;
-  display.drawStr(getCenterX(errorTitle), titleY, errorTitle);
+  display.drawStr(getCenterXStatic(errorTitle), titleY, errorTitle);
 
   // X图标（居中在显示区域，更大）
   int centerX = area.x + area.width / 2;
@@ -556,7 +763,7 @@ void displayError(const char* message) {
   display.drawLine(centerX + 10, centerY - 9, centerX - 10, centerY + 11);
 
   // 错误消息居中 - 使用较大字体
-  display.setFont(u8g2_font_helvR08_tf);  // Regular 8pt
+  uiSetFont(u8g2_font_helvR08_tf);  // Regular 8pt
   int msgWidth = display.getStrWidth(message);
 
   if (msgWidth <= area.width - 4) {
@@ -565,5 +772,5 @@ void displayError(const char* message) {
     display.drawStr(area.x + 2, area.y + area.height - 4, message);
   }
 
-  display.sendBuffer();
+  presentFrame();
 }
@@ -6,15 +6,22 @@
  * 作者: Eaglson Development Team
  *
  * 🔧 v2.5 重大更新:
- * ✅ 离线交易队列：WiFi断开时自动缓存到NVS,恢复后同步
+ * ✅ 离线交易队列：WiFi断开时写入Flash环形日志,恢复后同步
  * ✅ API输入验证：防止异常数据导致系统崩溃
  * ✅ 配置管理系统：WiFi密码和API密钥存储到NVS,支持运行时更新
  *
  * 📁 文件结构:
  * - config.h: 配置和数据结构
  * - ConfigManager.h: 配置管理类(新增)
+ * - OfflineLog.h: 离线交易环形日志(txlog分区)
+ * - CardCache.h: 本地卡片缓存(离线授权)
+ * - PulseEngine.h: 硬件定时脉冲输出(每个洗车位一路)
+ * - Bay.h: 洗车位(读卡器/脉冲/按钮/会话状态)
+ * - EffectScheduler.h: 蜂鸣器/LED效果调度(非阻塞)
+ * - DisplayDiff.h: OLED帧差分局部刷新
  * - GoldSky_Utils.ino: 工具函数(日志/LED/按钮/NFC)
- * - GoldSky_Display.ino: 显示函数
+ * - GoldSky_Display.ino: 显示函数 + 渲染任务
+ * - GoldSky_Net.ino: 网络任务(异步Supabase请求)
  * - GoldSky_Lite.ino: 主程序(本文件)
  *
  * 📖 详细文档: OPTIMIZATION_SUMMARY_V2.5.md
@@ -33,7 +40,23 @@
 
 // =============== 配置文件 ===============
 #include "config.h"
+#include "LogRing.h"
 #include "ConfigManager.h"
+#include "SupabaseClient.h"
+#include "JsonPool.h"
+#include "OfflineLog.h"
+#include "CardCache.h"
+#include "PulseEngine.h"
+#include "EffectScheduler.h"
+#include "DisplayDiff.h"
+#include "UiAssets.h"
+#include "NfcReader.h"
+#include "LatencyTrace.h"
+#include "LoopProfiler.h"
+#include "WifiManager.h"
+#include "BootProfile.h"
+#include "HeapMonitor.h"
+#include "Bay.h"
 #include "HealthMonitor.h"
 
 // =================== 配置别名（使用config.h中定义的数组）===================
@@ -45,254 +68,87 @@ bool watchdogEnabled = false;
 // 日志级别全局变量（可在运行时通过串口命令修改）
 int CURRENT_LOG_LEVEL = LOG_LEVEL_INFO;
 
+// 异步日志缓冲区（RTC_NOINIT：软复位后保留，用于上传复位前的日志）
+RTC_NOINIT_ATTR LogRingStore logRingStore;
+LogRing logRing;
+
 // =================== 全局对象 ===================
 // 2.42" OLED SSD1309 128x64 I2C (180度旋转)
 U8G2_SSD1309_128X64_NONAME0_F_HW_I2C display(U8G2_R2, U8X8_PIN_NONE, I2C_SCL, I2C_SDA);
-MFRC522 mfrc522(RC522_CS, RC522_RST);
+DisplayDiff displayDiff;  // 只发送变化的图块（I2C 100kHz下整屏约100ms）
 Preferences prefs;
 ConfigManager config(&prefs);
+SupabaseClient supabase;  // Supabase长连接客户端（仅网络任务使用）
+EffectScheduler effects;  // 蜂鸣器和状态LED（入队后立即返回）
+LatencyTrace latencyTrace;  // 刷卡→洗车各阶段耗时直方图（随健康度日志上传）
+LoopProfiler loopProfiler;  // loop()各子系统耗时/阻塞时间（串口 perf）
+WifiManager wifiManager;    // 事件驱动的WiFi连接（快速重连/指数退避）
+BootProfile bootProfile;    // 启动各阶段耗时（随第一条健康度日志上传）
+HeapMonitor heapMonitor;    // 最大空闲块/碎片率、分配失败、空闲检查点（串口 heap）
+
+// =================== 洗车位 ===================
+NfcBusLock nfcBus;                     // 各洗车位的MFRC522共用SPI总线
+Bay bays[MAX_BAYS] = {{0}, {1}, {2}};  // 与 BAY_PINS 一一对应（修改 MAX_BAYS 时同步修改）
+int bayCount = 1;                      // 启用的洗车位数（启动时从NVS读取）
+int bayRoundRobin = 0;                 // 本次loop最先读卡的洗车位
+uint32_t bayNfcDeferred = 0;           // 读卡预算用完、顺延到下次loop的次数
 
 // =================== 健康度监测 ===================
 HealthMetrics healthMetrics;
 HealthMonitor healthMonitor;
 
-// =================== 离线交易队列 ===================
-PendingTransaction offlineQueue[MAX_OFFLINE_QUEUE];
-int offlineQueueCount = 0;
+// =================== 离线交易日志 ===================
+OfflineLog offlineLog;  // txlog分区环形日志（仅网络任务读写）
+
+// 离线同步进度（由网络任务更新）
+uint32_t offlineSyncCursor = 0;                  // 下一批起始槽位
+bool offlineSyncCursorValid = false;             // false时从最旧未确认记录开始
+bool offlineSyncPassDone = false;                // 本轮已遍历到日志末尾
+bool offlineSyncIsolate = false;                 // 批量被拒后逐条同步
+volatile bool offlineSyncPending = false;        // 已提交同步请求，等待执行
+volatile unsigned long nextOfflineSyncTime = 0;  // 下次同步时间
+unsigned long offlineSyncBackoffMs = 0;          // 当前退避时间
+bool rpcDebitAvailable = true;                   // 服务器有 jc_debit_card（返回404后改用三步扣费）
+
+// =================== 卡片缓存 ===================
+CardCache cardCache;    // 本地卡片缓存（loop()和网络任务共用，内部加锁）
+
+// =================== JSON内存池 ===================
+JsonPool<NET_JSON_POOL_SIZE> netJsonPool;  // 网络任务中的JsonDocument（请求体+响应）
 
 // =================== 全局变量 ===================
-SystemState currentState = STATE_WELCOME;
 Language currentLanguage = LANG_EN;
-int selectedPackage = 0;
-String cardUID = "";
-CardInfo currentCardInfo;
-int sentPulses = 0;
-unsigned long stateStartTime = 0;
-unsigned long processingStartTime = 0;
-unsigned long lastPulseTime = 0;
 SystemStatus sysStatus;
 SystemLEDs ledIndicator;
 
-unsigned long lastDebounceTime[2] = {0, 0};
-bool lastButtonState[2] = {false, false};
-
-// 健壮性增强：自动重试计时器
-unsigned long lastNFCRetry = 0;
-unsigned long lastWiFiRetry = 0;
-bool buttonPressed[2] = {false, false};
-
-unsigned long lastWiFiCheck = 0;
 int apiRetryCount = 0;
 unsigned long lastHeartbeat = 0;
 unsigned long loopStartTime = 0;
 TaskHandle_t mainTaskHandle = NULL;
 
 // =================== 错误恢复机制（方案A优化1）===================
-unsigned long lastSuccessfulOperation = 0;
-int consecutiveErrors = 0;
+unsigned long lastSuccessfulOperation = 0;  // 连续错误次数按洗车位统计（Bay::consecutiveErrors）
 
 // =================== WiFi管理 ===================
+// 启动时发起连接（立即返回，连接在后台完成，未连上时以离线模式运行）
 void initWiFi() {
-  String ssid = config.getWiFiSSID();
-  String password = config.getWiFiPassword();
-
-  logInfo("连接WiFi: " + ssid);
-
-  // WiFi初始化带重试机制（最多3次）
-  sysStatus.wifiConnected = false;
-  WiFi.mode(WIFI_STA);
-
-  for (int retry = 0; retry < 3; retry++) {
-    if (retry > 0) {
-      logWarn("⚠️ WiFi重连尝试 " + String(retry) + "/3");
-      WiFi.disconnect();
-      delay(1000);
-    }
-
-    WiFi.begin(ssid.c_str(), password.c_str());
-
-    // 等待连接（每次尝试10秒）
-    unsigned long startTime = millis();
-    while (WiFi.status() != WL_CONNECTED && millis() - startTime < 10000) {
-      delay(500);
-      Serial.print(".");
-    }
-
-    if (WiFi.status() == WL_CONNECTED) {
-      sysStatus.wifiConnected = true;
-      Serial.println();
-      logInfo("✅ WiFi连接成功: " + WiFi.localIP().toString() +
-              (retry > 0 ? " (重试成功)" : ""));
-      return;  // 成功后立即返回
-    }
-
-    Serial.println();  // 换行
-  }
-
-  // 3次都失败
   sysStatus.wifiConnected = false;
-  logWarn("⚠️ WiFi连接失败（3次重试后），进入离线模式");
+  bootProfile.start(BOOT_STAGE_WIFI);
+  wifiManager.begin(config.getWiFiSSID(), config.getWiFiPassword());
 }
 
+// 每次loop调用：推进WiFi状态机（事件驱动，不阻塞）
 void checkWiFi() {
-  if (millis() - lastWiFiCheck > 30000) {
-    bool wasConnected = sysStatus.wifiConnected;
-    sysStatus.wifiConnected = (WiFi.status() == WL_CONNECTED);
-
-    // 如果之前连接正常但现在断开了，尝试重连
-    if (wasConnected && !sysStatus.wifiConnected) {
-      logWarn("⚠️ WiFi断开，尝试重连...");
-      WiFi.disconnect();
-      delay(500);
-      WiFi.begin(config.getWiFiSSID().c_str(), config.getWiFiPassword().c_str());
-
-      // 等待3秒尝试重连
-      unsigned long startTime = millis();
-      while (WiFi.status() != WL_CONNECTED && millis() - startTime < 3000) {
-        delay(500);
-      }
-
-      if (WiFi.status() == WL_CONNECTED) {
-        sysStatus.wifiConnected = true;
-        logInfo("✅ WiFi重连成功: " + WiFi.localIP().toString());
-      } else {
-        sysStatus.wifiConnected = false;
-        logWarn("⚠️ WiFi重连失败，继续离线模式");
-      }
-    }
-
-    lastWiFiCheck = millis();
-  }
-}
-
-// =================== NFC健康检查（增强版）===================
-bool verifyNFCHealth() {
-  // 第1步：检查版本寄存器
-  byte version = mfrc522.PCD_ReadRegister(mfrc522.VersionReg);
-  if (version == 0x00 || version == 0xFF) {
-    logWarn("⚠️ NFC版本号异常: 0x" + String(version, HEX));
-    return false;
-  }
-
-  // 第2步：检查天线状态
-  byte antennaStatus = mfrc522.PCD_ReadRegister(mfrc522.TxControlReg);
-  if ((antennaStatus & 0x03) != 0x03) {
-    logWarn("⚠️ NFC天线未开启，尝试重新开启");
-    mfrc522.PCD_AntennaOn();
-    delay(50);
-    antennaStatus = mfrc522.PCD_ReadRegister(mfrc522.TxControlReg);
-    if ((antennaStatus & 0x03) != 0x03) {
-      logWarn("❌ NFC天线开启失败");
-      return false;
-    }
-  }
-
-  // 第3步：验证寄存器读写功能
-  byte testValue = 0x20;  // Idle command
-  mfrc522.PCD_WriteRegister(mfrc522.CommandReg, testValue);
-  delay(10);
-  byte readBack = mfrc522.PCD_ReadRegister(mfrc522.CommandReg);
-  if (readBack != testValue) {
-    logWarn("❌ NFC寄存器读写验证失败 (写入: 0x" + String(testValue, HEX) +
-            ", 读回: 0x" + String(readBack, HEX) + ")");
-    return false;
-  }
-
-  // 第4步：检查错误寄存器
-  byte errorReg = mfrc522.PCD_ReadRegister(mfrc522.ErrorReg);
-  if (errorReg != 0x00) {
-    logWarn("⚠️ NFC错误寄存器异常: 0x" + String(errorReg, HEX));
-    // 清除错误标志
-    mfrc522.PCD_WriteRegister(mfrc522.ErrorReg, 0x00);
-  }
-
-  logDebug("✅ NFC健康检查通过 (版本: 0x" + String(version, HEX) +
-           ", 天线: ON, 寄存器: OK)");
-  return true;
-}
-
-// =================== NFC完全重置 ===================
-bool performNFCHardReset() {
-  logInfo("🔄 执行NFC硬件完全重置...");
-
-  // 硬件复位
-  digitalWrite(RC522_RST, LOW);
-  delay(100);  // 延长复位时间
-  digitalWrite(RC522_RST, HIGH);
-  delay(100);
-
-  // 重新初始化
-  mfrc522.PCD_Init(RC522_CS, RC522_RST);
-  delay(200);
-
-  // 配置最佳参数
-  mfrc522.PCD_AntennaOn();
-  mfrc522.PCD_SetAntennaGain(mfrc522.RxGain_max);
-
-  // 清除所有错误标志
-  mfrc522.PCD_WriteRegister(mfrc522.ErrorReg, 0x00);
-
-  // 验证健康状态
-  return verifyNFCHealth();
-}
-
-// =================== NFC自动恢复（增强版）===================
-void tryRecoverNFC() {
-  if (sysStatus.nfcWorking) {
-    // 即使标志为true，也定期验证健康度
-    static unsigned long lastHealthCheck = 0;
-    if (millis() - lastHealthCheck >= 300000) {  // 每5分钟检查一次
-      lastHealthCheck = millis();
-
-      if (!verifyNFCHealth()) {
-        logWarn("⚠️ NFC健康检查失败，尝试恢复...");
-        sysStatus.nfcWorking = false;  // 标记为失效，触发恢复流程
-        healthMetrics.nfcInitialized = false;
-      }
-    }
-    return;
-  }
-
-  if (millis() - lastNFCRetry < NFC_RETRY_INTERVAL_MS) return;  // 未到重试时间
-
-  lastNFCRetry = millis();
-
-  // 使用增强版硬件重置
-  if (performNFCHardReset()) {
-    sysStatus.nfcWorking = true;
-    healthMetrics.nfcInitialized = true;
-    logInfo("✅ NFC恢复成功");
-    beepSuccess();
-  } else {
-    logWarn("⚠️ NFC恢复失败，将在" + String(NFC_RETRY_INTERVAL_MS/1000) + "秒后重试");
-    healthMetrics.nfcInitialized = false;
-  }
-}
-
-// =================== WiFi自动恢复 ===================
-void tryRecoverWiFi() {
-  if (sysStatus.wifiConnected) return;  // WiFi正常，无需恢复
+  wifiManager.service();
 
-  if (millis() - lastWiFiRetry < WIFI_RETRY_INTERVAL_MS) return;  // 未到重试时间
-
-  lastWiFiRetry = millis();
-  logInfo("🔄 尝试恢复WiFi连接...");
-
-  WiFi.disconnect();
-  delay(500);
-  WiFi.begin(config.getWiFiSSID().c_str(), config.getWiFiPassword().c_str());
-
-  unsigned long startTime = millis();
-  while (WiFi.status() != WL_CONNECTED && millis() - startTime < 10000) {
-    delay(500);
-  }
-
-  if (WiFi.status() == WL_CONNECTED) {
-    sysStatus.wifiConnected = true;
-    logInfo("✅ WiFi恢复成功: " + WiFi.localIP().toString());
-  } else {
-    logWarn("⚠️ WiFi恢复失败，将在" + String(WIFI_RETRY_INTERVAL_MS/1000) + "秒后重试");
+  bool connected = wifiManager.isConnected();
+  if (connected != sysStatus.wifiConnected) {
+    sysStatus.wifiConnected = connected;
+    healthMetrics.wifiConnected = connected;
+    if (connected) bootProfile.finish(BOOT_STAGE_WIFI);
   }
+  uint32_t connects = wifiManager.getStats().connects;
+  healthMetrics.wifiReconnectCount = connects > 0 ? connects - 1 : 0;
 }
 
 // =================== API响应验证 ===================
@@ -331,574 +187,1267 @@ bool validateCardInfoResponse(const JsonDocument& doc) {
 }
 
 // =================== Supabase API ===================
-CardInfo getCardInfoFromSupabase(const String& decimalUID) {
+CardInfo getCardInfoFromSupabase(const CardUid& uid) {
   CardInfo info;
   info.clear();
-  info.cardUIDDecimal = decimalUID;
-  info.cardUID = decimalToHexUID(decimalUID);
+  info.uid = uid;
 
   // 输入验证
-  if (decimalUID.length() == 0 || decimalUID.length() > 15) {
+  char decimalUID[CARD_UID_DEC_LEN];
+  if (uid.toDecimal(decimalUID, sizeof(decimalUID)) == 0 || uid.isEmpty()) {
     logError("❌ 无效的卡号格式");
     return info;
   }
 
+  // 离线时由本地卡片缓存授权（见 authorizeFromCache）
   if (!sysStatus.wifiConnected) {
-    logDebug("🔄 离线模式测试");
-    if (decimalUID == "2345408116" || decimalUID == "1210711100") {
-      info.displayCardNumber = "JC-VIP-8116";
-      info.cardNumber = "****8116";
-      info.balance = 76.00;
-      info.isValid = true;
-      info.isActive = true;
-      info.userName = "Test User";
-      info.cardType = "Premium";
-      info.lastTransactionDate = "2025-10-29";
-      logDebug("✅ 离线验证成功");
-    }
     return info;
   }
 
-  HTTPClient http;
-  String endpoint = config.getSupabaseURL() +
-    "/rest/v1/jc_vip_cards?card_uid=eq." + decimalUID +
-    "&select=display_card_number,cardholder_name,card_credit,member_type,is_active,updated_at";
-
-  http.begin(endpoint);
-  String apiKey = config.getSupabaseKey();
-  http.addHeader("apikey", apiKey.c_str());
-  http.addHeader("Authorization", ("Bearer " + apiKey).c_str());
-  http.setTimeout(10000);
-
-  int httpCode = http.GET();
-
-  if (httpCode == 200) {
-    String response = http.getString();
-
-    // 检查响应长度
-    if (response.length() == 0 || response.length() > 4096) {
-      logError("❌ API响应长度异常: " + String(response.length()));
-      http.end();
-      return info;
-    }
-
-    JsonDocument doc;
-    DeserializationError error = deserializeJson(doc, response);
-
-    if (error) {
-      logError("❌ JSON解析失败: " + String(error.c_str()));
-      http.end();
-      return info;
-    }
-
+  char path[160];
+  snprintf(path, sizeof(path), "/rest/v1/jc_vip_cards?card_uid=eq.%s"
+           "&select=display_card_number,cardholder_name,card_credit,member_type,is_active,updated_at&limit=1",
+           decimalUID);
+
+  // 从连接流式解析，只保留用到的字段（内存池大小与响应长度无关）
+  JsonDocument filter(&netJsonPool);
+  JsonObject fields = filter.add<JsonObject>();
+  fields["display_card_number"] = true;
+  fields["cardholder_name"] = true;
+  fields["card_credit"] = true;
+  fields["member_type"] = true;
+  fields["is_active"] = true;
+  fields["updated_at"] = true;
+
+  JsonDocument doc(&netJsonPool);
+  uint32_t startUs = micros();
+  int httpCode = supabase.getJson(path, doc, &filter);
+  latencyTrace.record(SPAN_CARD_GET, micros() - startUs);
+
+  if (httpCode == SUPABASE_ERROR_JSON) {
+    logError("❌ JSON解析失败");
+  } else if (httpCode == 200) {
     // 验证响应数据
     if (!validateCardInfoResponse(doc)) {
-      http.end();
       return info;
     }
 
     // 提取数据
-    String displayNum = doc[0]["display_card_number"] | "";
-    if (displayNum.length() > 0) {
-      info.displayCardNumber = displayNum;
-      if (displayNum.length() >= 4) {
-        info.cardNumber = "****" + displayNum.substring(displayNum.length() - 4);
-      } else {
-        info.cardNumber = displayNum;
-      }
+    const char* displayNum = doc[0]["display_card_number"] | "";
+    if (displayNum[0] != '\0') {
+      info.setDisplayCardNumber(displayNum);
     } else {
-      info.displayCardNumber = "N/A";
-      info.cardNumber = "****" + decimalUID.substring(decimalUID.length() - 4);
+      strlcpy(info.displayCardNumber, "N/A", sizeof(info.displayCardNumber));
+      size_t length = strlen(decimalUID);
+      snprintf(info.cardNumber, sizeof(info.cardNumber), "****%s",
+               decimalUID + (length > 4 ? length - 4 : 0));
     }
 
     info.balance = doc[0]["card_credit"].as<float>();
     info.isValid = true;
     info.isActive = doc[0]["is_active"].as<bool>();
-    info.userName = doc[0]["cardholder_name"] | "Unknown";
+    strlcpy(info.userName, doc[0]["cardholder_name"] | "Unknown", sizeof(info.userName));
 
     int memberType = doc[0]["member_type"] | 0;
     if (memberType >= 0 && memberType <= 7) {
+      info.memberType = memberType;
       info.cardType = MEMBER_TYPES[memberType];
     } else {
       info.cardType = "Unknown";
     }
 
-    String updatedAt = doc[0]["updated_at"] | "";
-    if (updatedAt.length() > 0) {
-      info.lastTransactionDate = updatedAt.substring(0, 10);
+    // 只保留日期部分 YYYY-MM-DD
+    const char* updatedAt = doc[0]["updated_at"] | "";
+    if (updatedAt[0] != '\0') {
+      strlcpy(info.lastTransactionDate, updatedAt, min(sizeof(info.lastTransactionDate), (size_t)11));
     } else {
-      info.lastTransactionDate = "Never";
+      strlcpy(info.lastTransactionDate, "Never", sizeof(info.lastTransactionDate));
     }
 
     logDebug("✅ 在线验证成功");
-    logDebug("  完整卡号: " + info.displayCardNumber);
-    logDebug("  会员类型: " + info.cardType);
-    logDebug("  最后使用: " + info.lastTransactionDate);
+    LOG_D("  完整卡号: %s", info.displayCardNumber);
+    LOG_D("  会员类型: %s", info.cardType);
+    LOG_D("  最后使用: %s", info.lastTransactionDate);
   } else {
     logError("❌ API错误: HTTP " + String(httpCode));
   }
 
-  http.end();
   return info;
 }
 
-bool updateCardBalance(const String& decimalUID, float newBalance) {
+// 离线时返回false：断网交易由离线日志重放时补扣
+bool updateCardBalance(const CardUid& uid, float newBalance) {
   if (!sysStatus.wifiConnected) {
-    logInfo("🔄 离线模式：余额更新已缓存");
-    return true;
+    return false;
   }
 
-  HTTPClient http;
-  String endpoint = config.getSupabaseURL() + "/rest/v1/jc_vip_cards?card_uid=eq." + decimalUID;
-
-  JsonDocument doc;
+  JsonDocument doc(&netJsonPool);
   doc["card_credit"] = newBalance;
 
-  String jsonString;
-  serializeJson(doc, jsonString);
-
-  http.begin(endpoint);
-  String apiKey = config.getSupabaseKey();
-  http.addHeader("apikey", apiKey.c_str());
-  http.addHeader("Authorization", ("Bearer " + apiKey).c_str());
-  http.addHeader("Content-Type", "application/json");
-  http.addHeader("Prefer", "return=minimal");
-
-  int httpCode = http.PATCH(jsonString);
-  http.end();
+  char path[64];
+  char decimalUID[CARD_UID_DEC_LEN];
+  uid.toDecimal(decimalUID, sizeof(decimalUID));
+  snprintf(path, sizeof(path), "/rest/v1/jc_vip_cards?card_uid=eq.%s", decimalUID);
+  uint32_t startUs = micros();
+  int httpCode = supabase.patchJson(path, doc);
+  latencyTrace.record(SPAN_BALANCE_PATCH, micros() - startUs);
 
   return (httpCode == 204);
 }
 
-// =================== 离线队列管理 ===================
-void addToOfflineQueue(const String& decimalUID, float amount, float balanceBefore, const String& packageName) {
-  if (offlineQueueCount >= MAX_OFFLINE_QUEUE) {
-    logWarn("⚠️ 离线队列已满，覆盖最旧记录");
-    // 移除最旧的记录
-    for (int i = 0; i < offlineQueueCount - 1; i++) {
-      offlineQueue[i] = offlineQueue[i + 1];
-    }
-    offlineQueueCount--;
-  }
+// =================== 离线交易日志 ===================
+// 说明：离线日志只在网络任务中读写（loop()只读取 offlineLog.pendingCount()）
+
+// 分配交易序号：NVS中按块预留上限，每 OFFLINE_SEQ_RESERVE_BLOCK 笔才写一次
+// 重启后从预留上限之后继续，序号永不重复（跳过未用完的部分）
+uint32_t txSeqNext = 0;
+uint32_t txSeqReserved = 0;
 
-  // 添加新交易
-  offlineQueue[offlineQueueCount].cardUID = decimalUID;
-  offlineQueue[offlineQueueCount].amount = amount;
-  offlineQueue[offlineQueueCount].balanceBefore = balanceBefore;
-  offlineQueue[offlineQueueCount].packageName = packageName;
-  offlineQueue[offlineQueueCount].timestamp = millis();
-  offlineQueueCount++;
+uint32_t allocTxSeq() {
+  if (txSeqNext > txSeqReserved) {
+    txSeqReserved = txSeqNext + OFFLINE_SEQ_RESERVE_BLOCK - 1;
+    prefs.putUInt("tx_seq", txSeqReserved);
+  }
+  return txSeqNext++;
+}
 
-  // 保存到NVS
-  prefs.putInt("queue_count", offlineQueueCount);
-  String key = "tx_" + String(offlineQueueCount - 1);
-  String data = decimalUID + "|" + String(amount, 2) + "|" + String(balanceBefore, 2) + "|" + packageName;
-  prefs.putString(key.c_str(), data);
+// 交易幂等键：<芯片MAC>-<交易序号>，重试/重放时服务器据此去重
+void formatIdempotencyKey(uint32_t seq, char* key, size_t size) {
+  snprintf(key, size, "%012llX-%lu", (unsigned long long)ESP.getEfuseMac(), (unsigned long)seq);
+}
 
-  logInfo("✅ 交易已缓存到离线队列 (" + String(offlineQueueCount) + "/" + String(MAX_OFFLINE_QUEUE) + ")");
+void fillPendingTransaction(PendingTransaction& tx, uint32_t seq, const CardUid& uid,
+                            float amount, float balanceBefore, const char* packageName, uint8_t bay) {
+  tx.clear();
+  tx.bay = bay;
+  tx.seq = seq;
+  tx.timestamp = millis();
+  tx.amount = amount;
+  tx.balanceBefore = balanceBefore;
+  tx.uid = uid;
+  strlcpy(tx.packageName, packageName, sizeof(tx.packageName));
 }
 
-void loadOfflineQueue() {
-  offlineQueueCount = prefs.getInt("queue_count", 0);
-  if (offlineQueueCount > MAX_OFFLINE_QUEUE) {
-    offlineQueueCount = MAX_OFFLINE_QUEUE;
+// kind: 重放方式 OFFLINE_REC_KIND_*；offlineSpend: 计入卡片缓存的离线累计（断网授权），重放确认后扣除
+void addToOfflineQueue(const CardUid& uid, float amount, float balanceBefore,
+                       const char* packageName, uint32_t seq, uint8_t bay, uint8_t kind, bool offlineSpend) {
+  PendingTransaction tx;
+  fillPendingTransaction(tx, seq, uid, amount, balanceBefore, packageName, bay);
+  tx.kind = kind;
+  tx.offlineSpend = offlineSpend ? 1 : 0;
+
+  if (!offlineLog.append(tx)) {
+    char text[CARD_UID_DEC_LEN];
+    LOG_E("❌ 交易写入离线日志失败: %s", maskCardUid(uid, text, sizeof(text)));
+    return;
   }
 
-  for (int i = 0; i < offlineQueueCount; i++) {
+  logInfo("✅ 交易已缓存到离线日志 (" + String(offlineLog.pendingCount()) + "/" + String(offlineLog.capacity()) + ")");
+}
+
+// 旧版本NVS队列（tx_<i> 字符串）迁移到离线日志，迁移后删除NVS记录
+void migrateLegacyOfflineQueue() {
+  int legacyCount = prefs.getInt("queue_count", 0);
+  if (legacyCount <= 0) return;
+
+  int migrated = 0;
+  for (int i = 0; i < legacyCount; i++) {
     String key = "tx_" + String(i);
     String data = prefs.getString(key.c_str(), "");
-    if (data.length() > 0) {
-      int pos1 = data.indexOf('|');
-      int pos2 = data.indexOf('|', pos1 + 1);
-      int pos3 = data.indexOf('|', pos2 + 1);
-
-      offlineQueue[i].cardUID = data.substring(0, pos1);
-      offlineQueue[i].amount = data.substring(pos1 + 1, pos2).toFloat();
-      offlineQueue[i].balanceBefore = data.substring(pos2 + 1, pos3).toFloat();
-      offlineQueue[i].packageName = data.substring(pos3 + 1);
+    prefs.remove(key.c_str());
+    if (data.length() == 0) continue;
+
+    int pos1 = data.indexOf('|');
+    int pos2 = data.indexOf('|', pos1 + 1);
+    int pos3 = data.indexOf('|', pos2 + 1);
+    int pos4 = data.indexOf('|', pos3 + 1);
+
+    // 沿用旧幂等键中的序号，已上传过的记录重放时仍会被服务器去重
+    uint32_t seq = 0;
+    String packageName;
+    if (pos4 > 0) {
+      packageName = data.substring(pos3 + 1, pos4);
+      String oldKey = data.substring(pos4 + 1);
+      seq = strtoul(oldKey.substring(oldKey.lastIndexOf('-') + 1).c_str(), NULL, 10);
+    } else {
+      packageName = data.substring(pos3 + 1);
     }
-  }
+    if (seq == 0) seq = allocTxSeq();
+
+    CardUid uid;
+    if (!CardUid::parseDecimal(data.substring(0, pos1).c_str(), uid)) continue;
 
-  if (offlineQueueCount > 0) {
-    logInfo("📥 离线缓存: " + String(offlineQueueCount) + " 笔");
+    PendingTransaction tx;
+    fillPendingTransaction(tx, seq, uid,
+                           data.substring(pos1 + 1, pos2).toFloat(),
+                           data.substring(pos2 + 1, pos3).toFloat(), packageName.c_str(), 0);
+    if (offlineLog.append(tx)) migrated++;
   }
+
+  prefs.remove("queue_count");
+  logInfo("📦 旧版离线队列已迁移: " + String(migrated) + " 笔");
 }
 
-bool syncOfflineQueue() {
-  if (offlineQueueCount == 0 || !sysStatus.wifiConnected) {
-    return false;
+// 打开离线日志并恢复（断电中途写入的记录由CRC校验过滤）
+void loadOfflineQueue() {
+  if (!offlineLog.begin()) {
+    logError("❌ 离线日志不可用，断网交易将无法缓存");
+    return;
   }
 
-  logInfo("🔄 同步离线交易队列 (" + String(offlineQueueCount) + " 笔)...");
-  int successCount = 0;
-  int failCount = 0;
+  // 交易序号从NVS预留上限和日志最大序号中较大者之后继续
+  uint32_t reserved = prefs.getUInt("tx_seq", 0);
+  txSeqNext = max(reserved, offlineLog.getMaxSeq()) + 1;
+  txSeqReserved = txSeqNext - 1;
 
-  for (int i = 0; i < offlineQueueCount; i++) {
-    PendingTransaction& tx = offlineQueue[i];
+  migrateLegacyOfflineQueue();
 
-    HTTPClient http;
-    String endpoint = config.getSupabaseURL() + "/rest/v1/jc_transaction_history";
+  if (offlineLog.pendingCount() > 0) {
+    logInfo("📥 离线缓存: " + String(offlineLog.pendingCount()) + " 笔");
+  }
+}
+
+// 服务器拒绝补扣的离线交易：写入未收款记录（CHARGE_UNCOLLECTED），成功后确认，返回HTTP状态码
+int replayUncollected(const PendingTransaction& tx, uint32_t slot, const CardUid& uid, float balanceBefore) {
+  int httpCode = postTransactionRow(uid, tx.amount, balanceBefore, tx.packageName, tx.seq, tx.bay,
+                                    TX_TYPE_CHARGE_UNCOLLECTED, NULL);
+  if (httpCode == 200 || httpCode == 201) {
+    offlineLog.acknowledge(slot);
+    if (tx.offlineSpend) cardCache.settleOffline(uid, -tx.amount);
+    cardCache.expire(uid);
+    sysStatus.uncollectedCharges++;
+  }
+  return httpCode;
+}
 
-    JsonDocument doc;
-    doc["machine_id"] = config.getMachineID();
-    doc["card_uid"] = tx.cardUID.toInt();
-    doc["transaction_type"] = "CHARGE";
-    doc["third_party_reference"] = tx.packageName;
-    doc["transaction_amount"] = tx.amount;
-    doc["balance_before"] = tx.balanceBefore;
+// 补扣一条服务器未扣费的离线交易（网络任务中调用），与在线扣费使用同一个幂等键，服务器已处理过的不会重复扣费
+// - 通过 jc_debit_card 补扣；服务器没有该函数时按三步扣费：
+//   先查询余额，再插入交易记录（只插入新记录），新写入时才更新余额
+// - 服务器拒绝扣费（卡片停用/余额不足/已删除）时补写未收款记录（CHARGE_UNCOLLECTED）
+// 返回: 1 已确认；0 本轮跳过（留在日志中）；-1 网络或服务器错误（需要退避）
+int replayOfflineDebit(const PendingTransaction& tx, uint32_t slot) {
+  char key[32];
+  formatIdempotencyKey(tx.seq, key, sizeof(key));
+
+  CardUid uid;
+  if (!tx.getUid(uid)) {
+    LOG_E("❌ 离线记录UID无效，跳过: %s", key);
+    return 0;
+  }
+
+  float amount = -tx.amount;
+  float settled = tx.offlineSpend ? amount : 0;
+  int httpCode = 0;
+
+  if (rpcDebitAvailable) {
+    DebitResult result = {};
+    httpCode = debitCardRPC(uid, amount, tx.packageName, tx.seq, tx.bay, result);
+
+    if (httpCode == 200 && result.ok) {
+      offlineLog.acknowledge(slot);
+      if (result.duplicate) {
+        cardCache.settleOffline(uid, settled);
+      } else {
+        cardCache.applyServerBalance(uid, result.balanceAfter, settled);
+      }
+      return 1;
+    }
 
-    String jsonString;
-    serializeJson(doc, jsonString);
+    if (httpCode == 200 && strcmp(result.reason, "uncollected") == 0) {
+      // 该幂等键已记为未收款（之前的尝试已写入）：按未收款结清，不重复写记录
+      offlineLog.acknowledge(slot);
+      cardCache.settleOffline(uid, settled);
+      cardCache.expire(uid);
+      return 1;
+    }
 
-    http.begin(endpoint);
-    String apiKey = config.getSupabaseKey();
-    http.addHeader("apikey", apiKey.c_str());
-    http.addHeader("Authorization", ("Bearer " + apiKey).c_str());
-    http.addHeader("Content-Type", "application/json");
-    http.addHeader("Prefer", "return=minimal");
+    if (httpCode == 200) {
+      // 服务已经提供，服务器无法扣费：写未收款记录供对账
+      logWarn("⚠️ 离线交易无法扣费 (" + String(result.reason) + "): " + String(key));
+      httpCode = replayUncollected(tx, slot, uid, tx.balanceBefore);
+      if (httpCode == 200 || httpCode == 201) return 1;
+    } else if (httpCode == 404) {
+      logWarn("⚠️ 服务器未部署 jc_debit_card，离线交易改用三步扣费");
+      rpcDebitAvailable = false;
+    }
+  }
 
-    int httpCode = http.POST(jsonString);
-    http.end();
+  if (!rpcDebitAvailable) {
+    CardInfo fresh = getCardInfoFromSupabase(uid);
+    if (!fresh.isValid) {
+      logWarn("⚠️ 离线交易卡片查询失败，本轮跳过: " + String(key));
+      return 0;
+    }
 
-    if (httpCode == 201) {
-      successCount++;
-      // 删除NVS中的记录
-      String key = "tx_" + String(i);
-      prefs.remove(key.c_str());
+    if (!fresh.isActive || fresh.balance < amount) {
+      logWarn("⚠️ 离线交易无法扣费 (" + String(fresh.isActive ? "insufficient" : "inactive") + "): " + String(key));
+      httpCode = replayUncollected(tx, slot, uid, fresh.balance);
+      if (httpCode == 200 || httpCode == 201) return 1;
     } else {
-      failCount++;
-      logWarn("⚠️ 离线交易同步失败 #" + String(i) + " (HTTP " + String(httpCode) + ")");
+      bool inserted = false;
+      httpCode = postTransactionRow(uid, tx.amount, fresh.balance, tx.packageName, tx.seq, tx.bay,
+                                    TX_TYPE_CHARGE, &inserted);
+      if (httpCode == 200 || httpCode == 201) {
+        // 交易记录已写入，之后重试不会再扣费：余额是绝对值，失败时立即重试一次
+        float balanceAfter = fresh.balance - amount;
+        offlineLog.acknowledge(slot);
+        if (inserted && (updateCardBalance(uid, balanceAfter) || updateCardBalance(uid, balanceAfter))) {
+          cardCache.applyServerBalance(uid, balanceAfter, settled);
+        } else {
+          if (inserted) {
+            logError("❌ 离线交易已记录但余额更新失败，需要对账: " + String(key));
+          }
+          cardCache.settleOffline(uid, settled);
+        }
+        return 1;
+      }
     }
-
-    delay(100);  // 避免API限流
   }
 
-  if (successCount > 0) {
-    logInfo("✅ 成功同步 " + String(successCount) + " 笔离线交易");
-    // 重新整理队列
-    offlineQueueCount = 0;
-    prefs.putInt("queue_count", 0);
+  if (httpCode >= 400 && httpCode < 500 && httpCode != 404) {
+    // 单条记录被拒绝：保留记录但跳过，不阻塞后续记录
+    logError("❌ 离线交易被服务器拒绝 (HTTP " + String(httpCode) + "): " + String(key));
+    return 0;
   }
 
-  return (successCount > 0);
+  logWarn("⚠️ 离线同步失败 (HTTP " + String(httpCode) + ")，稍后重试");
+  return -1;
 }
 
-bool recordTransaction(const String& decimalUID, float amount, float balanceBefore, const String& packageName) {
-  // 离线模式：添加到队列
-  if (!sysStatus.wifiConnected) {
-    addToOfflineQueue(decimalUID, amount, balanceBefore, packageName);
-    return true;
-  }
+// 同步一批离线交易（网络任务中调用，每次只处理一批）
+// 服务器未扣费的记录逐条补扣；只缺交易记录（含未收款记录）的合并为一次PostgREST批量upsert，
+// 按幂等键合并重复记录，返回的行即为服务器已确认的记录
+// 返回: >=0 本批确认数量；-1 网络或服务器错误（需要退避）
+int syncOfflineChunk() {
+  if (offlineLog.pendingCount() == 0 || !sysStatus.wifiConnected) {
+    offlineSyncPassDone = true;
+    return 0;
+  }
+
+  if (!offlineSyncCursorValid) {
+    offlineSyncCursor = offlineLog.getHeadSlot();
+    offlineSyncCursorValid = true;
+  }
+
+  int chunkSize = offlineSyncIsolate ? 1 : OFFLINE_SYNC_CHUNK_SIZE;
+  PendingTransaction records[OFFLINE_SYNC_CHUNK_SIZE];
+  uint32_t slots[OFFLINE_SYNC_CHUNK_SIZE];
+  uint32_t nextCursor;
+  int count = offlineLog.readPending(offlineSyncCursor, records, slots, chunkSize, nextCursor);
+
+  if (count == 0) {
+    offlineSyncPassDone = true;
+    return 0;
+  }
+
+  int confirmedCount = 0;
+  int rowCount = 0;
+  char keys[OFFLINE_SYNC_CHUNK_SIZE][32];
+  char uids[OFFLINE_SYNC_CHUNK_SIZE][CARD_UID_DEC_LEN];
+  uint32_t rowSlots[OFFLINE_SYNC_CHUNK_SIZE];
+  bool rowUncollected[OFFLINE_SYNC_CHUNK_SIZE];
+  JsonDocument doc(&netJsonPool);
+  JsonArray rows = doc.to<JsonArray>();
+  for (int i = 0; i < count; i++) {
+    const PendingTransaction& tx = records[i];
+    if (tx.kind == OFFLINE_REC_KIND_DEBIT) {
+      // 出错时游标不前进，已确认的记录下次读取时跳过
+      int replayed = replayOfflineDebit(tx, slots[i]);
+      if (replayed < 0) return -1;
+      confirmedCount += replayed;
+      continue;
+    }
 
-  // 在线模式：直接发送
-  HTTPClient http;
-  String endpoint = config.getSupabaseURL() + "/rest/v1/jc_transaction_history";
+    formatIdempotencyKey(tx.seq, keys[rowCount], sizeof(keys[rowCount]));
+    tx.formatUid(uids[rowCount], sizeof(uids[rowCount]));
+    rowSlots[rowCount] = slots[i];
+    rowUncollected[rowCount] = tx.kind == OFFLINE_REC_KIND_UNCOLLECTED;
+
+    JsonObject row = rows.add<JsonObject>();
+    row["machine_id"] = config.getBayMachineID(tx.bay);
+    row["card_uid"] = serialized(uids[rowCount]);  // 十进制原样输出（7/10字节UID超出double精度）
+    row["transaction_type"] = rowUncollected[rowCount] ? TX_TYPE_CHARGE_UNCOLLECTED : TX_TYPE_CHARGE;
+    row["third_party_reference"] = tx.packageName;
+    row["transaction_amount"] = tx.amount;
+    row["balance_before"] = tx.balanceBefore;
+    row["idempotency_key"] = keys[rowCount];
+    rowCount++;
+  }
+
+  if (rowCount == 0) {
+    offlineSyncCursor = nextCursor;
+    if (confirmedCount > 0) {
+      logInfo("✅ 离线交易已补扣 " + String(confirmedCount) + " 笔，剩余 " + String(offlineLog.pendingCount()) + " 笔");
+    }
+    return confirmedCount;
+  }
 
-  JsonDocument doc;
-  doc["machine_id"] = config.getMachineID();
-  doc["card_uid"] = decimalUID.toInt();
-  doc["transaction_type"] = "CHARGE";
-  doc["third_party_reference"] = packageName;
-  doc["transaction_amount"] = amount;
-  doc["balance_before"] = balanceBefore;
+  // 响应只含幂等键（select=idempotency_key），直接从连接解析
+  JsonDocument result(&netJsonPool);
+  int httpCode = supabase.postJson(
+    "/rest/v1/jc_transaction_history?on_conflict=idempotency_key&select=idempotency_key",
+    doc, "return=representation,resolution=merge-duplicates", &result);
 
-  String jsonString;
-  serializeJson(doc, jsonString);
+  if (httpCode == SUPABASE_ERROR_JSON) {
+    logWarn("⚠️ 离线同步请求/响应JSON处理失败，下次重试");
+    return -1;
+  }
 
-  http.begin(endpoint);
-  String apiKey = config.getSupabaseKey();
-  http.addHeader("apikey", apiKey.c_str());
-  http.addHeader("Authorization", ("Bearer " + apiKey).c_str());
-  http.addHeader("Content-Type", "application/json");
-  http.addHeader("Prefer", "return=minimal");
+  if (httpCode == 200 || httpCode == 201) {
 
-  int httpCode = http.POST(jsonString);
-  http.end();
+    // 逐条确认：只标记服务器返回了幂等键的记录
+    bool confirmed[OFFLINE_SYNC_CHUNK_SIZE] = {false};
+    for (JsonVariant row : result.as<JsonArray>()) {
+      const char* key = row["idempotency_key"] | "";
+      for (int j = 0; j < rowCount; j++) {
+        if (!confirmed[j] && strcmp(keys[j], key) == 0) {
+          confirmed[j] = true;
+          offlineLog.acknowledge(rowSlots[j]);
+          if (rowUncollected[j]) sysStatus.uncollectedCharges++;
+          confirmedCount++;
+          break;
+        }
+      }
+    }
 
-  if (httpCode == 201) {
-    sysStatus.totalTransactions++;
-    sysStatus.totalRevenue += amount;
+    // 未被确认的记录留在日志中，下一轮再试
+    offlineSyncCursor = nextCursor;
 
-    // 记录交易到健康度监测
-    healthMonitor.recordTransaction();
+    if (confirmedCount > 0) {
+      logInfo("✅ 离线交易已同步 " + String(confirmedCount) + " 笔，剩余 " + String(offlineLog.pendingCount()) + " 笔");
+    }
+    return confirmedCount;
+  }
 
-    // 成功后尝试同步离线队列
-    if (offlineQueueCount > 0) {
-      syncOfflineQueue();
+  if (httpCode >= 400 && httpCode < 500) {
+    if (rowCount > 1) {
+      // 整批被拒绝：逐条重试，隔离出问题记录
+      logWarn("⚠️ 离线批量同步被拒绝 (HTTP " + String(httpCode) + ")，改为逐条同步");
+      offlineSyncIsolate = true;
+    } else {
+      // 单条记录被拒绝：保留记录但跳过，不阻塞后续记录
+      logError("❌ 离线交易被服务器拒绝 (HTTP " + String(httpCode) + "): " + String(keys[0]));
+      offlineSyncCursor = nextCursor;
     }
+    return 0;
+  }
 
-    return true;
+  logWarn("⚠️ 离线同步失败 (HTTP " + String(httpCode) + ")，稍后重试");
+  return -1;
+}
+
+// 网络任务：执行一步同步并安排下一步
+void runOfflineSyncStep() {
+  int result = syncOfflineChunk();
+  unsigned long now = millis();
+
+  if (result < 0) {
+    // 指数退避
+    offlineSyncBackoffMs = offlineSyncBackoffMs == 0 ? OFFLINE_SYNC_RETRY_MS
+                                                     : min(offlineSyncBackoffMs * 2, (unsigned long)OFFLINE_SYNC_MAX_BACKOFF_MS);
+    nextOfflineSyncTime = now + offlineSyncBackoffMs;
+  } else if (offlineSyncPassDone) {
+    // 本轮已遍历完，剩余的是被拒绝的记录，等待较长时间再试
+    offlineSyncBackoffMs = 0;
+    offlineSyncCursorValid = false;
+    offlineSyncPassDone = false;
+    offlineSyncIsolate = false;
+    nextOfflineSyncTime = now + OFFLINE_SYNC_RETRY_MS;
   } else {
-    // 在线发送失败，添加到离线队列
-    logWarn("⚠️ 在线交易失败 (HTTP " + String(httpCode) + ")，转为离线模式");
-    addToOfflineQueue(decimalUID, amount, balanceBefore, packageName);
-    return true;  // 仍返回true，因为已缓存
+    offlineSyncBackoffMs = 0;
+    nextOfflineSyncTime = now + OFFLINE_SYNC_INTERVAL_MS;
   }
-}
 
-// =================== 状态处理函数 ===================
-void handleWelcomeState() {
-  setSystemLEDStatus();
+  offlineSyncPending = false;
+}
 
-  // 持续刷新显示以支持滚动动画
-  displayWelcome();
+// loop()：按计划提交同步请求（每次一批，跨多次loop完成）
+void scheduleOfflineSync() {
+  static bool wasConnected = false;
 
-  // ✅ 优化：欢迎界面刷新时间戳，避免待机时自动重启
-  static unsigned long lastWelcomeUpdate = 0;
-  if (millis() - lastWelcomeUpdate > 60000) {  // 每60秒刷新一次
-    lastSuccessfulOperation = millis();
-    lastWelcomeUpdate = millis();
+  if (!sysStatus.wifiConnected) {
+    wasConnected = false;
+    return;
   }
 
-  // ✅ 新增：WELCOME状态下持续检测NFC（用于健康度监测）
-  // 说明：即使在待机状态也检测NFC，确保健康度数据准确
-  //      检测到卡片不会触发业务逻辑，仅用于验证NFC模块工作状态
-  static unsigned long lastNFCCheck = 0;
-  if (millis() - lastNFCCheck >= 2000) {  // 每2秒检测一次
-    String uid = readCardUID();  // 调用检测，会更新成功/失败计数
-    // 不做任何处理，仅用于测试NFC是否响应
-    lastNFCCheck = millis();
+  // WiFi恢复后随机延迟，避免多台终端同时冲击API
+  if (!wasConnected) {
+    wasConnected = true;
+    nextOfflineSyncTime = millis() + random(OFFLINE_SYNC_JITTER_MS);
   }
 
-  if (readButtonImproved(BTN_OK)) {
-    currentState = STATE_SELECT_PACKAGE;
-    selectedPackage = 0;
-    stateStartTime = millis();
-    beepShort();
-    logDebug("✅ 用户启动服务");
+  if (offlineLog.pendingCount() == 0 || offlineSyncPending) return;
+  if ((long)(millis() - nextOfflineSyncTime) < 0) return;
+
+  offlineSyncPending = netSubmitOfflineSync();
+}
+
+// 写入一行交易记录（按幂等键去重），返回HTTP状态码
+// type: TX_TYPE_*；inserted非NULL时只插入新记录（ignore-duplicates），返回的幂等键表示本次新写入
+int postTransactionRow(const CardUid& uid, float amount, float balanceBefore, const char* packageName,
+                       uint32_t seq, uint8_t bay, const char* type, bool* inserted) {
+  char idempotencyKey[32];
+  formatIdempotencyKey(seq, idempotencyKey, sizeof(idempotencyKey));
+  char decimalUID[CARD_UID_DEC_LEN];
+  uid.toDecimal(decimalUID, sizeof(decimalUID));
+
+  JsonDocument doc(&netJsonPool);
+  doc["machine_id"] = config.getBayMachineID(bay);
+  doc["card_uid"] = serialized(decimalUID);  // 十进制原样输出（7/10字节UID超出double精度）
+  doc["transaction_type"] = type;
+  doc["third_party_reference"] = packageName;
+  doc["transaction_amount"] = amount;
+  doc["balance_before"] = balanceBefore;
+  doc["idempotency_key"] = idempotencyKey;
+
+  if (inserted == NULL) {
+    return supabase.postJson("/rest/v1/jc_transaction_history?on_conflict=idempotency_key", doc,
+                             "return=minimal,resolution=merge-duplicates");
   }
+
+  // 响应只含新写入行的幂等键（select=idempotency_key），直接从连接解析
+  JsonDocument result(&netJsonPool);
+  int httpCode = supabase.postJson(
+    "/rest/v1/jc_transaction_history?on_conflict=idempotency_key&select=idempotency_key",
+    doc, "return=representation,resolution=ignore-duplicates", &result);
+  *inserted = result.as<JsonArray>().size() > 0;
+  return httpCode;
 }
 
-void handleSelectPackageState() {
-  setSystemLEDStatus();
+// 交易已被服务器记录：更新统计
+void noteTransactionRecorded(float amount) {
+  sysStatus.totalTransactions++;
+  sysStatus.totalRevenue += amount;
 
-  // 只在首次进入或按键时刷新显示，避免过度刷新
-  static bool displayRefreshed = false;
-  static int lastSelectedPackage = -1;
+  // 记录交易到健康度监测
+  healthMonitor.recordTransaction();
 
-  if (!displayRefreshed || lastSelectedPackage != selectedPackage) {
-    displayPackageSelection();
-    displayRefreshed = true;
-    lastSelectedPackage = selectedPackage;
+  // 网络正常，尽快同步离线队列
+  if (offlineLog.pendingCount() > 0) {
+    nextOfflineSyncTime = millis();
   }
+}
 
-  if (readButtonImproved(BTN_SELECT)) {
-    selectedPackage = (selectedPackage + 1) % PACKAGE_COUNT;
-    stateStartTime = millis();  // 重置超时计时器
-    displayRefreshed = false;  // 标记需要刷新
-    beepShort();
+// 余额已在服务器上更新（三步扣费）后补写交易记录
+// seq: 交易序号（在线失败转入离线日志后沿用同一个幂等键）；bay: 交易所属洗车位（机器ID）
+bool recordTransaction(const CardUid& uid, float amount, float balanceBefore,
+                       const char* packageName, uint32_t seq, uint8_t bay) {
+  // 离线模式：写入离线日志
+  if (!sysStatus.wifiConnected) {
+    addToOfflineQueue(uid, amount, balanceBefore, packageName, seq, bay, OFFLINE_REC_KIND_RECORD, false);
+    return true;
   }
 
-  if (readButtonImproved(BTN_OK)) {
-    displayRefreshed = false;  // 重置刷新标志，为下次进入准备
-    if (packages[selectedPackage].isQuery) {
-      currentState = STATE_VIP_QUERY;
-      stateStartTime = millis();
-      beepShort();
-      logDebug("进入VIP信息查询");
-    } else {
-      currentState = STATE_CARD_SCAN;
-      stateStartTime = millis();
-      beepShort();
-      logDebug("套餐选择: " + String(packages[selectedPackage].name_en));
-    }
+  // 在线模式：直接发送
+  uint32_t startUs = micros();
+  int httpCode = postTransactionRow(uid, amount, balanceBefore, packageName, seq, bay, TX_TYPE_CHARGE, NULL);
+  latencyTrace.record(SPAN_TX_POST, micros() - startUs);
+
+  if (httpCode == 201 || httpCode == 200) {
+    noteTransactionRecorded(amount);
+    return true;
+  } else {
+    // 在线发送失败，添加到离线队列
+    LOG_W("⚠️ 在线交易失败 (HTTP %d)，转为离线模式", httpCode);
+    addToOfflineQueue(uid, amount, balanceBefore, packageName, seq, bay, OFFLINE_REC_KIND_RECORD, false);
+    return true;  // 仍返回true，因为已缓存
   }
 }
 
-void handleCardScanState() {
-  setSystemLEDStatus();
-
-  // 调试：检查是否进入刷卡状态 + NFC模块状态
-  static unsigned long lastDebugPrint = 0;
-  static bool antennaInfoShown = false;
+// 缓存授权的服务已经开始，服务器拒绝扣费（卡片停用/余额不足/已删除）：
+// 写入未收款记录（余额未扣除，不计入营收），对账时按 transaction_type 查找
+void recordUncollectedCharge(const CardUid& uid, float amount, float balanceBefore,
+                             const char* packageName, uint32_t seq, uint8_t bay) {
+  int httpCode = postTransactionRow(uid, amount, balanceBefore, packageName, seq, bay,
+                                    TX_TYPE_CHARGE_UNCOLLECTED, NULL);
+  if (httpCode == 201 || httpCode == 200) {
+    sysStatus.uncollectedCharges++;
+    return;
+  }
 
-  // 首次进入或每5秒打印一次
-  if (lastDebugPrint == 0 || millis() - lastDebugPrint > 5000) {
-    byte version = mfrc522.PCD_ReadRegister(mfrc522.VersionReg);
+  logWarn("⚠️ 未收款记录写入失败 (HTTP " + String(httpCode) + ")，转入离线日志");
+  addToOfflineQueue(uid, amount, balanceBefore, packageName, seq, bay, OFFLINE_REC_KIND_UNCOLLECTED, false);
+}
 
-    logVerbose("等待刷卡... [NFC版本: 0x" + String(version, HEX) + ", 状态: " +
-            (sysStatus.nfcWorking ? "正常" : "异常") + "]");
+// =================== 扣费 ===================
+// 优先调用服务器函数 jc_debit_card（supabase/002_debit_card_rpc.sql），一次请求完成
+// 余额检查、扣费和交易记录；服务器未部署该函数时回退到 PATCH余额 + POST交易 的旧流程
+// （rpcDebitAvailable 见全局变量，离线重放也使用）
+
+// 返回HTTP状态码，200时填写result
+int debitCardRPC(const CardUid& uid, float amount, const char* packageName,
+                 uint32_t seq, uint8_t bay, DebitResult& result) {
+  char idempotencyKey[32];
+  formatIdempotencyKey(seq, idempotencyKey, sizeof(idempotencyKey));
+  char decimalUID[CARD_UID_DEC_LEN];
+  uid.toDecimal(decimalUID, sizeof(decimalUID));
+
+  JsonDocument doc(&netJsonPool);
+  doc["p_card_uid"] = serialized(decimalUID);
+  doc["p_amount"] = amount;
+  doc["p_machine_id"] = config.getBayMachineID(bay);
+  doc["p_package"] = packageName;
+  doc["p_idempotency_key"] = idempotencyKey;
+
+  JsonDocument reply(&netJsonPool);
+  uint32_t startUs = micros();
+  int httpCode = supabase.postJson("/rest/v1/rpc/jc_debit_card", doc, NULL, &reply);
+  latencyTrace.record(SPAN_DEBIT_RPC, micros() - startUs);
+  if (httpCode == SUPABASE_ERROR_JSON) {
+    logError("❌ 扣费请求/响应JSON处理失败");  // 负值：按结果未知处理（同一幂等键重试）
+  }
+  if (httpCode != 200) {
+    return httpCode;
+  }
+
+  result.ok = reply["ok"] | false;
+  result.duplicate = reply["duplicate"] | false;
+  result.balanceBefore = reply["balance_before"] | 0.0f;
+  result.balanceAfter = reply["balance_after"] | 0.0f;
+  strlcpy(result.reason, reply["reason"] | "", sizeof(result.reason));
+  return httpCode;
+}
 
-    // 第一次打印时检查并修复天线状态
-    if (!antennaInfoShown) {
-      byte txControl = mfrc522.PCD_ReadRegister(MFRC522::TxControlReg);
-      byte gain = mfrc522.PCD_ReadRegister(MFRC522::RFCfgReg);
+// 扣费转入离线日志，联网后补扣（同一幂等键）
+void queueOfflineDebit(const NetJob& job, uint32_t seq) {
+  addToOfflineQueue(job.uid, -job.amount, job.balanceBefore, job.packageName, seq, job.bay,
+                    OFFLINE_REC_KIND_DEBIT, job.offlineAuthorized);
+}
 
-      logDebug("   天线: 0x" + String(txControl, HEX) + " (bit0&1应=1), 增益: 0x" + String(gain, HEX));
+// 服务器已扣费：更新缓存余额（断网授权的扣费同时从离线累计中扣除）
+void settleCachedCharge(const NetJob& job, float balanceAfter) {
+  cardCache.applyServerBalance(job.uid, balanceAfter, job.offlineAuthorized ? job.amount : 0);
+}
 
-      // 如果天线被关闭，强制重新开启
-      if ((txControl & 0x03) != 0x03) {
-        logWarn("   ⚠️ 天线已关闭，重新开启...");
-        mfrc522.PCD_AntennaOn();
-        delay(10);
-        mfrc522.PCD_SetAntennaGain(mfrc522.RxGain_max);
-        delay(10);
+// 执行扣费请求（网络任务调用）
+// 结果写入out：success、扣费前余额（out.cardInfo.balance）、服务器拒绝原因
+void chargeCard(const NetJob& job, NetResult& out) {
+  const CardUid& uid = job.uid;
+  const char* packageName = job.packageName;
+  uint32_t seq = allocTxSeq();
 
-        // 验证
-        txControl = mfrc522.PCD_ReadRegister(MFRC522::TxControlReg);
-        gain = mfrc522.PCD_ReadRegister(MFRC522::RFCfgReg);
-        logDebug("   修复后: 天线=0x" + String(txControl, HEX) + ", 增益=0x" + String(gain, HEX));
-      }
+  out.success = false;
+  out.cardInfo.clear();
+  out.cardInfo.uid = uid;
+  out.reason[0] = '\0';
 
-      antennaInfoShown = true;
+  if (!sysStatus.wifiConnected) {
+    // 缓存授权的服务已经开始：写入离线日志，联网后补扣；其他扣费需要服务器确认
+    if (job.cacheAuthorized) {
+      queueOfflineDebit(job, seq);
+      out.success = true;
+      out.cardInfo.isValid = true;
+      out.cardInfo.isActive = true;
+      out.cardInfo.balance = job.balanceBefore;
     }
-
-    lastDebugPrint = millis();
+    return;
   }
 
-  displayCardScan();
+  if (rpcDebitAvailable) {
+    DebitResult result = {};
+    int httpCode = debitCardRPC(uid, job.amount, packageName, seq, job.bay, result);
+    if (httpCode < 0 || httpCode >= 500) {
+      // 结果未知：同一幂等键重试一次，服务器已扣过费时返回duplicate
+      httpCode = debitCardRPC(uid, job.amount, packageName, seq, job.bay, result);
+    }
 
-  String uid = readCardUID();
+    if (httpCode == 200 && result.ok) {
+      noteTransactionRecorded(-job.amount);
+      settleCachedCharge(job, result.balanceAfter);
+      out.success = true;
+      out.cardInfo.isValid = true;
+      out.cardInfo.isActive = true;
+      out.cardInfo.balance = result.balanceBefore;
+      LOG_D("✅ RPC扣费成功，余额: $%.2f%s", result.balanceAfter,
+            result.duplicate ? " (重复请求)" : "");
+      return;
+    }
 
-  // 调试：显示读卡尝试
-  static unsigned long lastReadAttempt = 0;
-  if (millis() - lastReadAttempt > 1000) {
-    if (uid.length() == 0) {
-      Serial.print(".");  // 简单的心跳显示
+    if (httpCode == 200) {
+      LOG_W("⚠️ 服务器拒绝扣费: %s", result.reason);
+      strlcpy(out.reason, result.reason, sizeof(out.reason));
+      if (job.cacheAuthorized) {
+        // 缓存授权的服务已经开始：没有扣到费，记为未收款（不是营收）
+        // uncollected：该幂等键已有未收款记录，不再重复写入
+        if (strcmp(result.reason, "uncollected") != 0) {
+          recordUncollectedCharge(uid, -job.amount, job.balanceBefore, packageName, seq, job.bay);
+        }
+        if (job.offlineAuthorized) cardCache.settleOffline(uid, job.amount);
+        cardCache.expire(uid);
+      }
+      return;
+    }
+
+    if (httpCode == 404) {
+      logWarn("⚠️ 服务器未部署 jc_debit_card，改用三步扣费");
+      rpcDebitAvailable = false;
+    } else {
+      LOG_E("❌ RPC扣费失败 (HTTP %d)", httpCode);
+      if (job.cacheAuthorized) {
+        // 结果未知或服务器暂时不可用：离线同步通过 jc_debit_card 用同一幂等键重试，不直接写交易记录
+        queueOfflineDebit(job, seq);
+      }
+      return;
     }
-    lastReadAttempt = millis();
   }
 
-  if (uid.length() > 0) {
-    beepShort();
+  // 旧流程：查询余额（需要时） + PATCH绝对余额 + POST交易记录
+  float balanceBefore = job.balanceBefore;
+
+  // 缓存授权或直接扣费：先向服务器查询余额，避免用过期余额覆盖
+  if (job.cacheAuthorized || job.directDebit) {
+    CardInfo fresh = getCardInfoFromSupabase(uid);
+    if (fresh.isValid) {
+      cardCache.store(fresh);
+      balanceBefore = fresh.balance;
+    } else if (job.cacheAuthorized) {
+      // 没有服务器余额，不能用缓存余额覆盖：转入离线日志补扣
+      queueOfflineDebit(job, seq);
+      out.success = true;
+      out.cardInfo.isValid = true;
+      out.cardInfo.isActive = true;
+      out.cardInfo.balance = balanceBefore;
+      return;
+    }
+
+    if (job.directDebit) {
+      if (!fresh.isValid) {
+        strlcpy(out.reason, "not_found", sizeof(out.reason));
+        return;
+      }
+      if (!fresh.isActive) {
+        strlcpy(out.reason, "inactive", sizeof(out.reason));
+        return;
+      }
+      if (fresh.balance < job.amount) {
+        strlcpy(out.reason, "insufficient", sizeof(out.reason));
+        return;
+      }
+    } else if (!fresh.isActive || fresh.balance < job.amount) {
+      // 与 jc_debit_card 一致：不扣停用卡片/余额不足的卡片，记为未收款
+      char text[CARD_UID_DEC_LEN];
+      LOG_W("⚠️ 缓存授权的卡片在服务器上已停用或余额不足: %s", maskCardUid(uid, text, sizeof(text)));
+      strlcpy(out.reason, fresh.isActive ? "insufficient" : "inactive", sizeof(out.reason));
+      recordUncollectedCharge(uid, -job.amount, fresh.balance, packageName, seq, job.bay);
+      if (job.offlineAuthorized) cardCache.settleOffline(uid, job.amount);
+      cardCache.expire(uid);
+      return;
+    }
+  }
 
-    displayProcessing("Verifying...", 0.3);
-    ledIndicator.network = LED_BLINK_FAST;
-    updateLEDIndicators();
+  float balanceAfter = balanceBefore - job.amount;
+  bool success = updateCardBalance(uid, balanceAfter);
+  if (success) {
+    recordTransaction(uid, -job.amount, balanceBefore, packageName, seq, job.bay);
+    settleCachedCharge(job, balanceAfter);
+  } else if (job.cacheAuthorized) {
+    // 余额没有更新：转入离线日志补扣，不写没有扣费的交易记录
+    queueOfflineDebit(job, seq);
+    success = true;
+  }
 
-    currentCardInfo = getCardInfoFromSupabase(uid);
+  out.success = success;
+  out.cardInfo.isValid = true;
+  out.cardInfo.isActive = true;
+  out.cardInfo.balance = balanceBefore;
+}
 
-    if (currentCardInfo.isValid && currentCardInfo.isActive) {
-      lastSuccessfulOperation = millis();  // ✅ 优化1: 验证成功
-      if (currentCardInfo.balance >= packages[selectedPackage].price) {
+// =================== 状态机 ===================
+// 每个洗车位一个状态机实例（Bay），处理函数都以洗车位为参数
+// 状态切换统一走 transitionTo()：先执行当前状态的 onExit，再执行新状态的 onEnter
+// 超时统一由 checkStateTimeout() 按 STATE_TABLE 处理，处理函数中不使用 delay()
+unsigned long stateLoopMaxMs[STATE_COUNT] = {0};  // 各状态下loop最大耗时
 
-        const Package& pkg = packages[selectedPackage];
-        float amount = pkg.price;
-        float balanceBefore = currentCardInfo.balance;
-        float balanceAfter = balanceBefore - amount;
+void transitionTo(Bay& bay, SystemState next) {
+  const StateDef& from = getStateDef(bay.state);
+  if (from.onExit) from.onExit(bay);
 
-        displayProcessing("Processing...", 0.6);
+  LOG_V("洗车位%d 状态: %s → %s", bay.number(), getStateString(bay.state),
+        getStateString(next));
 
-        bool success = updateCardBalance(currentCardInfo.cardUIDDecimal, balanceAfter);
-        recordTransaction(currentCardInfo.cardUIDDecimal, -amount, balanceBefore, String(pkg.name_en));
+  bay.state = next;
+  bay.stateStartTime = millis();
 
-        if (success) {
-          lastSuccessfulOperation = millis();  // ✅ 优化1: 支付成功
-          consecutiveErrors = 0;  // ✅ 重置错误计数
-          currentCardInfo.balance = balanceAfter;
-          displayProcessing("Paid!", 1.0);
-          delay(1000);
+  const StateDef& to = getStateDef(next);
+  bay.stateTimeoutMs = to.timeoutMs;
+  bay.stateTimeoutTarget = to.timeoutTarget;
+  setNFCPollMode(bay, nfcModeFor(to));
+  if (to.onEnter) to.onEnter(bay);
+}
 
-          // ✅ 扣费成功后进入准备状态
-          currentState = STATE_SYSTEM_READY;
-          stateStartTime = millis();
-          beepSuccess();
-          logDebug("✅ 支付成功，余额: $" + String(balanceAfter, 2));
-        } else {
-          consecutiveErrors++;  // ✅ 优化1: 支付失败
-          displayError("Transaction Failed");
-          beepError();
-          delay(2000);
-          resetToWelcome();
-        }
-      } else {
-        displayError(TEXT_ERROR_LOW_BALANCE[currentLanguage]);
-        consecutiveErrors++;  // ✅ 优化1: 余额不足
-        beepError();
-        delay(2000);
-        resetToWelcome();
-      }
-    } else {
-      displayError(TEXT_ERROR_INVALID_CARD[currentLanguage]);
-      beepError();
-      consecutiveErrors++;  // ✅ 优化1: 卡片无效
-      delay(2000);
-      resetToWelcome();
-    }
-  }
+// 定时提示页：durationMs后进入next（进入WELCOME时按resetToWelcome清理会话）
+void showMessage(Bay& bay, const char* text, bool isError, unsigned long durationMs, SystemState next) {
+  // 刷卡状态下的提示页即本次刷卡的结果（Paid!/拒绝/网络忙）
+  if (bay.state == STATE_CARD_SCAN && bay.cardTapUs != 0) {
+    latencyTrace.record(SPAN_TAP_TO_RESULT, micros() - bay.cardTapUs);
+  }
+  strlcpy(bay.messageText, text, sizeof(bay.messageText));
+  bay.messageIsError = isError;
+  transitionTo(bay, STATE_MESSAGE);
+  bay.stateTimeoutMs = durationMs;
+  bay.stateTimeoutTarget = next;
 }
 
-void handleVIPQueryState() {
-  setSystemLEDStatus();
-  displayVIPQueryScan();
+void showError(Bay& bay, const char* text) {
+  beepError();
+  showMessage(bay, text, true, STATE_MESSAGE_ERROR_MS, STATE_WELCOME);
+}
 
-  String uid = readCardUID();
+// 开始新的服务流程（欢迎页按OK，或错误提示页按OK跳过）
+void startSession(Bay& bay) {
+  bay.selectedPackage = 0;
+  transitionTo(bay, STATE_SELECT_PACKAGE);
+  LOG_D("✅ 洗车位%d 用户启动服务", bay.number());
+}
 
-  if (uid.length() > 0) {
-    beepShort();
+// =================== 先刷卡流程 ===================
+// 欢迎页/选套餐页刷卡时记下卡片并立即提交查询，顾客选套餐期间查询在后台完成（结果写入卡片缓存），
+// 确认套餐后直接按缓存/查询结果授权，刷卡后的网络等待被选套餐的时间掩盖。
+// 没有提前刷卡时仍按原流程在刷卡页刷卡
+uint32_t tapFirstTaps = 0;      // 提前刷卡次数
+uint32_t tapFirstHidden = 0;    // 确认时查询已完成（等待被掩盖）
+uint32_t tapFirstWaited = 0;    // 确认时查询仍在进行（刷卡页等待剩余部分）
+uint32_t tapFirstStale = 0;     // 查询结果过期/未查询，确认时重新联网
+
+// 先刷卡模式下欢迎页和选套餐页也保留读到的卡片
+NfcPollMode nfcModeFor(const StateDef& def) {
+  if (config.getTapFirst() && (def.state == STATE_WELCOME || def.state == STATE_SELECT_PACKAGE)) {
+    return NFC_POLL_ACTIVE;
+  }
+  return def.nfcMode;
+}
 
-    displayProcessing("Querying...", 0.5);
-    ledIndicator.network = LED_BLINK_FAST;
-    updateLEDIndicators();
+void clearPrefetch(Bay& bay) {
+  bay.prefetchUid.clear();
+  bay.prefetchInfo.clear();
+  bay.prefetchReady = false;
+}
 
-    currentCardInfo = getCardInfoFromSupabase(uid);
+// 记下提前刷的卡片并在后台查询（再次刷卡时替换，旧查询的结果按编号忽略）
+void startPrefetch(Bay& bay, const CardUid& uid) {
+  clearPrefetch(bay);
+  bay.prefetchUid = uid;
+  tapFirstTaps++;
 
-    if (currentCardInfo.isValid) {
-      currentState = STATE_VIP_DISPLAY;
-      stateStartTime = millis();
-      beepSuccess();
-      logInfo("✅ VIP查询成功");
-      logDebug("  卡号: " + currentCardInfo.displayCardNumber);
-      logDebug("  余额: $" + String(currentCardInfo.balance, 2));
-      logDebug("  最后使用: " + currentCardInfo.lastTransactionDate);
-    } else {
-      displayError("Invalid or Inactive Card");
-      beepError();
-      delay(2000);
-      resetToWelcome();
-    }
+  // 离线时不查询：确认时按原流程凭本地缓存授权
+  if (!sysStatus.wifiConnected) {
+    bay.pendingNetTicket = 0;
+    return;
   }
+  bay.pendingNetTicket = netSubmitCardLookup(bay.index, uid);
+  LOG_D("洗车位%d 提前刷卡，后台查询卡片", bay.number());
+}
+
+// 选套餐期间取回查询结果（不阻塞）
+void pollPrefetch(Bay& bay) {
+  if (bay.pendingNetTicket == 0) return;
+
+  NetResult result;
+  if (netPollResult(bay.index, bay.pendingNetTicket, result) != NET_JOB_DONE) return;
+  bay.pendingNetTicket = 0;
+  bay.prefetchInfo = result.cardInfo;
+  bay.prefetchReady = true;
+  bay.prefetchAtMs = millis();
 }
 
-void handleVIPDisplayState() {
-  setSystemLEDStatus();
+bool prefetchFresh(const Bay& bay) {
+  return bay.prefetchReady && millis() - bay.prefetchAtMs <= TAP_FIRST_PREFETCH_MAX_AGE_MS;
+}
 
-  // 只在首次进入时刷新显示
-  static bool displayRefreshed = false;
-  if (!displayRefreshed) {
-    displayVIPInfo();
-    displayRefreshed = true;
+// 确认套餐：用提前刷的卡片支付或查询VIP信息（耗时统计从确认时刻开始）
+void confirmPrefetchedCard(Bay& bay) {
+  CardUid uid = bay.prefetchUid;
+  bool vip = packages[bay.selectedPackage].isQuery;
+  bool fresh = prefetchFresh(bay);
+  CardInfo info = bay.prefetchInfo;
+  bool pending = bay.pendingNetTicket != 0;
+
+  clearPrefetch(bay);
+  bay.cardTapUs = vip ? 0 : micros();
+  transitionTo(bay, vip ? STATE_VIP_QUERY : STATE_CARD_SCAN);
+
+  // 查询仍在进行：由刷卡页/VIP查询页等待结果，之后按原流程处理
+  if (pending) {
+    tapFirstWaited++;
+    if (vip) {
+      viewShowProgress(bay, "Querying...", 0.5);
+    } else {
+      viewShowProgress(bay, "Verifying...", 0.3);
+    }
+    return;
   }
 
-  if (millis() - stateStartTime > STATE_TIMEOUT_VIP_DISPLAY_MS) {
-    displayRefreshed = false;  // 重置标志
-    resetToWelcome();
+  if (!fresh) {
+    tapFirstStale++;
+    if (vip) {
+      submitVipLookup(bay, uid);
+    } else {
+      payWithCard(bay, uid);
+    }
+    return;
   }
 
-  if (readButtonImproved(BTN_OK)) {
-    displayRefreshed = false;  // 重置标志
-    resetToWelcome();
+  tapFirstHidden++;
+  if (vip) {
+    onVipLookupDone(bay, info);
+  } else if (!authorizeFromCache(bay, uid)) {
+    onCardScanLookupDone(bay, info);  // 缓存未命中（如余额不足）：按查询结果扣费或拒绝
   }
 }
 
-void handleSystemReadyState() {
-  setSystemLEDStatus();
+void printFlowStatus() {
+  Serial.println("\n=== 刷卡流程 ===");
+  Serial.printf("模式: %s, 查询结果有效期 %d 秒\n", config.getTapFirst() ? "先刷卡" : "先选套餐",
+                TAP_FIRST_PREFETCH_MAX_AGE_MS / 1000);
+  Serial.printf("提前刷卡: %u 次, 确认时已查询完成 %u, 仍在查询 %u, 过期/未查询 %u\n", tapFirstTaps,
+                tapFirstHidden, tapFirstWaited, tapFirstStale);
+  Serial.println("===============\n");
+}
 
-  unsigned long elapsed = millis() - stateStartTime;
-  float progress = (float)elapsed / STATE_TIMEOUT_READY_MS;
+// =================== 状态处理函数 ===================
+void handleWelcomeState(Bay& bay) {
+  setSystemLEDStatus(bay);
 
-  if (progress > 1.0) progress = 1.0;
+  // 滚动动画由渲染任务按帧率绘制
+  viewShow(bay, SCREEN_WELCOME);
 
-  displayProcessing("Ready...", progress);
+  // ✅ 优化：欢迎界面刷新时间戳，避免待机时自动重启
+  static unsigned long lastWelcomeUpdate = 0;
+  if (millis() - lastWelcomeUpdate > 60000) {  // 每60秒刷新一次
+    lastSuccessfulOperation = millis();
+    lastWelcomeUpdate = millis();
+  }
 
-  if (elapsed >= STATE_TIMEOUT_READY_MS) {
-    // ✅ 进入洗车状态时，重置所有脉冲相关变量
-    currentState = STATE_PROCESSING;
-    processingStartTime = millis();
-    stateStartTime = millis();
-    sentPulses = 0;              // ✅ 重置已发送脉冲数
-    lastPulseTime = millis();    // ✅ 重置脉冲计时器为当前时间
+  if (readButtonImproved(bay, BAY_BTN_OK)) {
+    beepShort();
+    startSession(bay);
+    return;
+  }
 
-    logInfo("✅ 开始洗车服务");
-    logDebug("  脉冲计时器初始化: " + String(lastPulseTime));
+  // 先刷卡：直接进入选套餐，同时在后台查询卡片
+  CardUid uid;
+  if (readCardUID(bay, uid)) {
+    beepShort();
+    startSession(bay);
+    startPrefetch(bay, uid);
+    viewShow(bay, SCREEN_PACKAGES);
   }
 }
 
-void handleProcessingState() {
-  setSystemLEDStatus();
+void onEnterSelectPackage(Bay& bay) {
+  viewShow(bay, SCREEN_PACKAGES);
+}
 
-  const Package& pkg = packages[selectedPackage];
-  unsigned long elapsed = millis() - processingStartTime;
+void handleSelectPackageState(Bay& bay) {
+  setSystemLEDStatus(bay);
+  pollPrefetch(bay);
+
+  // 先刷卡：选套餐期间刷卡（或换一张卡）
+  CardUid uid;
+  if (readCardUID(bay, uid)) {
+    beepShort();
+    startPrefetch(bay, uid);
+    bay.stateStartTime = millis();  // 重置超时计时器
+    viewShow(bay, SCREEN_PACKAGES);
+  }
+
+  if (readButtonImproved(bay, BAY_BTN_SELECT)) {
+    bay.selectedPackage = (bay.selectedPackage + 1) % PACKAGE_COUNT;
+    bay.stateStartTime = millis();  // 重置超时计时器
+    viewShow(bay, SCREEN_PACKAGES);
+    beepShort();
+  }
+
+  if (readButtonImproved(bay, BAY_BTN_OK)) {
+    beepShort();
+    if (!bay.prefetchUid.isEmpty()) {
+      LOG_D("洗车位%d 套餐选择: %s（已刷卡）", bay.number(), packages[bay.selectedPackage].name_en);
+      confirmPrefetchedCard(bay);
+    } else if (packages[bay.selectedPackage].isQuery) {
+      logDebug("进入VIP信息查询");
+      transitionTo(bay, STATE_VIP_QUERY);
+    } else {
+      LOG_D("洗车位%d 套餐选择: %s", bay.number(), packages[bay.selectedPackage].name_en);
+      transitionTo(bay, STATE_CARD_SCAN);
+    }
+  }
+}
+
+void handleCardScanState(Bay& bay) {
+  setSystemLEDStatus(bay);
+
+  // 等待网络任务返回结果（不阻塞loop）
+  if (bay.pendingNetTicket != 0) {
+    if (bay.hasDisplay()) ledIndicator.network = LED_BLINK_FAST;
+
+    NetResult result;
+    if (netPollResult(bay.index, bay.pendingNetTicket, result) != NET_JOB_DONE) {
+      return;  // 仍在处理中
+    }
+    bay.pendingNetTicket = 0;
+
+    if (result.type == NET_JOB_CARD_LOOKUP) {
+      onCardScanLookupDone(bay, result.cardInfo);
+    } else if (!result.success && result.reason[0] != '\0') {
+      onCardScanChargeRejected(bay, result.reason);
+    } else {
+      if (result.success) {
+        bay.cardInfo.balance = result.cardInfo.balance;  // 服务器返回的扣费前余额
+      }
+      onCardScanChargeDone(bay, result.success);
+    }
+    return;
+  }
+
+  viewShow(bay, SCREEN_CARD_SCAN);
+
+  CardUid uid;
+  bool gotCard = readCardUID(bay, uid);
+
+  // 调试：显示读卡尝试
+  static unsigned long lastReadAttempt = 0;
+  if (millis() - lastReadAttempt > 1000) {
+    if (!gotCard) {
+      Serial.print(".");  // 简单的心跳显示
+    }
+    lastReadAttempt = millis();
+  }
+
+  if (gotCard) {
+    beepShort();
+    payWithCard(bay, uid);
+  }
+}
+
+// 用卡片支付所选套餐：本地缓存授权，未命中时联网扣费（结果由刷卡页等待）
+void payWithCard(Bay& bay, const CardUid& uid) {
+  // 本地缓存授权（命中时无需等待网络）
+  if (authorizeFromCache(bay, uid)) {
+    return;
+  }
+
+  if (rpcDebitAvailable) {
+    // 单次请求扣费：服务器检查余额，无需先查询卡片
+    const Package& pkg = packages[bay.selectedPackage];
+    viewShowProgress(bay, "Processing...", 0.5);
+    bay.cardInfo.clear();
+    bay.cardInfo.uid = uid;
+    bay.pendingNetTicket = netSubmitDirectDebit(bay.index, uid, pkg.price, pkg.name_en);
+  } else {
+    viewShowProgress(bay, "Verifying...", 0.3);
+    bay.pendingNetTicket = netSubmitCardLookup(bay.index, uid);
+  }
+
+  if (bay.pendingNetTicket == 0) {
+    bay.consecutiveErrors++;
+    showError(bay, "Network Busy");
+  }
+}
+
+// 本地缓存授权：命中且策略允许时立即扣除本地余额，服务器扣费在后台完成
+// 返回true表示已处理（授权或离线拒绝），false表示需要联网查询
+bool authorizeFromCache(Bay& bay, const CardUid& uid) {
+  const Package& pkg = packages[bay.selectedPackage];
+  bool online = sysStatus.wifiConnected;
+
+  CardInfo info;
+  CardCacheResult result = cardCache.authorize(uid, pkg.price, online,
+                                               config.getOfflineSpendCap(), info);
+  const char* error;
+
+  if (result == CARD_CACHE_MISS) {
+    if (online) {
+      return false;
+    }
+    // 离线且没有缓存记录：无法验证
+    logWarn("⚠️ 离线模式：卡片不在本地缓存中");
+    error = "Offline - Card Unknown";
+  } else if (result == CARD_CACHE_APPROVED) {
+    // 后台扣费：在线时先刷新服务器余额，离线时写入离线日志
+    if (netSubmitCharge(bay.index, uid, pkg.price, info.balance, pkg.name_en, true, !online) == 0) {
+      cardCache.refund(uid, pkg.price, !online);
+      return false;
+    }
+
+    logInfo(online ? "⚡ 缓存授权成功" : "📴 离线授权成功");
+    bay.cardInfo = info;
+    onCardScanChargeDone(bay, true);
+    return true;
+  } else if (result == CARD_CACHE_DECLINED_BALANCE) {
+    error = TEXT_ERROR_LOW_BALANCE[currentLanguage];
+  } else if (result == CARD_CACHE_DECLINED_LIMIT) {
+    LOG_W("⚠️ 超过离线消费上限 ($%.2f)", config.getOfflineSpendCap());
+    error = "Offline Limit Reached";
+  } else {
+    error = TEXT_ERROR_INVALID_CARD[currentLanguage];
+  }
+
+  bay.consecutiveErrors++;
+  showError(bay, error);
+  return true;
+}
+
+// 刷卡验证结果返回
+void onCardScanLookupDone(Bay& bay, const CardInfo& info) {
+  bay.cardInfo = info;
+
+  if (bay.cardInfo.isValid && bay.cardInfo.isActive) {
+    lastSuccessfulOperation = millis();  // ✅ 优化1: 验证成功
+    if (bay.cardInfo.balance >= packages[bay.selectedPackage].price) {
+
+      const Package& pkg = packages[bay.selectedPackage];
+
+      viewShowProgress(bay, "Processing...", 0.6);
+
+      bay.pendingNetTicket = netSubmitCharge(bay.index, bay.cardInfo.uid, pkg.price,
+                                             bay.cardInfo.balance, pkg.name_en, false, false);
+      if (bay.pendingNetTicket == 0) {
+        onCardScanChargeDone(bay, false);
+      }
+    } else {
+      bay.consecutiveErrors++;  // ✅ 优化1: 余额不足
+      showError(bay, TEXT_ERROR_LOW_BALANCE[currentLanguage]);
+    }
+  } else {
+    bay.consecutiveErrors++;  // ✅ 优化1: 卡片无效
+    showError(bay, TEXT_ERROR_INVALID_CARD[currentLanguage]);
+  }
+}
+
+// 扣费结果返回
+void onCardScanChargeDone(Bay& bay, bool success) {
+  if (success) {
+    float balanceAfter = bay.cardInfo.balance - packages[bay.selectedPackage].price;
+
+    lastSuccessfulOperation = millis();  // ✅ 优化1: 支付成功
+    bay.consecutiveErrors = 0;  // ✅ 重置错误计数
+    bay.cardInfo.balance = balanceAfter;
+    beepSuccess();
+    LOG_D("✅ 洗车位%d 支付成功，余额: $%.2f", bay.number(), balanceAfter);
+
+    // ✅ 显示"Paid!"后进入准备状态
+    showMessage(bay, "Paid!", false, STATE_MESSAGE_PAID_MS, STATE_SYSTEM_READY);
+  } else {
+    bay.consecutiveErrors++;  // ✅ 优化1: 支付失败
+    showError(bay, "Transaction Failed");
+  }
+}
+
+// 服务器拒绝扣费（直接扣费时的余额/状态检查）
+void onCardScanChargeRejected(Bay& bay, const char* reason) {
+  bay.consecutiveErrors++;
+  if (strcmp(reason, "insufficient") == 0) {
+    showError(bay, TEXT_ERROR_LOW_BALANCE[currentLanguage]);
+  } else {
+    showError(bay, TEXT_ERROR_INVALID_CARD[currentLanguage]);
+  }
+}
+
+void handleVIPQueryState(Bay& bay) {
+  setSystemLEDStatus(bay);
+
+  // 等待网络任务返回查询结果
+  if (bay.pendingNetTicket != 0) {
+    if (bay.hasDisplay()) ledIndicator.network = LED_BLINK_FAST;
+
+    NetResult result;
+    if (netPollResult(bay.index, bay.pendingNetTicket, result) != NET_JOB_DONE) {
+      return;  // 仍在查询中
+    }
+    bay.pendingNetTicket = 0;
+    onVipLookupDone(bay, result.cardInfo);
+    return;
+  }
+
+  viewShow(bay, SCREEN_VIP_SCAN);
+
+  CardUid uid;
+  if (readCardUID(bay, uid)) {
+    beepShort();
+    submitVipLookup(bay, uid);
+  }
+}
+
+// 查询VIP卡片信息（离线时显示本地缓存中的信息）
+void submitVipLookup(Bay& bay, const CardUid& uid) {
+  if (!sysStatus.wifiConnected && cardCache.peek(uid, bay.cardInfo)) {
+    beepSuccess();
+    logInfo("✅ VIP查询（本地缓存）");
+    transitionTo(bay, STATE_VIP_DISPLAY);
+    return;
+  }
+
+  viewShowProgress(bay, "Querying...", 0.5);
+
+  bay.pendingNetTicket = netSubmitCardLookup(bay.index, uid);
+  if (bay.pendingNetTicket == 0) {
+    showError(bay, "Network Busy");
+  }
+}
+
+void onVipLookupDone(Bay& bay, const CardInfo& info) {
+  bay.cardInfo = info;
+
+  if (bay.cardInfo.isValid) {
+    beepSuccess();
+    logInfo("✅ VIP查询成功");
+    LOG_D("  卡号: %s", bay.cardInfo.displayCardNumber);
+    LOG_D("  余额: $%.2f", bay.cardInfo.balance);
+    LOG_D("  最后使用: %s", bay.cardInfo.lastTransactionDate);
+    transitionTo(bay, STATE_VIP_DISPLAY);
+  } else {
+    showError(bay, "Invalid or Inactive Card");
+  }
+}
+
+void onEnterVIPDisplay(Bay& bay) {
+  viewShowCard(bay, SCREEN_VIP_INFO, bay.cardInfo);
+}
+
+void handleVIPDisplayState(Bay& bay) {
+  setSystemLEDStatus(bay);
+
+  if (readButtonImproved(bay, BAY_BTN_OK)) {
+    resetToWelcome(bay);
+  }
+}
+
+void handleSystemReadyState(Bay& bay) {
+  setSystemLEDStatus(bay);
+
+  // 超时后由状态表进入 STATE_PROCESSING
+  unsigned long elapsed = millis() - bay.stateStartTime;
+  float progress = (float)elapsed / STATE_TIMEOUT_READY_MS;
+
+  if (progress > 1.0) progress = 1.0;
+
+  viewShowProgress(bay, "Ready...", progress);
+}
+
+// ✅ 进入洗车状态时启动本洗车位的脉冲串（由esp_timer在后台输出）
+void onEnterProcessing(Bay& bay) {
+  const Package& pkg = packages[bay.selectedPackage];
+  bay.processingStartTime = millis();
+  bay.lastLoggedPulses = 0;
+
+  if (!bay.pulse.start(pkg.pulses, pkg.pulseWidthMs, pkg.pulsePeriodMs)) {
+    LOG_E("❌ 洗车位%d 脉冲输出启动失败", bay.number());
+  }
+
+  LOG_I("✅ 洗车位%d 开始洗车服务", bay.number());
+  LOG_D("  脉冲: %d × %u/%ums", pkg.pulses, pkg.pulseWidthMs, pkg.pulsePeriodMs);
+}
+
+// 离开洗车状态（完成/超时/复位）时停止脉冲串并拉低输出
+void onExitProcessing(Bay& bay) {
+  bay.pulse.stop();
+}
+
+void handleProcessingState(Bay& bay) {
+  setSystemLEDStatus(bay);
+
+  const Package& pkg = packages[bay.selectedPackage];
+  unsigned long elapsed = millis() - bay.processingStartTime;
   unsigned long totalTimeMs = pkg.minutes * 60000UL;
 
   int remainingMin = 0;
@@ -910,127 +1459,220 @@ void handleProcessingState() {
     remainingSec = (remainingMs % 60000) / 1000;
   }
 
-  displayWashProgress(sentPulses, pkg.pulses, remainingMin, remainingSec);
+  // 脉冲由PulseEngine在后台输出，这里只读取进度
+  int sentPulses = bay.pulse.pulsesSent();
+  if (sentPulses < bay.lastLoggedPulses) bay.lastLoggedPulses = 0;
 
-  // ✅ 修复后的脉冲控制逻辑：使用全局变量，不使用静态变量
-  if (millis() - lastPulseTime >= PULSE_INTERVAL_MS && sentPulses < pkg.pulses) {
-    digitalWrite(PULSE_OUT, HIGH);
-    delay(PULSE_WIDTH_MS);
-    digitalWrite(PULSE_OUT, LOW);
+  viewShowWash(bay, sentPulses, pkg.pulses, remainingMin, remainingSec);
 
-    sentPulses++;
-    lastPulseTime = millis();  // 更新全局变量
+  // 刷卡→第一个脉冲（micros()与esp_timer同源）
+  if (bay.cardTapUs != 0) {
+    uint64_t firstPulseUs = bay.pulse.firstPulseUs();
+    if (firstPulseUs != 0) {
+      latencyTrace.record(SPAN_TAP_TO_PULSE, (uint32_t)firstPulseUs - bay.cardTapUs);
+      bay.cardTapUs = 0;
+    }
+  }
 
-    logDebug("🚿 脉冲 " + String(sentPulses) + "/" + String(pkg.pulses));
+  if (sentPulses != bay.lastLoggedPulses) {
+    bay.lastLoggedPulses = sentPulses;
+    LOG_D("🚿 洗车位%d 脉冲 %d/%d", bay.number(), sentPulses, pkg.pulses);
   }
 
   // 检查是否完成：脉冲数达到目标
   if (sentPulses >= pkg.pulses) {
-    currentState = STATE_COMPLETE;
-    stateStartTime = millis();
-    digitalWrite(PULSE_OUT, LOW);
-    logInfo("✅ 洗车完成 (脉冲: " + String(sentPulses) + "/" + String(pkg.pulses) + ")");
+    LOG_I("✅ 洗车位%d 洗车完成 (脉冲: %d/%d, 最大偏差 %uus)", bay.number(), sentPulses, pkg.pulses,
+          bay.pulse.maxLatenessUs());
+    transitionTo(bay, STATE_COMPLETE);
   }
   // 或者时间超时（安全机制）
   else if (elapsed >= totalTimeMs) {
-    currentState = STATE_COMPLETE;
-    stateStartTime = millis();
-    digitalWrite(PULSE_OUT, LOW);
-    logWarn("⚠️ 洗车超时 (时间到，脉冲: " + String(sentPulses) + "/" + String(pkg.pulses) + ")");
+    LOG_W("⚠️ 洗车位%d 洗车超时 (时间到，脉冲: %d/%d)", bay.number(), sentPulses, pkg.pulses);
+    transitionTo(bay, STATE_COMPLETE);
   }
 }
 
-void handleCompleteState() {
-  setSystemLEDStatus();
+void onEnterComplete(Bay& bay) {
+  viewShowCard(bay, SCREEN_COMPLETE, bay.cardInfo);
+  beepComplete();
+  logDebug("✅ 进入完成页面");
+}
 
-  // 重置标志（每次重新进入STATE_COMPLETE时）
-  static SystemState lastState = STATE_WELCOME;  // 初始化为非COMPLETE状态
-  static bool displayRefreshed = false;
-  static bool soundPlayed = false;
+void handleCompleteState(Bay& bay) {
+  setSystemLEDStatus(bay);
+}
 
-  // ✅ 修复：检测从其他状态切换到COMPLETE（确保每次都能重置）
-  if (lastState != STATE_COMPLETE) {
-    // 刚进入STATE_COMPLETE，重置所有标志
-    displayRefreshed = false;
-    soundPlayed = false;
-    lastState = STATE_COMPLETE;
-    logDebug("✅ 进入完成页面");
-  }
+void onEnterError(Bay& bay) {
+  viewShowError(bay, "System Error");
+  beepError();
+}
 
-  // 只在首次进入时刷新显示
-  if (!displayRefreshed) {
-    displayComplete();
-    displayRefreshed = true;
-    logDebug("✅ 显示完成页面");
-  }
+void handleErrorState(Bay& bay) {
+  setSystemLEDStatus(bay);
+}
 
-  // 只在首次进入时播放声音
-  if (!soundPlayed) {
-    beepSuccess();
-    delay(200);
-    beepSuccess();
-    soundPlayed = true;
+void onEnterMessage(Bay& bay) {
+  if (bay.messageIsError) {
+    viewShowError(bay, bay.messageText);
+  } else {
+    viewShowProgress(bay, bay.messageText, 1.0);
   }
+}
 
-  // 超时后返回欢迎页
-  if (millis() - stateStartTime > STATE_TIMEOUT_COMPLETE_MS) {
-    // ✅ 修复：退出时重置lastState，确保下次能正确进入
-    lastState = STATE_WELCOME;
-    logDebug("⏱️ 完成页面超时，返回欢迎页");
-    resetToWelcome();
+void handleMessageState(Bay& bay) {
+  setSystemLEDStatus(bay);
+
+  // 错误提示期间按OK：跳过提示直接开始新的流程（按键不会丢失）
+  if (bay.messageIsError && readButtonImproved(bay, BAY_BTN_OK)) {
+    resetToWelcome(bay);
+    startSession(bay);
   }
 }
 
+// =================== 状态转换表 ===================
+// 顺序必须与 SystemState 枚举一致
+const StateDef STATE_TABLE[STATE_COUNT] = {
+  // 状态                 超时                          超时后进入           错误音  网络忙暂停  NFC读卡          onEnter               onUpdate                   onExit
+  {STATE_WELCOME,        0,                            STATE_WELCOME,       false, false, NFC_POLL_IDLE,   NULL,                 handleWelcomeState,        NULL},
+  {STATE_SELECT_PACKAGE, STATE_TIMEOUT_SELECT_MS,      STATE_WELCOME,       true,  false, NFC_POLL_OFF,    onEnterSelectPackage, handleSelectPackageState,  NULL},
+  {STATE_CARD_SCAN,      STATE_TIMEOUT_CARD_SCAN_MS,   STATE_WELCOME,       true,  true,  NFC_POLL_ACTIVE, NULL,                 handleCardScanState,       NULL},
+  {STATE_SYSTEM_READY,   STATE_TIMEOUT_READY_MS,       STATE_PROCESSING,    false, false, NFC_POLL_OFF,    NULL,                 handleSystemReadyState,    NULL},
+  {STATE_PROCESSING,     STATE_TIMEOUT_PROCESSING_MS,  STATE_COMPLETE,      true,  false, NFC_POLL_OFF,    onEnterProcessing,    handleProcessingState,     onExitProcessing},
+  {STATE_COMPLETE,       STATE_TIMEOUT_COMPLETE_MS,    STATE_WELCOME,       false, false, NFC_POLL_OFF,    onEnterComplete,      handleCompleteState,       NULL},
+  {STATE_VIP_QUERY,      STATE_TIMEOUT_VIP_QUERY_MS,   STATE_WELCOME,       true,  true,  NFC_POLL_ACTIVE, NULL,                 handleVIPQueryState,       NULL},
+  {STATE_VIP_DISPLAY,    STATE_TIMEOUT_VIP_DISPLAY_MS, STATE_WELCOME,       false, false, NFC_POLL_OFF,    onEnterVIPDisplay,    handleVIPDisplayState,     NULL},
+  {STATE_ERROR,          STATE_TIMEOUT_ERROR_MS,       STATE_WELCOME,       false, false, NFC_POLL_OFF,    onEnterError,         handleErrorState,          NULL},
+  {STATE_MESSAGE,        0,                            STATE_WELCOME,       false, false, NFC_POLL_OFF,    onEnterMessage,       handleMessageState,        NULL}
+};
+
+const StateDef& getStateDef(SystemState state) {
+  if ((int)state < 0 || state >= STATE_COUNT) {
+    return STATE_TABLE[STATE_WELCOME];
+  }
+  return STATE_TABLE[state];
+}
+
 // =================== 系统管理 ===================
-void resetToWelcome() {
-  logDebug("返回欢迎屏幕");
+void resetToWelcome(Bay& bay) {
+  LOG_D("洗车位%d 返回欢迎屏幕", bay.number());
+
+  // 放弃未完成的网络请求（迟到的结果按编号忽略）
+  bay.pendingNetTicket = 0;
+  netCancelForeground(bay.index);
 
-  currentState = STATE_WELCOME;
-  cardUID = "";
-  selectedPackage = 0;
-  sentPulses = 0;
-  lastPulseTime = 0;  // ✅ 重置脉冲计时器
-  stateStartTime = millis();
-  currentCardInfo.clear();
+  transitionTo(bay, STATE_WELCOME);  // 洗车中复位时由onExit停止脉冲输出
 
-  digitalWrite(PULSE_OUT, LOW);
+  bay.selectedPackage = 0;
+  bay.cardInfo.clear();
+  bay.cardTapUs = 0;  // 未到达脉冲的刷卡不计入刷卡→脉冲统计
+  clearPrefetch(bay);
 
   for(int i = 0; i < 2; i++) {
-    buttonPressed[i] = false;
-    lastButtonState[i] = false;
+    bay.buttonPressed[i] = false;
+    bay.lastButtonState[i] = false;
+  }
+
+  // 所有洗车位都空闲：会话的临时内存都已归还，记录一次堆检查点
+  if (allBaysIdle()) {
+    heapMonitor.checkpoint();
   }
 
   beepShort();
 }
 
-void checkStateTimeout() {
-  // ✅ 修复：STATE_COMPLETE 由自己的handler处理超时，不在这里检查
-  if (currentState == STATE_WELCOME ||
-      currentState == STATE_PROCESSING ||
-      currentState == STATE_COMPLETE) {
+// 统一超时调度：按进入状态时记录的超时和目标状态切换
+void checkStateTimeout(Bay& bay) {
+  if (bay.stateTimeoutMs == 0) {
     return;
   }
 
-  unsigned long elapsed = millis() - stateStartTime;
-  unsigned long timeout = 0;
+  // 网络请求进行中（尤其是扣费）不能超时退出，否则会丢失扣费结果
+  const StateDef& def = getStateDef(bay.state);
+  if (def.holdWhileNetBusy && netForegroundBusy(bay.index)) {
+    return;
+  }
 
-  switch (currentState) {
-    case STATE_SELECT_PACKAGE: timeout = STATE_TIMEOUT_SELECT_MS; break;
-    case STATE_CARD_SCAN: timeout = STATE_TIMEOUT_CARD_SCAN_MS; break;
-    case STATE_VIP_QUERY: timeout = STATE_TIMEOUT_VIP_QUERY_MS; break;
-    case STATE_VIP_DISPLAY: timeout = STATE_TIMEOUT_VIP_DISPLAY_MS; break;
-    case STATE_SYSTEM_READY: timeout = STATE_TIMEOUT_READY_MS + 1000; break;
-    // ✅ 移除 STATE_COMPLETE 的超时检查
-    default: return;
+  if (millis() - bay.stateStartTime <= bay.stateTimeoutMs) {
+    return;
   }
 
-  if (elapsed > timeout) {
-    logWarn("状态超时");
+  if (def.timeoutAlert) {
+    LOG_W("洗车位%d 状态超时: %s", bay.number(), getStateString(bay.state));
     beepError();
-    resetToWelcome();
+  }
+
+  if (bay.stateTimeoutTarget == STATE_WELCOME) {
+    resetToWelcome(bay);
+  } else {
+    transitionTo(bay, bay.stateTimeoutTarget);
   }
 }
 
+// 记录loop耗时（按本次执行的状态统计），新的最大值超出预算时警告
+void recordLoopLatency(SystemState state, unsigned long loopTime) {
+  if ((int)state < 0 || state >= STATE_COUNT || loopTime <= stateLoopMaxMs[state]) {
+    return;
+  }
+
+  stateLoopMaxMs[state] = loopTime;
+  if (loopTime > LOOP_LATENCY_BUDGET_MS) {
+    LOG_W("⚠️ loop耗时 %lums (状态 %s, 预算 %dms)", loopTime, getStateString(state),
+          LOOP_LATENCY_BUDGET_MS);
+  }
+}
+
+void printStateTable() {
+  Serial.println("\n=== 状态机 ===");
+  for (int i = 0; i < bayCount; i++) {
+    const Bay& bay = bays[i];
+    Serial.printf("洗车位%d: %s, 已停留 %lu ms", bay.number(), getStateString(bay.state),
+                  millis() - bay.stateStartTime);
+    if (bay.stateTimeoutMs > 0) {
+      Serial.printf(", 超时 %lu ms → %s", bay.stateTimeoutMs, getStateString(bay.stateTimeoutTarget));
+    }
+    Serial.println();
+  }
+  for (int i = 0; i < STATE_COUNT; i++) {
+    const StateDef& def = STATE_TABLE[i];
+    Serial.printf("%-15s 超时 %7lu → %-14s loop最大 %lu ms\n",
+                  getStateString(def.state), def.timeoutMs,
+                  getStateString(def.timeoutTarget), stateLoopMaxMs[i]);
+  }
+  Serial.printf("loop最大耗时: %lu ms (预算 %d ms)\n", sysStatus.maxLoopTime, LOOP_LATENCY_BUDGET_MS);
+  Serial.println("==============\n");
+}
+
+// 串口 bays：各洗车位的状态、机器ID、读卡器和脉冲输出
+void printBayStatus() {
+  Serial.println("\n=== 洗车位 ===");
+  Serial.printf("启用: %d/%d, 读卡预算 %d us/loop, 顺延 %u 次\n", bayCount, MAX_BAYS,
+                BAY_NFC_BUDGET_US, bayNfcDeferred);
+  for (int i = 0; i < bayCount; i++) {
+    Bay& bay = bays[i];
+    Serial.printf("洗车位%d [%s]%s: %s, 读卡器 %s (CS %d/RST %d), 脉冲 GPIO%d %s, 连续错误 %d\n",
+                  bay.number(), config.getBayMachineID(i).c_str(), bay.hasDisplay() ? " OLED" : "",
+                  getStateString(bay.state), bay.nfcWorking ? "正常" : "故障", bay.pins.nfcCs,
+                  bay.pins.nfcRst, bay.pins.pulse, bay.pulse.isRunning() ? "输出中" : "空闲",
+                  bay.consecutiveErrors);
+  }
+  Serial.println("==============\n");
+}
+
+// 所有洗车位都在欢迎页（没有进行中的会话）
+bool allBaysIdle() {
+  for (int i = 0; i < bayCount; i++) {
+    if (bays[i].state != STATE_WELCOME) return false;
+  }
+  return true;
+}
+
+// 内存保护重启：未上传的分钟记录先写入NVS
+void restartForHeap() {
+  healthMonitor.persistSamples();
+  delay(2000);
+  ESP.restart();
+}
+
 void performHealthCheck() {
   if (millis() - lastHeartbeat > 60000) {
     sysStatus.updateMemoryStats();
@@ -1040,46 +1682,61 @@ void performHealthCheck() {
     healthMetrics.wifiRSSI = WiFi.isConnected() ? WiFi.RSSI() : 0;
     healthMetrics.totalTransactions = sysStatus.totalTransactions;
 
-    // NFC健康检查
-    if (sysStatus.nfcWorking) {
-      byte version = mfrc522.PCD_ReadRegister(mfrc522.VersionReg);
+    // NFC健康检查（使用读卡调度最近一次批量检查的结果，不访问SPI）
+    bool nfcVersionsOk = true;
+    for (int i = 0; i < bayCount; i++) {
+      if (!bays[i].nfcWorking) continue;
+      byte version = bays[i].nfc.getHealth().version;
       if (version == 0x00 || version == 0xFF) {
-        healthMetrics.nfcInitialized = false;
-        healthMonitor.recordError("NFC固件版本异常: 0x" + String(version, HEX));
-      } else {
-        healthMetrics.nfcInitialized = true;
+        nfcVersionsOk = false;
+        healthMonitor.recordError("洗车位" + String(bays[i].number()) + " NFC固件版本异常: 0x" +
+                                  String(version, HEX));
       }
     }
+    if (sysStatus.nfcWorking) {
+      healthMetrics.nfcInitialized = nfcVersionsOk;
+    }
 
     logDebug("=== 系统健康检查 ===");
-    logDebug("运行: " + String(millis() / 1000) + "s");
-    logDebug("内存: " + String(ESP.getFreeHeap() / 1024) + "KB");
-    logDebug("交易: " + String(sysStatus.totalTransactions));
-    logDebug("收入: $" + String(sysStatus.totalRevenue, 2));
+    LOG_D("运行: %lus", millis() / 1000);
+    LOG_D("内存: %uKB", ESP.getFreeHeap() / 1024);
+    LOG_D("交易: %lu", sysStatus.totalTransactions);
+    LOG_D("收入: $%.2f", sysStatus.totalRevenue);
+    if (sysStatus.uncollectedCharges > 0) {
+      LOG_D("未收款: %lu 笔", sysStatus.uncollectedCharges);
+    }
 
     // =================== 内存保护机制（方案A优化2）===================
-    uint32_t freeHeap = ESP.getFreeHeap();
+    // 分配失败取决于最大空闲块：剩余总量足够但碎片化时同样需要处理
+    HeapSnapshot heap = heapMonitor.sample();
+    LOG_D("最大空闲块: %uKB, 碎片率 %u%%", heap.largestBlock / 1024, heap.fragPercent);
 
     // ⚠️ 内存严重不足 - 立即重启
-    if (freeHeap < 20000) {
+    if (heap.freeBytes < HEAP_RESTART_FREE_BYTES) {
       Serial.println("❌ 内存严重不足，立即重启...");
-      Serial.printf("   当前剩余: %u KB (< 20KB)\n", freeHeap / 1024);
-      delay(2000);
-      ESP.restart();
+      Serial.printf("   当前剩余: %u KB (< %d 字节)\n", heap.freeBytes / 1024, HEAP_RESTART_FREE_BYTES);
+      restartForHeap();
     }
 
-    // ⚠️ 内存预警 - 尝试释放
-    if (freeHeap < 40000) {
+    // ⚠️ 碎片化：没有足够大的连续内存（TLS重新握手会失败）- 等所有洗车位空闲时重启
+    if (heap.largestBlock < HEAP_RESTART_BLOCK_BYTES && allBaysIdle()) {
+      Serial.println("❌ 堆碎片化，最大空闲块过小，重启...");
+      Serial.printf("   最大空闲块: %u KB (< %d KB), 剩余 %u KB\n", heap.largestBlock / 1024,
+                    HEAP_RESTART_BLOCK_BYTES / 1024, heap.freeBytes / 1024);
+      restartForHeap();
+    }
+
+    // ⚠️ 内存预警 - 记录到健康度日志（不再断开WiFi"释放内存"，那会让终端离线）
+    if (heap.freeBytes < HEAP_WARN_FREE_BYTES) {
       Serial.println("⚠️ 内存预警！");
-      Serial.printf("   当前剩余: %u KB (< 40KB)\n", freeHeap / 1024);
-
-      // 尝试通过WiFi重连释放内存
-      if (WiFi.status() == WL_CONNECTED) {
-        Serial.println("   尝试WiFi重连释放内存...");
-        WiFi.disconnect();
-        delay(500);
-        WiFi.reconnect();
-      }
+      Serial.printf("   当前剩余: %u KB (< %d 字节)\n", heap.freeBytes / 1024, HEAP_WARN_FREE_BYTES);
+      healthMonitor.recordError("内存预警: " + String(heap.freeBytes / 1024) + "KB");
+    } else if (heap.largestBlock < HEAP_WARN_BLOCK_BYTES || heap.fragPercent > HEAP_WARN_FRAG_PERCENT) {
+      Serial.println("⚠️ 堆碎片预警！");
+      Serial.printf("   最大空闲块: %u KB, 剩余 %u KB, 碎片率 %u%%\n", heap.largestBlock / 1024,
+                    heap.freeBytes / 1024, heap.fragPercent);
+      healthMonitor.recordError("堆碎片预警: 最大块" + String(heap.largestBlock / 1024) + "KB/剩余" +
+                                String(heap.freeBytes / 1024) + "KB");
     }
 
     lastHeartbeat = millis();
@@ -1087,9 +1744,175 @@ void performHealthCheck() {
 }
 
 // =================== 主程序 ===================
+// =================== 启动初始化任务 ===================
+// OLED（I2C）和NFC（SPI）在不同的总线上，各自由初始化任务并行完成（每个洗车位的读卡器一个任务），
+// 同时setup()加载配置、离线日志和卡片缓存；全部完成后才启动渲染任务和读卡
+SemaphoreHandle_t bootTasksDone = NULL;
+bool bootOledOk = false;
+bool bootNfcOk = false;
+
+// I2C + OLED：先探测OLED地址，无应答时才扫描整条总线（诊断接线）
+bool initDisplay() {
+  // 启用内部上拉电阻（以防模块没有上拉）
+  pinMode(I2C_SDA, INPUT_PULLUP);
+  pinMode(I2C_SCL, INPUT_PULLUP);
+
+  Wire.begin(I2C_SDA, I2C_SCL);
+  Wire.setClock(100000);  // 降低I2C速度到100kHz，提高稳定性
+  delay(BOOT_I2C_SETTLE_MS);
+
+  Wire.beginTransmission(OLED_I2C_ADDRESS);
+  if (Wire.endTransmission() != 0) {
+    logWarn("⚠️ OLED地址0x" + String(OLED_I2C_ADDRESS, HEX) + "无应答，扫描I2C总线...");
+    int deviceCount = 0;
+    for (byte addr = 1; addr < 127; addr++) {
+      Wire.beginTransmission(addr);
+      if (Wire.endTransmission() == 0) {
+        logWarn("   发现设备: 0x" + String(addr, HEX));
+        deviceCount++;
+      }
+    }
+    if (deviceCount == 0) {
+      logError("❌ I2C总线上没有发现任何设备！");
+      logError("   请检查：1) SDA/SCL接线  2) 模块供电  3) 上拉电阻");
+    }
+  }
+
+  // OLED初始化（失败重试）
+  for (int attempt = 1; attempt <= BOOT_OLED_ATTEMPTS; attempt++) {
+    if (display.begin()) {
+      display.enableUTF8Print();
+      logInfo("✅ OLED初始化成功");
+      return true;
+    }
+    logWarn("   OLED第" + String(attempt) + "次初始化失败");
+    delay(BOOT_OLED_RETRY_MS);
+  }
+
+  logError("❌ OLED初始化完全失败（" + String(BOOT_OLED_ATTEMPTS) + "次尝试）");
+  logError("   可能原因：");
+  logError("   1. OLED模块损坏或接触不良");
+  logError("   2. I2C地址错误（当前0x3C）");
+  logError("   3. 电源电压不足（需要3.3V）");
+  logError("   4. SDA/SCL接线错误");
+  return false;
+}
+
+// SPI + NFC：硬件复位 + 初始化，失败后继续运行（降级模式，运行时自动重试）
+bool initNFC(Bay& bay) {
+  bool ok = bay.nfc.begin(&bay.nfcBackend, millis());
+  byte version = bay.nfc.getHealth().version;
+  LOG_D("   洗车位%d 读取到NFC版本号: 0x%02X", bay.number(), version);
+
+  if (ok) {
+    LOG_I("✅ 洗车位%d NFC初始化成功: v0x%02X%s", bay.number(), version,
+          bay.nfc.isIrqMode() ? " (IRQ检测)" : " (轮询检测)");
+  } else {
+    LOG_E("❌ 洗车位%d NFC初始化失败，版本号: 0x%02X", bay.number(), version);
+    logError("   可能原因：");
+    logError("   1. MFRC522模块未连接或损坏");
+    logError("   2. SPI接线错误（MOSI/MISO/SCK/CS/RST）");
+    logError("   3. 电源电压不足（需要3.3V）");
+    logError("   4. 模块与ESP32-S3不兼容");
+    logWarn("⚠️ 系统将以降级模式运行（NFC功能不可用）");
+    logWarn("⚠️ NFC将在运行时自动重试恢复");
+  }
+  return ok;
+}
+
+void bootDisplayTask(void* param) {
+  bootProfile.start(BOOT_STAGE_OLED);
+  bootOledOk = initDisplay();
+  bootProfile.finish(BOOT_STAGE_OLED, bootOledOk);
+  xSemaphoreGive(bootTasksDone);
+  vTaskDelete(NULL);
+}
+
+// 每个洗车位一个初始化任务：复位等待期间不占用SPI总线，各读卡器的复位/启动可以重叠
+portMUX_TYPE bootNfcMux = portMUX_INITIALIZER_UNLOCKED;
+int bootNfcRemaining = 0;
+
+void bootNfcTask(void* param) {
+  Bay* bay = (Bay*)param;
+  bay->nfcWorking = initNFC(*bay);
+
+  // 最后一个完成的任务结束NFC阶段（任一读卡器失败即记为失败）
+  portENTER_CRITICAL(&bootNfcMux);
+  bool last = --bootNfcRemaining == 0;
+  portEXIT_CRITICAL(&bootNfcMux);
+  if (last) {
+    bool allOk = true;
+    for (int i = 0; i < bayCount; i++) {
+      if (!bays[i].nfcWorking) allOk = false;
+    }
+    bootNfcOk = allOk;
+    bootProfile.finish(BOOT_STAGE_NFC, allOk);
+  }
+
+  xSemaphoreGive(bootTasksDone);
+  vTaskDelete(NULL);
+}
+
+// OLED不依赖配置，最先启动
+void startDisplayBootTask() {
+  bootTasksDone = xSemaphoreCreateCounting(1 + MAX_BAYS, 0);
+  xTaskCreatePinnedToCore(bootDisplayTask, "boot_oled", BOOT_TASK_STACK_SIZE, NULL,
+                          BOOT_TASK_PRIORITY, NULL, 0);
+}
+
+// 读卡器数量来自配置：加载配置后启动
+void startNfcBootTasks() {
+  bootProfile.start(BOOT_STAGE_NFC);
+
+  // 先拉高所有片选，避免未初始化的读卡器响应总线
+  for (int i = 0; i < MAX_BAYS; i++) {
+    pinMode(BAY_PINS[i].nfcCs, OUTPUT);
+    digitalWrite(BAY_PINS[i].nfcCs, HIGH);
+  }
+  SPI.begin(SPI_SCK, SPI_MISO, SPI_MOSI, RC522_CS);
+  nfcBus.begin();
+
+  bootNfcRemaining = bayCount;
+  for (int i = 0; i < bayCount; i++) {
+    char name[20];
+    snprintf(name, sizeof(name), "boot_nfc%d", i + 1);
+    xTaskCreatePinnedToCore(bootNfcTask, name, BOOT_TASK_STACK_SIZE, &bays[i],
+                            BOOT_TASK_PRIORITY, NULL, 1);
+  }
+}
+
+// 等待所有初始化任务结束（各自的重试次数有限，不会一直等）
+void waitBootTasks() {
+  for (int i = 0; i < 1 + bayCount; i++) {
+    xSemaphoreTake(bootTasksDone, portMAX_DELAY);
+  }
+  vSemaphoreDelete(bootTasksDone);
+  bootTasksDone = NULL;
+
+  sysStatus.displayWorking = bootOledOk;
+  sysStatus.nfcWorking = bootNfcOk;
+}
+
+// 启用的洗车位：按钮输入、脉冲输出（配置为输出并拉低）
+void initBays() {
+  for (int i = 0; i < bayCount; i++) {
+    Bay& bay = bays[i];
+    pinMode(bay.pins.btnOk, INPUT);
+    pinMode(bay.pins.btnSelect, INPUT);
+    if (!bay.pulse.begin(&bay.pulseBackend)) {
+      LOG_E("❌ 洗车位%d 脉冲定时器创建失败", bay.number());
+    }
+  }
+  LOG_I("🚗 洗车位: %d 个", bayCount);
+}
+
 void setup() {
+  bootProfile.start(BOOT_STAGE_CORE);
   Serial.begin(115200);
-  delay(1000);
+  logRing.begin(&logRingStore);
+  logRing.startTask();
+  loopProfiler.begin();
+  heapMonitor.begin();  // 尽早登记分配失败回调
 
   Serial.println("=====================================");
   Serial.printf("🚗 Eaglson Coin Wash Terminal %s\n", FIRMWARE_VERSION);
@@ -1099,35 +1922,36 @@ void setup() {
 
   mainTaskHandle = xTaskGetCurrentTaskHandle();
 
-  pinMode(BTN_OK, INPUT);
-  pinMode(BTN_SELECT, INPUT);
   pinMode(LED_POWER, OUTPUT);
   pinMode(LED_NETWORK, OUTPUT);
   pinMode(LED_PROGRESS, OUTPUT);
   pinMode(LED_STATUS, OUTPUT);
   pinMode(BUZZER, OUTPUT);
-  pinMode(PULSE_OUT, OUTPUT);
 
   digitalWrite(LED_POWER, LOW);
   digitalWrite(LED_NETWORK, LOW);
   digitalWrite(LED_PROGRESS, LOW);
   digitalWrite(LED_STATUS, LOW);
   digitalWrite(BUZZER, LOW);
-  digitalWrite(PULSE_OUT, LOW);
 
-  logInfo("LED自检...");
-  digitalWrite(LED_POWER, HIGH); delay(200);
-  digitalWrite(LED_NETWORK, HIGH); delay(200);
-  digitalWrite(LED_PROGRESS, HIGH); delay(200);
-  digitalWrite(LED_STATUS, HIGH); delay(200);
-  digitalWrite(LED_POWER, LOW);
-  digitalWrite(LED_NETWORK, LOW);
-  digitalWrite(LED_PROGRESS, LOW);
-  digitalWrite(LED_STATUS, LOW);
+  // 效果调度器接管LED和蜂鸣器
+  if (!effects.begin()) {
+    logError("❌ 声光效果定时器创建失败");
+  }
 
+  // LED自检：4个LED同时点亮，由效果调度器定时熄灭（不阻塞启动）
+  for (int i = 0; i < EFFECT_LED_COUNT; i++) {
+    effects.flashLED((EffectLED)i, LED_ON, BOOT_LED_TEST_MS, EFFECT_PRIORITY_LOW);
+  }
   beepShort();
+  bootProfile.finish(BOOT_STAGE_CORE);
+
+  // ============== OLED和NFC由初始化任务并行初始化 ==============
+  logInfo("🖥️ 初始化OLED和NFC（并行）...");
+  startDisplayBootTask();
 
   // ============== 初始化NVS存储和配置管理 ==============
+  bootProfile.start(BOOT_STAGE_CONFIG);
   logInfo("💾 初始化NVS存储...");
   prefs.begin("goldsky", false);  // false = 读写模式
 
@@ -1136,145 +1960,44 @@ void setup() {
 
   // 初始化配置管理器（从NVS加载或使用默认值）
   config.init(WIFI_SSID, WIFI_PASSWORD, SUPABASE_URL, SUPABASE_KEY, MACHINE_ID);
+  bayCount = config.getBayCount();
+  initBays();
+  bootProfile.finish(BOOT_STAGE_CONFIG);
 
-  // 加载离线交易队列
-  loadOfflineQueue();
-
-  // ============== 先初始化I2C（避免SPI干扰）==============
-  logInfo("🖥️ 初始化I2C和OLED...");
-
-  // 启用内部上拉电阻（以防模块没有上拉）
-  pinMode(I2C_SDA, INPUT_PULLUP);
-  pinMode(I2C_SCL, INPUT_PULLUP);
-  delay(50);
-
-  Wire.begin(I2C_SDA, I2C_SCL);
-  Wire.setClock(100000);  // 降低I2C速度到100kHz，提高稳定性
-  delay(300);  // 增加延迟，等待I2C总线稳定
-
-  // I2C设备扫描
-  logDebug("📡 扫描I2C总线...");
-  int deviceCount = 0;
-  for (byte addr = 1; addr < 127; addr++) {
-    Wire.beginTransmission(addr);
-    if (Wire.endTransmission() == 0) {
-      logDebug("   发现设备: 0x" + String(addr, HEX));
-      deviceCount++;
-    }
-  }
-  logDebug("   共发现 " + String(deviceCount) + " 个I2C设备");
-
-  if (deviceCount == 0) {
-    logError("❌ I2C总线上没有发现任何设备！");
-    logError("   请检查：1) SDA/SCL接线  2) 模块供电  3) 上拉电阻");
-  }
-
-  // OLED初始化（增加重试机制）
-  logDebug("🔄 尝试初始化OLED...");
-  bool oledSuccess = false;
-
-  for (int attempt = 1; attempt <= 3; attempt++) {
-    logDebug("   尝试 " + String(attempt) + "/3...");
-    delay(200);
-
-    if (display.begin()) {
-      display.enableUTF8Print();
-      oledSuccess = true;
-      logInfo("✅ OLED初始化成功");
-      break;
-    } else {
-      logWarn("   OLED第" + String(attempt) + "次初始化失败");
-      delay(500);
-    }
-  }
-
-  if (oledSuccess) {
-    sysStatus.displayWorking = true;
-
-    // 测试显示一个简单的内容
-    display.clearBuffer();
-    display.setFont(u8g2_font_helvB10_tf);
-    display.drawStr(20, 30, "OLED OK!");
-    display.sendBuffer();
-    delay(1000);
-
-    logDebug("✅ OLED显示测试通过");
-  } else {
-    sysStatus.displayWorking = false;
-    logError("❌ OLED初始化完全失败（3次尝试）");
-    logError("   可能原因：");
-    logError("   1. OLED模块损坏或接触不良");
-    logError("   2. I2C地址错误（当前0x3C）");
-    logError("   3. 电源电压不足（需要3.3V）");
-    logError("   4. SDA/SCL接线错误");
-  }
-
-  // ============== 然后初始化SPI和NFC ==============
-  logDebug("🔌 初始化SPI和NFC...");
-
-  // 使用自定义引脚初始化SPI
-  SPI.begin(SPI_SCK, SPI_MISO, SPI_MOSI, RC522_CS);
-  delay(100);
-
-  // NFC硬件复位
-  pinMode(RC522_RST, OUTPUT);
-  digitalWrite(RC522_RST, LOW);
-  delay(10);
-  digitalWrite(RC522_RST, HIGH);
-  delay(50);
-
-  // NFC初始化 - 失败后继续运行（降级模式）
-  mfrc522.PCD_Init(RC522_CS, RC522_RST);
-  delay(200);
-
-  byte version = mfrc522.PCD_ReadRegister(mfrc522.VersionReg);
-  logDebug("   读取到NFC版本号: 0x" + String(version, HEX));
-
-  if (version != 0x00 && version != 0xFF) {
-    sysStatus.nfcWorking = true;
-    mfrc522.PCD_AntennaOn();
-    mfrc522.PCD_SetAntennaGain(mfrc522.RxGain_max);
-    logInfo("✅ NFC初始化成功: v0x" + String(version, HEX));
-  } else {
-    sysStatus.nfcWorking = false;
-    logError("❌ NFC初始化失败，版本号: 0x" + String(version, HEX));
-    logError("   可能原因：");
-    logError("   1. MFRC522模块未连接或损坏");
-    logError("   2. SPI接线错误（MOSI/MISO/SCK/CS/RST）");
-    logError("   3. 电源电压不足（需要3.3V）");
-    logError("   4. 模块与ESP32-S3不兼容");
-    logWarn("⚠️ 系统将以降级模式运行（NFC功能不可用）");
-    logWarn("⚠️ NFC将在运行时自动重试恢复");
-  }
+  startNfcBootTasks();
 
+  // 发起WiFi连接（后台完成，loop()中由事件推进）
   initWiFi();
 
-  if (sysStatus.displayWorking) {
-    delay(100);  // 给I2C总线喘息时间
-    display.clearBuffer();
-    display.setFont(u8g2_font_6x10_tf);
-    display.drawStr(25, 15, "System Ready!");
-
-    char buffer[30];
-    sprintf(buffer, "NFC: %s", sysStatus.nfcWorking ? "OK" : "Failed");
-    display.drawStr(10, 30, buffer);
-
-    sprintf(buffer, "WiFi: %s", sysStatus.wifiConnected ? "OK" : "Offline");
-    display.drawStr(10, 45, buffer);
-
-    display.sendBuffer();
-    delay(100);  // 给I2C总线喘息时间
-  }
-
-  beepSuccess();
-  delay(2000);
+  bootProfile.start(BOOT_STAGE_STORAGE);
+  // 打开离线交易日志（txlog分区）
+  loadOfflineQueue();
 
-  currentState = STATE_WELCOME;
-  stateStartTime = millis();
+  // 加载卡片缓存快照
+  cardCache.begin();
 
   // =================== 初始化健康度监测 ===================
   logInfo("🏥 初始化健康度监测系统...");
   healthMonitor.begin();
+  bootProfile.finish(BOOT_STAGE_STORAGE);
+
+  // 启动网络任务（此后所有Supabase请求都在网络任务中执行）
+  bootProfile.start(BOOT_STAGE_NET);
+  supabase.begin(config.getSupabaseURL(), config.getSupabaseKey());
+  startNetworkTask();
+  bootProfile.finish(BOOT_STAGE_NET);
+
+  waitBootTasks();
+
+  // 此后OLED只由渲染任务访问
+  bootProfile.start(BOOT_STAGE_UI);
+  buildUiAssets();
+  startRenderTask();
+  for (int i = 0; i < bayCount; i++) {
+    transitionTo(bays[i], STATE_WELCOME);
+  }
+  bootProfile.finish(BOOT_STAGE_UI);
+  bootProfile.markReady();
 
   // 初始化健康度指标
   healthMetrics.wifiConnected = sysStatus.wifiConnected;
@@ -1282,58 +2005,118 @@ void setup() {
   healthMetrics.oledWorking = sysStatus.displayWorking;
   healthMetrics.wifiRSSI = WiFi.isConnected() ? WiFi.RSSI() : 0;
 
-  // 获取NFC固件版本
-  if (sysStatus.nfcWorking) {
-    byte version = mfrc522.PCD_ReadRegister(mfrc522.VersionReg);
-    healthMetrics.nfcFirmwareVersion = "0x" + String(version, HEX);
+  // 软复位前的最后几条日志，随基线日志上传
+  healthMetrics.resetReason = (int)logRing.getResetReason();
+  if (logRing.getPostMortem() != NULL) {
+    LOG_W("🧾 检测到软复位（原因 %d），保留复位前日志 %d 条", healthMetrics.resetReason,
+          logRing.getPostMortemLines());
+    healthMetrics.postMortemLog = logRing.getPostMortem();
+    logRing.clearPostMortem();
   }
 
-  // 上传初始化基线日志（延迟3秒确保WiFi稳定）
-  delay(3000);
-  logInfo("📊 上传系统初始化基线日志...");
-  if (healthMonitor.uploadHealthLog()) {
-    logInfo("✅ 初始化日志上传成功");
-  } else {
-    logWarn("⚠️ 初始化日志上传失败（WiFi未连接或网络问题）");
+  // 获取NFC固件版本（洗车位1）
+  if (bays[0].nfcWorking) {
+    healthMetrics.nfcFirmwareVersion = "0x" + String(bays[0].nfc.getHealth().version, HEX);
   }
 
-  logInfo("🚀 系统已就绪");
+  // 初始化基线日志（含启动耗时）在WiFi连接后由loop()发送
+  healthMonitor.scheduleBaselineUpload();
+
+  beepSuccess();
+  unsigned long readyMs = bootProfile.getReadyMs();
+  if (readyMs > BOOT_TARGET_MS) {
+    LOG_W("⚠️ 启动耗时 %lu ms，超过目标 %d ms", readyMs, BOOT_TARGET_MS);
+    bootProfile.printStatus();
+  }
+  LOG_I("🚀 系统已就绪（%lu ms，%d 个洗车位，NFC %s，OLED %s）", readyMs, bayCount,
+        sysStatus.nfcWorking ? "正常" : "故障", sysStatus.displayWorking ? "正常" : "故障");
   logDebug("服务选项: 4个洗车套餐 + VIP查询");
   lastHeartbeat = millis();
   lastSuccessfulOperation = millis();  // 初始化成功操作时间戳
 }
 
+// =================== 洗车位读卡调度 ===================
+// 各洗车位的读卡器共用SPI总线：从 bayRoundRobin 开始依次读卡，本次loop的读卡耗时超过
+// BAY_NFC_BUDGET_US 时其余洗车位顺延到下次loop（并从它们开始），避免某个读卡器的复位/读卡拖慢整个loop
+void serviceBaysNFC() {
+  uint32_t startUs = micros();
+  int next = bayRoundRobin;
+  for (int n = 0; n < bayCount; n++) {
+    int i = (bayRoundRobin + n) % bayCount;
+    if (n > 0 && micros() - startUs > BAY_NFC_BUDGET_US) {
+      next = i;
+      bayNfcDeferred++;
+      break;
+    }
+    serviceNFC(bays[i]);
+    next = (i + 1) % bayCount;
+  }
+  bayRoundRobin = next;
+}
+
+// 其他洗车位是否正在洗车（自动重启前检查）
+bool otherBayProcessing(const Bay& bay) {
+  for (int i = 0; i < bayCount; i++) {
+    if (i != bay.index && bays[i].state == STATE_PROCESSING) return true;
+  }
+  return false;
+}
+
 void loop() {
   loopStartTime = millis();
+  loopProfiler.enter(PROF_LOOP);
+
+  for (int i = 0; i < bayCount; i++) {
+    Bay& bay = bays[i];
+
+    // =================== 错误恢复监控（方案A优化1）===================
+    // 5分钟无操作自动重启（欢迎界面除外；其他洗车位正在洗车时不重启）
+    if (bay.state != STATE_WELCOME && millis() - lastSuccessfulOperation > AUTO_RESTART_TIMEOUT_MS &&
+        !otherBayProcessing(bay)) {
+      Serial.println("⚠️ 长时间无操作，自动重启...");
+      Serial.printf("   上次成功操作: %lu 秒前\n", (millis() - lastSuccessfulOperation) / 1000);
+      Serial.printf("   洗车位%d 当前状态: %d\n", bay.number(), bay.state);
+      healthMonitor.persistSamples();
+      delay(1000);
+      ESP.restart();
+    }
 
-  // =================== 错误恢复监控（方案A优化1）===================
-  // 5分钟无操作自动重启（欢迎界面除外）
-  if (currentState != STATE_WELCOME && millis() - lastSuccessfulOperation > AUTO_RESTART_TIMEOUT_MS) {
-    Serial.println("⚠️ 长时间无操作，自动重启...");
-    Serial.printf("   上次成功操作: %lu 秒前\n", (millis() - lastSuccessfulOperation) / 1000);
-    Serial.printf("   当前状态: %d\n", currentState);
-    delay(1000);
-    ESP.restart();
+    // 连续错误自动重置
+    if (bay.consecutiveErrors >= MAX_CONSECUTIVE_ERRORS) {
+      Serial.printf("⚠️ 洗车位%d 连续错误 %d 次，重置\n", bay.number(), bay.consecutiveErrors);
+      bay.consecutiveErrors = 0;
+      beepError();
+      resetToWelcome(bay);
+    }
   }
 
-  // 连续错误自动重置
-  if (consecutiveErrors >= MAX_CONSECUTIVE_ERRORS) {
-    Serial.printf("⚠️ 连续错误 %d 次，重置系统\n", consecutiveErrors);
-    consecutiveErrors = 0;
-    beepError();
-    resetToWelcome();
+  { ProfScope scope(loopProfiler, PROF_CHECK_WIFI); checkWiFi(); }
+  {
+    ProfScope scope(loopProfiler, PROF_STATE_TIMEOUT);
+    for (int i = 0; i < bayCount; i++) checkStateTimeout(bays[i]);
   }
+  { ProfScope scope(loopProfiler, PROF_HEALTH_CHECK); performHealthCheck(); }
 
-  checkWiFi();
-  checkStateTimeout();
-  performHealthCheck();
-
-  // 健壮性增强：自动尝试恢复失败的模块
-  tryRecoverNFC();
-  tryRecoverWiFi();
+  // NFC读卡调度（检测卡片、空闲健康检查、故障复位）
+  int firstBay = bayRoundRobin;
+  { ProfScope scope(loopProfiler, PROF_NFC); serviceBaysNFC(); }
 
   // =================== 健康度监测（定期上传）===================
-  healthMonitor.checkAndUpload();
+  { ProfScope scope(loopProfiler, PROF_HEALTH_UPLOAD); healthMonitor.checkAndUpload(); }
+
+  // =================== 离线交易分批同步 ===================
+  { ProfScope scope(loopProfiler, PROF_OFFLINE_SYNC); scheduleOfflineSync(); }
+
+  // =================== 卡片缓存快照（所有洗车位待机时保存，写NVS记为阻塞）===================
+  bool allIdle = true;
+  for (int i = 0; i < bayCount; i++) {
+    if (bays[i].state != STATE_WELCOME) allIdle = false;
+  }
+  if (allIdle) {
+    ProfScope scope(loopProfiler, PROF_CACHE_SAVE);
+    ProfBlocked wait(loopProfiler);
+    cardCache.saveIfDue();
+  }
 
   // =================== 基于成功率的NFC自动恢复 ===================
   static unsigned long lastNFCSuccessRateCheck = 0;
@@ -1343,10 +2126,12 @@ void loop() {
     float successRate = healthMetrics.getNFCSuccessRate();
     int totalReads = healthMetrics.nfcReadSuccessCount + healthMetrics.nfcReadFailCount;
 
-    // 如果有足够的样本数据，且成功率低于50%
+    // 如果有足够的样本数据，且成功率低于50%（成功率为所有读卡器合计）
     if (totalReads >= 10 && successRate < 50.0 && sysStatus.nfcWorking) {
       logWarn("⚠️ NFC成功率过低 (" + String(successRate, 1) + "%)，触发自动恢复");
-      sysStatus.nfcWorking = false;  // 触发恢复流程
+      for (int i = 0; i < bayCount; i++) {
+        bays[i].nfc.requestReset();  // 下一次loop复位芯片
+      }
 
       // 重置统计数据
       healthMetrics.nfcReadSuccessCount = 0;
@@ -1354,65 +2139,160 @@ void loop() {
     }
   }
 
-  switch (currentState) {
-    case STATE_WELCOME:
-      handleWelcomeState();
-      break;
+  // 按状态表执行各洗车位当前状态的处理函数（与读卡相同的轮转顺序）
+  SystemState loopStates[MAX_BAYS];
+  for (int n = 0; n < bayCount; n++) {
+    Bay& bay = bays[(firstBay + n) % bayCount];
+    loopStates[bay.index] = bay.state;
+    if ((int)bay.state < 0 || bay.state >= STATE_COUNT) {
+      resetToWelcome(bay);
+    } else {
+      ProfScope scope(loopProfiler, PROF_STATE_BASE + bay.state);
+      getStateDef(bay.state).onUpdate(bay);
+    }
+  }
 
-    case STATE_SELECT_PACKAGE:
-      handleSelectPackageState();
-      break;
+  // 每次loop只提交一次LED模式（状态处理函数中的临时覆盖也在这里生效）
+  { ProfScope scope(loopProfiler, PROF_LEDS); updateLEDIndicators(); }
 
-    case STATE_CARD_SCAN:
-      handleCardScanState();
-      break;
+  unsigned long loopTime = millis() - loopStartTime;
+  if (loopTime > sysStatus.maxLoopTime) {
+    sysStatus.maxLoopTime = loopTime;
+  }
+  for (int i = 0; i < bayCount; i++) {
+    recordLoopLatency(loopStates[i], loopTime);
+  }
 
-    case STATE_VIP_QUERY:
-      handleVIPQueryState();
-      break;
+  // 更新健康度指标（当前状态在生成日志时读取，loop中不拼接字符串）
+  healthMetrics.loopExecutionTimeMs = loopTime;
+  healthMonitor.recordLoopTime(loopTime);
 
-    case STATE_VIP_DISPLAY:
-      handleVIPDisplayState();
-      break;
+  // 串口命令处理（用于远程调试）
+  { ProfScope scope(loopProfiler, PROF_SERIAL); handleSerialCommands(); }
+  loopProfiler.exit();
 
-    case STATE_SYSTEM_READY:
-      handleSystemReadyState();
-      break;
+  if (loopProfiler.dumpDue()) {
+    loopProfiler.printStatus(getStateString);
+  }
 
-    case STATE_PROCESSING:
-      handleProcessingState();
-      break;
+  // 按周期预算休眠：本次工作越久，休眠越短（至少 LOOP_MIN_SLEEP_MS）
+  unsigned long workMs = millis() - loopStartTime;
+  unsigned long sleepMs = workMs + LOOP_MIN_SLEEP_MS < LOOP_PERIOD_MS ? LOOP_PERIOD_MS - workMs : LOOP_MIN_SLEEP_MS;
+  ProfScope scope(loopProfiler, PROF_SLEEP);
+  ProfBlocked wait(loopProfiler);
+  delay(sleepMs);
+}
 
-    case STATE_COMPLETE:
-      handleCompleteState();
-      break;
+// =================== 脉冲时序模拟 ===================
+// 用模拟后端跑一遍套餐的脉冲串，打印每个脉冲的计划/实际时间（不驱动GPIO）
+void runPulseSimulation(int packageIndex, uint32_t latencyUs) {
+  if (packageIndex < 0 || packageIndex >= PACKAGE_COUNT || packages[packageIndex].isQuery) {
+    Serial.println("❌ 套餐编号无效");
+    return;
+  }
 
-    case STATE_ERROR:
-      setSystemLEDStatus();
-      displayError("System Error");
-      beepError();
-      delay(5000);
-      resetToWelcome();
-      break;
+  const Package& pkg = packages[packageIndex];
+  SimPulseBackend sim;
+  PulseEngine engine;
+  engine.begin(&sim);
+  sim.callbackLatencyUs = latencyUs;
 
-    default:
-      resetToWelcome();
-      break;
+  if (!engine.start(pkg.pulses, pkg.pulseWidthMs, pkg.pulsePeriodMs)) {
+    Serial.println("❌ 脉冲参数无效");
+    return;
   }
 
-  unsigned long loopTime = millis() - loopStartTime;
-  if (loopTime > sysStatus.maxLoopTime) {
-    sysStatus.maxLoopTime = loopTime;
+  // 按周期推进模拟时钟，直到脉冲串结束
+  uint64_t periodUs = (uint64_t)pkg.pulsePeriodMs * 1000;
+  for (int i = 0; i <= pkg.pulses + 1 && engine.isRunning(); i++) {
+    sim.advanceTo((i + 1) * periodUs + latencyUs);
   }
 
-  // 更新健康度指标
-  healthMetrics.currentState = getStateString(currentState);
-  healthMetrics.loopExecutionTimeMs = loopTime;
+  Serial.printf("\n=== 脉冲模拟: %s ===\n", pkg.name_en);
+  Serial.printf("脉冲: %d × 宽度 %ums / 周期 %ums, 回调延迟 %uus\n",
+                pkg.pulses, pkg.pulseWidthMs, pkg.pulsePeriodMs, latencyUs);
 
-  // 串口命令处理（用于远程调试）
-  handleSerialCommands();
+  uint64_t lastDriftUs = 0;
+  for (int i = 0; i + 1 < sim.edgeCount; i += 2) {
+    int n = i / 2;
+    uint64_t planned = (uint64_t)(n + 1) * periodUs;
+    uint64_t rise = sim.edges[i].timeUs;
+    uint32_t width = (uint32_t)(sim.edges[i + 1].timeUs - rise);
+    lastDriftUs = rise - planned;
+    Serial.printf("  #%d 上升 %lu.%03lums, 宽度 %lu.%03lums\n", n + 1,
+                  (unsigned long)(rise / 1000), (unsigned long)(rise % 1000),
+                  (unsigned long)(width / 1000), (unsigned long)(width % 1000));
+  }
+
+  Serial.printf("已发送: %d/%d, 最大偏差 %uus, 末脉冲漂移 %luus\n",
+                engine.pulsesSent(), pkg.pulses, engine.maxLatenessUs(),
+                (unsigned long)lastDriftUs);
+  Serial.println("========================\n");
+}
 
-  delay(50);
+// =================== NFC读卡模拟 ===================
+// 按loop周期驱动模拟读卡器，放卡时间落在两次loop之间的不同位置
+void runNfcSimulation(bool irq) {
+  SimNfcBackend sim;
+  NfcReader reader;
+  sim.irqWired = irq;
+  sim.advanceUs(1000000);
+  reader.begin(&sim, sim.nowUs() / 1000);
+  reader.setMode(NFC_POLL_ACTIVE);
+
+  const uint32_t loopUs = 50000;  // loop周期
+  const int taps = 10;
+  const uint8_t cardBytes[4] = {0x12, 0x34, 0x56, 0x78};
+  CardUid uid;
+
+  uint32_t startUs = sim.nowUs();
+  uint32_t startOps = sim.busOps;
+  uint32_t nextLoopUs = startUs;
+  uint32_t totalTapUs = 0;
+  uint32_t maxTapUs = 0;
+  int reads = 0;
+
+  for (int t = 0; t < taps; t++) {
+    uint32_t tapUs = nextLoopUs + 1000000 + (t * 7919) % loopUs;
+
+    // 等待放卡
+    while (nextLoopUs <= tapUs) {
+      if (nextLoopUs > sim.nowUs()) sim.advanceUs(nextLoopUs - sim.nowUs());
+      reader.poll(nextLoopUs / 1000, uid);
+      nextLoopUs += loopUs;
+    }
+    sim.advanceUs(tapUs - sim.nowUs());
+    sim.presentCard(cardBytes, sizeof(cardBytes));
+
+    // 等待读到UID
+    for (int i = 0; i < 20; i++) {
+      if (nextLoopUs > sim.nowUs()) sim.advanceUs(nextLoopUs - sim.nowUs());
+      nextLoopUs += loopUs;
+      if (reader.poll(sim.nowUs() / 1000, uid)) {
+        uint32_t us = sim.nowUs() - tapUs;
+        totalTapUs += us;
+        if (us > maxTapUs) maxTapUs = us;
+        reads++;
+        break;
+      }
+    }
+    sim.removeCard();
+  }
+
+  const NfcReaderStats& stats = reader.getStats();
+  uint32_t elapsedMs = (sim.nowUs() - startUs) / 1000;
+  Serial.printf("\n=== NFC模拟: %s ===\n", irq ? "IRQ检测" : "轮询检测");
+  Serial.printf("刷卡: %d/%d, loop周期 %lu ms\n", reads, taps, (unsigned long)(loopUs / 1000));
+  if (reads > 0) {
+    Serial.printf("放卡→UID: 平均 %lu us, 最长 %lu us; 检测→UID: 平均 %lu us\n",
+                  (unsigned long)(totalTapUs / reads), (unsigned long)maxTapUs,
+                  (unsigned long)(stats.totalLatencyUs / stats.reads));
+  }
+  Serial.printf("SPI事务: %lu (%lu 次/秒), 轮询 %u, IRQ发送 %u\n",
+                (unsigned long)(sim.busOps - startOps),
+                (unsigned long)((sim.busOps - startOps) * 1000UL / max(elapsedMs, (uint32_t)1)),
+                stats.polls, stats.irqArms);
+  Serial.println("========================\n");
 }
 
 // =================== 串口命令处理 ===================
@@ -1420,6 +2300,7 @@ void handleSerialCommands() {
   if (Serial.available()) {
     String cmd = Serial.readStringUntil('\n');
     cmd.trim();
+    String rawCmd = cmd;  // 机器ID区分大小写
     cmd.toLowerCase();
 
     if (cmd == "log error") {
@@ -1437,10 +2318,16 @@ void handleSerialCommands() {
     else if (cmd == "log debug") {
       CURRENT_LOG_LEVEL = LOG_LEVEL_DEBUG;
       Serial.println("✅ 日志级别: DEBUG（调试模式）");
+      if (LOG_LEVEL_DEBUG > LOG_COMPILE_LEVEL) {
+        Serial.printf("⚠️ 编译期最低级别为 %d，DEBUG日志已在编译时删除\n", LOG_COMPILE_LEVEL);
+      }
     }
     else if (cmd == "log verbose") {
       CURRENT_LOG_LEVEL = LOG_LEVEL_VERBOSE;
       Serial.println("✅ 日志级别: VERBOSE（详细模式）");
+      if (LOG_LEVEL_VERBOSE > LOG_COMPILE_LEVEL) {
+        Serial.printf("⚠️ 编译期最低级别为 %d，VERBOSE日志已在编译时删除\n", LOG_COMPILE_LEVEL);
+      }
     }
     else if (cmd == "log status") {
       Serial.println("\n=== 日志系统状态 ===");
@@ -1454,59 +2341,208 @@ void handleSerialCommands() {
         default: Serial.println("UNKNOWN"); break;
       }
       Serial.println("脱敏: " + String(LOG_MASK_SENSITIVE ? "开启" : "关闭"));
+      logRing.printStatus();
+      if (healthMetrics.postMortemLog.length() > 0) {
+        Serial.printf("复位前日志待上传: %u 字节\n", healthMetrics.postMortemLog.length());
+      }
       Serial.println("===================\n");
     }
     else if (cmd == "cache") {
-      Serial.println("\n=== 离线缓存队列 ===");
-      Serial.printf("队列数量: %d/%d\n", offlineQueueCount, MAX_OFFLINE_QUEUE);
+      uint32_t pendingCount = offlineLog.pendingCount();
+      Serial.println("\n=== 离线交易日志 ===");
+      if (!offlineLog.isReady()) {
+        Serial.println("❌ 日志分区不可用（请使用 partitions.csv 烧录）");
+      }
+      Serial.printf("待同步: %u/%u\n", pendingCount, offlineLog.capacity());
+      Serial.printf("日志位置: 最旧 %u, 写入 %u, 最大序号 %u\n", offlineLog.getHeadSlot(),
+                    offlineLog.getTailSlot(), offlineLog.getMaxSeq());
+      if (offlineLog.getDroppedCount() > 0) {
+        Serial.printf("⚠️ 日志写满丢弃: %u 笔\n", offlineLog.getDroppedCount());
+      }
       Serial.printf("WiFi状态: %s\n", sysStatus.wifiConnected ? "已连接" : "未连接");
-      if (offlineQueueCount == 0) {
-        Serial.println("✅ 队列为空");
+      Serial.printf("同步进度: 槽位 %u, 每批 %d 笔%s, 补扣方式: %s\n", offlineSyncCursor,
+                    offlineSyncIsolate ? 1 : OFFLINE_SYNC_CHUNK_SIZE,
+                    offlineSyncIsolate ? " (逐条隔离)" : "",
+                    rpcDebitAvailable ? "jc_debit_card" : "三步扣费");
+      if (pendingCount > 0 && sysStatus.wifiConnected) {
+        long waitMs = (long)(nextOfflineSyncTime - millis());
+        Serial.printf("下次同步: %ld 秒后\n", waitMs > 0 ? waitMs / 1000 : 0);
+      }
+      if (pendingCount == 0) {
+        Serial.println("✅ 没有待同步交易");
       }
       Serial.println("===================\n");
     }
+    else if (cmd == "cards") {
+      cardCache.printStatus();
+      Serial.printf("离线消费上限: $%.2f/卡\n", config.getOfflineSpendCap());
+    }
+    else if (cmd == "cards clear") {
+      cardCache.clear();
+      Serial.println("✅ 卡片缓存已清空");
+    }
+    else if (cmd.startsWith("offline cap ")) {
+      config.setOfflineSpendCap(cmd.substring(12).toFloat());
+    }
+    else if (cmd == "wifi") {
+      wifiManager.printStatus();
+    }
+    else if (cmd == "wifi reconnect") {
+      wifiManager.reconnectNow();
+      Serial.println("✅ 已发起WiFi重连");
+    }
+    else if (cmd == "wifi forget") {
+      wifiManager.forgetCache();
+      Serial.println("✅ 已清除缓存的AP/信道/租约（下次为完整连接）");
+    }
+    else if (cmd == "net") {
+      supabase.printStats();
+      netJsonPool.printStats("网络任务");
+      healthMonitor.printJsonPoolStats();
+    }
+    else if (cmd == "net reset") {
+      supabase.resetStats();
+      Serial.println("✅ 连接统计已清零");
+    }
+    else if (cmd == "pulse") {
+      for (int i = 0; i < bayCount; i++) {
+        PulseEngine& pulse = bays[i].pulse;
+        Serial.printf("洗车位%d 脉冲输出(GPIO%d): %s, 已发送 %d/%d, 最大偏差 %uus\n", bays[i].number(),
+                      bays[i].pins.pulse, pulse.isRunning() ? "运行中" : "空闲", pulse.pulsesSent(),
+                      pulse.pulsesTarget(), pulse.maxLatenessUs());
+      }
+    }
+    else if (cmd.startsWith("pulse sim ")) {
+      // pulse sim <套餐1-4> [回调延迟us]
+      String args = cmd.substring(10);
+      int space = args.indexOf(' ');
+      int packageIndex = (int)args.toInt() - 1;
+      uint32_t latencyUs = space > 0 ? (uint32_t)args.substring(space + 1).toInt() : 0;
+      runPulseSimulation(packageIndex, latencyUs);
+    }
+    else if (cmd == "states") {
+      printStateTable();
+    }
+    else if (cmd == "flow") {
+      printFlowStatus();
+    }
+    else if (cmd == "flow tap" || cmd == "flow select") {
+      config.setTapFirst(cmd == "flow tap");
+      for (int i = 0; i < bayCount; i++) {
+        setNFCPollMode(bays[i], nfcModeFor(getStateDef(bays[i].state)));
+      }
+    }
+    else if (cmd == "bays") {
+      printBayStatus();
+    }
+    else if (cmd.startsWith("bays ")) {
+      config.setBayCount(cmd.substring(5).toInt());
+    }
+    else if (cmd.startsWith("bay ") && cmd.indexOf(" id") > 0) {
+      // bay <n> id <机器ID>（省略ID时恢复默认）
+      int bay = (int)cmd.substring(4).toInt() - 1;
+      int idStart = cmd.indexOf(" id") + 3;
+      String id = rawCmd.substring(idStart);
+      id.trim();
+      config.setBayMachineID(bay, id);
+    }
+    else if (cmd == "display") {
+      printRenderStats();
+      displayDiff.printStats();
+    }
+    else if (cmd == "display reset") {
+      resetRenderStats();
+      displayDiff.resetStats();
+      Serial.println("✅ 显示刷新统计已清零");
+    }
+    else if (cmd == "latency") {
+      latencyTrace.printStatus();
+    }
+    else if (cmd == "latency reset") {
+      latencyTrace.reset();
+      Serial.println("✅ 耗时统计已清零");
+    }
+    else if (cmd == "perf") {
+      loopProfiler.printStatus(getStateString);
+    }
+    else if (cmd == "boot") {
+      bootProfile.printStatus();
+    }
+    else if (cmd == "heap") {
+      heapMonitor.printStatus();
+    }
+    else if (cmd == "perf reset") {
+      loopProfiler.reset();
+      Serial.println("✅ loop剖析已清零");
+    }
+    else if (cmd.startsWith("perf every ")) {
+      long seconds = cmd.substring(11).toInt();
+      loopProfiler.setDumpInterval(seconds > 0 ? (unsigned long)seconds * 1000 : 0);
+      if (seconds > 0) {
+        Serial.printf("✅ 每 %ld 秒打印loop剖析\n", seconds);
+      } else {
+        Serial.println("✅ 已关闭定期打印");
+      }
+    }
+    else if (cmd == "fx") {
+      effects.printStatus();
+    }
     else if (cmd == "health") {
       healthMonitor.printStatus();
     }
     else if (cmd == "health upload") {
       Serial.println("🏥 手动上传健康度日志...");
       if (healthMonitor.uploadHealthLog()) {
-        Serial.println("✅ 上传成功");
+        Serial.println("✅ 已提交到网络任务");
       } else {
         Serial.println("❌ 上传失败");
       }
     }
+    else if (cmd == "nfc") {
+      for (int i = 0; i < bayCount; i++) {
+        Serial.printf("\n--- 洗车位%d ---", bays[i].number());
+        bays[i].nfc.printStatus();
+      }
+      Serial.printf("SPI总线: 等待 %u 次, 最长 %u us; 读卡顺延 %u 次\n", nfcBus.getWaits(),
+                    nfcBus.getMaxWaitUs(), bayNfcDeferred);
+    }
     else if (cmd == "nfc test") {
-      Serial.println("🔍 NFC健康诊断测试...");
-
-      byte version = mfrc522.PCD_ReadRegister(mfrc522.VersionReg);
-      Serial.println("   版本寄存器: 0x" + String(version, HEX));
-
-      byte antenna = mfrc522.PCD_ReadRegister(mfrc522.TxControlReg);
-      Serial.println("   天线状态: 0x" + String(antenna, HEX) + " (" +
-                     String((antenna & 0x03) == 0x03 ? "ON" : "OFF") + ")");
-
-      byte errorReg = mfrc522.PCD_ReadRegister(mfrc522.ErrorReg);
-      Serial.println("   错误寄存器: 0x" + String(errorReg, HEX));
-
-      byte gainReg = mfrc522.PCD_ReadRegister(mfrc522.RFCfgReg);
-      Serial.println("   增益配置: 0x" + String(gainReg, HEX));
-
-      if (verifyNFCHealth()) {
-        Serial.println("✅ NFC模块健康");
-      } else {
-        Serial.println("❌ NFC模块异常");
+      for (int i = 0; i < bayCount; i++) {
+        Bay& bay = bays[i];
+        Serial.printf("🔍 洗车位%d NFC健康诊断测试...\n", bay.number());
+
+        bool ok = bay.nfc.probeNow(millis());
+        const NfcHealth& health = bay.nfc.getHealth();
+        Serial.println("   版本寄存器: 0x" + String(health.version, HEX));
+        Serial.println("   天线状态: 0x" + String(health.txControl, HEX) + " (" +
+                       String((health.txControl & 0x03) == 0x03 ? "ON" : "OFF") + ")");
+        Serial.println("   错误寄存器: 0x" + String(health.errorReg, HEX));
+        Serial.println("   增益配置: 0x" + String(health.rfCfg, HEX));
+        Serial.println("   寄存器读写: " + String(health.loopbackOk ? "OK" : "失败"));
+
+        if (ok) {
+          Serial.println("✅ NFC模块健康");
+        } else {
+          Serial.println("❌ NFC模块异常");
+        }
       }
     }
     else if (cmd == "nfc reset") {
-      Serial.println("🔄 手动重置NFC模块...");
-      if (performNFCHardReset()) {
-        sysStatus.nfcWorking = true;
-        healthMetrics.nfcInitialized = true;
-        Serial.println("✅ NFC重置成功");
-      } else {
-        Serial.println("❌ NFC重置失败");
+      for (int i = 0; i < bayCount; i++) {
+        Bay& bay = bays[i];
+        Serial.printf("🔄 手动重置洗车位%d NFC模块...\n", bay.number());
+        if (bay.nfc.resetNow(millis())) {
+          bay.nfcWorking = true;
+          Serial.println("✅ NFC重置成功");
+        } else {
+          Serial.println("❌ NFC重置失败");
+        }
       }
+      updateNfcWorking();
+    }
+    else if (cmd == "nfc sim") {
+      runNfcSimulation(true);
+      runNfcSimulation(false);
     }
     else if (cmd == "help") {
       Serial.println("\n=== 可用命令 ===");
@@ -1517,10 +2553,39 @@ void handleSerialCommands() {
       Serial.println("log verbose - 设置日志级别为VERBOSE");
       Serial.println("log status  - 查看日志系统状态");
       Serial.println("cache       - 查看离线缓存");
+      Serial.println("cards       - 查看卡片缓存");
+      Serial.println("cards clear - 清空卡片缓存");
+      Serial.println("offline cap <金额> - 设置每张卡离线消费上限（0=禁止）");
       Serial.println("health      - 查看系统健康度状态");
       Serial.println("health upload - 立即上传健康度日志");
-      Serial.println("nfc test    - NFC模块健康诊断");
-      Serial.println("nfc reset   - 手动重置NFC模块");
+      Serial.println("wifi        - 查看WiFi连接状态/耗时/断开原因");
+      Serial.println("wifi reconnect - 立即重连（跳过退避）");
+      Serial.println("wifi forget - 清除缓存的AP/信道/租约");
+      Serial.println("net         - 查看Supabase连接统计");
+      Serial.println("net reset   - 清零连接统计");
+      Serial.println("pulse       - 查看脉冲输出状态");
+      Serial.println("latency     - 查看交易路径各阶段耗时（p50/p95/p99）");
+      Serial.println("latency reset - 清零耗时统计");
+      Serial.println("perf        - 查看loop各子系统耗时（次数/累计/最长/分布/阻塞）");
+      Serial.println("boot        - 查看启动各阶段耗时（OLED/NFC并行初始化、WiFi后台连接）");
+      Serial.println("heap        - 查看堆内存（最大空闲块/碎片率/分配失败/空闲检查点/分配点）");
+      Serial.println("perf reset  - 清零loop剖析");
+      Serial.println("perf every <秒> - 定期打印loop剖析（0=关闭）");
+      Serial.println("fx          - 查看蜂鸣器/LED效果调度");
+      Serial.println("display     - 查看渲染任务和OLED刷新统计（帧耗时/丢帧/I2C字节）");
+      Serial.println("display reset - 清零刷新统计");
+      Serial.println("states      - 查看状态表/超时/各状态loop最大耗时");
+      Serial.println("flow        - 查看刷卡流程（先刷卡/先选套餐）和提前查询统计");
+      Serial.println("flow tap    - 先刷卡：欢迎页/选套餐页刷卡，选套餐期间后台查询");
+      Serial.println("flow select - 先选套餐（默认）");
+      Serial.println("bays        - 查看各洗车位状态/机器ID/读卡器/脉冲输出");
+      Serial.println("bays <1-3>  - 设置启用的洗车位数（重启后生效）");
+      Serial.println("bay <n> id <机器ID> - 设置洗车位的机器ID（省略ID恢复默认）");
+      Serial.println("pulse sim <套餐> [延迟us] - 模拟套餐脉冲时序");
+      Serial.println("nfc         - 查看各洗车位NFC读卡调度（检测→UID耗时/健康检查/SPI总线等待）");
+      Serial.println("nfc test    - NFC模块健康诊断（所有洗车位）");
+      Serial.println("nfc sim     - 模拟刷卡，比较IRQ与轮询");
+      Serial.println("nfc reset   - 手动重置NFC模块（所有洗车位）");
       Serial.println("help        - 显示此帮助");
       Serial.println("================\n");
     }
@@ -0,0 +1,200 @@
+/*
+ * GoldSky_Net.ino
+ * 网络任务 - 在第二核心上异步执行所有Supabase请求
+ *
+ * 包含：请求队列、网络工作任务、结果轮询接口
+ *
+ * 说明：
+ * - loop()只负责提交请求和轮询结果，永远不等待HTTP
+ * - 离线日志(offlineLog)只在网络任务中读写
+ * - 每个洗车位同一时刻只有一个前台请求（刷卡验证/扣费），新请求会使该洗车位的旧结果失效
+ */
+
+// =================== 网络任务状态 ===================
+QueueHandle_t netJobQueue = NULL;
+SemaphoreHandle_t netResultMutex = NULL;
+TaskHandle_t netTaskHandle = NULL;
+
+NetResult netResults[MAX_BAYS];               // 各洗车位最近完成的前台请求结果
+uint32_t netNextTicket = 1;                   // 请求编号（0保留为"无请求"，所有洗车位共用）
+uint32_t netForegroundTickets[MAX_BAYS] = {}; // 各洗车位当前等待结果的前台请求
+
+// =================== 网络工作任务 ===================
+void netTaskLoop(void* param) {
+  NetJob job;
+
+  for (;;) {
+    if (xQueueReceive(netJobQueue, &job, portMAX_DELAY) != pdTRUE) {
+      continue;
+    }
+
+    switch (job.type) {
+      case NET_JOB_CARD_LOOKUP: {
+        CardInfo info = getCardInfoFromSupabase(job.uid);
+        if (info.isValid) {
+          cardCache.store(info);
+        }
+        netPublishResult(job, info.isValid, info, "");
+        break;
+      }
+
+      case NET_JOB_CHARGE: {
+        NetResult charge;
+        chargeCard(job, charge);
+
+        // 缓存授权的扣费在后台完成，界面不等待结果
+        if (!job.cacheAuthorized) {
+          netPublishResult(job, charge.success, charge.cardInfo, charge.reason);
+        }
+
+        // 直接扣费的卡片不在缓存中：界面返回后再补充查询，下次刷卡可本地授权
+        if (charge.success && sysStatus.wifiConnected && !cardCache.contains(job.uid)) {
+          CardInfo info = getCardInfoFromSupabase(job.uid);
+          if (info.isValid) {
+            cardCache.store(info);
+          }
+        }
+        break;
+      }
+
+      case NET_JOB_HEALTH_UPLOAD:
+        healthMonitor.postHealthLog();
+        break;
+
+      case NET_JOB_SYNC_OFFLINE:
+        runOfflineSyncStep();
+        break;
+    }
+  }
+}
+
+// 写入前台请求结果（每个洗车位只保留最新一个）
+void netPublishResult(const NetJob& job, bool success, const CardInfo& info, const char* reason) {
+  if (job.bay >= MAX_BAYS) return;
+  NetResult& netResult = netResults[job.bay];
+  xSemaphoreTake(netResultMutex, portMAX_DELAY);
+  netResult.ticket = job.ticket;
+  netResult.type = job.type;
+  netResult.success = success;
+  netResult.cardInfo = info;
+  strlcpy(netResult.reason, reason, sizeof(netResult.reason));
+  xSemaphoreGive(netResultMutex);
+}
+
+// =================== 初始化 ===================
+// 在加载配置之后调用：队列长度按启用的洗车位数
+void startNetworkTask() {
+  netJobQueue = xQueueCreate(NET_QUEUE_BASE_LENGTH + NET_QUEUE_PER_BAY * bayCount, sizeof(NetJob));
+  netResultMutex = xSemaphoreCreateMutex();
+
+  xTaskCreatePinnedToCore(netTaskLoop, "net", NET_TASK_STACK_SIZE, NULL,
+                          NET_TASK_PRIORITY, &netTaskHandle, NET_TASK_CORE);
+
+  logInfo("🌐 网络任务已启动 (核心" + String(NET_TASK_CORE) + ")");
+}
+
+// =================== 请求提交 ===================
+// 返回请求编号，队列已满时返回0
+uint32_t netSubmit(NetJob& job) {
+  job.ticket = netNextTicket++;
+  if (netNextTicket == 0) netNextTicket = 1;
+
+  if (xQueueSend(netJobQueue, &job, 0) != pdTRUE) {
+    logWarn("⚠️ 网络请求队列已满，请求被拒绝");
+    return 0;
+  }
+  return job.ticket;
+}
+
+uint32_t netSubmitCardLookup(uint8_t bay, const CardUid& uid) {
+  NetJob job = {};
+  job.type = NET_JOB_CARD_LOOKUP;
+  job.bay = bay;
+  job.uid = uid;
+
+  netForegroundTickets[bay] = netSubmit(job);
+  return netForegroundTickets[bay];
+}
+
+// cacheAuthorized=true：已凭本地缓存授权，作为后台请求提交（不占用前台结果）
+// offlineAuthorized=true：断网时授权（扣费计入卡片缓存的离线累计）
+uint32_t netSubmitCharge(uint8_t bay, const CardUid& uid, float amount, float balanceBefore,
+                         const char* packageName, bool cacheAuthorized, bool offlineAuthorized) {
+  NetJob job = {};
+  job.type = NET_JOB_CHARGE;
+  job.bay = bay;
+  job.uid = uid;
+  job.amount = amount;
+  job.balanceBefore = balanceBefore;
+  strlcpy(job.packageName, packageName, sizeof(job.packageName));
+  job.cacheAuthorized = cacheAuthorized;
+  job.offlineAuthorized = offlineAuthorized;
+
+  if (cacheAuthorized) {
+    return netSubmit(job);
+  }
+
+  netForegroundTickets[bay] = netSubmit(job);
+  return netForegroundTickets[bay];
+}
+
+// 直接扣费：不先查询卡片，由服务器函数检查余额（单次请求）
+uint32_t netSubmitDirectDebit(uint8_t bay, const CardUid& uid, float amount, const char* packageName) {
+  NetJob job = {};
+  job.type = NET_JOB_CHARGE;
+  job.bay = bay;
+  job.uid = uid;
+  job.amount = amount;
+  strlcpy(job.packageName, packageName, sizeof(job.packageName));
+  job.directDebit = true;
+
+  netForegroundTickets[bay] = netSubmit(job);
+  return netForegroundTickets[bay];
+}
+
+// 后台上传健康度日志（请求体在 HealthMonitor 的固定缓冲区中，发送完之前不会重新生成）
+bool netSubmitHealthUpload() {
+  NetJob job = {};
+  job.type = NET_JOB_HEALTH_UPLOAD;
+  return netSubmit(job) != 0;
+}
+
+// 后台同步一批离线交易
+bool netSubmitOfflineSync() {
+  NetJob job = {};
+  job.type = NET_JOB_SYNC_OFFLINE;
+  return netSubmit(job) != 0;
+}
+
+// =================== 结果轮询 ===================
+NetJobStatus netPollResult(uint8_t bay, uint32_t ticket, NetResult& out) {
+  if (ticket == 0) return NET_JOB_NONE;
+
+  bool done = false;
+  xSemaphoreTake(netResultMutex, portMAX_DELAY);
+  if (netResults[bay].ticket == ticket) {
+    out = netResults[bay];
+    done = true;
+  }
+  xSemaphoreGive(netResultMutex);
+
+  if (done && ticket == netForegroundTickets[bay]) {
+    netForegroundTickets[bay] = 0;
+  }
+  return done ? NET_JOB_DONE : NET_JOB_PENDING;
+}
+
+// 该洗车位是否有前台请求尚未完成（用于暂停状态超时）
+bool netForegroundBusy(uint8_t bay) {
+  if (netForegroundTickets[bay] == 0) return false;
+
+  xSemaphoreTake(netResultMutex, portMAX_DELAY);
+  bool busy = (netResults[bay].ticket != netForegroundTickets[bay]);
+  xSemaphoreGive(netResultMutex);
+  return busy;
+}
+
+// 放弃该洗车位的前台请求（返回欢迎页时调用，迟到的结果将被忽略）
+void netCancelForeground(uint8_t bay) {
+  netForegroundTickets[bay] = 0;
+}
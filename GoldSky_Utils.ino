@@ -2,7 +2,7 @@
  * GoldSky_Utils.ino
  * 工具函数集合
  *
- * 包含：日志、蜂鸣器、LED控制、UID转换、按钮读取、NFC读卡
+ * 包含：日志、蜂鸣器、LED控制、按钮读取、NFC读卡
  */
 
 // =================== 日志函数（商用优化版）===================
@@ -26,113 +26,58 @@ String maskSensitiveData(const String& data) {
   return data;
 }
 
-// 统一日志输出（支持分级）
-void logMessage(int level, const String& levelStr, const String& message) {
-  // 只在当前级别允许时输出
-  if (level <= CURRENT_LOG_LEVEL) {
-    Serial.printf("[%lu][%s] %s\n", millis(), levelStr.c_str(), message.c_str());
-  }
-}
-
-// 分级日志函数
-void logError(const String& message) {
-  logMessage(LOG_LEVEL_ERROR, "ERROR", message);
-}
-
-void logWarn(const String& message) {
-  logMessage(LOG_LEVEL_WARN, "WARN", message);
-}
-
-void logInfo(const String& message) {
-  logMessage(LOG_LEVEL_INFO, "INFO", message);
-}
+// logError/logWarn/logInfo/logDebug/logVerbose 为宏（LogRing.h），写入异步日志缓冲区
 
-void logDebug(const String& message) {
-  logMessage(LOG_LEVEL_DEBUG, "DEBUG", message);
-}
-
-void logVerbose(const String& message) {
-  logMessage(LOG_LEVEL_VERBOSE, "VERBOSE", message);
+// 卡片UID脱敏（十进制，只显示前2位和后2位），返回out
+const char* maskCardUid(const CardUid& uid, char* out, size_t size) {
+  size_t length = uid.toDecimal(out, size);
+  #if LOG_MASK_SENSITIVE
+    for (size_t i = 2; length > 4 && i < length - 2; i++) {
+      out[i] = '*';
+    }
+  #endif
+  return out;
 }
 
 // 交易日志（自动脱敏）
-void logTransaction(const String& cardUID, float amount, const String& packageName) {
-  String maskedUID = maskSensitiveData(cardUID);
-  String msg = "💳 交易: 卡号=" + maskedUID + ", 金额=$" + String(amount, 2) + ", 套餐=" + packageName;
-  logInfo(msg);
+void logTransaction(const CardUid& uid, float amount, const char* packageName) {
+  char masked[CARD_UID_DEC_LEN];
+  LOG_I("💳 交易: 卡号=%s, 金额=$%.2f, 套餐=%s", maskCardUid(uid, masked, sizeof(masked)),
+        amount, packageName);
 }
 
 // =================== 蜂鸣器函数 ===================
+// 入队后立即返回，由EffectScheduler定时输出
 void beepShort() {
-  digitalWrite(BUZZER, HIGH);
-  delay(100);
-  digitalWrite(BUZZER, LOW);
+  effects.playSound(SOUND_SHORT);
 }
 
 void beepSuccess() {
-  for(int i = 0; i < 2; i++) {
-    digitalWrite(BUZZER, HIGH);
-    delay(100);
-    digitalWrite(BUZZER, LOW);
-    delay(100);
-  }
+  effects.playSound(SOUND_SUCCESS);
 }
 
 void beepError() {
-  for(int i = 0; i < 3; i++) {
-    digitalWrite(BUZZER, HIGH);
-    delay(150);
-    digitalWrite(BUZZER, LOW);
-    delay(100);
-  }
+  effects.playSound(SOUND_ERROR);
+  effects.flashLED(EFFECT_LED_STATUS, LED_BLINK_FAST, 650, EFFECT_PRIORITY_ALERT);
 }
 
-// =================== LED控制函数 ===================
-// LED输出辅助函数 - 根据极性配置自动反相
-inline void ledWrite(int pin, bool state) {
-  #if LED_COMMON_ANODE
-    digitalWrite(pin, !state);  // 共阳极: 反相输出
-  #else
-    digitalWrite(pin, state);   // 共阴极: 直接输出
-  #endif
-}
-
-void updateSingleLED(int pin, LEDStatus status) {
-  switch (status) {
-    case LED_OFF:
-      ledWrite(pin, LOW);
-      break;
-
-    case LED_ON:
-      ledWrite(pin, HIGH);
-      break;
-
-    case LED_BLINK_SLOW:
-      if (millis() - ledIndicator.lastBlinkTime > 500) {
-        ledIndicator.blinkState = !ledIndicator.blinkState;
-        ledIndicator.lastBlinkTime = millis();
-      }
-      ledWrite(pin, ledIndicator.blinkState ? HIGH : LOW);
-      break;
-
-    case LED_BLINK_FAST:
-      if (millis() - ledIndicator.lastBlinkTime > 100) {
-        ledIndicator.blinkState = !ledIndicator.blinkState;
-        ledIndicator.lastBlinkTime = millis();
-      }
-      ledWrite(pin, ledIndicator.blinkState ? HIGH : LOW);
-      break;
-  }
+void beepComplete() {
+  effects.playSound(SOUND_COMPLETE);
 }
 
+// =================== LED控制函数 ===================
+// 把ledIndicator中的基础模式交给EffectScheduler（每次loop调用一次，模式不变时保持闪烁相位）
 void updateLEDIndicators() {
-  ledWrite(LED_POWER, ledIndicator.power ? HIGH : LOW);
-  updateSingleLED(LED_NETWORK, ledIndicator.network);
-  updateSingleLED(LED_PROGRESS, ledIndicator.progress);
-  updateSingleLED(LED_STATUS, ledIndicator.status);
+  effects.setLED(EFFECT_LED_POWER, ledIndicator.power ? LED_ON : LED_OFF);
+  effects.setLED(EFFECT_LED_NETWORK, ledIndicator.network);
+  effects.setLED(EFFECT_LED_PROGRESS, ledIndicator.progress);
+  effects.setLED(EFFECT_LED_STATUS, ledIndicator.status);
 }
 
-void setSystemLEDStatus() {
+// 状态LED只反映带显示屏的洗车位（其余洗车位没有独立的LED）
+void setSystemLEDStatus(Bay& bay) {
+  if (!bay.hasDisplay()) return;
+
   ledIndicator.power = true;
 
   // 网络LED：连接=常亮，断开=慢闪
@@ -148,7 +93,7 @@ void setSystemLEDStatus() {
     // PROGRESS LED根据状态设置，STATUS被故障占用
   } else {
     // 正常流程的LED状态
-    switch (currentState) {
+    switch (bay.state) {
       case STATE_WELCOME:
         ledIndicator.progress = LED_OFF;
         ledIndicator.status = LED_OFF;
@@ -195,11 +140,15 @@ void setSystemLEDStatus() {
         ledIndicator.progress = LED_OFF;
         ledIndicator.status = LED_BLINK_FAST;
         break;
+
+      case STATE_MESSAGE:
+        ledIndicator.status = bay.messageIsError ? LED_BLINK_FAST : LED_ON;
+        break;
     }
   }
 
   // PROGRESS LED始终根据状态设置（不受NFC故障影响）
-  switch (currentState) {
+  switch (bay.state) {
     case STATE_WELCOME:
       ledIndicator.progress = LED_OFF;
       break;
@@ -217,165 +166,122 @@ void setSystemLEDStatus() {
     case STATE_ERROR:
       ledIndicator.progress = LED_OFF;
       break;
+    case STATE_MESSAGE:
+      ledIndicator.progress = bay.messageIsError ? LED_OFF : LED_ON;
+      break;
   }
-
-  updateLEDIndicators();
-}
-
-// =================== UID转换函数 ===================
-String hexUIDToDecimal(const String& hexUID) {
-  unsigned long decimalValue = 0;
-  for (int i = 0; i < hexUID.length(); i++) {
-    char c = hexUID.charAt(i);
-    decimalValue *= 16;
-    if (c >= '0' && c <= '9') {
-      decimalValue += c - '0';
-    } else if (c >= 'A' && c <= 'F') {
-      decimalValue += c - 'A' + 10;
-    } else if (c >= 'a' && c <= 'f') {
-      decimalValue += c - 'a' + 10;
-    }
-  }
-  return String(decimalValue);
-}
-
-String decimalToHexUID(const String& decimalUID) {
-  unsigned long decimalValue = decimalUID.toInt();
-  String hexUID = String(decimalValue, HEX);
-  hexUID.toUpperCase();
-  while(hexUID.length() < 8) {
-    hexUID = "0" + hexUID;
-  }
-  return hexUID;
 }
 
 // =================== 按钮读取 ===================
-bool readButtonImproved(int pin) {
-  int pinIndex = (pin == BTN_OK) ? 0 : 1;
+bool readButtonImproved(Bay& bay, int button) {
+  int pin = bay.buttonPin(button);
   bool reading = digitalRead(pin);
 
-  if (reading != lastButtonState[pinIndex]) {
-    lastDebounceTime[pinIndex] = millis();
+  if (reading != bay.lastButtonState[button]) {
+    bay.lastDebounceTime[button] = millis();
   }
 
-  if ((millis() - lastDebounceTime[pinIndex]) > 50) {
-    if (reading && !buttonPressed[pinIndex]) {
-      buttonPressed[pinIndex] = true;
-      lastButtonState[pinIndex] = reading;
-      logInfo("按钮按下: GPIO" + String(pin));
+  if ((millis() - bay.lastDebounceTime[button]) > 50) {
+    if (reading && !bay.buttonPressed[button]) {
+      bay.buttonPressed[button] = true;
+      bay.lastButtonState[button] = reading;
+      LOG_I("洗车位%d 按钮按下: GPIO%d", bay.number(), pin);
       return true;
     } else if (!reading) {
-      buttonPressed[pinIndex] = false;
+      bay.buttonPressed[button] = false;
     }
   }
 
-  lastButtonState[pinIndex] = reading;
+  bay.lastButtonState[button] = reading;
   return false;
 }
 
-// =================== NFC健康检查和恢复 ===================
-bool checkAndRecoverNFC() {
-  byte version = mfrc522.PCD_ReadRegister(mfrc522.VersionReg);
-
-  // 版本号正常（通常是0x91或0x92）
-  if (version != 0x00 && version != 0xFF) {
-    // 健康，静默返回（避免过多日志）
-    return true;
-  }
-
-  // NFC模块异常，尝试重新初始化
-  logWarn("⚠️ NFC模块异常(版本: 0x" + String(version, HEX) + ")，尝试恢复...");
-
-  mfrc522.PCD_Init(RC522_CS, RC522_RST);
-  delay(50);
-  mfrc522.PCD_Reset();
-  delay(50);
-
-  version = mfrc522.PCD_ReadRegister(mfrc522.VersionReg);
-  if (version != 0x00 && version != 0xFF) {
-    mfrc522.PCD_AntennaOn();
-    delay(10);
-    mfrc522.PCD_SetAntennaGain(mfrc522.RxGain_max);
-    logInfo("✅ NFC恢复成功: 0x" + String(version, HEX));
-    sysStatus.nfcWorking = true;
-    return true;
-  }
-
-  logError("❌ NFC恢复失败");
-  sysStatus.nfcWorking = false;
-  return false;
+// =================== NFC读卡（调度见 NfcReader.h）===================
+// 状态切换时调用：设置本洗车位的读卡频率，丢弃上一状态未取走的卡片
+void setNFCPollMode(Bay& bay, NfcPollMode mode) {
+  bay.nfc.setMode(mode);
+  bay.pendingCardUID.clear();
 }
 
-// =================== NFC读卡 ===================
-// 全局变量：记录上次健康检查时间和连续失败次数
-static unsigned long lastNFCHealthCheck = 0;
-int nfcReadFailCount = 0;  // 移除static，允许其他文件访问
-
-String readCardUID() {
-  // 首次调用时初始化健康检查时间戳
-  if (lastNFCHealthCheck == 0) {
-    lastNFCHealthCheck = millis();
+// 所有启用的洗车位读卡器都正常时才算NFC正常（健康度指标和状态LED）
+void updateNfcWorking() {
+  bool allWorking = true;
+  for (int i = 0; i < bayCount; i++) {
+    if (!bays[i].nfcWorking) allWorking = false;
   }
+  sysStatus.nfcWorking = allWorking;
+  healthMetrics.nfcInitialized = allWorking;
+}
 
-  // 只在以下情况检查NFC健康：
-  // 1. 连续读卡失败5次以上
-  // 2. 距离上次检查超过60秒
-  if (nfcReadFailCount > 5 || (millis() - lastNFCHealthCheck > 60000)) {
-    if (!checkAndRecoverNFC()) {
-      nfcReadFailCount++;
-      return "";
+// 每次loop按轮转顺序调用（在状态处理函数之前）：按读卡频率检测卡片，同步NFC健康状态
+void serviceNFC(Bay& bay) {
+  uint32_t failuresBefore = bay.nfc.getStats().readFailures;
+  CardUid uid;
+  bool gotCard = bay.nfc.poll(millis(), uid);
+
+  bool healthy = bay.nfc.isHealthy();
+  if (healthy != bay.nfcWorking) {
+    const NfcHealth& health = bay.nfc.getHealth();
+    if (healthy) {
+      LOG_I("✅ 洗车位%d NFC恢复成功: 0x%02X", bay.number(), health.version);
+      beepSuccess();
+    } else {
+      LOG_W("⚠️ 洗车位%d NFC健康检查失败 (版本: 0x%02X, 天线: 0x%02X)，将在%d秒内复位重试",
+            bay.number(), health.version, health.txControl, NFC_RETRY_INTERVAL_MS / 1000);
     }
-    lastNFCHealthCheck = millis();
-    nfcReadFailCount = 0;  // 恢复成功后重置计数
-  }
-
-  if (!mfrc522.PICC_IsNewCardPresent()) {
-    return "";
-  }
-
-  // 静默检测：只在首次检测或连续失败时记录
-  static unsigned long lastDetectLog = 0;
-  if (millis() - lastDetectLog > 2000) {  // 2秒内只记录一次
-    logVerbose("🔍 检测到卡片，正在读取...");  // 改为VERBOSE（商用不输出）
-    lastDetectLog = millis();
+    bay.nfcWorking = healthy;
+    updateNfcWorking();
   }
 
-  if (!mfrc522.PICC_ReadCardSerial()) {
-    nfcReadFailCount++;
-    // ✅ 优化：只在连续失败3次后才记录错误，减少日志噪音
-    if (nfcReadFailCount >= 3 && nfcReadFailCount % 3 == 0) {
-      logError("❌ 读取卡片序列号失败 (连续" + String(nfcReadFailCount) + "次)");
+  if (bay.nfc.getStats().readFailures != failuresBefore) {
+    bay.nfcReadFailCount++;
+    // 只在连续失败3次后才记录错误，减少日志噪音
+    if (bay.nfcReadFailCount >= 3 && bay.nfcReadFailCount % 3 == 0) {
+      LOG_E("❌ 洗车位%d 读取卡片序列号失败 (连续%d次)", bay.number(), bay.nfcReadFailCount);
     }
     healthMonitor.recordNFCFailure();  // 记录NFC读卡失败
-    return "";
+    return;
   }
 
-  String hexUID = "";
-  for (byte i = 0; i < mfrc522.uid.size; i++) {
-    if (mfrc522.uid.uidByte[i] < 0x10) hexUID += "0";
-    hexUID += String(mfrc522.uid.uidByte[i], HEX);
+  if (!gotCard) return;
+
+  // 商用：脱敏显示（格式化只在对应级别开启时执行）
+  char text[CARD_UID_DEC_LEN];
+  LOG_I("洗车位%d 读取到卡片: %s (%luus)", bay.number(), maskCardUid(uid, text, sizeof(text)),
+        (unsigned long)bay.nfc.getStats().lastLatencyUs);
+  if (LOG_ENABLED(LOG_LEVEL_DEBUG)) {
+    char hex[CARD_UID_HEX_LEN];
+    uid.toHex(hex, sizeof(hex));
+    uid.toDecimal(text, sizeof(text));
+    LOG_D("完整UID: HEX=%s, DEC=%s", hex, text);  // 完整信息改为DEBUG
   }
 
-  hexUID.toUpperCase();
-  String decimalUID = hexUIDToDecimal(hexUID);
-
-  mfrc522.PICC_HaltA();
-  mfrc522.PCD_StopCrypto1();
-
-  // 商用：脱敏显示
-  String maskedUID = maskSensitiveData(decimalUID);
-  logInfo("读取到卡片: " + maskedUID);
-  logDebug("完整UID: HEX=" + hexUID + ", DEC=" + decimalUID);  // 完整信息改为DEBUG
-
   // 成功读卡后重置失败计数
-  nfcReadFailCount = 0;
+  bay.nfcReadFailCount = 0;
   healthMonitor.recordNFCSuccess();  // 记录NFC读卡成功
 
-  return decimalUID;
+  const NfcReaderStats& stats = bay.nfc.getStats();
+  latencyTrace.record(SPAN_NFC_DETECT, stats.lastDetectUs);
+  latencyTrace.record(SPAN_NFC_UID, stats.lastReadUs);
+
+  // 只有等待刷卡的状态保留卡片；待机时的检测只用于健康度统计
+  if (bay.nfc.getMode() == NFC_POLL_ACTIVE) {
+    bay.pendingCardUID = uid;
+    bay.pendingCardTapUs = micros() - stats.lastDetectUs - stats.lastReadUs;
+  }
+}
+
+// 取走本洗车位本次loop读到的卡片（没有则返回false）
+bool readCardUID(Bay& bay, CardUid& uid) {
+  if (bay.pendingCardUID.isEmpty()) return false;
+  uid = bay.pendingCardUID;
+  bay.cardTapUs = bay.pendingCardTapUs;
+  bay.pendingCardUID.clear();
+  return true;
 }
 
-// =================== 状态转字符串（健康度日志用）===================
-String getStateString(SystemState state) {
+// =================== 状态名称（健康度日志/串口用，常量字符串不占堆）===================
+const char* getStateString(SystemState state) {
   switch (state) {
     case STATE_WELCOME:        return "WELCOME";
     case STATE_SELECT_PACKAGE: return "SELECT_PACKAGE";
@@ -386,6 +292,7 @@ String getStateString(SystemState state) {
     case STATE_PROCESSING:     return "PROCESSING";
     case STATE_COMPLETE:       return "COMPLETE";
     case STATE_ERROR:          return "ERROR";
+    case STATE_MESSAGE:        return "MESSAGE";
     default:                   return "UNKNOWN";
   }
 }
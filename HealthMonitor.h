@@ -2,9 +2,11 @@
  * HealthMonitor.h - 系统健康度监测模块
  *
  * 功能：
- * - 每30分钟自动采集系统健康度数据
- * - 上传到 Supabase 数据库
+ * - 每分钟采样一条定长记录（HealthSampler.h），每30分钟连同当前快照批量上传一次
+ * - 上传到 Supabase 数据库；失败或断网时分钟记录保留到下个周期（重启后也不丢）
+ * - 最近1小时交易数、最近30分钟错误数按分钟分桶滚动计算
  * - 帮助诊断刷卡无响应等问题
+ * - 日志请求体生成到固定缓冲区（不在堆上分配），网络任务发送完之前不重新生成
  *
  * 版本: v1.0
  * 日期: 2025-12-04
@@ -19,20 +21,125 @@
 #include <ArduinoJson.h>
 #include "config.h"
 #include "ConfigManager.h"
+#include "SupabaseClient.h"
+#include "JsonPool.h"
+#include "LatencyTrace.h"
+#include "HealthSampler.h"
+#include "OfflineLog.h"
+#include "BootProfile.h"
+#include "HeapMonitor.h"
+#include "Bay.h"
 
 // =================== 健康度监测配置 ===================
 #define HEALTH_LOG_INTERVAL 1800000  // 30分钟 (毫秒)
+#define HEALTH_JSON_POOL_SIZE 7680   // 健康度日志JSON内存池（含复位前日志约2.5KB、耗时直方图约1KB、启动耗时0.3KB）
+#define HEALTH_BACKLOG_RETRY_MS 60000  // 分钟记录积压超过一批时，下一批的上传间隔
+#define HEALTH_PAYLOAD_MAX 8192      // 健康度日志请求体（JSON快照 + 分钟记录）
 // #define HEALTH_LOG_INTERVAL 300000   // 5分钟 (测试用)
 
 // =================== 全局健康度指标 ===================
 extern HealthMetrics healthMetrics;
 extern ConfigManager config;  // 使用外部配置管理器
+extern SupabaseClient supabase;  // Supabase长连接客户端
+extern LatencyTrace latencyTrace;  // 交易路径耗时直方图
+extern BootProfile bootProfile;    // 启动各阶段耗时（只随第一条日志上传）
+extern OfflineLog offlineLog;      // 离线交易积压数
+extern Bay bays[MAX_BAYS];         // 分钟采样记录洗车位1的状态
+extern int bayCount;
+
+const char* getStateString(SystemState state);  // GoldSky_Utils.ino
+
+// 网络任务接口（定义在 GoldSky_Net.ino）
+bool netSubmitHealthUpload();
 
 // =================== 健康度监测类 ===================
 class HealthMonitor {
 private:
   unsigned long lastHealthLogTime = 0;
   String deviceId = "";
+  JsonPool<HEALTH_JSON_POOL_SIZE> jsonPool;  // 只在loop()中生成JSON
+  char latencyJson[LATENCY_JSON_MAX];        // 耗时直方图（原样嵌入健康度日志）
+  char samplesJson[HEALTH_SAMPLES_JSON_MAX]; // 分钟记录（拼接在健康度日志末尾）
+  char bootJson[BOOT_REPORT_JSON_MAX];       // 启动耗时
+  char payload[HEALTH_PAYLOAD_MAX];          // 请求体（loop()生成，网络任务发送）
+  size_t payloadLength = 0;
+  bool bootReportSent = false;
+  bool baselinePending = false;              // 启动基线日志等待WiFi连接
+
+  // 分钟采样（只在loop()中访问）
+  HealthSampleRing samples;
+  uint32_t lastSampleMinute = 0;
+  uint16_t loopMaxMsThisMinute = 0;
+  uint16_t nfcOkThisMinute = 0;
+  uint16_t nfcFailThisMinute = 0;
+
+  // 按分钟滚动的计数（网络任务也会记录交易）
+  MinuteCounter<60> transactionsByMinute;
+  MinuteCounter<30> errorsByMinute;
+
+  // 正在上传的一批分钟记录：网络任务写结果，loop()确认或保存到NVS
+  // 上传按提交顺序编号，网络任务按顺序完成，编号到达batchUpload时即为这一批的结果
+  int batchCount = 0;                // 本次生成的日志中带的记录数
+  bool batchInFlight = false;
+  uint32_t batchEndSeq = 0;
+  uint32_t batchUpload = 0;
+  uint32_t submittedUploads = 0;     // loop()提交的上传数
+  volatile uint32_t completedUploads = 0;  // 网络任务完成的上传数（相等时请求体缓冲区空闲）
+  volatile uint8_t batchResult = 0;  // 0=未完成 1=成功 2=失败
+
+  static uint32_t currentMinute() {
+    return millis() / 60000;
+  }
+
+  static uint8_t saturate8(uint32_t value) {
+    return value > 255 ? 255 : (uint8_t)value;
+  }
+
+  // 上一分钟结束：写入一条记录
+  void takeSample(uint32_t minute) {
+    HealthSample s = {};
+    s.minute = minute;
+    s.boot = samples.getBoot();
+    s.freeHeapKb = ESP.getFreeHeap() / 1024;
+    s.minFreeHeapKb = ESP.getMinFreeHeap() / 1024;
+    s.maxBlockKb = ESP.getMaxAllocHeap() / 1024;
+    s.loopMaxMs = loopMaxMsThisMinute;
+    s.rssi = WiFi.isConnected() ? (int8_t)WiFi.RSSI() : 0;
+    s.flags = (WiFi.isConnected() ? HEALTH_FLAG_WIFI : 0) |
+              (healthMetrics.nfcInitialized ? HEALTH_FLAG_NFC : 0) |
+              (healthMetrics.oledWorking ? HEALTH_FLAG_OLED : 0);
+    s.state = (uint8_t)bays[0].state;
+    s.transactions = saturate8(transactionsByMinute.countAt(minute));
+    s.nfcOk = saturate8(nfcOkThisMinute);
+    s.nfcFail = saturate8(nfcFailThisMinute);
+    s.errors = saturate8(errorsByMinute.countAt(minute));
+    s.offlinePending = saturate8(offlineLog.pendingCount());
+    samples.push(s);
+
+    loopMaxMsThisMinute = 0;
+    nfcOkThisMinute = 0;
+    nfcFailThisMinute = 0;
+  }
+
+  // 网络任务上传完一批后，在loop()中处理结果
+  void finishBatch() {
+    if (!batchInFlight || batchResult == 0) return;
+
+    if (batchResult == 1) {
+      samples.ack(batchEndSeq);
+    } else {
+      samples.persist();  // 留到下个周期，重启也不丢
+    }
+    batchInFlight = false;
+    batchResult = 0;
+  }
+
+  // 滚动窗口计数写回健康度指标
+  void refreshWindowCounters() {
+    uint32_t minute = currentMinute();
+    healthMetrics.transactionsLastHour = transactionsByMinute.sum(minute);
+    healthMetrics.errorCountLast30Min = errorsByMinute.sum(minute);
+  }
 
   // 获取设备ID (使用MAC地址)
   String getDeviceId() {
@@ -47,9 +154,18 @@ private:
     return deviceId;
   }
 
-  // 构建健康度日志 JSON
-  String buildHealthLogJSON() {
-    JsonDocument doc;
+  // 各洗车位的当前状态（多个洗车位时逗号分隔）
+  void formatStates(char* out, size_t size) {
+    size_t length = 0;
+    out[0] = '\0';
+    for (int i = 0; i < bayCount && length < size; i++) {
+      length += snprintf(out + length, size - length, i > 0 ? ",%s" : "%s", getStateString(bays[i].state));
+    }
+  }
+
+  // 构建健康度日志 JSON 到 payload，返回长度（放不下时返回0）
+  size_t buildHealthLogJSON() {
+    JsonDocument doc(&jsonPool);
 
     doc["device_id"] = getDeviceId();
 
@@ -61,6 +177,11 @@ private:
     doc["free_heap"] = healthMetrics.freeHeap;
     doc["min_free_heap"] = healthMetrics.minFreeHeap;
     doc["heap_usage_percent"] = healthMetrics.getHeapUsagePercent();
+    doc["max_alloc_heap"] = healthMetrics.maxAllocHeap;
+    doc["min_max_alloc_heap"] = healthMetrics.minMaxAllocHeap;
+    doc["heap_frag_percent"] = HeapMonitor::fragPercent(healthMetrics.freeHeap, healthMetrics.maxAllocHeap);
+    doc["max_heap_frag_percent"] = heapMonitor.getMaxFragPercent();
+    doc["heap_alloc_failures"] = heapMonitor.getFailedAllocs();
 
     // WiFi 状态
     doc["wifi_connected"] = healthMetrics.wifiConnected;
@@ -81,11 +202,14 @@ private:
     doc["i2c_error_count"] = healthMetrics.i2cErrorCount;
 
     // 业务统计
+    refreshWindowCounters();
     doc["total_transactions"] = healthMetrics.totalTransactions;
     doc["transactions_last_hour"] = healthMetrics.transactionsLastHour;
 
     // 系统状态
-    doc["current_state"] = healthMetrics.currentState;
+    char states[48];
+    formatStates(states, sizeof(states));
+    doc["current_state"] = states;
     doc["loop_execution_time_ms"] = healthMetrics.loopExecutionTimeMs;
     doc["watchdog_reset_count"] = healthMetrics.watchdogResetCount;
 
@@ -93,62 +217,165 @@ private:
     doc["last_error"] = healthMetrics.lastError;
     doc["error_count_last_30min"] = healthMetrics.errorCountLast30Min;
 
-    String jsonString;
-    serializeJson(doc, jsonString);
-    return jsonString;
+    // 交易路径各阶段耗时（本周期）
+    if (latencyTrace.toJson(latencyJson, sizeof(latencyJson)) > 0) {
+      doc["latency_histograms"] = serialized(latencyJson);
+    }
+
+    // 启动耗时（启动后第一条日志）
+    if (!bootReportSent && bootProfile.toJson(bootJson, sizeof(bootJson)) > 0) {
+      doc["boot_report"] = serialized(bootJson);
+    }
+
+    // 复位诊断
+    doc["reset_reason"] = healthMetrics.resetReason;
+    if (healthMetrics.postMortemLog.length() > 0) {
+      doc["post_mortem_log"] = healthMetrics.postMortemLog;
+    }
+
+    // 分钟记录：已是JSON文本，直接拼接在末尾（不经过内存池）
+    size_t samplesLength = 0;
+    batchCount = 0;
+    if (!batchInFlight) {
+      batchCount = samples.encodeBatch(currentMinute(), samplesJson, sizeof(samplesJson), batchEndSeq);
+      if (batchCount > 0) samplesLength = strlen(samplesJson);
+    }
+
+    static const char SAMPLES_KEY[] = ",\"samples\":";
+    size_t length = measureJson(doc);
+    if (samplesLength > 0 && length + sizeof(SAMPLES_KEY) + samplesLength + 1 > sizeof(payload)) {
+      batchCount = 0;  // 放不下：分钟记录留到下一次
+      samplesLength = 0;
+    }
+    if (doc.overflowed() || length + 1 > sizeof(payload)) {
+      Serial.printf("❌ 健康度日志过大或内存池不足 (%u 字节)\n", (unsigned)length);
+      return 0;
+    }
+
+    serializeJson(doc, payload, sizeof(payload));
+    if (samplesLength > 0) {
+      length--;  // 去掉结尾的 }
+      memcpy(payload + length, SAMPLES_KEY, sizeof(SAMPLES_KEY) - 1);
+      length += sizeof(SAMPLES_KEY) - 1;
+      memcpy(payload + length, samplesJson, samplesLength);
+      length += samplesLength;
+      payload[length++] = '}';
+      payload[length] = '\0';
+    }
+    return length;
   }
 
 public:
   // 初始化
   void begin() {
     lastHealthLogTime = millis();
+    lastSampleMinute = currentMinute();
+    samples.begin();
     Serial.println("🏥 健康度监测系统已启动");
     Serial.println("   设备ID: " + getDeviceId());
-    Serial.println("   上传间隔: " + String(HEALTH_LOG_INTERVAL / 60000) + " 分钟");
+    Serial.println("   上传间隔: " + String(HEALTH_LOG_INTERVAL / 60000) + " 分钟（每分钟采样）");
+    if (samples.unsentCount() > 0) {
+      Serial.println("   上次未上传的分钟记录: " + String(samples.unsentCount()) + " 条");
+    }
   }
 
-  // 定期检查并上传健康度日志
+  // 每次loop调用：每分钟采样一次，定期上传（异步，不阻塞loop）
   void checkAndUpload() {
     unsigned long currentTime = millis();
 
-    // 检查是否到达上传时间
-    if (currentTime - lastHealthLogTime >= HEALTH_LOG_INTERVAL) {
-      uploadHealthLog();
+    uint32_t minute = currentMinute();
+    if (minute != lastSampleMinute) {
+      takeSample(lastSampleMinute);
+      lastSampleMinute = minute;
+    }
+    finishBatch();
+
+    // 启动基线日志：WiFi连上后立即发送（不在setup()中等待）
+    if (baselinePending && WiFi.isConnected() && !batchInFlight) {
+      baselinePending = false;
+      Serial.println("📊 上传系统初始化基线日志...");
+      if (!uploadHealthLog()) {
+        Serial.println("⚠️ 初始化日志上传失败（网络任务队列满）");
+      }
+      lastHealthLogTime = currentTime;
+      return;
+    }
+
+    // 到达上传时间；积压超过一批时缩短间隔，尽快补传
+    unsigned long interval = samples.unsentCount() > HEALTH_BATCH_MAX_SAMPLES && WiFi.isConnected()
+                               ? HEALTH_BACKLOG_RETRY_MS : HEALTH_LOG_INTERVAL;
+    if (currentTime - lastHealthLogTime >= interval && !batchInFlight) {
+      if (!uploadHealthLog()) {
+        samples.persist();  // 断网/队列满：分钟记录写入NVS
+      }
       lastHealthLogTime = currentTime;
     }
   }
 
-  // 立即上传健康度日志
+  // setup()结束时调用：基线日志（含启动耗时、复位前日志）在WiFi连接后由loop()发送
+  void scheduleBaselineUpload() {
+    baselinePending = true;
+  }
+
+  // 计划内重启前调用：未上传的分钟记录写入NVS
+  void persistSamples() {
+    samples.persist();
+  }
+
+  // loop()每次迭代结束时调用
+  void recordLoopTime(unsigned long ms) {
+    if (ms > loopMaxMsThisMinute) loopMaxMsThisMinute = ms > 65535 ? 65535 : (uint16_t)ms;
+  }
+
+  // 立即上传健康度日志：在loop()中生成JSON快照，交给网络任务发送
   bool uploadHealthLog() {
     // 更新健康度指标
     healthMetrics.update();
 
-    Serial.println("\n📊 正在上传健康度日志...");
-
     // 检查WiFi连接
     if (!WiFi.isConnected()) {
       Serial.println("❌ WiFi未连接，跳过健康度日志上传");
       return false;
     }
 
-    HTTPClient http;
-    String url = config.getSupabaseURL() + "/rest/v1/system_health_logs";
+    // 上一条还在发送：请求体缓冲区仍被网络任务使用
+    if (completedUploads != submittedUploads) {
+      Serial.println("⚠️ 上一条健康度日志还在发送，跳过");
+      return false;
+    }
 
-    http.begin(url);
-    String apiKey = config.getSupabaseKey();
-    http.addHeader("apikey", apiKey.c_str());
-    http.addHeader("Authorization", ("Bearer " + apiKey).c_str());
-    http.addHeader("Content-Type", "application/json");
-    http.addHeader("Prefer", "return=minimal");
+    payloadLength = buildHealthLogJSON();
+    if (payloadLength == 0) {
+      return false;
+    }
+    uint32_t upload = submittedUploads + 1;
+    if (batchCount > 0) {
+      batchUpload = upload;
+      batchResult = 0;
+      batchInFlight = true;
+    }
+    if (!netSubmitHealthUpload()) {
+      batchInFlight = false;
+      return false;
+    }
+    submittedUploads = upload;
+    healthMetrics.postMortemLog = "";  // 复位前日志只上传一次
+    bootReportSent = true;             // 启动耗时同样只上传一次
+    latencyTrace.reset();              // 耗时直方图按上传周期统计
+    return true;
+  }
 
-    String jsonPayload = buildHealthLogJSON();
+  // 发送健康度日志（仅在网络任务中调用）
+  bool postHealthLog() {
+    Serial.println("\n📊 正在上传健康度日志...");
 
     Serial.println("   设备ID: " + getDeviceId());
     Serial.println("   运行时长: " + String(healthMetrics.uptimeSeconds / 3600.0, 1) + " 小时");
     Serial.println("   剩余内存: " + String(healthMetrics.freeHeap / 1024) + " KB");
     Serial.println("   NFC成功率: " + String(healthMetrics.getNFCSuccessRate(), 1) + "%");
 
-    int httpCode = http.POST(jsonPayload);
+    String response;
+    int httpCode = supabase.post("/rest/v1/system_health_logs", payload, payloadLength, "return=minimal", &response);
 
     bool success = false;
     if (httpCode == 201 || httpCode == 200) {
@@ -158,22 +385,26 @@ public:
       Serial.println("❌ 健康度日志上传失败");
       Serial.println("   HTTP Code: " + String(httpCode));
       if (httpCode > 0) {
-        String response = http.getString();
         Serial.println("   Response: " + response);
       } else {
-        Serial.println("   Error: " + http.errorToString(httpCode));
+        Serial.println("   Error: " + HTTPClient::errorToString(httpCode));
       }
     }
 
-    http.end();
+    completedUploads++;
+    if (completedUploads == batchUpload) {
+      batchResult = success ? 1 : 2;
+    }
     return success;
   }
 
   // 记录错误
   void recordError(const String& error) {
+    HEAP_SITE(HEAP_SITE_ERROR_TEXT, error.length());
     healthMetrics.lastError = error;
-    healthMetrics.errorCountLast30Min++;
     healthMetrics.lastErrorTime = millis();
+    errorsByMinute.add(currentMinute());
+    healthMetrics.errorCountLast30Min = errorsByMinute.sum(currentMinute());
   }
 
   // 记录NFC读卡成功
@@ -181,34 +412,31 @@ public:
     healthMetrics.nfcReadSuccessCount++;
     healthMetrics.nfcLastReadSuccess = true;
     healthMetrics.nfcLastActiveTime = millis();
+    nfcOkThisMinute++;
   }
 
   // 记录NFC读卡失败
   void recordNFCFailure() {
     healthMetrics.nfcReadFailCount++;
     healthMetrics.nfcLastReadSuccess = false;
+    nfcFailThisMinute++;
   }
 
-  // 记录交易
+  // 记录交易（网络任务中调用）
   void recordTransaction() {
     healthMetrics.totalTransactions++;
-    healthMetrics.transactionsLastHour++;
     healthMetrics.lastTransactionTime = millis();
+    transactionsByMinute.add(currentMinute());
   }
 
-  // 重置30分钟错误计数
-  void resetErrorCount30Min() {
-    healthMetrics.errorCountLast30Min = 0;
-  }
-
-  // 重置最近1小时交易计数
-  void resetTransactionCountLastHour() {
-    healthMetrics.transactionsLastHour = 0;
+  // 打印当前健康度状态（用于调试）
+  void printJsonPoolStats() {
+    jsonPool.printStats("健康度日志");
   }
 
-  // 打印当前健康度状态（用于调试）
   void printStatus() {
     healthMetrics.update();
+    refreshWindowCounters();
 
     Serial.println("\n╔════════════════════════════════════════════════╗");
     Serial.println("║           系统健康度状态报告                   ║");
@@ -219,6 +447,9 @@ public:
     Serial.println("   剩余堆内存: " + String(healthMetrics.freeHeap / 1024) + " KB");
     Serial.println("   最小堆内存: " + String(healthMetrics.minFreeHeap / 1024) + " KB");
     Serial.println("   堆使用率: " + String(healthMetrics.getHeapUsagePercent(), 1) + "%");
+    Serial.println("   最大空闲块: " + String(healthMetrics.maxAllocHeap / 1024) + " KB（最低 " +
+                   String(healthMetrics.minMaxAllocHeap / 1024) + " KB）, 碎片率 " +
+                   String(HeapMonitor::fragPercent(healthMetrics.freeHeap, healthMetrics.maxAllocHeap)) + "%");
     Serial.println("\n📡 WiFi 状态:");
     Serial.println("   连接状态: " + String(healthMetrics.wifiConnected ? "已连接" : "未连接"));
     Serial.println("   信号强度: " + String(healthMetrics.wifiRSSI) + " dBm");
@@ -237,11 +468,19 @@ public:
     Serial.println("   总交易数: " + String(healthMetrics.totalTransactions));
     Serial.println("   最近1小时: " + String(healthMetrics.transactionsLastHour) + " 笔");
     Serial.println("\n⚙️ 系统状态:");
-    Serial.println("   当前状态: " + healthMetrics.currentState);
+    char states[48];
+    formatStates(states, sizeof(states));
+    Serial.println("   当前状态: " + String(states));
     Serial.println("   循环耗时: " + String(healthMetrics.loopExecutionTimeMs) + " ms");
     Serial.println("\n⚠️ 错误统计:");
     Serial.println("   最后错误: " + (healthMetrics.lastError.length() > 0 ? healthMetrics.lastError : "无"));
     Serial.println("   最近30分钟: " + String(healthMetrics.errorCountLast30Min) + " 次错误");
+    Serial.println("\n🗂️ 分钟记录:");
+    Serial.println("   未上传: " + String(samples.unsentCount()) + " 条" +
+                   (batchInFlight ? "（上传中）" : "") +
+                   ", NVS中: " + String(samples.getPersisted()) + " 条" +
+                   ", 缓冲区满丢弃: " + String(samples.getDropped()) + " 条");
+    Serial.println("   启动序号: " + String(samples.getBoot()));
     Serial.println("════════════════════════════════════════════════\n");
   }
 };
@@ -0,0 +1,258 @@
+/*
+ * HealthSampler.h - 每分钟健康度采样（环形缓冲区 + 批量上传 + 断电保留）
+ *
+ * 功能：
+ * - 每分钟一条24字节的定长记录（堆内存、最大空闲块、信号、各计数、loop最长耗时……），存在RAM环形缓冲区
+ * - 健康度日志上传时把未上传的记录按列打包（samples），分钟/启动序号/堆/最大空闲块/信号按差分编码，
+ *   一次请求带上整个周期的分钟数据（格式见 supabase/005_health_samples.sql，
+ *   v2 增加 blk 列，见 007_health_heap_fragmentation.sql）
+ * - 上传失败或断网时把未上传记录写入NVS（每个上传周期最多写一次），重启后恢复继续上传
+ *   （升级前保存的v1记录在启动时转换）
+ * - MinuteCounter：按分钟分桶的计数，最近N分钟的合计随时间滚动（最近1小时交易、30分钟错误）
+ *
+ * 线程安全：HealthSampleRing 只在 loop() 中使用；MinuteCounter 用自旋锁（网络任务也会记录交易）
+ *
+ * 版本: v1.0
+ */
+
+#ifndef HEALTH_SAMPLER_H
+#define HEALTH_SAMPLER_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "HeapMonitor.h"
+
+// =================== 采样配置 ===================
+#define HEALTH_SAMPLE_RING_SIZE 180      // RAM中保留的分钟记录（3小时，4.3KB）
+#define HEALTH_BATCH_MAX_SAMPLES 60      // 每次上传最多带的记录数（积压时分多次上传）
+#define HEALTH_PERSIST_MAX_SAMPLES 120   // NVS中最多保留的未上传记录（2.9KB）
+#define HEALTH_SAMPLES_JSON_MAX 3328     // 打包后的samples JSON上限
+#define HEALTH_SAMPLE_NAMESPACE "health"
+#define HEALTH_SAMPLE_VERSION 2
+#define HEALTH_SAMPLE_V1_SIZE 20         // v1记录（没有 maxBlockKb）
+
+#define HEALTH_FLAG_WIFI 0x01
+#define HEALTH_FLAG_NFC  0x02
+#define HEALTH_FLAG_OLED 0x04
+
+// =================== 分钟记录 ===================
+struct HealthSample {
+  uint32_t minute;          // 启动后第几分钟
+  uint16_t boot;            // 启动序号（NVS计数，区分重启前后的记录）
+  uint16_t freeHeapKb;
+  uint16_t minFreeHeapKb;   // 启动以来的最低值
+  uint16_t loopMaxMs;       // 本分钟loop最长耗时
+  int8_t rssi;
+  uint8_t flags;            // HEALTH_FLAG_*
+  uint8_t state;            // 本分钟结束时的状态
+  uint8_t transactions;     // 以下为本分钟计数（255封顶）
+  uint8_t nfcOk;
+  uint8_t nfcFail;
+  uint8_t errors;
+  uint8_t offlinePending;   // 离线队列积压（255封顶）
+  uint16_t maxBlockKb;      // 最大空闲块（v2）
+  uint8_t reserved[2];
+};
+
+static_assert(sizeof(HealthSample) == 24, "HealthSample 必须为24字节");
+static_assert(offsetof(HealthSample, maxBlockKb) == HEALTH_SAMPLE_V1_SIZE, "v1记录必须是v2记录的前缀");
+
+// =================== 分钟计数窗口 ===================
+template <int N>
+class MinuteCounter {
+private:
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+  uint32_t minutes[N];
+  uint16_t counts[N];
+
+public:
+  MinuteCounter() {
+    memset(minutes, 0xFF, sizeof(minutes));
+    memset(counts, 0, sizeof(counts));
+  }
+
+  void add(uint32_t minute, uint16_t n = 1) {
+    int slot = minute % N;
+    portENTER_CRITICAL(&mux);
+    if (minutes[slot] != minute) {
+      minutes[slot] = minute;
+      counts[slot] = 0;
+    }
+    counts[slot] += n;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  uint16_t countAt(uint32_t minute) {
+    int slot = minute % N;
+    portENTER_CRITICAL(&mux);
+    uint16_t n = minutes[slot] == minute ? counts[slot] : 0;
+    portEXIT_CRITICAL(&mux);
+    return n;
+  }
+
+  // 最近N分钟（含当前分钟）的合计
+  uint32_t sum(uint32_t now) {
+    uint32_t total = 0;
+    portENTER_CRITICAL(&mux);
+    for (int i = 0; i < N; i++) {
+      if (minutes[i] != 0xFFFFFFFF && now - minutes[i] < (uint32_t)N) total += counts[i];
+    }
+    portEXIT_CRITICAL(&mux);
+    return total;
+  }
+};
+
+// =================== 记录缓冲区 ===================
+class HealthSampleRing {
+private:
+  HealthSample ring[HEALTH_SAMPLE_RING_SIZE];
+  uint32_t headSeq = 0;        // 下一条记录的序号
+  uint32_t unsentSeq = 0;      // 最旧的未上传记录
+  uint32_t droppedCount = 0;   // 缓冲区写满时丢弃的未上传记录
+  uint32_t persistedCount = 0; // NVS中的记录数（0=NVS中没有）
+  uint32_t persistedHeadSeq = 0;
+  uint16_t boot = 0;
+  Preferences store;
+
+  const HealthSample& at(uint32_t seq) const {
+    return ring[seq % HEALTH_SAMPLE_RING_SIZE];
+  }
+
+  // 差分编码的列：分钟、启动序号、堆、最低堆、最大空闲块、信号
+  static int32_t column(const HealthSample& s, int col) {
+    switch (col) {
+      case 0:  return (int32_t)s.minute;
+      case 1:  return s.boot;
+      case 2:  return s.freeHeapKb;
+      case 3:  return s.minFreeHeapKb;
+      case 4:  return s.maxBlockKb;
+      case 5:  return s.rssi;
+      case 6:  return s.loopMaxMs;
+      case 7:  return s.transactions;
+      case 8:  return s.nfcOk;
+      case 9:  return s.nfcFail;
+      case 10: return s.errors;
+      case 11: return s.offlinePending;
+      case 12: return s.state;
+      default: return s.flags;
+    }
+  }
+
+  static const int COLUMN_COUNT = 14;
+  static const int DELTA_COLUMNS = 6;   // 前6列差分编码
+
+  static const char* columnName(int col) {
+    static const char* NAMES[COLUMN_COUNT] = {
+      "m", "b", "heap", "min_heap", "blk", "rssi", "loop_ms", "tx",
+      "nfc_ok", "nfc_fail", "err", "offline", "st", "f"
+    };
+    return NAMES[col];
+  }
+
+  size_t encode(uint32_t firstSeq, int count, uint32_t nowMinute, char* out, size_t size) const {
+    size_t length = snprintf(out, size, "{\"v\":%d,\"n\":%d,\"now_m\":%lu,\"now_b\":%u",
+                             HEALTH_SAMPLE_VERSION, count, (unsigned long)nowMinute, boot);
+    for (int col = 0; col < COLUMN_COUNT && length < size; col++) {
+      length += snprintf(out + length, size - length, ",\"%s\":[", columnName(col));
+      int32_t previous = 0;
+      for (int i = 0; i < count && length < size; i++) {
+        int32_t value = column(at(firstSeq + i), col);
+        int32_t encoded = col < DELTA_COLUMNS && i > 0 ? value - previous : value;
+        previous = value;
+        length += snprintf(out + length, size - length, i > 0 ? ",%ld" : "%ld", (long)encoded);
+      }
+      if (length < size) length += snprintf(out + length, size - length, "]");
+    }
+    if (length < size) length += snprintf(out + length, size - length, "}");
+    return length;
+  }
+
+public:
+  // 启动时调用：启动序号+1，恢复上次未上传的记录
+  void begin() {
+    store.begin(HEALTH_SAMPLE_NAMESPACE, false);
+    boot = (uint16_t)(store.getUInt("boots", 0) + 1);
+    store.putUInt("boots", boot);
+
+    size_t bytes = store.getBytesLength("pending");
+    uint8_t version = store.getUChar("version", 0);
+    size_t recordSize = version == 1 ? HEALTH_SAMPLE_V1_SIZE : sizeof(HealthSample);
+    if ((version == 1 || version == HEALTH_SAMPLE_VERSION) && bytes > 0 &&
+        bytes % recordSize == 0 && bytes <= HEALTH_PERSIST_MAX_SAMPLES * recordSize) {
+      store.getBytes("pending", ring, bytes);   // 环形缓冲区为空，直接从头放入
+      persistedCount = bytes / recordSize;
+      if (version == 1) {
+        // v1记录是v2的前缀：从后往前就地展开（目标位置不小于源位置，不会覆盖未处理的记录）
+        for (int i = (int)persistedCount - 1; i >= 0; i--) {
+          memmove(&ring[i], (uint8_t*)ring + i * HEALTH_SAMPLE_V1_SIZE, HEALTH_SAMPLE_V1_SIZE);
+          ring[i].maxBlockKb = 0;
+          memset(ring[i].reserved, 0, sizeof(ring[i].reserved));
+        }
+      }
+      headSeq = persistedCount;
+      persistedHeadSeq = headSeq;
+    }
+  }
+
+  uint16_t getBoot() const { return boot; }
+  uint32_t unsentCount() const { return headSeq - unsentSeq; }
+  uint32_t getDropped() const { return droppedCount; }
+  uint32_t getPersisted() const { return persistedCount; }
+
+  void push(const HealthSample& sample) {
+    ring[headSeq % HEALTH_SAMPLE_RING_SIZE] = sample;
+    headSeq++;
+    if (headSeq - unsentSeq > HEALTH_SAMPLE_RING_SIZE) {
+      unsentSeq = headSeq - HEALTH_SAMPLE_RING_SIZE;
+      droppedCount++;
+    }
+  }
+
+  // 打包最旧的未上传记录（最多HEALTH_BATCH_MAX_SAMPLES条，放不下时减半）
+  // 返回打包的条数，endSeq为上传成功后传给ack()的序号
+  int encodeBatch(uint32_t nowMinute, char* out, size_t size, uint32_t& endSeq) const {
+    int count = (int)min(unsentCount(), (uint32_t)HEALTH_BATCH_MAX_SAMPLES);
+    while (count > 0 && encode(unsentSeq, count, nowMinute, out, size) >= size) {
+      count /= 2;
+    }
+    if (count == 0 && size > 0) out[0] = '\0';
+    endSeq = unsentSeq + count;
+    return count;
+  }
+
+  // 上传成功：确认到endSeq为止的记录；NVS中的副本随之更新
+  void ack(uint32_t endSeq) {
+    if ((int32_t)(endSeq - unsentSeq) > 0) unsentSeq = endSeq;
+    if (persistedCount > 0) persist();
+  }
+
+  // 把未上传的记录（最新的HEALTH_PERSIST_MAX_SAMPLES条）写入NVS；全部已上传时删除
+  void persist() {
+    uint32_t count = min(unsentCount(), (uint32_t)HEALTH_PERSIST_MAX_SAMPLES);
+    if (count == 0) {
+      if (persistedCount > 0) store.remove("pending");
+      persistedCount = 0;
+      return;
+    }
+    if (count == persistedCount && headSeq == persistedHeadSeq) return;  // 上次写入后没有变化
+
+    // 环形缓冲区可能回绕，先复制成连续的数组（只在上传失败时执行）
+    HealthSample* buffer = (HealthSample*)malloc(count * sizeof(HealthSample));
+    if (buffer == NULL) return;
+    HEAP_SITE(HEAP_SITE_SAMPLE_PERSIST, count * sizeof(HealthSample));
+    uint32_t first = headSeq - count;
+    for (uint32_t i = 0; i < count; i++) buffer[i] = at(first + i);
+    store.putBytes("pending", buffer, count * sizeof(HealthSample));
+    store.putUChar("version", HEALTH_SAMPLE_VERSION);
+    free(buffer);
+    persistedCount = count;
+    persistedHeadSeq = headSeq;
+  }
+
+  // 最近一条记录（没有则返回NULL）
+  const HealthSample* latest() const {
+    return headSeq > 0 ? &at(headSeq - 1) : NULL;
+  }
+};
+
+#endif // HEALTH_SAMPLER_H
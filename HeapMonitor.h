@@ -0,0 +1,180 @@
+/*
+ * HeapMonitor.h - 堆内存碎片监测
+ *
+ * 功能：
+ * - 采样剩余堆和最大空闲块（分配失败取决于最大空闲块，不只是剩余总量），
+ *   碎片率 = 1 - 最大空闲块/剩余堆；记录启动以来的最小空闲块和最高碎片率
+ * - 分配失败计数（heap_caps_register_failed_alloc_callback），记录最近一次失败的大小
+ * - 空闲检查点：所有洗车位回到欢迎页（resetToWelcome）时记录一次，交易路径的临时内存
+ *   都来自固定缓冲区（JsonPool、SupabaseClient请求体、视图模型），长期运行下空闲时的堆应保持平坦
+ * - 分配点统计（config.h HEAP_SITE_STATS，默认关闭）：按分配点统计仍在使用堆的代码（次数/字节），
+ *   在分配处写 HEAP_SITE(HEAP_SITE_xxx, 字节数)，关闭时编译为空
+ * - 随健康度日志上传（max_alloc_heap 等，见 supabase/007_health_heap_fragmentation.sql），串口命令 heap 查看
+ *
+ * 线程安全：分配失败回调在分配所在的任务中执行，分配点计数在loop()和网络任务中记录，用自旋锁保护；
+ *           采样和检查点只在 loop() 中调用
+ *
+ * 版本: v1.0
+ */
+
+#ifndef HEAP_MONITOR_H
+#define HEAP_MONITOR_H
+
+#include <Arduino.h>
+#include <esp_heap_caps.h>
+#include "config.h"
+
+// =================== 分配点 ===================
+enum HeapSite {
+  HEAP_SITE_HTTP_REQUEST,    // HTTPClient每次请求的URL/请求头（库内部String）
+  HEAP_SITE_HTTP_RESPONSE,   // 健康度日志上传的响应文本
+  HEAP_SITE_SAMPLE_PERSIST,  // 分钟记录写入NVS前的临时数组（上传失败时）
+  HEAP_SITE_ERROR_TEXT,      // 健康度指标的最后错误文本
+  HEAP_SITE_COUNT
+};
+
+struct HeapSnapshot {
+  uint32_t freeBytes;
+  uint32_t largestBlock;
+  uint8_t fragPercent;
+};
+
+class HeapMonitor {
+private:
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+  // 启动以来（loop()中采样）
+  uint32_t minLargestBlock = UINT32_MAX;
+  uint8_t maxFragPercent = 0;
+
+  // 空闲检查点
+  uint32_t idleCount = 0;
+  HeapSnapshot lastIdle = {};
+  uint32_t minIdleLargestBlock = UINT32_MAX;
+
+  // 分配失败（回调中记录）
+  uint32_t failedAllocs = 0;
+  uint32_t lastFailedSize = 0;
+
+  // 分配点（HEAP_SITE_STATS）
+  uint32_t siteCalls[HEAP_SITE_COUNT];
+  uint32_t siteBytes[HEAP_SITE_COUNT];
+
+  static const char* siteName(int site) {
+    static const char* NAMES[HEAP_SITE_COUNT] = {
+      "http_request", "http_response", "sample_persist", "error_text"
+    };
+    return site >= 0 && site < HEAP_SITE_COUNT ? NAMES[site] : "unknown";
+  }
+
+  static void onAllocFailed(size_t size, uint32_t caps, const char* functionName);
+
+public:
+  HeapMonitor() {
+    memset(siteCalls, 0, sizeof(siteCalls));
+    memset(siteBytes, 0, sizeof(siteBytes));
+  }
+
+  void begin() {
+    heap_caps_register_failed_alloc_callback(onAllocFailed);
+    sample();
+  }
+
+  static uint8_t fragPercent(uint32_t freeBytes, uint32_t largestBlock) {
+    if (freeBytes == 0 || largestBlock >= freeBytes) return 0;
+    return (uint8_t)(100 - (uint64_t)largestBlock * 100 / freeBytes);
+  }
+
+  static HeapSnapshot read() {
+    HeapSnapshot s;
+    s.freeBytes = ESP.getFreeHeap();
+    s.largestBlock = ESP.getMaxAllocHeap();
+    s.fragPercent = fragPercent(s.freeBytes, s.largestBlock);
+    return s;
+  }
+
+  // 读取当前值并更新启动以来的极值
+  HeapSnapshot sample() {
+    HeapSnapshot s = read();
+    if (s.largestBlock < minLargestBlock) minLargestBlock = s.largestBlock;
+    if (s.fragPercent > maxFragPercent) maxFragPercent = s.fragPercent;
+    return s;
+  }
+
+  // 所有洗车位回到欢迎页时调用
+  void checkpoint() {
+    lastIdle = sample();
+    idleCount++;
+    if (lastIdle.largestBlock < minIdleLargestBlock) minIdleLargestBlock = lastIdle.largestBlock;
+  }
+
+  void recordAllocFailure(size_t size) {
+    portENTER_CRITICAL(&mux);
+    failedAllocs++;
+    lastFailedSize = size;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  void countSite(HeapSite site, size_t bytes) {
+    portENTER_CRITICAL(&mux);
+    siteCalls[site]++;
+    siteBytes[site] += bytes;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  uint32_t getMinLargestBlock() const { return minLargestBlock == UINT32_MAX ? 0 : minLargestBlock; }
+  uint8_t getMaxFragPercent() const { return maxFragPercent; }
+  uint32_t getFailedAllocs() const { return failedAllocs; }
+
+  void printStatus() {
+    HeapSnapshot now = sample();
+    portENTER_CRITICAL(&mux);
+    uint32_t failed = failedAllocs;
+    uint32_t failedSize = lastFailedSize;
+    portEXIT_CRITICAL(&mux);
+
+    Serial.println("\n=== 堆内存 ===");
+    Serial.printf("当前: 剩余 %u KB, 最大空闲块 %u KB, 碎片率 %u%%\n", now.freeBytes / 1024,
+                  now.largestBlock / 1024, now.fragPercent);
+    Serial.printf("启动以来: 最低剩余 %u KB, 最小空闲块 %u KB, 最高碎片率 %u%%\n",
+                  ESP.getMinFreeHeap() / 1024, getMinLargestBlock() / 1024, maxFragPercent);
+    if (idleCount > 0) {
+      Serial.printf("空闲检查点: %u 次, 最近 剩余 %u KB / 最大空闲块 %u KB, 最小空闲块 %u KB\n", idleCount,
+                    lastIdle.freeBytes / 1024, lastIdle.largestBlock / 1024, minIdleLargestBlock / 1024);
+    } else {
+      Serial.println("空闲检查点: 无（还没有完成的会话）");
+    }
+    Serial.printf("分配失败: %u 次", failed);
+    if (failed > 0) Serial.printf("（最近一次 %u 字节）", failedSize);
+    Serial.println();
+
+#if HEAP_SITE_STATS
+    Serial.println("分配点            次数        字节");
+    for (int i = 0; i < HEAP_SITE_COUNT; i++) {
+      portENTER_CRITICAL(&mux);
+      uint32_t calls = siteCalls[i];
+      uint32_t bytes = siteBytes[i];
+      portEXIT_CRITICAL(&mux);
+      Serial.printf("  %-16s %6u %10u\n", siteName(i), calls, bytes);
+    }
+#else
+    Serial.println("分配点统计: 未开启（config.h HEAP_SITE_STATS）");
+#endif
+    Serial.println("==============\n");
+  }
+};
+
+extern HeapMonitor heapMonitor;  // GoldSky_Lite.ino
+
+// 不能分配内存或输出日志：只计数
+inline void HeapMonitor::onAllocFailed(size_t size, uint32_t caps, const char* functionName) {
+  heapMonitor.recordAllocFailure(size);
+}
+
+#if HEAP_SITE_STATS
+#define HEAP_SITE(site, bytes) heapMonitor.countSite(site, bytes)
+#else
+#define HEAP_SITE(site, bytes) ((void)0)
+#endif
+
+#endif // HEAP_MONITOR_H
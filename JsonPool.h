@@ -0,0 +1,118 @@
+/*
+ * JsonPool.h - JsonDocument 固定内存池
+ *
+ * 功能：
+ * - ArduinoJson 7 的自定义分配器：从静态数组顺序分配，不使用堆
+ * - 文档释放后（存活块数归零）整块回收；最后一块可原地扩展/回退
+ * - 统计峰值占用、分配次数和分配失败次数（失败时文档 overflowed()）
+ *
+ * 说明：
+ * - 每个任务使用自己的内存池（网络任务、loop()），不加锁
+ * - 同时存活的文档共用一个内存池，全部释放后才回收
+ *
+ * 版本: v1.0
+ */
+
+#ifndef JSON_POOL_H
+#define JSON_POOL_H
+
+#include <Arduino.h>
+#include <ArduinoJson.h>
+
+template <size_t CAPACITY>
+class JsonPool : public ArduinoJson::Allocator {
+private:
+  static const size_t HEADER = 8;   // 块头：块大小（8字节对齐）
+
+  alignas(8) uint8_t arena[CAPACITY];
+  size_t used = 0;
+  uint8_t* lastBlock = NULL;        // 最后分配的块（可原地扩展）
+  int liveBlocks = 0;
+
+  size_t peak = 0;
+  uint32_t allocCount = 0;
+  uint32_t failCount = 0;
+
+  static size_t alignUp(size_t n) { return (n + 7) & ~(size_t)7; }
+
+  static uint32_t& blockSize(void* p) {
+    return *(uint32_t*)((uint8_t*)p - HEADER);
+  }
+
+  void notePeak() {
+    if (used > peak) peak = used;
+  }
+
+public:
+  void* allocate(size_t size) override {
+    size_t need = HEADER + alignUp(size);
+    if (used + need > CAPACITY) {
+      failCount++;
+      return NULL;
+    }
+
+    uint8_t* p = arena + used + HEADER;
+    blockSize(p) = size;
+    used += need;
+    lastBlock = p;
+    liveBlocks++;
+    allocCount++;
+    notePeak();
+    return p;
+  }
+
+  void deallocate(void* p) override {
+    if (p == NULL) return;
+    liveBlocks--;
+    if (p == lastBlock) {
+      used = (uint8_t*)p - HEADER - arena;
+      lastBlock = NULL;
+    }
+    if (liveBlocks <= 0) {
+      liveBlocks = 0;
+      used = 0;
+      lastBlock = NULL;
+    }
+  }
+
+  void* reallocate(void* p, size_t size) override {
+    if (p == NULL) return allocate(size);
+
+    // 最后一块：原地扩展或缩小
+    if (p == lastBlock) {
+      size_t end = (uint8_t*)p - arena + alignUp(size);
+      if (end > CAPACITY) {
+        failCount++;
+        return NULL;
+      }
+      blockSize(p) = size;
+      used = end;
+      notePeak();
+      return p;
+    }
+
+    void* q = allocate(size);
+    if (q == NULL) return NULL;
+    memcpy(q, p, min((size_t)blockSize(p), size));
+    deallocate(p);
+    return q;
+  }
+
+  size_t capacity() const { return CAPACITY; }
+  size_t usedBytes() const { return used; }
+  size_t peakBytes() const { return peak; }
+  uint32_t failures() const { return failCount; }
+
+  void resetPeak() {
+    peak = used;
+    allocCount = 0;
+    failCount = 0;
+  }
+
+  void printStats(const char* name) {
+    Serial.printf("JSON内存池(%s): 峰值 %u/%u 字节, 当前 %u, 分配 %u 次, 失败 %u 次\n",
+                  name, (unsigned)peak, (unsigned)CAPACITY, (unsigned)used, allocCount, failCount);
+  }
+};
+
+#endif // JSON_POOL_H
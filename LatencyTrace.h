@@ -0,0 +1,186 @@
+/*
+ * LatencyTrace.h - 刷卡→洗车各阶段耗时直方图
+ *
+ * 功能：
+ * - 交易路径上每个阶段记录一次耗时：检测卡片、读UID、查卡(GET)、更新余额(PATCH)、
+ *   写交易(POST)、RPC扣费，以及刷卡→显示结果、刷卡→第一个脉冲
+ * - 按固定的对数分桶累计（不保存单次样本，内存固定），从分桶估算 p50/p95/p99
+ * - 随健康度日志上传本周期的直方图（latency_histograms，见 supabase/004_health_latency.sql），
+ *   上传后清零；串口命令 latency 查看
+ *
+ * 用于区分"刷卡没反应"的原因：射频（检测/读UID）、网络（请求耗时）还是服务器
+ *
+ * 线程安全：loop()（读卡/授权/脉冲）和网络任务（HTTP请求）都会记录，用自旋锁保护
+ *
+ * 版本: v1.0
+ */
+
+#ifndef LATENCY_TRACE_H
+#define LATENCY_TRACE_H
+
+#include <Arduino.h>
+
+// =================== 阶段 ===================
+enum LatencySpan {
+  SPAN_NFC_DETECT,      // 检测卡片：轮询REQA应答，或IRQ触发到loop处理
+  SPAN_NFC_UID,         // 防冲突+选卡读取UID
+  SPAN_CARD_GET,        // 查询卡片 GET jc_vip_cards
+  SPAN_BALANCE_PATCH,   // 更新余额 PATCH jc_vip_cards（三步扣费）
+  SPAN_TX_POST,         // 写交易 POST jc_transaction_history（三步扣费）
+  SPAN_DEBIT_RPC,       // 单次请求扣费 rpc/jc_debit_card
+  SPAN_TAP_TO_RESULT,   // 刷卡→显示结果（Paid!/拒绝/网络忙）
+  SPAN_TAP_TO_PULSE,    // 刷卡→第一个脉冲上升沿（含Paid!和Ready页停留）
+  SPAN_COUNT
+};
+
+// =================== 分桶 ===================
+// 上界（微秒），最后一个桶为 >20s
+#define LATENCY_BUCKET_COUNT 16
+static const uint32_t LATENCY_BUCKET_US[LATENCY_BUCKET_COUNT - 1] = {
+  500, 1000, 2000, 5000, 10000, 20000, 50000, 100000,
+  200000, 500000, 1000000, 2000000, 5000000, 10000000, 20000000
+};
+
+#define LATENCY_JSON_MAX 1536   // 全部阶段的直方图JSON（约1KB）
+
+struct LatencyHistogram {
+  uint32_t buckets[LATENCY_BUCKET_COUNT];
+  uint32_t count;
+  uint32_t maxUs;
+  uint64_t totalUs;
+
+  void clear() {
+    memset(this, 0, sizeof(*this));
+  }
+
+  void add(uint32_t us) {
+    int i = 0;
+    while (i < LATENCY_BUCKET_COUNT - 1 && us > LATENCY_BUCKET_US[i]) i++;
+    buckets[i]++;
+    count++;
+    totalUs += us;
+    if (us > maxUs) maxUs = us;
+  }
+
+  // 分位数（p = 0~1）：在所在桶内线性插值，不超过最大值
+  uint32_t percentileUs(float p) const {
+    if (count == 0) return 0;
+    uint32_t rank = (uint32_t)ceilf(p * count);
+    if (rank == 0) rank = 1;
+
+    uint32_t before = 0;
+    for (int i = 0; i < LATENCY_BUCKET_COUNT; i++) {
+      if (before + buckets[i] >= rank) {
+        uint32_t lower = i > 0 ? LATENCY_BUCKET_US[i - 1] : 0;
+        uint32_t upper = i < LATENCY_BUCKET_COUNT - 1 ? LATENCY_BUCKET_US[i] : maxUs;
+        if (upper > maxUs) upper = maxUs;
+        if (lower > upper) lower = upper;
+        float fraction = (float)(rank - before) / buckets[i];
+        return lower + (uint32_t)((upper - lower) * fraction);
+      }
+      before += buckets[i];
+    }
+    return maxUs;
+  }
+};
+
+// =================== 耗时记录 ===================
+class LatencyTrace {
+private:
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+  LatencyHistogram spans[SPAN_COUNT];
+  unsigned long windowStartMs = 0;
+
+  void snapshot(LatencyHistogram* out) {
+    portENTER_CRITICAL(&mux);
+    memcpy(out, spans, sizeof(spans));
+    portEXIT_CRITICAL(&mux);
+  }
+
+public:
+  LatencyTrace() {
+    memset(spans, 0, sizeof(spans));
+  }
+
+  static const char* spanName(int span) {
+    static const char* NAMES[SPAN_COUNT] = {
+      "nfc_detect", "nfc_uid", "card_get", "balance_patch",
+      "tx_post", "debit_rpc", "tap_to_result", "tap_to_pulse"
+    };
+    return span >= 0 && span < SPAN_COUNT ? NAMES[span] : "unknown";
+  }
+
+  void record(LatencySpan span, uint32_t us) {
+    portENTER_CRITICAL(&mux);
+    spans[span].add(us);
+    portEXIT_CRITICAL(&mux);
+  }
+
+  // 开始新的统计周期（健康度日志上传后调用）
+  void reset() {
+    portENTER_CRITICAL(&mux);
+    memset(spans, 0, sizeof(spans));
+    portEXIT_CRITICAL(&mux);
+    windowStartMs = millis();
+  }
+
+  // 本周期的直方图JSON，只包含有样本的阶段：
+  // {"card_get":{"n":12,"p50":95.2,"p95":..,"p99":..,"max":..,"b":[0,0,...]}, ...}
+  // 时间单位为毫秒，b为各桶计数（省略末尾的0）；没有样本时返回0
+  size_t toJson(char* out, size_t size) {
+    LatencyHistogram copy[SPAN_COUNT];
+    snapshot(copy);
+
+    size_t length = 0;
+    bool any = false;
+    for (int s = 0; s < SPAN_COUNT && length < size; s++) {
+      const LatencyHistogram& h = copy[s];
+      if (h.count == 0) continue;
+
+      length += snprintf(out + length, size - length,
+                         "%s\"%s\":{\"n\":%u,\"p50\":%.1f,\"p95\":%.1f,\"p99\":%.1f,\"max\":%.1f,\"b\":[",
+                         any ? "," : "{", spanName(s), h.count, h.percentileUs(0.50f) / 1000.0f,
+                         h.percentileUs(0.95f) / 1000.0f, h.percentileUs(0.99f) / 1000.0f,
+                         h.maxUs / 1000.0f);
+      int last = LATENCY_BUCKET_COUNT - 1;
+      while (last > 0 && h.buckets[last] == 0) last--;
+      for (int i = 0; i <= last && length < size; i++) {
+        length += snprintf(out + length, size - length, i > 0 ? ",%u" : "%u", h.buckets[i]);
+      }
+      if (length < size) length += snprintf(out + length, size - length, "]}");
+      any = true;
+    }
+    if (!any) {
+      if (size > 0) out[0] = '\0';
+      return 0;
+    }
+    if (length < size) length += snprintf(out + length, size - length, "}");
+    if (length >= size) {
+      out[0] = '\0';  // 缓冲区不足：不上传截断的JSON
+      return 0;
+    }
+    return length;
+  }
+
+  void printStatus() {
+    LatencyHistogram copy[SPAN_COUNT];
+    snapshot(copy);
+
+    Serial.println("\n=== 交易路径耗时 ===");
+    Serial.printf("统计周期: %lu 秒（健康度日志上传后清零）\n", (millis() - windowStartMs) / 1000);
+    Serial.println("阶段            次数      p50(ms)   p95(ms)   p99(ms)   最长(ms)");
+    for (int s = 0; s < SPAN_COUNT; s++) {
+      const LatencyHistogram& h = copy[s];
+      if (h.count == 0) {
+        Serial.printf("%-14s  %6u\n", spanName(s), 0u);
+        continue;
+      }
+      Serial.printf("%-14s  %6u  %9.1f %9.1f %9.1f %9.1f\n", spanName(s), h.count,
+                    h.percentileUs(0.50f) / 1000.0f, h.percentileUs(0.95f) / 1000.0f,
+                    h.percentileUs(0.99f) / 1000.0f, h.maxUs / 1000.0f);
+    }
+    Serial.println("====================\n");
+  }
+};
+
+#endif // LATENCY_TRACE_H
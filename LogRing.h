@@ -0,0 +1,253 @@
+/*
+ * LogRing.h - 异步日志（固定大小环形缓冲区 + 低优先级输出任务）
+ *
+ * 功能：
+ * - LOG_E/LOG_W/LOG_I/LOG_D/LOG_V(fmt, ...)：printf风格，级别不够时参数不求值、不格式化
+ * - 旧接口 logError/logWarn/logInfo/logDebug/logVerbose(String) 改为宏，
+ *   级别不够时不会拼接String（不再产生堆分配）
+ * - 低于 LOG_COMPILE_LEVEL 的日志在编译期被删除
+ * - 日志写入环形缓冲区后立即返回，由低优先级任务输出到串口（loop不再等待串口）
+ * - 环形缓冲区位于RTC_NOINIT内存，软复位（看门狗/异常/ESP.restart）后保留，
+ *   启动时取出上次运行的最后几条日志，随健康度日志上传
+ *
+ * 并发：
+ * - 写入无锁：原子递增取得序号，写完后发布槽位序号；多任务可同时写
+ * - 只有输出任务读取；读到正在写或已被覆盖的槽位时跳过并计入丢弃数
+ * - 缓冲区满时覆盖最旧的日志（输出任务跟不上时丢弃，不阻塞写入方）
+ *
+ * 版本: v1.0
+ */
+
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <Arduino.h>
+#include <esp_system.h>
+#include "config.h"
+
+#define LOG_RING_MAGIC 0x4C4F4752   // "LOGR"
+
+struct LogEntry {
+  volatile uint32_t seq;           // 写完后 = 序号+1；0 = 正在写
+  uint32_t timeMs;
+  uint8_t level;
+  char text[LOG_LINE_MAX];
+};
+
+// RTC_NOINIT内存中的环形缓冲区（约4KB）
+struct LogRingStore {
+  uint32_t magic;
+  uint32_t head;                   // 下一条日志的序号
+  uint32_t bootCount;
+  LogEntry entries[LOG_RING_SIZE];
+};
+
+class LogRing {
+private:
+  LogRingStore* store = NULL;
+  uint32_t readSeq = 0;            // 输出任务下一条要读的序号
+  uint32_t dropped = 0;
+  uint32_t printed = 0;
+  TaskHandle_t taskHandle = NULL;
+
+  char* postMortem = NULL;         // 上次运行的最后几条日志（启动时复制）
+  int postMortemLines = 0;
+  esp_reset_reason_t resetReason = ESP_RST_UNKNOWN;
+
+  static const char* levelName(uint8_t level) {
+    static const char* NAMES[] = {"NONE", "ERROR", "WARN", "INFO", "DEBUG", "VERBOSE"};
+    return level <= LOG_LEVEL_VERBOSE ? NAMES[level] : "?";
+  }
+
+  // 取出一条日志（只由输出任务调用）
+  bool readNext(LogEntry& out) {
+    uint32_t head = __atomic_load_n(&store->head, __ATOMIC_ACQUIRE);
+    if (readSeq == head) return false;
+
+    // 落后超过一圈：最旧的日志已被覆盖
+    if (head - readSeq > LOG_RING_SIZE) {
+      dropped += head - readSeq - LOG_RING_SIZE;
+      readSeq = head - LOG_RING_SIZE;
+    }
+
+    LogEntry& e = store->entries[readSeq % LOG_RING_SIZE];
+    uint32_t seq = e.seq;
+    if (seq == 0 || (int32_t)(seq - (readSeq + 1)) < 0) {
+      return false;  // 写入方还没写完，稍后再读
+    }
+    if (seq != readSeq + 1) {
+      dropped++;     // 已被更新的日志覆盖
+      readSeq++;
+      out.level = LOG_LEVEL_NONE;
+      return true;   // 继续读下一条
+    }
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    out.timeMs = e.timeMs;
+    out.level = e.level;
+    memcpy(out.text, e.text, LOG_LINE_MAX);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    readSeq++;
+    if (e.seq != seq) {
+      dropped++;     // 复制期间被覆盖
+      out.level = LOG_LEVEL_NONE;
+    }
+    return true;
+  }
+
+  // 启动时复制上次运行的最后几条日志
+  void capturePostMortem() {
+    uint32_t head = store->head;
+    uint32_t count = min((uint32_t)LOG_POST_MORTEM_LINES, min(head, (uint32_t)LOG_RING_SIZE));
+    if (count == 0) return;
+
+    size_t capacity = count * (LOG_LINE_MAX + 24);
+    postMortem = (char*)malloc(capacity);
+    if (postMortem == NULL) return;
+
+    size_t used = 0;
+    postMortem[0] = '\0';
+    for (uint32_t seq = head - count; seq != head; seq++) {
+      const LogEntry& e = store->entries[seq % LOG_RING_SIZE];
+      if (e.seq != seq + 1) continue;
+      char text[LOG_LINE_MAX];
+      memcpy(text, e.text, LOG_LINE_MAX);
+      text[LOG_LINE_MAX - 1] = '\0';
+      int n = snprintf(postMortem + used, capacity - used, "[%lu][%s] %s\n",
+                       (unsigned long)e.timeMs, levelName(e.level), text);
+      if (n < 0 || used + n >= capacity) break;
+      used += n;
+      postMortemLines++;
+    }
+  }
+
+  static void taskLoop(void* param) {
+    LogRing* self = static_cast<LogRing*>(param);
+    for (;;) {
+      if (!self->drain(LOG_DRAIN_BATCH)) {
+        vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+      }
+    }
+  }
+
+public:
+  // 启动时调用（在任何日志之前）；保留软复位前的日志
+  void begin(LogRingStore* s) {
+    store = s;
+    resetReason = esp_reset_reason();
+
+    bool retained = store->magic == LOG_RING_MAGIC && resetReason != ESP_RST_POWERON;
+    if (retained) {
+      store->bootCount++;
+      capturePostMortem();
+    } else {
+      memset(store, 0, sizeof(LogRingStore));
+      store->magic = LOG_RING_MAGIC;
+    }
+    readSeq = store->head;
+  }
+
+  void write(int level, const char* text) {
+    if (store == NULL) {
+      Serial.printf("[%lu][%s] %s\n", millis(), levelName(level), text);
+      return;
+    }
+
+    uint32_t seq = __atomic_fetch_add(&store->head, 1, __ATOMIC_RELAXED);
+    LogEntry& e = store->entries[seq % LOG_RING_SIZE];
+    e.seq = 0;
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    e.timeMs = millis();
+    e.level = (uint8_t)level;
+    strlcpy(e.text, text, LOG_LINE_MAX);  // 超长截断
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    e.seq = seq + 1;
+  }
+
+  void write(int level, const String& text) {
+    write(level, text.c_str());
+  }
+
+  __attribute__((format(printf, 3, 4)))
+  void writef(int level, const char* format, ...) {
+    char text[LOG_LINE_MAX];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    write(level, text);
+  }
+
+  // 输出最多maxLines条到串口，返回是否还有未输出的日志
+  bool drain(int maxLines) {
+    if (store == NULL) return false;
+
+    LogEntry e;
+    for (int i = 0; i < maxLines; i++) {
+      if (!readNext(e)) return false;
+      if (e.level == LOG_LEVEL_NONE) continue;
+      e.text[LOG_LINE_MAX - 1] = '\0';
+      Serial.printf("[%lu][%s] %s\n", (unsigned long)e.timeMs, levelName(e.level), e.text);
+      printed++;
+    }
+    return true;
+  }
+
+  void startTask() {
+    xTaskCreatePinnedToCore(taskLoop, "log", LOG_TASK_STACK_SIZE, this,
+                            LOG_TASK_PRIORITY, &taskHandle, LOG_TASK_CORE);
+  }
+
+  // 上次运行的最后几条日志（没有则返回NULL）
+  const char* getPostMortem() { return postMortem; }
+  int getPostMortemLines() { return postMortemLines; }
+  esp_reset_reason_t getResetReason() { return resetReason; }
+
+  // 上传后释放
+  void clearPostMortem() {
+    free(postMortem);
+    postMortem = NULL;
+    postMortemLines = 0;
+  }
+
+  void printStatus() {
+    uint32_t head = store ? store->head : 0;
+    Serial.printf("日志缓冲: %u 条 × %u 字节, 已写 %lu, 已输出 %u, 待输出 %lu, 丢弃 %u\n",
+                  LOG_RING_SIZE, LOG_LINE_MAX, (unsigned long)head, printed,
+                  (unsigned long)(head - readSeq), dropped);
+    Serial.printf("编译期最低级别: %d, 复位原因: %d, 软复位次数: %lu\n", LOG_COMPILE_LEVEL,
+                  (int)resetReason, (unsigned long)(store ? store->bootCount : 0));
+    if (postMortem != NULL) {
+      Serial.printf("上次运行的最后 %d 条日志（待上传）:\n%s", postMortemLines, postMortem);
+    }
+  }
+};
+
+// =================== 日志宏 ===================
+// 定义在 GoldSky_Lite.ino
+extern LogRing logRing;
+extern int CURRENT_LOG_LEVEL;
+
+#define LOG_ENABLED(level) ((level) <= LOG_COMPILE_LEVEL && (level) <= CURRENT_LOG_LEVEL)
+
+#define LOG_AT(level, ...) \
+  do { if (LOG_ENABLED(level)) logRing.writef((level), __VA_ARGS__); } while (0)
+
+#define LOG_E(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#define LOG_W(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#define LOG_I(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#define LOG_D(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#define LOG_V(...) LOG_AT(LOG_LEVEL_VERBOSE, __VA_ARGS__)
+
+// 旧接口：消息表达式只在级别允许时求值
+#define LOG_STR_AT(level, message) \
+  do { if (LOG_ENABLED(level)) logRing.write((level), (message)); } while (0)
+
+#define logError(message)   LOG_STR_AT(LOG_LEVEL_ERROR, message)
+#define logWarn(message)    LOG_STR_AT(LOG_LEVEL_WARN, message)
+#define logInfo(message)    LOG_STR_AT(LOG_LEVEL_INFO, message)
+#define logDebug(message)   LOG_STR_AT(LOG_LEVEL_DEBUG, message)
+#define logVerbose(message) LOG_STR_AT(LOG_LEVEL_VERBOSE, message)
+
+#endif // LOG_RING_H
@@ -0,0 +1,257 @@
+/*
+ * LoopProfiler.h - loop() 各子系统耗时剖析
+ *
+ * 功能：
+ * - 按子系统（WiFi检查、NFC调度、健康检查、离线同步、串口命令……）和状态处理函数统计：
+ *   调用次数、累计耗时、最长耗时、耗时分布（固定分桶）
+ * - 阻塞时间归属：ProfBlocked 包住 delay()/写NVS 等等待I/O的调用，
+ *   计入当前所在的子系统，用于区分"CPU忙"和"在等"
+ * - 时间戳用CPU周期计数器（一条指令），超过10秒的调用改用 millis()（周期计数32位，240MHz约18秒回绕）
+ * - 串口命令 perf / perf reset / perf every <秒> 查看
+ *
+ * 只在 loop() 任务中使用，不加锁
+ *
+ * 用法：
+ *   { ProfScope scope(loopProfiler, PROF_CHECK_WIFI); checkWiFi(); }
+ *   { ProfBlocked wait(loopProfiler); delay(500); }   // 在某个 ProfScope 内
+ *
+ * 版本: v1.0
+ */
+
+#ifndef LOOP_PROFILER_H
+#define LOOP_PROFILER_H
+
+#include <Arduino.h>
+#include "config.h"
+
+// =================== 统计项 ===================
+enum ProfSlot {
+  PROF_LOOP,            // loop()本次工作（不含末尾休眠）
+  PROF_SLEEP,           // loop()末尾休眠
+  PROF_CHECK_WIFI,
+  PROF_STATE_TIMEOUT,
+  PROF_HEALTH_CHECK,
+  PROF_NFC,             // serviceNFC（所有洗车位的读卡器，含NFC故障复位）
+  PROF_HEALTH_UPLOAD,
+  PROF_OFFLINE_SYNC,
+  PROF_CACHE_SAVE,
+  PROF_LEDS,
+  PROF_SERIAL,
+  PROF_STATE_BASE,      // 之后每个状态处理函数一项：PROF_STATE_BASE + state（各洗车位合计）
+  PROF_SLOT_COUNT = PROF_STATE_BASE + STATE_COUNT
+};
+
+// =================== 分桶 ===================
+// 上界（微秒），最后一个桶为 >200ms
+#define PROF_BUCKET_COUNT 13
+static const uint32_t PROF_BUCKET_US[PROF_BUCKET_COUNT - 1] = {
+  50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, 50000, 100000, 200000
+};
+
+#define PROF_MAX_DEPTH 4           // 嵌套层数（loop → 子系统 → ...）
+#define PROF_LONG_CALL_MS 10000    // 超过此时长改用millis()计时
+
+struct ProfStats {
+  uint32_t calls;
+  uint32_t maxUs;
+  uint64_t totalUs;
+  uint64_t blockedUs;
+  uint32_t buckets[PROF_BUCKET_COUNT];
+
+  void add(uint32_t us, uint32_t blocked) {
+    int i = 0;
+    while (i < PROF_BUCKET_COUNT - 1 && us > PROF_BUCKET_US[i]) i++;
+    buckets[i]++;
+    calls++;
+    totalUs += us;
+    blockedUs += blocked;
+    if (us > maxUs) maxUs = us;
+  }
+
+  // 分位数所在桶的上界（粗略，够判断量级）
+  uint32_t percentileBoundUs(float p) const {
+    if (calls == 0) return 0;
+    uint32_t rank = (uint32_t)ceilf(p * calls);
+    uint32_t seen = 0;
+    for (int i = 0; i < PROF_BUCKET_COUNT - 1; i++) {
+      seen += buckets[i];
+      if (seen >= rank) return PROF_BUCKET_US[i] < maxUs ? PROF_BUCKET_US[i] : maxUs;
+    }
+    return maxUs;
+  }
+};
+
+class LoopProfiler {
+private:
+  struct Frame {
+    uint8_t slot;
+    uint32_t startCycles;
+    unsigned long startMs;
+    uint32_t blockedUs;
+  };
+
+  ProfStats stats[PROF_SLOT_COUNT];
+  Frame stack[PROF_MAX_DEPTH];
+  int depth = 0;
+  uint32_t cyclesPerUs = 240;
+  unsigned long windowStartMs = 0;
+  unsigned long dumpIntervalMs = PERF_DUMP_INTERVAL_MS;
+  unsigned long lastDumpMs = 0;
+
+  static const char* slotName(int slot) {
+    static const char* NAMES[PROF_STATE_BASE] = {
+      "loop", "sleep", "checkWiFi", "stateTimeout", "healthCheck", "serviceNFC",
+      "healthUpload", "offlineSync", "cacheSave", "leds", "serial"
+    };
+    return slot >= 0 && slot < PROF_STATE_BASE ? NAMES[slot] : "unknown";
+  }
+
+public:
+  LoopProfiler() {
+    memset(stats, 0, sizeof(stats));
+  }
+
+  void begin() {
+    cyclesPerUs = ESP.getCpuFreqMHz();
+    if (cyclesPerUs == 0) cyclesPerUs = 240;
+    reset();
+  }
+
+  // 从调用时刻到现在的微秒数
+  uint32_t elapsedUs(uint32_t startCycles, unsigned long startMs) const {
+    unsigned long ms = millis() - startMs;
+    if (ms > PROF_LONG_CALL_MS) return ms * 1000;
+    return (ESP.getCycleCount() - startCycles) / cyclesPerUs;
+  }
+
+  void enter(int slot) {
+    if (depth >= PROF_MAX_DEPTH || slot < 0 || slot >= PROF_SLOT_COUNT) {
+      depth++;  // 仍然计数，保证 enter/exit 配对
+      return;
+    }
+    Frame& f = stack[depth++];
+    f.slot = (uint8_t)slot;
+    f.blockedUs = 0;
+    f.startMs = millis();
+    f.startCycles = ESP.getCycleCount();
+  }
+
+  void exit() {
+    if (depth == 0) return;
+    depth--;
+    if (depth >= PROF_MAX_DEPTH) return;
+
+    Frame& f = stack[depth];
+    uint32_t us = elapsedUs(f.startCycles, f.startMs);
+    uint32_t blocked = f.blockedUs < us ? f.blockedUs : us;
+    stats[f.slot].add(us, blocked);
+    if (depth > 0 && depth - 1 < PROF_MAX_DEPTH) {
+      stack[depth - 1].blockedUs += blocked;  // 外层的耗时包含内层的阻塞
+    }
+  }
+
+  // 阻塞时间计入当前最内层的统计项
+  void addBlocked(uint32_t us) {
+    if (depth > 0 && depth <= PROF_MAX_DEPTH) stack[depth - 1].blockedUs += us;
+  }
+
+  void reset() {
+    memset(stats, 0, sizeof(stats));
+    windowStartMs = millis();
+  }
+
+  void setDumpInterval(unsigned long ms) {
+    dumpIntervalMs = ms;
+    lastDumpMs = millis();
+  }
+
+  // 定期打印（间隔为0时关闭）；loop()空闲时调用
+  bool dumpDue() {
+    if (dumpIntervalMs == 0 || millis() - lastDumpMs < dumpIntervalMs) return false;
+    lastDumpMs = millis();
+    return true;
+  }
+
+  const ProfStats& get(int slot) const {
+    return stats[slot];
+  }
+
+  // stateName: 状态编号 → 名称（状态处理函数一行显示为 state:名称）
+  void printStatus(const char* (*stateName)(SystemState)) {
+    unsigned long windowMs = millis() - windowStartMs;
+    if (windowMs == 0) windowMs = 1;
+    const ProfStats& loop = stats[PROF_LOOP];
+
+    Serial.println("\n=== loop剖析 ===");
+    Serial.printf("统计周期: %lu 秒, loop %u 次", windowMs / 1000, loop.calls);
+    if (loop.calls > 0) {
+      Serial.printf(", 平均工作 %lu us, 周期目标 %d ms",
+                    (unsigned long)(loop.totalUs / loop.calls), LOOP_PERIOD_MS);
+    }
+    Serial.println();
+    Serial.println("项目                    次数   累计(ms)  占比   平均(us)  p95≤(us)  最长(us)  阻塞(ms)");
+    for (int i = 0; i < PROF_SLOT_COUNT; i++) {
+      const ProfStats& s = stats[i];
+      if (s.calls == 0) continue;
+
+      char name[24];
+      if (i >= PROF_STATE_BASE) {
+        snprintf(name, sizeof(name), "state:%s", stateName((SystemState)(i - PROF_STATE_BASE)));
+      } else {
+        snprintf(name, sizeof(name), "%s", slotName(i));
+      }
+      Serial.printf("%-22s %6u %10.1f %5.1f%% %9lu %9u %9u %9.1f\n", name, s.calls,
+                    s.totalUs / 1000.0f, s.totalUs / 10.0f / windowMs,
+                    (unsigned long)(s.totalUs / s.calls), s.percentileBoundUs(0.95f), s.maxUs,
+                    s.blockedUs / 1000.0f);
+    }
+
+    Serial.print("分桶上界(us):");
+    for (int i = 0; i < PROF_BUCKET_COUNT - 1; i++) Serial.printf(" %u", PROF_BUCKET_US[i]);
+    Serial.println(" >");
+    for (int i = 0; i < PROF_SLOT_COUNT; i++) {
+      const ProfStats& s = stats[i];
+      if (s.calls == 0 || i == PROF_SLEEP) continue;
+      Serial.printf("  %-20s", i >= PROF_STATE_BASE ? stateName((SystemState)(i - PROF_STATE_BASE))
+                                                    : slotName(i));
+      for (int b = 0; b < PROF_BUCKET_COUNT; b++) Serial.printf(" %u", s.buckets[b]);
+      Serial.println();
+    }
+    Serial.println("================\n");
+  }
+};
+
+// =================== 作用域计时 ===================
+class ProfScope {
+private:
+  LoopProfiler& profiler;
+
+public:
+  ProfScope(LoopProfiler& p, int slot) : profiler(p) {
+    profiler.enter(slot);
+  }
+
+  ~ProfScope() {
+    profiler.exit();
+  }
+};
+
+// 包住等待I/O或休眠的调用，时间记为所在子系统的阻塞时间
+class ProfBlocked {
+private:
+  LoopProfiler& profiler;
+  uint32_t startCycles;
+  unsigned long startMs;
+
+public:
+  explicit ProfBlocked(LoopProfiler& p) : profiler(p) {
+    startMs = millis();
+    startCycles = ESP.getCycleCount();
+  }
+
+  ~ProfBlocked() {
+    profiler.addBlocked(profiler.elapsedUs(startCycles, startMs));
+  }
+};
+
+#endif // LOOP_PROFILER_H
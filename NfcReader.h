@@ -0,0 +1,549 @@
+/*
+ * NfcReader.h - NFC读卡调度（IRQ检测 + 自适应轮询 + 空闲健康检查）
+ *
+ * 功能：
+ * - 读卡频率由状态表决定：刷卡/VIP查询时高频（或IRQ），待机时低频，其余状态不检测
+ * - IRQ模式：定期发送REQA，卡片应答时MFRC522拉低IRQ，中断记录检测时间，loop中再读UID
+ * - 寄存器健康检查（版本/天线/增益/错误/读写回环）集中成一次批量读取，
+ *   只在非刷卡状态按间隔执行，或连续读卡失败时立即执行；失败后按间隔复位芯片
+ * - 统计检测→UID的耗时（最短/平均/最长）以及轮询、IRQ、健康检查次数
+ *
+ * 后端：
+ * - Mfrc522NfcBackend: MFRC522（SPI），可选IRQ引脚；多个读卡器共用SPI总线时由 NfcBusLock 仲裁
+ * - SimNfcBackend: 模拟读卡器（虚拟时钟、放卡/移卡、注入故障），可在主机上验证调度
+ *
+ * 线程安全：只在loop()中调用（IRQ只设置标志）
+ *
+ * 版本: v1.0
+ */
+
+#ifndef NFC_READER_H
+#define NFC_READER_H
+
+#include <Arduino.h>
+#include <MFRC522.h>
+#include "config.h"
+#include "CardUid.h"
+
+// 一次批量读取的健康寄存器
+struct NfcHealth {
+  uint8_t version;
+  uint8_t txControl;
+  uint8_t rfCfg;
+  uint8_t errorReg;
+  bool loopbackOk;        // 寄存器写入后读回一致
+  bool ok;
+};
+
+// =================== 后端接口 ===================
+class NfcBackend {
+public:
+  virtual ~NfcBackend() {}
+  virtual bool begin() = 0;                                 // 初始化芯片
+  virtual bool hardReset() = 0;                             // 硬件复位并重新配置
+  virtual void probe(NfcHealth& health) = 0;                // 批量读取健康寄存器
+  virtual bool supportsIrq() = 0;
+  virtual void armIrq() = 0;                                // 发送REQA，卡片应答时触发IRQ
+  virtual bool takeIrq(uint32_t& detectUs) = 0;             // 取出IRQ标志及触发时间
+  virtual bool isCardPresent() = 0;                         // 轮询：REQA/WUPA
+  virtual bool readUid(CardUid& uid) = 0;                   // 防冲突+选卡，完成后HALT
+  virtual uint32_t nowUs() = 0;
+};
+
+// =================== SPI总线仲裁 ===================
+// 多个MFRC522共用一条SPI总线（各自片选）：每段寄存器访问持有互斥锁，
+// 复位和上电等待不持锁，几个读卡器可以同时初始化
+class NfcBusLock {
+private:
+  SemaphoreHandle_t mutex = NULL;
+  uint32_t waits = 0;          // 需要等待其他读卡器的次数
+  uint32_t maxWaitUs = 0;
+
+public:
+  // 在第一个读卡器初始化之前调用
+  void begin() {
+    if (mutex == NULL) mutex = xSemaphoreCreateMutex();
+  }
+
+  void lock() {
+    if (mutex == NULL) return;
+    if (xSemaphoreTake(mutex, 0) == pdTRUE) return;
+    uint32_t start = micros();
+    xSemaphoreTake(mutex, portMAX_DELAY);
+    uint32_t waited = micros() - start;
+    waits++;
+    if (waited > maxWaitUs) maxWaitUs = waited;
+  }
+
+  void unlock() {
+    if (mutex != NULL) xSemaphoreGive(mutex);
+  }
+
+  uint32_t getWaits() const { return waits; }
+  uint32_t getMaxWaitUs() const { return maxWaitUs; }
+};
+
+class NfcBusGuard {
+private:
+  NfcBusLock* bus;
+
+public:
+  explicit NfcBusGuard(NfcBusLock* b) : bus(b) {
+    if (bus != NULL) bus->lock();
+  }
+
+  ~NfcBusGuard() {
+    if (bus != NULL) bus->unlock();
+  }
+};
+
+// =================== MFRC522 后端 ===================
+class Mfrc522NfcBackend : public NfcBackend {
+private:
+  MFRC522& rfid;
+  int csPin;
+  int rstPin;
+  int irqPin;
+  NfcBusLock* bus;
+  volatile bool irqFlag = false;
+  volatile uint32_t irqUs = 0;
+
+  static void IRAM_ATTR onIrq(void* arg) {
+    Mfrc522NfcBackend* self = static_cast<Mfrc522NfcBackend*>(arg);
+    if (!self->irqFlag) {
+      self->irqUs = micros();
+      self->irqFlag = true;
+    }
+  }
+
+  static bool versionValid(uint8_t version) {
+    return version != 0x00 && version != 0xFF;
+  }
+
+  // 天线、增益和IRQ使能（PCD_Init会复位这些寄存器）
+  void configure() {
+    rfid.PCD_AntennaOn();
+    rfid.PCD_SetAntennaGain(MFRC522::RxGain_max);
+    if (irqPin >= 0) {
+      rfid.PCD_WriteRegister(MFRC522::ComIEnReg, 0xA0);  // IRqInv + RxIEn：收到应答时IRQ拉低
+      clearIrq();
+    }
+  }
+
+  void clearIrq() {
+    rfid.PCD_WriteRegister(MFRC522::ComIrqReg, 0x7F);
+    irqFlag = false;
+  }
+
+public:
+  // bus: 共用SPI总线时的仲裁锁（NULL = 独占总线）
+  Mfrc522NfcBackend(MFRC522& reader, int cs, int rst, int irq, NfcBusLock* sharedBus = NULL)
+    : rfid(reader), csPin(cs), rstPin(rst), irqPin(irq), bus(sharedBus) {}
+
+  bool begin() override {
+    pinMode(rstPin, OUTPUT);
+    digitalWrite(rstPin, LOW);
+    delay(10);
+    digitalWrite(rstPin, HIGH);
+    delay(50);
+
+    {
+      NfcBusGuard guard(bus);
+      rfid.PCD_Init(csPin, rstPin);
+    }
+    delay(200);
+
+    NfcBusGuard guard(bus);
+    if (!versionValid(rfid.PCD_ReadRegister(MFRC522::VersionReg))) return false;
+
+    if (irqPin >= 0) {
+      pinMode(irqPin, INPUT_PULLUP);
+      attachInterruptArg(irqPin, onIrq, this, FALLING);
+    }
+    configure();
+    return true;
+  }
+
+  bool hardReset() override {
+    digitalWrite(rstPin, LOW);
+    delay(100);
+    digitalWrite(rstPin, HIGH);
+    delay(100);
+
+    {
+      NfcBusGuard guard(bus);
+      rfid.PCD_Init(csPin, rstPin);
+    }
+    delay(200);
+
+    NfcBusGuard guard(bus);
+    if (!versionValid(rfid.PCD_ReadRegister(MFRC522::VersionReg))) return false;
+    configure();
+    return true;
+  }
+
+  void probe(NfcHealth& health) override {
+    NfcBusGuard guard(bus);
+    health.version = rfid.PCD_ReadRegister(MFRC522::VersionReg);
+    health.txControl = rfid.PCD_ReadRegister(MFRC522::TxControlReg);
+    health.rfCfg = rfid.PCD_ReadRegister(MFRC522::RFCfgReg);
+    health.errorReg = rfid.PCD_ReadRegister(MFRC522::ErrorReg);
+
+    // 天线被关闭时重新开启（不算故障）
+    if ((health.txControl & 0x03) != 0x03) {
+      rfid.PCD_AntennaOn();
+      health.txControl = rfid.PCD_ReadRegister(MFRC522::TxControlReg);
+    }
+
+    // 读写回环：写入Idle命令后读回（同时结束IRQ模式下未完成的接收）
+    rfid.PCD_WriteRegister(MFRC522::CommandReg, MFRC522::PCD_Idle);
+    health.loopbackOk = (rfid.PCD_ReadRegister(MFRC522::CommandReg) & 0x0F) == MFRC522::PCD_Idle;
+
+    health.ok = versionValid(health.version) && (health.txControl & 0x03) == 0x03 && health.loopbackOk;
+  }
+
+  bool supportsIrq() override { return irqPin >= 0; }
+
+  void armIrq() override {
+    NfcBusGuard guard(bus);
+    clearIrq();
+    rfid.PCD_WriteRegister(MFRC522::FIFODataReg, MFRC522::PICC_CMD_REQA);
+    rfid.PCD_WriteRegister(MFRC522::CommandReg, MFRC522::PCD_Transceive);
+    rfid.PCD_WriteRegister(MFRC522::BitFramingReg, 0x87);  // StartSend，短帧7位
+  }
+
+  bool takeIrq(uint32_t& detectUs) override {
+    if (!irqFlag) return false;
+    detectUs = irqUs;
+    irqFlag = false;
+    return true;
+  }
+
+  bool isCardPresent() override {
+    NfcBusGuard guard(bus);
+    return rfid.PICC_IsNewCardPresent();
+  }
+
+  bool readUid(CardUid& uid) override {
+    NfcBusGuard guard(bus);
+    bool ok = rfid.PICC_ReadCardSerial();
+    if (ok) {
+      uid.size = min((int)rfid.uid.size, CARD_UID_MAX_BYTES);
+      memcpy(uid.bytes, rfid.uid.uidByte, uid.size);
+      rfid.PICC_HaltA();
+      rfid.PCD_StopCrypto1();
+    }
+    if (irqPin >= 0) clearIrq();
+    return ok;
+  }
+
+  uint32_t nowUs() override { return micros(); }
+};
+
+// =================== 模拟读卡器 ===================
+class SimNfcBackend : public NfcBackend {
+private:
+  uint32_t now = 0;
+  bool cardInField = false;
+  bool cardHalted = false;     // 已读取的卡片HALT后不再应答，直到移开
+  bool irqArmed = false;
+  bool irqPending = false;
+  uint32_t irqAtUs = 0;
+  CardUid card;
+
+public:
+  bool healthy = true;         // false = 版本寄存器读到0xFF
+  bool resetFixes = true;      // hardReset后恢复健康
+  int failReads = 0;           // 接下来这么多次readUid失败
+  uint32_t readCostUs = 2500;  // 防冲突+选卡耗时
+  bool irqWired = true;         // false = 模拟未接IRQ（轮询）
+  uint32_t busOps = 0;         // SPI事务次数（比较轮询与IRQ的开销）
+
+  bool begin() override { return healthy; }
+
+  bool hardReset() override {
+    busOps++;
+    if (resetFixes) healthy = true;
+    return healthy;
+  }
+
+  void probe(NfcHealth& health) override {
+    busOps += 6;
+    health.version = healthy ? 0x92 : 0xFF;
+    health.txControl = healthy ? 0x83 : 0xFF;
+    health.rfCfg = 0x70;
+    health.errorReg = 0;
+    health.loopbackOk = healthy;
+    health.ok = healthy;
+  }
+
+  bool supportsIrq() override { return irqWired; }
+
+  void armIrq() override {
+    busOps += 4;
+    irqArmed = true;
+    irqPending = false;
+    if (cardInField && !cardHalted) {
+      irqPending = true;
+      irqAtUs = now;
+    }
+  }
+
+  bool takeIrq(uint32_t& detectUs) override {
+    if (!irqPending) return false;
+    detectUs = irqAtUs;
+    irqPending = false;
+    irqArmed = false;
+    return true;
+  }
+
+  bool isCardPresent() override {
+    busOps += 8;
+    return healthy && cardInField && !cardHalted;
+  }
+
+  bool readUid(CardUid& uid) override {
+    busOps += 20;
+    now += readCostUs;
+    if (failReads > 0) {
+      failReads--;
+      return false;
+    }
+    if (!healthy || !cardInField || cardHalted) return false;
+    uid = card;
+    cardHalted = true;
+    return true;
+  }
+
+  uint32_t nowUs() override { return now; }
+
+  // 放卡：已启动IRQ接收时立即触发
+  void presentCard(const uint8_t* bytes, uint8_t size) {
+    card.size = min((int)size, CARD_UID_MAX_BYTES);
+    memcpy(card.bytes, bytes, card.size);
+    cardInField = true;
+    cardHalted = false;
+    if (irqArmed) {
+      irqPending = true;
+      irqAtUs = now;
+    }
+  }
+
+  void removeCard() {
+    cardInField = false;
+    cardHalted = false;
+  }
+
+  void advanceUs(uint32_t us) { now += us; }
+};
+
+// =================== 读卡调度 ===================
+struct NfcReaderStats {
+  uint32_t polls;            // 轮询次数（REQA）
+  uint32_t irqArms;          // IRQ模式重新发送REQA次数
+  uint32_t detections;       // 检测到卡片
+  uint32_t reads;            // 成功读取UID
+  uint32_t readFailures;
+  uint32_t probes;           // 批量健康检查
+  uint32_t resets;           // 芯片复位
+  uint32_t lastLatencyUs;    // 检测→UID
+  uint32_t lastDetectUs;     // 最近一次检测步骤：REQA应答（轮询），或IRQ触发到loop处理
+  uint32_t lastReadUs;       // 最近一次防冲突+选卡
+  uint32_t minLatencyUs;
+  uint32_t maxLatencyUs;
+  uint64_t totalLatencyUs;
+};
+
+class NfcReader {
+private:
+  NfcBackend* backend = NULL;
+  NfcPollMode mode = NFC_POLL_IDLE;
+  bool useIrq = false;
+  bool healthy = false;
+  NfcHealth health;
+  NfcReaderStats stats;
+  int consecutiveFailures = 0;
+
+  uint32_t lastPollMs = 0;
+  uint32_t lastArmMs = 0;
+  uint32_t lastProbeMs = 0;
+  uint32_t lastResetMs = 0;
+  bool resetDue = false;       // 下一次poll立即复位（不等重试间隔）
+
+  void recordLatency(uint32_t us) {
+    stats.lastLatencyUs = us;
+    stats.totalLatencyUs += us;
+    if (stats.reads == 1 || us < stats.minLatencyUs) stats.minLatencyUs = us;
+    if (us > stats.maxLatencyUs) stats.maxLatencyUs = us;
+  }
+
+  void runProbe(uint32_t nowMs) {
+    backend->probe(health);
+    stats.probes++;
+    lastProbeMs = nowMs;
+    lastArmMs = 0;  // 回环测试会结束IRQ接收，需要重新发送REQA
+    if (!health.ok) {
+      healthy = false;
+      resetDue = true;
+    }
+  }
+
+  // 健康检查只在不等待刷卡时按间隔执行；连续读卡失败时任何状态都立即执行
+  void probeIfDue(uint32_t nowMs) {
+    bool periodic = mode != NFC_POLL_ACTIVE && nowMs - lastProbeMs >= NFC_HEALTH_INTERVAL_MS;
+    if (periodic || consecutiveFailures >= NFC_FAIL_PROBE_THRESHOLD) {
+      runProbe(nowMs);
+      if (healthy) consecutiveFailures = 0;
+    }
+  }
+
+  void tryReset(uint32_t nowMs) {
+    if (!resetDue && nowMs - lastResetMs < NFC_RETRY_INTERVAL_MS) return;
+    lastResetMs = nowMs;
+    stats.resets++;
+    if (backend->hardReset()) {
+      runProbe(nowMs);
+      healthy = health.ok;
+      if (healthy) consecutiveFailures = 0;
+    }
+    resetDue = false;  // 复位后仍失败则按重试间隔再试
+  }
+
+public:
+  NfcReader() {
+    memset(&stats, 0, sizeof(stats));
+    memset(&health, 0, sizeof(health));
+  }
+
+  bool begin(NfcBackend* b, uint32_t nowMs) {
+    backend = b;
+    useIrq = backend->supportsIrq();
+    lastResetMs = nowMs;
+    if (backend->begin()) {
+      runProbe(nowMs);
+      healthy = health.ok;
+    } else {
+      backend->probe(health);
+      healthy = false;
+    }
+    resetDue = false;
+    return healthy;
+  }
+
+  // 状态切换时调用；进入ACTIVE时立即检测
+  void setMode(NfcPollMode newMode) {
+    if (newMode == mode) return;
+    mode = newMode;
+    lastPollMs = 0;
+    lastArmMs = 0;
+  }
+
+  // 每次loop调用；读到卡片时返回true
+  bool poll(uint32_t nowMs, CardUid& uid) {
+    if (backend == NULL) return false;
+
+    if (!healthy) {
+      tryReset(nowMs);
+      return false;
+    }
+
+    bool detected = false;
+    uint32_t detectUs = 0;
+
+    if (mode == NFC_POLL_ACTIVE && useIrq) {
+      if (backend->takeIrq(detectUs)) {
+        detected = true;
+        stats.lastDetectUs = backend->nowUs() - detectUs;
+      } else if (lastArmMs == 0 || nowMs - lastArmMs >= NFC_IRQ_REARM_MS) {
+        backend->armIrq();
+        stats.irqArms++;
+        lastArmMs = nowMs;
+      }
+    } else if (mode != NFC_POLL_OFF) {
+      uint32_t interval = mode == NFC_POLL_ACTIVE ? NFC_POLL_ACTIVE_MS : NFC_POLL_IDLE_MS;
+      if (lastPollMs == 0 || nowMs - lastPollMs >= interval) {
+        lastPollMs = nowMs;
+        stats.polls++;
+        uint32_t pollUs = backend->nowUs();
+        if (backend->isCardPresent()) {
+          detected = true;
+          detectUs = backend->nowUs();
+          stats.lastDetectUs = detectUs - pollUs;
+        }
+      }
+    }
+
+    if (!detected) {
+      probeIfDue(nowMs);
+      return false;
+    }
+
+    stats.detections++;
+    uint32_t readStartUs = backend->nowUs();
+    if (!backend->readUid(uid)) {
+      stats.readFailures++;
+      consecutiveFailures++;
+      lastArmMs = 0;
+      return false;
+    }
+
+    stats.reads++;
+    stats.lastReadUs = backend->nowUs() - readStartUs;
+    recordLatency(backend->nowUs() - detectUs);
+    consecutiveFailures = 0;
+    lastArmMs = 0;
+    return true;
+  }
+
+  // 外部判断读卡异常（如成功率过低）时请求复位
+  void requestReset() {
+    healthy = false;
+    resetDue = true;
+  }
+
+  // 手动检查/复位（串口命令）
+  bool probeNow(uint32_t nowMs) {
+    runProbe(nowMs);
+    if (health.ok) healthy = true;
+    return health.ok;
+  }
+
+  bool resetNow(uint32_t nowMs) {
+    resetDue = true;
+    tryReset(nowMs);
+    return healthy;
+  }
+
+  bool isHealthy() { return healthy; }
+  bool isIrqMode() { return useIrq; }
+  NfcPollMode getMode() { return mode; }
+  int getConsecutiveFailures() { return consecutiveFailures; }
+  const NfcHealth& getHealth() { return health; }
+  const NfcReaderStats& getStats() { return stats; }
+
+  void resetStats() {
+    memset(&stats, 0, sizeof(stats));
+  }
+
+  void printStatus() {
+    static const char* MODE_NAMES[] = {"OFF", "IDLE", "ACTIVE"};
+    Serial.println("\n=== NFC读卡 ===");
+    Serial.printf("状态: %s, 模式: %s, 检测方式: %s\n", healthy ? "正常" : "异常",
+                  MODE_NAMES[mode], useIrq ? "IRQ" : "轮询");
+    Serial.printf("寄存器: 版本 0x%02X, 天线 0x%02X, 增益 0x%02X, 错误 0x%02X, 回环 %s\n",
+                  health.version, health.txControl, health.rfCfg, health.errorReg,
+                  health.loopbackOk ? "OK" : "失败");
+    Serial.printf("轮询: %u, IRQ发送: %u, 检测: %u, 读取: %u, 失败: %u (连续 %d)\n",
+                  stats.polls, stats.irqArms, stats.detections, stats.reads,
+                  stats.readFailures, consecutiveFailures);
+    Serial.printf("健康检查: %u, 复位: %u\n", stats.probes, stats.resets);
+    if (stats.reads > 0) {
+      Serial.printf("检测→UID: 最近 %u us, 平均 %lu us, 最短 %u us, 最长 %u us\n",
+                    stats.lastLatencyUs, (unsigned long)(stats.totalLatencyUs / stats.reads),
+                    stats.minLatencyUs, stats.maxLatencyUs);
+    }
+    Serial.println("===============\n");
+  }
+};
+
+#endif // NFC_READER_H
@@ -0,0 +1,241 @@
+/*
+ * OfflineLog.h - 离线交易环形日志（Flash专用分区）
+ *
+ * 功能：
+ * - 固定64字节二进制记录（PendingTransaction），只追加写入
+ * - 每条记录带CRC32，状态字节只由1变0（写入→已确认），无需擦除即可更新
+ * - 按扇区循环使用分区，所有扇区均匀磨损；日志写满时丢弃最旧扇区
+ * - 启动时扫描分区恢复读写位置，断电中途写入的残缺记录自动跳过
+ *
+ * 分区：partitions.csv 中的 "txlog"（256KB = 4096条记录）
+ * 注意：只能在网络任务中读写（启动恢复除外）
+ *
+ * 版本: v1.0
+ */
+
+#ifndef OFFLINE_LOG_H
+#define OFFLINE_LOG_H
+
+#include <Arduino.h>
+#include <esp_partition.h>
+#include <esp_crc.h>
+#include "config.h"
+
+// =================== 日志配置 ===================
+#define OFFLINE_LOG_PARTITION "txlog"
+#define OFFLINE_LOG_SECTOR_SIZE 4096
+#define OFFLINE_LOG_SLOTS_PER_SECTOR (OFFLINE_LOG_SECTOR_SIZE / sizeof(PendingTransaction))
+#define OFFLINE_LOG_SCAN_BATCH 16     // 启动扫描时每次读取的记录数（1KB栈）
+
+static_assert(sizeof(PendingTransaction) == 64, "PendingTransaction 必须为64字节");
+static_assert(OFFLINE_LOG_SECTOR_SIZE % sizeof(PendingTransaction) == 0, "记录不能跨扇区");
+
+// =================== 离线交易日志 ===================
+class OfflineLog {
+private:
+  const esp_partition_t* part = NULL;
+  uint32_t slotCount = 0;
+  uint32_t headSlot = 0;            // 最旧的未确认记录
+  uint32_t tailSlot = 0;            // 下一个写入位置
+  volatile uint32_t pending = 0;    // 未确认记录数（loop()只读）
+  uint32_t maxSeq = 0;              // 日志中最大的交易序号
+  uint32_t droppedCount = 0;        // 日志写满时丢弃的记录数
+
+  size_t slotOffset(uint32_t slot) { return slot * sizeof(PendingTransaction); }
+  uint32_t nextSlot(uint32_t slot) { return (slot + 1) % slotCount; }
+
+  static uint32_t recordCRC(const PendingTransaction& rec) {
+    const uint8_t* start = (const uint8_t*)&rec.seq;
+    return esp_crc32_le(0, start, sizeof(PendingTransaction) - offsetof(PendingTransaction, seq));
+  }
+
+  static bool isBlank(const PendingTransaction& rec) {
+    const uint8_t* p = (const uint8_t*)&rec;
+    for (size_t i = 0; i < sizeof(PendingTransaction); i++) {
+      if (p[i] != 0xFF) return false;
+    }
+    return true;
+  }
+
+  // CRC正确即为有效记录（数据已完整写入，即使状态字节未及更新）
+  // 升级前写入的v1记录（十进制UID）仍可同步
+  static bool isValid(const PendingTransaction& rec) {
+    return rec.version >= OFFLINE_REC_MIN_VERSION && rec.version <= OFFLINE_REC_VERSION &&
+           rec.crc == recordCRC(rec);
+  }
+
+  static bool isPending(const PendingTransaction& rec) {
+    return isValid(rec) && rec.state != OFFLINE_REC_ACKED;
+  }
+
+  bool readSlot(uint32_t slot, PendingTransaction& rec) {
+    return esp_partition_read(part, slotOffset(slot), &rec, sizeof(rec)) == ESP_OK;
+  }
+
+  bool writeState(uint32_t slot, uint8_t state) {
+    return esp_partition_write(part, slotOffset(slot), &state, 1) == ESP_OK;
+  }
+
+  // 从headSlot向前找到第一条未确认记录（到tailSlot为止）
+  void advanceHead() {
+    PendingTransaction rec;
+    while (headSlot != tailSlot) {
+      if (readSlot(headSlot, rec) && isPending(rec)) return;
+      headSlot = nextSlot(headSlot);
+    }
+  }
+
+  // 写入新扇区前擦除；扇区内仍有未确认记录说明日志已满，丢弃它们
+  bool prepareSector(uint32_t firstSlot) {
+    bool blank = true;
+    int lost = 0;
+    PendingTransaction rec;
+
+    for (uint32_t i = 0; i < OFFLINE_LOG_SLOTS_PER_SECTOR; i++) {
+      if (!readSlot(firstSlot + i, rec)) return false;
+      if (!isBlank(rec)) blank = false;
+      if (isPending(rec)) lost++;
+    }
+
+    if (blank) return true;  // 已是擦除状态，不做多余擦除
+
+    size_t sectorOffset = slotOffset(firstSlot);
+    if (esp_partition_erase_range(part, sectorOffset, OFFLINE_LOG_SECTOR_SIZE) != ESP_OK) {
+      Serial.println("❌ 离线日志扇区擦除失败");
+      return false;
+    }
+
+    if (lost > 0) {
+      droppedCount += lost;
+      pending -= lost;
+      Serial.printf("⚠️ 离线日志已满，丢弃最旧的 %d 笔记录\n", lost);
+      advanceHead();
+    }
+    return true;
+  }
+
+public:
+  // 打开分区并恢复读写位置
+  bool begin() {
+    part = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                    OFFLINE_LOG_PARTITION);
+    if (part == NULL) {
+      Serial.println("❌ 未找到离线日志分区 \"" OFFLINE_LOG_PARTITION "\"（请使用 partitions.csv）");
+      return false;
+    }
+
+    slotCount = (part->size / OFFLINE_LOG_SECTOR_SIZE) * OFFLINE_LOG_SLOTS_PER_SECTOR;
+    pending = 0;
+    maxSeq = 0;
+
+    bool found = false;
+    uint32_t maxSlot = 0;
+    uint32_t minPendingSeq = UINT32_MAX;
+    PendingTransaction batch[OFFLINE_LOG_SCAN_BATCH];
+
+    for (uint32_t base = 0; base < slotCount; base += OFFLINE_LOG_SCAN_BATCH) {
+      if (esp_partition_read(part, slotOffset(base), batch, sizeof(batch)) != ESP_OK) {
+        Serial.println("❌ 离线日志读取失败");
+        part = NULL;
+        return false;
+      }
+
+      for (uint32_t i = 0; i < OFFLINE_LOG_SCAN_BATCH; i++) {
+        const PendingTransaction& rec = batch[i];
+        if (!isValid(rec)) continue;
+
+        if (!found || rec.seq > maxSeq) {
+          maxSeq = rec.seq;
+          maxSlot = base + i;
+          found = true;
+        }
+        if (rec.state != OFFLINE_REC_ACKED) {
+          pending++;
+          if (rec.seq < minPendingSeq) {
+            minPendingSeq = rec.seq;
+            headSlot = base + i;
+          }
+        }
+      }
+    }
+
+    tailSlot = found ? nextSlot(maxSlot) : 0;
+    if (pending == 0) headSlot = tailSlot;
+    return true;
+  }
+
+  bool isReady() { return part != NULL; }
+
+  // 追加一条记录（seq等数据由调用者填写）
+  bool append(PendingTransaction& rec) {
+    if (part == NULL) return false;
+
+    PendingTransaction existing;
+    for (uint32_t attempt = 0; attempt < slotCount; attempt++) {
+      if (tailSlot % OFFLINE_LOG_SLOTS_PER_SECTOR == 0 && !prepareSector(tailSlot)) {
+        return false;
+      }
+
+      // 跳过断电残留的非空槽位
+      if (!readSlot(tailSlot, existing)) return false;
+      if (!isBlank(existing)) {
+        tailSlot = nextSlot(tailSlot);
+        continue;
+      }
+
+      rec.state = OFFLINE_REC_EMPTY;
+      rec.version = OFFLINE_REC_VERSION;
+      rec.reserved = 0xFF;
+      rec.crc = recordCRC(rec);
+
+      // 先写数据，再写状态字节（提交）
+      if (esp_partition_write(part, slotOffset(tailSlot), &rec, sizeof(rec)) != ESP_OK ||
+          !writeState(tailSlot, OFFLINE_REC_WRITTEN)) {
+        Serial.println("❌ 离线日志写入失败");
+        return false;
+      }
+
+      if (pending == 0) headSlot = tailSlot;
+      pending++;
+      if (rec.seq > maxSeq) maxSeq = rec.seq;
+      tailSlot = nextSlot(tailSlot);
+      return true;
+    }
+    return false;
+  }
+
+  // 从startSlot开始读取最多max条未确认记录
+  // nextCursor返回最后检查位置的下一个槽位（到达tailSlot表示本轮结束）
+  int readPending(uint32_t startSlot, PendingTransaction* out, uint32_t* slots,
+                  int max, uint32_t& nextCursor) {
+    int count = 0;
+    uint32_t slot = startSlot % (slotCount ? slotCount : 1);
+
+    while (part != NULL && slot != tailSlot && count < max) {
+      if (readSlot(slot, out[count]) && isPending(out[count])) {
+        slots[count] = slot;
+        count++;
+      }
+      slot = nextSlot(slot);
+    }
+
+    nextCursor = slot;
+    return count;
+  }
+
+  // 标记记录已被服务器确认
+  void acknowledge(uint32_t slot) {
+    if (part == NULL || !writeState(slot, OFFLINE_REC_ACKED)) return;
+    if (pending > 0) pending--;
+    if (slot == headSlot) advanceHead();
+  }
+
+  uint32_t pendingCount() { return pending; }
+  uint32_t capacity() { return slotCount; }
+  uint32_t getHeadSlot() { return headSlot; }
+  uint32_t getTailSlot() { return tailSlot; }
+  uint32_t getMaxSeq() { return maxSeq; }
+  uint32_t getDroppedCount() { return droppedCount; }
+};
+
+#endif // OFFLINE_LOG_H
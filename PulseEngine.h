@@ -0,0 +1,249 @@
+/*
+ * PulseEngine.h - 硬件定时脉冲发生器（PULSE_OUT → 洗车控制器）
+ *
+ * 功能：
+ * - 按套餐表中的脉冲数/宽度/周期异步输出脉冲串，loop()不再阻塞
+ * - 每个边沿按绝对时间（起始时间 + n×周期）安排，不会累积漂移
+ * - 记录实际边沿与计划时间的最大偏差，便于验证时序
+ *
+ * 后端：
+ * - EspTimerPulseBackend: esp_timer（64位硬件定时器，微秒精度）驱动GPIO
+ * - SimPulseBackend: 软件模拟时钟，记录每个边沿，可在主机上验证时序
+ *
+ * 线程安全：边沿回调在esp_timer任务中执行，与loop()共享的状态用自旋锁保护
+ *
+ * 版本: v1.0
+ */
+
+#ifndef PULSE_ENGINE_H
+#define PULSE_ENGINE_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <driver/gpio.h>
+
+// =================== 后端接口 ===================
+class PulseBackend {
+public:
+  typedef void (*Callback)(void* arg);
+
+  virtual ~PulseBackend() {}
+  virtual bool begin(Callback callback, void* arg) = 0;
+  virtual uint64_t nowUs() = 0;
+  virtual void setOutput(bool high) = 0;
+  virtual void scheduleAt(uint64_t timeUs) = 0;  // 在绝对时间调用一次回调
+  virtual void cancel() = 0;
+};
+
+// =================== esp_timer 后端 ===================
+class EspTimerPulseBackend : public PulseBackend {
+private:
+  int pin;
+  esp_timer_handle_t timer = NULL;
+
+public:
+  EspTimerPulseBackend(int outputPin) : pin(outputPin) {}
+
+  bool begin(Callback callback, void* arg) override {
+    pinMode(pin, OUTPUT);
+    gpio_set_level((gpio_num_t)pin, 0);
+
+    esp_timer_create_args_t args = {};
+    args.callback = callback;
+    args.arg = arg;
+    args.dispatch_method = ESP_TIMER_TASK;
+    args.name = "pulse";
+    return esp_timer_create(&args, &timer) == ESP_OK;
+  }
+
+  uint64_t nowUs() override {
+    return (uint64_t)esp_timer_get_time();
+  }
+
+  void setOutput(bool high) override {
+    gpio_set_level((gpio_num_t)pin, high ? 1 : 0);
+  }
+
+  void scheduleAt(uint64_t timeUs) override {
+    int64_t delayUs = (int64_t)(timeUs - nowUs());
+    if (delayUs < 0) delayUs = 0;
+    esp_timer_stop(timer);  // 未启动时返回错误，忽略
+    esp_timer_start_once(timer, (uint64_t)delayUs);
+  }
+
+  void cancel() override {
+    esp_timer_stop(timer);
+  }
+};
+
+// =================== 软件模拟后端 ===================
+#define SIM_PULSE_MAX_EDGES 64
+
+struct SimPulseEdge {
+  uint64_t timeUs;
+  bool high;
+};
+
+class SimPulseBackend : public PulseBackend {
+private:
+  Callback callback = NULL;
+  void* callbackArg = NULL;
+  uint64_t now = 0;
+  uint64_t pending = UINT64_MAX;
+  bool level = false;
+
+public:
+  SimPulseEdge edges[SIM_PULSE_MAX_EDGES];
+  int edgeCount = 0;
+  uint32_t callbackLatencyUs = 0;  // 模拟回调延迟（验证偏差统计）
+
+  bool begin(Callback cb, void* arg) override {
+    callback = cb;
+    callbackArg = arg;
+    now = 0;
+    pending = UINT64_MAX;
+    level = false;
+    edgeCount = 0;
+    return true;
+  }
+
+  uint64_t nowUs() override { return now; }
+
+  // 只记录电平变化
+  void setOutput(bool high) override {
+    if (high == level) return;
+    level = high;
+    if (edgeCount < SIM_PULSE_MAX_EDGES) {
+      edges[edgeCount].timeUs = now;
+      edges[edgeCount].high = high;
+      edgeCount++;
+    }
+  }
+
+  void scheduleAt(uint64_t timeUs) override { pending = timeUs; }
+
+  void cancel() override { pending = UINT64_MAX; }
+
+  // 推进模拟时钟，依次触发到期的回调
+  void advanceTo(uint64_t timeUs) {
+    while (pending != UINT64_MAX && pending + callbackLatencyUs <= timeUs) {
+      now = pending + callbackLatencyUs;
+      pending = UINT64_MAX;
+      callback(callbackArg);
+    }
+    now = timeUs;
+  }
+};
+
+// =================== 脉冲发生器 ===================
+class PulseEngine {
+private:
+  PulseBackend* backend = NULL;
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+
+  volatile int targetPulses = 0;
+  volatile int sentPulses = 0;
+  volatile bool running = false;
+  bool outputHigh = false;
+
+  uint32_t widthUs = 0;
+  uint32_t periodUs = 0;
+  uint64_t startUs = 0;       // 第一个上升沿的计划时间
+  uint64_t nextEdgeUs = 0;
+  uint32_t maxLateUs = 0;     // 实际边沿相对计划时间的最大延迟
+  uint64_t firstEdgeUs = 0;   // 第一个上升沿的实际时间（0=尚未输出）
+
+  static void onTimer(void* arg) {
+    static_cast<PulseEngine*>(arg)->onEdge();
+  }
+
+  void onEdge() {
+    portENTER_CRITICAL(&mux);
+    if (!running) {
+      portEXIT_CRITICAL(&mux);
+      return;
+    }
+
+    uint64_t now = backend->nowUs();
+    if (now > nextEdgeUs && now - nextEdgeUs > maxLateUs) {
+      maxLateUs = (uint32_t)(now - nextEdgeUs);
+    }
+
+    if (!outputHigh) {
+      backend->setOutput(true);
+      outputHigh = true;
+      if (sentPulses == 0) firstEdgeUs = now;
+      nextEdgeUs = startUs + (uint64_t)sentPulses * periodUs + widthUs;
+    } else {
+      backend->setOutput(false);
+      outputHigh = false;
+      sentPulses++;
+      if (sentPulses >= targetPulses) {
+        running = false;
+        portEXIT_CRITICAL(&mux);
+        return;
+      }
+      nextEdgeUs = startUs + (uint64_t)sentPulses * periodUs;
+    }
+
+    backend->scheduleAt(nextEdgeUs);
+    portEXIT_CRITICAL(&mux);
+  }
+
+public:
+  bool begin(PulseBackend* b) {
+    backend = b;
+    return backend->begin(onTimer, this);
+  }
+
+  // 开始输出脉冲串：第一个脉冲在一个周期后开始（与原先行为一致）
+  bool start(int count, uint32_t widthMs, uint32_t periodMs) {
+    if (backend == NULL || running || count <= 0 || widthMs == 0 || widthMs >= periodMs) {
+      return false;
+    }
+
+    portENTER_CRITICAL(&mux);
+    targetPulses = count;
+    sentPulses = 0;
+    outputHigh = false;
+    widthUs = widthMs * 1000;
+    periodUs = periodMs * 1000;
+    maxLateUs = 0;
+    firstEdgeUs = 0;
+    startUs = backend->nowUs() + periodUs;
+    nextEdgeUs = startUs;
+    running = true;
+    backend->setOutput(false);
+    backend->scheduleAt(nextEdgeUs);
+    portEXIT_CRITICAL(&mux);
+    return true;
+  }
+
+  // 立即停止并拉低输出（当前脉冲被截断，不计入已发送数）
+  void stop() {
+    if (backend == NULL) return;
+
+    portENTER_CRITICAL(&mux);
+    running = false;
+    backend->cancel();
+    backend->setOutput(false);
+    outputHigh = false;
+    portEXIT_CRITICAL(&mux);
+  }
+
+  int pulsesSent() { return sentPulses; }
+  int pulsesTarget() { return targetPulses; }
+  bool isRunning() { return running; }
+  bool isDone() { return targetPulses > 0 && sentPulses >= targetPulses; }
+  uint32_t maxLatenessUs() { return maxLateUs; }
+
+  // 第一个上升沿的时间（esp_timer微秒，0=尚未输出）；64位读取需加锁
+  uint64_t firstPulseUs() {
+    portENTER_CRITICAL(&mux);
+    uint64_t us = firstEdgeUs;
+    portEXIT_CRITICAL(&mux);
+    return us;
+  }
+};
+
+#endif // PULSE_ENGINE_H
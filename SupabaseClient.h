@@ -0,0 +1,350 @@
+/*
+ * SupabaseClient.h - Supabase REST 长连接客户端
+ *
+ * 功能：
+ * - 所有REST请求复用同一个TLS连接（HTTP/1.1 keep-alive）
+ * - apikey / Authorization 请求头在配置加载时预先生成
+ * - 连接断开时自动重新握手并重试一次
+ * - 分别统计TLS握手耗时和请求耗时
+ * - JSON请求体序列化到固定缓冲区；JSON响应直接从连接流式解析（可带过滤器），
+ *   不先读成String
+ *
+ * 注意：只能在网络任务中使用（单一所有者，无需加锁）
+ *
+ * 版本: v1.0
+ */
+
+#ifndef SUPABASE_CLIENT_H
+#define SUPABASE_CLIENT_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <HTTPClient.h>
+#include <ArduinoJson.h>
+#include "HeapMonitor.h"
+
+// =================== 连接配置 ===================
+#define SUPABASE_PORT 443
+#define SUPABASE_HTTP_TIMEOUT_MS 10000       // 单次请求超时
+#define SUPABASE_HANDSHAKE_TIMEOUT_S 10      // TLS握手超时（秒）
+#define SUPABASE_BODY_MAX 3072               // JSON请求体缓冲区（离线同步一批约2KB）
+
+#define SUPABASE_ERROR_JSON -100             // 请求体过大/内存池不足，或响应JSON解析失败
+
+// =================== 连接统计 ===================
+struct SupabaseStats {
+  uint32_t handshakeCount = 0;      // 成功握手次数
+  uint32_t handshakeFailCount = 0;  // 握手失败次数
+  uint32_t handshakeTotalMs = 0;
+  uint32_t handshakeMaxMs = 0;
+
+  uint32_t requestCount = 0;        // 请求次数（不含握手）
+  uint32_t requestFailCount = 0;    // 传输层失败次数（HTTP错误码不计入）
+  uint32_t requestTotalMs = 0;
+  uint32_t requestMaxMs = 0;
+
+  uint32_t reusedCount = 0;         // 复用已有连接的请求次数
+
+  uint32_t bodyMaxBytes = 0;        // 最大JSON请求体
+  uint32_t jsonErrorCount = 0;      // JSON编码/解析失败次数
+
+  uint32_t avgHandshakeMs() const { return handshakeCount ? handshakeTotalMs / handshakeCount : 0; }
+  uint32_t avgRequestMs() const { return requestCount ? requestTotalMs / requestCount : 0; }
+};
+
+// =================== 响应体读取 ===================
+// 按Content-Length或chunked编码读取响应体，供deserializeJson直接解析
+class HttpBodyStream : public Stream {
+private:
+  Stream* in;
+  bool chunked;
+  int32_t remaining;        // 当前块（或整个响应体）剩余字节，-1 = 读到连接关闭
+  bool started = false;
+  bool done = false;
+  unsigned long deadline;
+
+  int readRaw() {
+    while (in->available() <= 0) {
+      if ((long)(millis() - deadline) > 0) return -1;
+      delay(1);
+    }
+    return in->read();
+  }
+
+  // 读取一行（块大小行/块尾），返回行长度
+  int readLine(char* line, int size) {
+    int n = 0;
+    for (;;) {
+      int c = readRaw();
+      if (c < 0) return -1;
+      if (c == '\n') break;
+      if (c != '\r' && n < size - 1) line[n++] = (char)c;
+    }
+    line[n] = '\0';
+    return n;
+  }
+
+  // 下一块（chunked）：返回false表示响应体结束
+  bool nextChunk() {
+    char line[16];
+    if (started && readLine(line, sizeof(line)) < 0) return false;  // 上一块末尾的CRLF
+    started = true;
+    if (readLine(line, sizeof(line)) < 0) return false;
+    remaining = strtol(line, NULL, 16);
+    if (remaining > 0) return true;
+
+    // 最后一块：跳过trailer直到空行
+    while (readLine(line, sizeof(line)) > 0) {}
+    return false;
+  }
+
+public:
+  HttpBodyStream(Stream* stream, int contentLength, bool isChunked)
+    : in(stream), chunked(isChunked), remaining(isChunked ? 0 : contentLength),
+      deadline(millis() + SUPABASE_HTTP_TIMEOUT_MS) {}
+
+  int read() override {
+    if (done) return -1;
+    if (remaining == 0) {
+      if (!chunked || !nextChunk()) {
+        done = true;
+        return -1;
+      }
+    }
+    int c = readRaw();
+    if (c < 0) {
+      done = true;
+      return -1;
+    }
+    if (remaining > 0) remaining--;
+    return c;
+  }
+
+  int available() override {
+    if (done) return 0;
+    int n = in->available();
+    return remaining > 0 ? min(n, (int)remaining) : n;
+  }
+
+  int peek() override { return -1; }   // deserializeJson只调用read()
+  size_t write(uint8_t) override { return 0; }
+
+  // 读完剩余响应体，保证连接可以复用
+  void drain() {
+    while (read() >= 0) {}
+  }
+};
+
+// =================== Supabase 客户端 ===================
+class SupabaseClient {
+private:
+  WiFiClientSecure tls;
+  HTTPClient http;
+
+  char body[SUPABASE_BODY_MAX];   // JSON请求体（网络任务单一所有者，复用）
+
+  String baseURL;
+  String host;
+  String apiKey;
+  String bearer;       // "Bearer <key>"，预先生成
+
+  SupabaseStats stats;
+
+  // 确保TLS连接可用，必要时重新握手
+  bool ensureConnected(bool& reused) {
+    if (tls.connected()) {
+      reused = true;
+      return true;
+    }
+
+    reused = false;
+    tls.stop();
+
+    unsigned long startTime = millis();
+    bool ok = tls.connect(host.c_str(), SUPABASE_PORT);
+    uint32_t elapsed = millis() - startTime;
+
+    if (!ok) {
+      stats.handshakeFailCount++;
+      Serial.println("❌ Supabase TLS握手失败 (" + String(elapsed) + " ms)");
+      return false;
+    }
+
+    stats.handshakeCount++;
+    stats.handshakeTotalMs += elapsed;
+    if (elapsed > stats.handshakeMaxMs) stats.handshakeMaxMs = elapsed;
+    return true;
+  }
+
+  // 响应去向：文本，或流式解析到JSON文档（2xx时）
+  struct Response {
+    String* text = NULL;
+    JsonDocument* json = NULL;
+    const JsonDocument* filter = NULL;
+    bool jsonOk = true;
+  };
+
+  // 2xx时解析JSON；其他状态码只读完响应体（保证连接可以复用）
+  void readJson(int httpCode, Response& out) {
+    HttpBodyStream stream(http.getStreamPtr(), http.getSize(),
+                          http.header("Transfer-Encoding").equalsIgnoreCase("chunked"));
+    if (httpCode < 200 || httpCode >= 300) {
+      stream.drain();
+      return;
+    }
+
+    DeserializationError error = out.filter != NULL
+      ? deserializeJson(*out.json, stream, DeserializationOption::Filter(*out.filter))
+      : deserializeJson(*out.json, stream);
+    stream.drain();
+    if (error) {
+      out.jsonOk = false;
+      stats.jsonErrorCount++;
+    }
+  }
+
+  // 发送请求（连接失效时重新握手并重试一次）
+  int send(const char* method, const char* path, const uint8_t* payload, size_t length,
+           const char* prefer, Response& out) {
+    static const char* HEADERS[] = {"Transfer-Encoding"};
+
+    for (int attempt = 0; attempt < 2; attempt++) {
+      bool reused = false;
+      if (!ensureConnected(reused)) {
+        return HTTPC_ERROR_CONNECTION_REFUSED;
+      }
+
+      HEAP_SITE(HEAP_SITE_HTTP_REQUEST, baseURL.length() + strlen(path));
+      http.begin(tls, baseURL + path);
+      http.setReuse(true);
+      http.setTimeout(SUPABASE_HTTP_TIMEOUT_MS);
+      http.addHeader("apikey", apiKey);
+      http.addHeader("Authorization", bearer);
+      if (payload != NULL) {
+        http.addHeader("Content-Type", "application/json");
+      }
+      if (prefer != NULL) {
+        http.addHeader("Prefer", prefer);
+      }
+      if (out.json != NULL) {
+        http.collectHeaders(HEADERS, 1);
+      }
+
+      unsigned long startTime = millis();
+      int httpCode = http.sendRequest(method, (uint8_t*)payload, length);
+
+      if (httpCode > 0 && out.json != NULL) {
+        readJson(httpCode, out);
+      } else if (httpCode > 0 && out.text != NULL) {
+        *out.text = http.getString();
+        HEAP_SITE(HEAP_SITE_HTTP_RESPONSE, out.text->length());
+      }
+      uint32_t elapsed = millis() - startTime;
+      http.end();  // keep-alive：连接保持打开
+
+      if (httpCode < 0) {
+        stats.requestFailCount++;
+        tls.stop();
+        // 复用的连接可能已被服务器关闭，重新握手后再试一次
+        if (reused && attempt == 0) {
+          continue;
+        }
+        return httpCode;
+      }
+
+      stats.requestCount++;
+      if (reused) stats.reusedCount++;
+      stats.requestTotalMs += elapsed;
+      if (elapsed > stats.requestMaxMs) stats.requestMaxMs = elapsed;
+      return httpCode;
+    }
+    return HTTPC_ERROR_CONNECTION_LOST;
+  }
+
+  int sendJson(const char* method, const char* path, const JsonDocument& request,
+               const char* prefer, JsonDocument* response, const JsonDocument* filter) {
+    size_t length = measureJson(request);
+    if (request.overflowed() || length >= sizeof(body)) {
+      stats.jsonErrorCount++;
+      Serial.printf("❌ JSON请求体过大或内存池不足 (%u 字节)\n", (unsigned)length);
+      return SUPABASE_ERROR_JSON;
+    }
+    serializeJson(request, body, sizeof(body));
+    if (length > stats.bodyMaxBytes) stats.bodyMaxBytes = length;
+
+    Response out;
+    out.json = response;
+    out.filter = filter;
+    int httpCode = send(method, path, (const uint8_t*)body, length, prefer, out);
+    return out.jsonOk ? httpCode : SUPABASE_ERROR_JSON;
+  }
+
+public:
+  // 加载URL和密钥（配置变化后需重新调用）
+  void begin(const String& url, const String& key) {
+    baseURL = url;
+    apiKey = key;
+    bearer = "Bearer " + key;
+
+    // 从URL中提取主机名
+    host = url;
+    int schemeEnd = host.indexOf("://");
+    if (schemeEnd >= 0) host = host.substring(schemeEnd + 3);
+    int pathStart = host.indexOf('/');
+    if (pathStart >= 0) host = host.substring(0, pathStart);
+
+    // 与原 HTTPClient::begin(url) 行为一致：不校验证书
+    tls.setInsecure();
+    tls.setHandshakeTimeout(SUPABASE_HANDSHAKE_TIMEOUT_S);
+    tls.stop();
+  }
+
+  // 文本请求体（健康度日志：JSON快照已在loop()中生成到固定缓冲区）
+  int post(const char* path, const char* payload, size_t length,
+           const char* prefer = "return=minimal", String* response = NULL) {
+    Response out;
+    out.text = response;
+    return send("POST", path, (const uint8_t*)payload, length, prefer, out);
+  }
+
+  // GET并流式解析JSON响应（filter为NULL时保留全部字段）
+  // 返回HTTP状态码；2xx但解析失败时返回 SUPABASE_ERROR_JSON
+  int getJson(const char* path, JsonDocument& response, const JsonDocument* filter = NULL) {
+    Response out;
+    out.json = &response;
+    out.filter = filter;
+    int httpCode = send("GET", path, NULL, 0, NULL, out);
+    return out.jsonOk ? httpCode : SUPABASE_ERROR_JSON;
+  }
+
+  // 请求体序列化到固定缓冲区；response不为NULL时流式解析响应
+  int postJson(const char* path, const JsonDocument& request, const char* prefer = "return=minimal",
+               JsonDocument* response = NULL, const JsonDocument* filter = NULL) {
+    return sendJson("POST", path, request, prefer, response, filter);
+  }
+
+  int patchJson(const char* path, const JsonDocument& request, const char* prefer = "return=minimal") {
+    return sendJson("PATCH", path, request, prefer, NULL, NULL);
+  }
+
+  const SupabaseStats& getStats() const { return stats; }
+
+  void resetStats() { stats = SupabaseStats(); }
+
+  void printStats() {
+    Serial.println("\n=== Supabase 连接统计 ===");
+    Serial.println("主机: " + host);
+    Serial.printf("TLS握手: %u 次 (失败 %u), 平均 %u ms, 最大 %u ms\n",
+                  stats.handshakeCount, stats.handshakeFailCount,
+                  stats.avgHandshakeMs(), stats.handshakeMaxMs);
+    Serial.printf("请求: %u 次 (复用连接 %u, 传输失败 %u), 平均 %u ms, 最大 %u ms\n",
+                  stats.requestCount, stats.reusedCount, stats.requestFailCount,
+                  stats.avgRequestMs(), stats.requestMaxMs);
+    Serial.printf("JSON请求体: 最大 %u/%u 字节, 编码/解析失败 %u 次\n",
+                  stats.bodyMaxBytes, SUPABASE_BODY_MAX, stats.jsonErrorCount);
+    Serial.println("========================\n");
+  }
+};
+
+#endif // SUPABASE_CLIENT_H
@@ -0,0 +1,192 @@
+/*
+ * UiAssets.h - 界面静态资源（预计算动画帧 + 文字宽度缓存）
+ *
+ * 功能：
+ * - 齿轮齿端点表：齿轮每次旋转45°，只有8个角度，端点在编译期算好，绘制时不再调用sin/cos
+ * - 滚动横幅：启动时把长广告文字预渲染成按列存储的位图，每帧只复制可见的列，
+ *   不再解码整串字形、不再测量宽度
+ * - 文字宽度缓存：常量字符串（TEXT_*、标题、套餐标签）按 字体+字符串指针 缓存宽度
+ *
+ * 说明：
+ * - 宽度缓存以指针为键，只能用于常量字符串；sprintf生成的缓冲区内容会变，不能缓存
+ * - 预渲染借用U8g2缓冲区，必须在渲染任务启动前调用（会清空缓冲区）
+ * - 只在渲染任务中使用，不加锁
+ *
+ * 版本: v1.0
+ */
+
+#ifndef UI_ASSETS_H
+#define UI_ASSETS_H
+
+#include <Arduino.h>
+#include <U8g2lib.h>
+
+// =================== 齿轮齿端点 ===================
+// 第k个角度为 k×45°，偏移 = floor(r×cos)、floor(r×sin)，内端 r=14，外端 r=20
+// （与原先 gearRadius=16 时 (gearRadius-2)、(gearRadius+4) 的浮点计算结果一致）
+#define GEAR_ANGLE_STEPS 8
+
+struct GearTooth {
+  int8_t x1, y1;   // 内端
+  int8_t x2, y2;   // 外端
+};
+
+static const GearTooth GEAR_TEETH[GEAR_ANGLE_STEPS] = {
+  {  14,   0,  20,   0 },   //   0°
+  {   9,   9,  14,  14 },   //  45°
+  {   0,  14,   0,  20 },   //  90°
+  { -10,   9, -15,  14 },   // 135°
+  { -14,   0, -20,   0 },   // 180°
+  { -10, -10, -15, -15 },   // 225°
+  {   0, -14,   0, -20 },   // 270°
+  {   9, -10,  14, -15 },   // 315°
+};
+
+// =================== 文字宽度缓存 ===================
+#define TEXT_WIDTH_CACHE_SIZE 48
+
+class TextWidthCache {
+private:
+  struct Entry {
+    const uint8_t* font;
+    const char* text;
+    int16_t width;
+  };
+
+  Entry entries[TEXT_WIDTH_CACHE_SIZE];
+  int count = 0;
+  uint32_t hits = 0;
+  uint32_t misses = 0;
+
+public:
+  // 返回常量字符串在font下的宽度（调用前font必须已是当前字体）
+  int measure(U8G2& display, const uint8_t* font, const char* text) {
+    for (int i = 0; i < count; i++) {
+      if (entries[i].text == text && entries[i].font == font) {
+        hits++;
+        return entries[i].width;
+      }
+    }
+
+    misses++;
+    int width = display.getStrWidth(text);
+    if (count < TEXT_WIDTH_CACHE_SIZE) {
+      entries[count].font = font;
+      entries[count].text = text;
+      entries[count].width = (int16_t)width;
+      count++;
+    }
+    return width;
+  }
+
+  void clear() {
+    count = 0;
+    hits = 0;
+    misses = 0;
+  }
+
+  void printStats() {
+    Serial.printf("文字宽度缓存: %d/%d 条, 命中 %u, 测量 %u\n",
+                  count, TEXT_WIDTH_CACHE_SIZE, hits, misses);
+  }
+};
+
+// =================== 预渲染滚动横幅 ===================
+#define SCROLL_STRIP_MAX_HEIGHT 16   // 每列用一个uint16_t保存
+
+class ScrollStrip {
+private:
+  uint16_t* columns = NULL;   // 每列一个位图，bit0 = 顶行
+  int width = 0;
+  int height = 0;
+  int ascent = 0;
+
+  // 读取逻辑坐标(x, y)的像素（全缓冲区为竖直字节排列，每页8行）
+  static bool pixelAt(const uint8_t* buffer, int bufferWidth, int bufferHeight,
+                      int x, int y, bool rotated) {
+    if (rotated) {
+      x = bufferWidth - 1 - x;
+      y = bufferHeight - 1 - y;
+    }
+    return (buffer[(y / 8) * bufferWidth + x] >> (y % 8)) & 1;
+  }
+
+public:
+  // 把text按font预渲染（启动时调用一次）
+  bool build(U8G2& display, const char* text, const uint8_t* font) {
+    display.setFont(font);
+    width = display.getStrWidth(text);
+    ascent = display.getAscent();
+    height = ascent - display.getDescent();
+    if (width <= 0 || height > SCROLL_STRIP_MAX_HEIGHT) return false;
+
+    columns = (uint16_t*)malloc(width * sizeof(uint16_t));
+    if (columns == NULL) return false;
+    memset(columns, 0, width * sizeof(uint16_t));
+
+    uint8_t* buffer = display.getBufferPtr();
+    int bufferWidth = display.getBufferTileWidth() * 8;
+    int bufferHeight = display.getBufferTileHeight() * 8;
+
+    // 探测屏幕旋转：逻辑(0,0)在原生缓冲区的左上角还是右下角（R0/R2）
+    display.clearBuffer();
+    display.drawPixel(0, 0);
+    bool rotated = (buffer[0] & 1) == 0;
+
+    // 一次渲染一屏宽度，逐列读回
+    for (int offset = 0; offset < width; offset += bufferWidth) {
+      display.clearBuffer();
+      display.drawStr(-offset, ascent, text);
+      for (int x = 0; x < bufferWidth && offset + x < width; x++) {
+        uint16_t bits = 0;
+        for (int y = 0; y < height; y++) {
+          if (pixelAt(buffer, bufferWidth, bufferHeight, x, y, rotated)) bits |= 1 << y;
+        }
+        columns[offset + x] = bits;
+      }
+    }
+
+    display.clearBuffer();
+    return true;
+  }
+
+  bool isReady() { return columns != NULL; }
+  int getWidth() { return width; }
+
+  // 左边界为x、基线为baselineY绘制，只处理[clipLeft, clipRight)内的列
+  void draw(U8G2& display, int x, int baselineY, int clipLeft, int clipRight) {
+    int top = baselineY - ascent;
+    int first = max(clipLeft - x, 0);
+    int last = min(clipRight - x, width);
+
+    for (int c = first; c < last; c++) {
+      uint16_t bits = columns[c];
+      int y = 0;
+      // 每段连续像素画一条竖线
+      while (bits != 0) {
+        if ((bits & 1) == 0) {
+          bits >>= 1;
+          y++;
+          continue;
+        }
+        int runStart = y;
+        while (bits & 1) {
+          bits >>= 1;
+          y++;
+        }
+        display.drawVLine(x + c, top + runStart, y - runStart);
+      }
+    }
+  }
+};
+
+// =================== 套餐标签 ===================
+// 套餐选择页的两行文字及宽度，启动时生成
+struct PackageLabel {
+  char line1[8];
+  char line2[8];
+  int16_t width1;
+  int16_t width2;
+};
+
+#endif // UI_ASSETS_H
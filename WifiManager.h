@@ -0,0 +1,294 @@
+/*
+ * WifiManager.h - 事件驱动的WiFi连接管理
+ *
+ * 功能：
+ * - 由 WiFi.onEvent 驱动的连接状态机（空闲 → 连接中 → 已连接 / 退避等待），loop()中调用 service() 推进，
+ *   不阻塞、不轮询 WiFi.status()
+ * - 快速重连：上次连接的BSSID/信道和DHCP租约缓存在NVS，重连时直接指定AP和信道（跳过扫描）
+ *   并沿用上次的IP（跳过DHCP），通常几百毫秒内恢复；失败后立即退回完整连接（扫描+DHCP）
+ * - 连接失败按指数退避重试（WIFI_BACKOFF_MIN_MS 起，每次翻倍，最长 WIFI_BACKOFF_MAX_MS）
+ * - 统计：连接耗时（快速/完整）、断开原因、断网时长，串口命令 wifi 查看
+ *
+ * 线程安全：事件回调在WiFi事件任务中执行，只记录事件（自旋锁保护），状态机只在 loop() 中运行
+ *
+ * 版本: v1.0
+ */
+
+#ifndef WIFI_MANAGER_H
+#define WIFI_MANAGER_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <Preferences.h>
+#include "config.h"
+#include "LogRing.h"
+
+#define WIFI_CACHE_NAMESPACE "wifi"
+#define WIFI_DISCONNECT_SETTLE_MS 50   // 发起连接后这段时间内的断开事件属于上一次连接
+
+enum WifiMgrState {
+  WIFI_MGR_IDLE,
+  WIFI_MGR_CONNECTING,
+  WIFI_MGR_CONNECTED,
+  WIFI_MGR_BACKOFF
+};
+
+// 上次成功连接的AP和租约（NVS）
+struct WifiCache {
+  uint8_t bssid[6];
+  uint8_t channel;
+  uint32_t ip;
+  uint32_t gateway;
+  uint32_t subnet;
+  uint32_t dns;
+};
+
+struct WifiStats {
+  uint32_t attempts;
+  uint32_t connects;
+  uint32_t fastConnects;        // 使用缓存的BSSID/信道连接成功
+  uint32_t fastFallbacks;       // 快速连接失败，退回完整连接
+  uint32_t disconnects;
+  uint8_t lastReason;           // 最近一次断开原因（wifi_err_reason_t）
+  uint32_t lastConnectMs;
+  uint32_t maxConnectMs;
+  uint32_t totalConnectMs;
+  uint32_t lastOutageMs;        // 最近一次从断开到恢复的时长
+  uint32_t maxOutageMs;
+};
+
+class WifiManager {
+private:
+  Preferences store;
+  String ssid;
+  String password;
+
+  WifiMgrState state = WIFI_MGR_IDLE;
+  WifiCache cache;
+  bool cacheValid = false;
+  bool attemptFast = false;
+  unsigned long attemptStartMs = 0;
+  unsigned long nextAttemptMs = 0;
+  unsigned long backoffMs = WIFI_BACKOFF_MIN_MS;
+  unsigned long disconnectedAtMs = 0;
+  bool everConnected = false;
+  WifiStats stats;
+
+  // 事件回调写入，loop()读取
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+  bool gotIpEvent = false;
+  bool disconnectEvent = false;
+  unsigned long disconnectEventMs = 0;
+  uint8_t disconnectReason = 0;
+
+  void onEvent(arduino_event_id_t event, arduino_event_info_t info) {
+    portENTER_CRITICAL(&mux);
+    if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP) {
+      gotIpEvent = true;
+    } else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED || event == ARDUINO_EVENT_WIFI_STA_LOST_IP) {
+      disconnectEvent = true;
+      disconnectEventMs = millis();
+      disconnectReason = event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED ? info.wifi_sta_disconnected.reason : 0;
+    }
+    portEXIT_CRITICAL(&mux);
+  }
+
+  void loadCache() {
+    cacheValid = store.getString("ssid", "") == ssid &&
+                 store.getBytesLength("ap") == sizeof(cache) &&
+                 store.getBytes("ap", &cache, sizeof(cache)) == sizeof(cache);
+  }
+
+  // 连接成功后更新缓存（AP/信道/租约有变化才写NVS）
+  void saveCache() {
+    WifiCache current = {};
+    uint8_t* bssid = WiFi.BSSID();
+    if (bssid != NULL) memcpy(current.bssid, bssid, sizeof(current.bssid));
+    current.channel = (uint8_t)WiFi.channel();
+    current.ip = (uint32_t)WiFi.localIP();
+    current.gateway = (uint32_t)WiFi.gatewayIP();
+    current.subnet = (uint32_t)WiFi.subnetMask();
+    current.dns = (uint32_t)WiFi.dnsIP();
+
+    if (cacheValid && memcmp(&current, &cache, sizeof(cache)) == 0) return;
+    cache = current;
+    cacheValid = true;
+    store.putString("ssid", ssid);
+    store.putBytes("ap", &cache, sizeof(cache));
+  }
+
+  void startAttempt(bool fast) {
+    attemptFast = fast && cacheValid;
+    attemptStartMs = millis();
+    stats.attempts++;
+
+    if (attemptFast && WIFI_REUSE_LEASE && cache.ip != 0) {
+      WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet), IPAddress(cache.dns));
+    } else {
+      WiFi.config(INADDR_NONE, INADDR_NONE, INADDR_NONE);  // DHCP
+    }
+
+    if (attemptFast) {
+      WiFi.begin(ssid.c_str(), password.c_str(), cache.channel, cache.bssid);
+    } else {
+      WiFi.begin(ssid.c_str(), password.c_str());
+    }
+    state = WIFI_MGR_CONNECTING;
+  }
+
+  void attemptFailed(const char* why) {
+    WiFi.disconnect();
+    if (attemptFast) {
+      // AP或信道变了（路由器重启后换信道等）：立即完整连接
+      stats.fastFallbacks++;
+      LOG_D("WiFi快速连接失败（%s），改为完整连接", why);
+      startAttempt(false);
+      return;
+    }
+
+    LOG_W("⚠️ WiFi连接失败（%s），%lu ms后重试", why, backoffMs);
+    nextAttemptMs = millis() + backoffMs;
+    backoffMs = min(backoffMs * 2, (unsigned long)WIFI_BACKOFF_MAX_MS);
+    state = WIFI_MGR_BACKOFF;
+  }
+
+  void connected() {
+    uint32_t elapsed = millis() - attemptStartMs;
+    stats.connects++;
+    if (attemptFast) stats.fastConnects++;
+    stats.lastConnectMs = elapsed;
+    stats.totalConnectMs += elapsed;
+    if (elapsed > stats.maxConnectMs) stats.maxConnectMs = elapsed;
+    if (everConnected) {
+      stats.lastOutageMs = millis() - disconnectedAtMs;
+      if (stats.lastOutageMs > stats.maxOutageMs) stats.maxOutageMs = stats.lastOutageMs;
+    }
+
+    LOG_I("✅ WiFi已连接: %s（%s，%lu ms）", WiFi.localIP().toString().c_str(),
+          attemptFast ? "快速" : "完整", (unsigned long)elapsed);
+    everConnected = true;
+    backoffMs = WIFI_BACKOFF_MIN_MS;
+    state = WIFI_MGR_CONNECTED;
+    saveCache();
+  }
+
+public:
+  WifiManager() {
+    memset(&cache, 0, sizeof(cache));
+    memset(&stats, 0, sizeof(stats));
+  }
+
+  // 启动连接（立即返回，结果由事件驱动）
+  void begin(const String& wifiSsid, const String& wifiPassword) {
+    ssid = wifiSsid;
+    password = wifiPassword;
+    store.begin(WIFI_CACHE_NAMESPACE, false);
+    loadCache();
+
+    WiFi.onEvent([this](arduino_event_id_t event, arduino_event_info_t info) { onEvent(event, info); });
+    WiFi.mode(WIFI_STA);
+    WiFi.setAutoReconnect(false);  // 重连由状态机负责（退避、快速重连）
+    WiFi.setSleep(false);
+    LOG_I("连接WiFi: %s%s", ssid.c_str(), cacheValid ? "（使用缓存的AP/信道）" : "");
+    startAttempt(true);
+  }
+
+  // loop()中调用：处理事件、超时和退避重试
+  void service() {
+    portENTER_CRITICAL(&mux);
+    bool gotIp = gotIpEvent;
+    bool lost = disconnectEvent;
+    unsigned long lostAt = disconnectEventMs;
+    uint8_t reason = disconnectReason;
+    gotIpEvent = false;
+    disconnectEvent = false;
+    portEXIT_CRITICAL(&mux);
+
+    // 发起本次连接之前（或刚发起时由begin()内部断开）产生的断开事件不计
+    if (lost && state == WIFI_MGR_CONNECTING && (long)(lostAt - attemptStartMs) < WIFI_DISCONNECT_SETTLE_MS) {
+      lost = false;
+    }
+    if (lost) stats.lastReason = reason;
+
+    switch (state) {
+      case WIFI_MGR_CONNECTING: {
+        if (gotIp && WiFi.isConnected()) {
+          connected();
+        } else if (lost) {
+          char why[16];
+          snprintf(why, sizeof(why), "原因 %u", reason);
+          attemptFailed(why);
+        } else if (millis() - attemptStartMs >=
+                   (attemptFast ? WIFI_FAST_CONNECT_TIMEOUT_MS : WIFI_CONNECT_TIMEOUT_MS)) {
+          attemptFailed("超时");
+        }
+        break;
+      }
+
+      case WIFI_MGR_CONNECTED:
+        if (lost) {
+          stats.disconnects++;
+          disconnectedAtMs = millis();
+          LOG_W("⚠️ WiFi断开（原因 %u），快速重连...", reason);
+          startAttempt(true);
+        }
+        break;
+
+      case WIFI_MGR_BACKOFF:
+        if ((long)(millis() - nextAttemptMs) >= 0) {
+          startAttempt(true);
+        }
+        break;
+
+      case WIFI_MGR_IDLE:
+        break;
+    }
+  }
+
+  bool isConnected() const { return state == WIFI_MGR_CONNECTED; }
+  WifiMgrState getState() const { return state; }
+  const WifiStats& getStats() const { return stats; }
+
+  // 手动重连（串口命令）：跳过退避立即连接
+  void reconnectNow() {
+    backoffMs = WIFI_BACKOFF_MIN_MS;
+    if (state != WIFI_MGR_CONNECTED) startAttempt(true);
+  }
+
+  // 清除缓存的AP/租约（AP更换或IP冲突时）
+  void forgetCache() {
+    cacheValid = false;
+    store.remove("ap");
+  }
+
+  void printStatus() {
+    static const char* STATE_NAMES[] = {"空闲", "连接中", "已连接", "退避等待"};
+    Serial.println("\n=== WiFi ===");
+    Serial.printf("状态: %s", STATE_NAMES[state]);
+    if (state == WIFI_MGR_CONNECTED) {
+      Serial.printf(", IP %s, RSSI %d dBm, 信道 %d", WiFi.localIP().toString().c_str(),
+                    WiFi.RSSI(), (int)WiFi.channel());
+    } else if (state == WIFI_MGR_BACKOFF) {
+      Serial.printf(", %ld ms后重试", (long)(nextAttemptMs - millis()));
+    }
+    Serial.println();
+    if (cacheValid) {
+      Serial.printf("缓存: BSSID %02X:%02X:%02X:%02X:%02X:%02X 信道 %u, IP %s\n",
+                    cache.bssid[0], cache.bssid[1], cache.bssid[2], cache.bssid[3], cache.bssid[4],
+                    cache.bssid[5], cache.channel, IPAddress(cache.ip).toString().c_str());
+    } else {
+      Serial.println("缓存: 无（下次为完整连接）");
+    }
+    Serial.printf("连接: %u 次尝试, %u 次成功（快速 %u）, 快速失败转完整 %u\n",
+                  stats.attempts, stats.connects, stats.fastConnects, stats.fastFallbacks);
+    if (stats.connects > 0) {
+      Serial.printf("连接耗时: 最近 %u ms, 平均 %u ms, 最长 %u ms\n", stats.lastConnectMs,
+                    stats.totalConnectMs / stats.connects, stats.maxConnectMs);
+    }
+    Serial.printf("断开: %u 次, 最近原因 %u, 最近断网 %u ms, 最长断网 %u ms\n", stats.disconnects,
+                  stats.lastReason, stats.lastOutageMs, stats.maxOutageMs);
+    Serial.println("============\n");
+  }
+};
+
+#endif // WIFI_MANAGER_H
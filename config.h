@@ -6,7 +6,7 @@
  *
  * v0.5 更新 (2025-11-08):
  * - PendingTransaction 结构 (离线交易)
- * - MAX_OFFLINE_QUEUE 常量
+ * - OFFLINE_REC_* 离线日志记录状态
  * - UI优化：NFC动画、滚动广告、齿轮动画
  * - Bug修复：完成页面显示、VIP INFO布局
  */
@@ -38,6 +38,7 @@
 #define SPI_SCK 12
 #define SPI_MISO 13
 #define RC522_RST 14
+#define RC522_IRQ -1  //   IRQ（-1=未接线，刷卡状态改用轮询）
 /*
 模块引脚	ESP32-S3	说明
 VCC	3.3V	电源（注意：必须是3.3V，不能用5V）
@@ -76,6 +77,31 @@ VT	RST	GPIO 14	RC522_RST
 
 #define PULSE_OUT 3
 
+// =================== 多洗车位（Bay.h）===================
+// 一块ESP32-S3控制多个洗车位：每个洗车位一个MFRC522（共用SPI总线，各自片选/复位）、
+// 一路脉冲输出和OK/SELECT按钮；OLED、4个LED和蜂鸣器只有一套
+#define MAX_BAYS 3                  // 编译期上限（剩余GPIO只够3个洗车位）
+#define BAY_COUNT_DEFAULT 1         // 出厂洗车位数（NVS，串口 bays <n> 修改，重启后生效）
+#define BAY_NFC_BUDGET_US 30000     // 每次loop读卡的时间预算，用完后其余洗车位下次优先读卡
+
+struct BayPins {
+  int8_t nfcCs;
+  int8_t nfcRst;
+  int8_t nfcIrq;       // -1 = 未接线（轮询）
+  int8_t pulse;
+  int8_t btnOk;
+  int8_t btnSelect;
+  bool display;        // 使用OLED和状态LED（只能有一个洗车位）
+};
+
+// 洗车位1沿用单机版引脚；GPIO 0/19/20/35-37/43-46 保留给启动、USB、PSRAM和串口
+static const BayPins BAY_PINS[MAX_BAYS] = {
+  // 片选      复位       IRQ        脉冲       OK      SELECT      OLED
+  {RC522_CS, RC522_RST, RC522_IRQ, PULSE_OUT, BTN_OK, BTN_SELECT, true},
+  {8,        9,         -1,        15,        17,     18,         false},
+  {21,       38,        -1,        39,        40,     47,         false}
+};
+
 // =================== WiFi和网络配置 ===================
 // 注意：请在实际部署时修改为您的WiFi凭证
 #define WIFI_SSID  "coinwash"        //"hanzg_hanyh"
@@ -100,6 +126,19 @@ VT	RST	GPIO 14	RC522_RST
 // 注意：这里不用 #define，而是用全局变量，以便运行时通过串口命令修改
 // 在 GoldSky_Lite.ino 中定义: int CURRENT_LOG_LEVEL = LOG_LEVEL_INFO;
 
+// 编译期最低级别：低于该级别的日志调用在编译时删除（商用固件可设为 LOG_LEVEL_INFO）
+#define LOG_COMPILE_LEVEL LOG_LEVEL_VERBOSE
+
+// 异步日志缓冲（LogRing.h，位于RTC_NOINIT内存，软复位后保留）
+#define LOG_RING_SIZE 32                // 缓冲条数
+#define LOG_LINE_MAX 120                // 每条最大字节数（超长截断）
+#define LOG_POST_MORTEM_LINES 16        // 软复位后随健康度日志上传的条数
+#define LOG_TASK_CORE 0
+#define LOG_TASK_STACK_SIZE 3072
+#define LOG_TASK_PRIORITY 1             // 最低的非空闲优先级
+#define LOG_DRAIN_BATCH 16              // 每次最多输出条数
+#define LOG_DRAIN_INTERVAL_MS 20        // 缓冲为空时的等待间隔
+
 // 敏感信息脱敏（商用必须开启）
 #define LOG_MASK_SENSITIVE false  // false = 显示完整卡号（调试用）
 
@@ -108,10 +147,24 @@ VT	RST	GPIO 14	RC522_RST
 #define FIRMWARE_VERSION "v2.4"
 #define MAX_RETRY_COUNT 3
 
+// =================== 堆内存保护 ===================
+// 分配失败取决于最大空闲块（连续内存），不只是剩余总量：碎片化后剩余很多也可能分配失败
+#define HEAP_RESTART_FREE_BYTES 20000      // 剩余堆低于此值：立即重启
+#define HEAP_WARN_FREE_BYTES 40000         // 剩余堆低于此值：记录预警
+#define HEAP_RESTART_BLOCK_BYTES 8192      // 最大空闲块低于此值：所有洗车位空闲时重启
+#define HEAP_WARN_BLOCK_BYTES 20480        // 最大空闲块低于此值：记录预警（TLS重新握手需要约16KB连续内存）
+#define HEAP_WARN_FRAG_PERCENT 60          // 碎片率（1 - 最大空闲块/剩余堆）高于此值：记录预警
+
+// 分配点计数（HeapMonitor.h）：统计仍在使用堆的代码位置，默认关闭，排查时编译参数加 -DHEAP_SITE_STATS=1
+#ifndef HEAP_SITE_STATS
+#define HEAP_SITE_STATS 0
+#endif
+
 // =================== 脉冲和超时配置 ===================
 // Nayax标准: active=500ms, inactive=500ms, 总周期=1000ms
 #define PULSE_WIDTH_MS 500        // 脉冲高电平时间（匹配Nayax的50×10ms）
 #define PULSE_INTERVAL_MS 1000    // 脉冲周期（高电平+低电平）
+// 以上为默认值，每个套餐可在PACKAGES中单独设置脉冲宽度和周期（由PulseEngine硬件定时输出）
 
 #define STATE_TIMEOUT_WELCOME_MS 60000
 #define STATE_TIMEOUT_SELECT_MS 20000
@@ -121,6 +174,13 @@ VT	RST	GPIO 14	RC522_RST
 #define STATE_TIMEOUT_COMPLETE_MS 5000       // 5秒（缩短完成页显示时间）
 #define STATE_TIMEOUT_VIP_QUERY_MS 15000
 #define STATE_TIMEOUT_VIP_DISPLAY_MS 15000
+#define STATE_TIMEOUT_ERROR_MS 5000          // 系统错误页显示时间
+#define STATE_MESSAGE_ERROR_MS 2000          // 错误提示（余额不足/卡片无效等）显示时间，按OK可跳过
+#define STATE_MESSAGE_PAID_MS 1000           // "Paid!" 显示时间
+#define LOOP_LATENCY_BUDGET_MS 100           // loop单次耗时预算，超出时记录警告
+#define LOOP_PERIOD_MS 50                    // loop周期目标：休眠时间 = 周期 - 本次工作耗时
+#define LOOP_MIN_SLEEP_MS 5                  // 工作超出周期时至少休眠（让出CPU给低优先级任务）
+#define PERF_DUMP_INTERVAL_MS 0              // loop剖析定期打印间隔，0=关闭（串口 perf every <秒>）
 
 // =================== 错误恢复配置（方案A优化1）===================
 #define MAX_CONSECUTIVE_ERRORS 5
@@ -128,10 +188,33 @@ VT	RST	GPIO 14	RC522_RST
 
 // =================== 健壮性增强配置 ===================
 #define NFC_RETRY_INTERVAL_MS 30000     // NFC重试间隔：30秒
-#define WIFI_RETRY_INTERVAL_MS 60000    // WiFi重试间隔：60秒
 #define ALLOW_OFFLINE_MODE true         // 允许离线模式运行
 #define FAULT_LED_BLINK_INTERVAL 300    // 故障LED闪烁间隔（ms）
 
+// =================== WiFi连接管理（WifiManager.h）===================
+#define WIFI_BACKOFF_MIN_MS 500         // 连接失败后的首次重试等待，之后每次翻倍
+#define WIFI_BACKOFF_MAX_MS 30000       // 最长重试等待
+#define WIFI_FAST_CONNECT_TIMEOUT_MS 3000   // 使用缓存的BSSID/信道连接的超时
+#define WIFI_CONNECT_TIMEOUT_MS 10000   // 完整连接（扫描+DHCP）的超时
+#define WIFI_REUSE_LEASE true           // 快速重连时沿用上次的DHCP租约（跳过DHCP）
+
+// =================== 启动配置（BootProfile.h）===================
+#define BOOT_TARGET_MS 1000             // 进入欢迎界面的目标耗时（超过时打印各阶段耗时）
+#define BOOT_LED_TEST_MS 800            // LED自检：4个LED同时点亮的时长（不阻塞）
+#define BOOT_I2C_SETTLE_MS 20           // 启用上拉后等待I2C总线稳定
+#define BOOT_OLED_ATTEMPTS 3            // OLED初始化重试次数
+#define BOOT_OLED_RETRY_MS 200          // OLED初始化失败后的重试间隔
+#define BOOT_TASK_STACK_SIZE 4096       // OLED/NFC初始化任务栈（完成后删除）
+#define BOOT_TASK_PRIORITY 2
+#define OLED_I2C_ADDRESS 0x3C
+
+// =================== NFC读卡调度（NfcReader.h）===================
+#define NFC_POLL_ACTIVE_MS 20           // 刷卡/VIP查询状态：轮询间隔（实际受loop周期限制）
+#define NFC_POLL_IDLE_MS 2000           // 待机：低频检测（健康度统计）
+#define NFC_IRQ_REARM_MS 100            // IRQ模式：重新发送REQA的间隔（卡片应答时IRQ拉低）
+#define NFC_HEALTH_INTERVAL_MS 60000    // 非刷卡状态下批量寄存器检查间隔
+#define NFC_FAIL_PROBE_THRESHOLD 5      // 连续读卡失败达到该次数时立即检查
+
 // =================== LED状态枚举 ===================
 enum LEDStatus {
   LED_OFF,
@@ -150,7 +233,33 @@ enum SystemState {
   STATE_COMPLETE,
   STATE_VIP_QUERY,
   STATE_VIP_DISPLAY,
-  STATE_ERROR
+  STATE_ERROR,
+  STATE_MESSAGE          // 定时提示页（Paid!/余额不足/卡片无效），到时后进入下一状态
+};
+
+#define STATE_COUNT (STATE_MESSAGE + 1)
+
+// =================== 状态转换表 ===================
+// 每个状态的超时和进入/更新/退出钩子，见 GoldSky_Lite.ino 中的 STATE_TABLE
+// NFC读卡频率（每个状态在状态表中指定）
+enum NfcPollMode {
+  NFC_POLL_OFF,      // 不检测卡片（只做健康检查）
+  NFC_POLL_IDLE,     // 低频检测
+  NFC_POLL_ACTIVE    // 等待刷卡：IRQ或高频轮询
+};
+
+class Bay;
+
+struct StateDef {
+  SystemState state;
+  unsigned long timeoutMs;       // 0 = 无超时
+  SystemState timeoutTarget;     // 超时后进入的状态
+  bool timeoutAlert;             // 超时时播放错误音
+  bool holdWhileNetBusy;         // 前台网络请求进行中暂停超时（不能丢失扣费结果）
+  NfcPollMode nfcMode;           // 本状态的NFC读卡频率
+  void (*onEnter)(Bay& bay);
+  void (*onUpdate)(Bay& bay);
+  void (*onExit)(Bay& bay);
 };
 
 enum Language {
@@ -176,6 +285,8 @@ struct Package {
   float price;
   int pulses;
   bool isQuery;
+  uint16_t pulseWidthMs;   // 每个脉冲高电平时间
+  uint16_t pulsePeriodMs;  // 脉冲周期（高电平+低电平）
 };
 
 // =================== 套餐配置 ===================
@@ -184,11 +295,11 @@ struct Package {
 
 // 套餐数组（可在此修改套餐详情和脉冲数）
 static Package PACKAGES[PACKAGE_COUNT] = {
-  {"4 Min Wash", "Lavage 4 min", "4分钟洗车", 4, 4.00, 4, false},   // $4/4min
-  {"7 Min Wash", "Lavage 7 min", "7分钟洗车", 7, 6.00, 7, false},   // $6/7min
-  {"9 Min Wash", "Lavage 9 min", "9分钟洗车", 9, 8.00, 9, false},   // $8/9min
-  {"14 Min Wash", "Lavage 14 min", "14分钟洗车", 14, 12.00, 14, false}, // $12/14min
-  {"VIP Info", "Info VIP", "VIP查询", 0, 0.00, 0, true}              // VIP查询选项
+  {"4 Min Wash", "Lavage 4 min", "4分钟洗车", 4, 4.00, 4, false, PULSE_WIDTH_MS, PULSE_INTERVAL_MS},   // $4/4min
+  {"7 Min Wash", "Lavage 7 min", "7分钟洗车", 7, 6.00, 7, false, PULSE_WIDTH_MS, PULSE_INTERVAL_MS},   // $6/7min
+  {"9 Min Wash", "Lavage 9 min", "9分钟洗车", 9, 8.00, 9, false, PULSE_WIDTH_MS, PULSE_INTERVAL_MS},   // $8/9min
+  {"14 Min Wash", "Lavage 14 min", "14分钟洗车", 14, 12.00, 14, false, PULSE_WIDTH_MS, PULSE_INTERVAL_MS}, // $12/14min
+  {"VIP Info", "Info VIP", "VIP查询", 0, 0.00, 0, true, 0, 0}              // VIP查询选项
 };
 
 // 会员类型
@@ -212,64 +323,222 @@ struct SystemLEDs {
   LEDStatus network;
   LEDStatus progress;
   LEDStatus status;
-  unsigned long lastBlinkTime;
-  bool blinkState;
 
   SystemLEDs() {
     power = false;
     network = LED_OFF;
     progress = LED_OFF;
     status = LED_OFF;
-    lastBlinkTime = 0;
-    blinkState = false;
   }
 };
 
 // =================== 卡片信息结构 ===================
+// 固定大小（不含String），可按值复制、放入队列结果，刷卡流程不分配堆内存
+#include "CardUid.h"
+
+#define CARD_NUMBER_LEN 20      // 显示卡号（与 CardCacheEntry 一致）
+#define CARD_MASKED_LEN 12      // 脱敏卡号 ****1234
+#define CARD_NAME_LEN 24
+#define CARD_DATE_LEN 12        // YYYY-MM-DD
+
 struct CardInfo {
-  String cardNumber;
-  String displayCardNumber;
-  String cardUID;
-  String cardUIDDecimal;
+  CardUid uid;
+  char cardNumber[CARD_MASKED_LEN];
+  char displayCardNumber[CARD_NUMBER_LEN];
   float balance;
   bool isActive;
   bool isValid;
-  String userName;
-  String cardType;
-  String lastTransactionDate;
+  char userName[CARD_NAME_LEN];
+  const char* cardType;   // 指向 MEMBER_TYPES 中的常量字符串
+  int memberType;
+  char lastTransactionDate[CARD_DATE_LEN];
 
   void clear() {
-    cardNumber = "";
-    displayCardNumber = "";
-    cardUID = "";
-    cardUIDDecimal = "";
-    balance = 0.0;
-    isActive = false;
-    isValid = false;
-    userName = "";
+    memset(this, 0, sizeof(*this));
     cardType = "";
-    lastTransactionDate = "";
+  }
+
+  // 由显示卡号生成脱敏卡号（后4位）
+  void setDisplayCardNumber(const char* number) {
+    strlcpy(displayCardNumber, number, sizeof(displayCardNumber));
+    size_t length = strlen(displayCardNumber);
+    if (length >= 4) {
+      snprintf(cardNumber, sizeof(cardNumber), "****%s", displayCardNumber + length - 4);
+    } else {
+      strlcpy(cardNumber, displayCardNumber, sizeof(cardNumber));
+    }
   }
 };
 
 // =================== 离线交易结构 ===================
+// 重放方式（记录写入时服务器上的状态）
+#define OFFLINE_REC_KIND_DEBIT 0    // 服务器未扣费：通过 jc_debit_card 补扣（同一幂等键）
+#define OFFLINE_REC_KIND_RECORD 1   // 余额已更新（三步扣费）：只补交易记录
+#define OFFLINE_REC_KIND_UNCOLLECTED 2  // 服务器拒绝扣费（服务已提供）：只补未收款记录
+
+// 交易类型（jc_transaction_history.transaction_type）
+#define TX_TYPE_CHARGE "CHARGE"
+#define TX_TYPE_CHARGE_UNCOLLECTED "CHARGE_UNCOLLECTED"  // 未扣余额、不计营收（见 supabase/002_debit_card_rpc.sql）
+
+// 固定64字节二进制记录，原样写入 txlog 分区（见 OfflineLog.h）
 struct PendingTransaction {
-  String cardUID;
-  float amount;
-  float balanceBefore;
-  String packageName;
-  unsigned long timestamp;
+  uint8_t state;           // 记录状态 OFFLINE_REC_*（只能由1变0，无需擦除）
+  uint8_t version;         // 记录格式版本
+  uint8_t bay;             // 洗车位（不在CRC范围内；旧记录为0xFF，超出范围时按洗车位1处理）
+  uint8_t reserved;
+  uint32_t crc;            // CRC32（从seq到记录末尾）
+  uint32_t seq;            // 交易序号（幂等键 = MAC-序号）
+  uint32_t timestamp;      // 记录时间 millis()
+  float amount;            // 交易金额（负数表示扣费）
+  float balanceBefore;     // 交易前余额
+  union {
+    char cardUID[18];      // v1：十进制UID字符串
+    struct {
+      CardUid uid;         // v2：二进制UID（支持7/10字节）
+      uint8_t uidReserved[18 - sizeof(CardUid)];
+    };
+  };
+  uint8_t kind;            // 重放方式 OFFLINE_REC_KIND_*（旧记录为0，按补扣处理）
+  uint8_t offlineSpend;    // 1=计入卡片缓存的离线累计（断网授权）
+  char packageName[20];    // 套餐名称
 
   void clear() {
-    cardUID = "";
-    amount = 0.0;
-    balanceBefore = 0.0;
-    packageName = "";
-    timestamp = 0;
+    memset(this, 0, sizeof(*this));
   }
+
+  // 十进制UID（兼容v1记录）
+  size_t formatUid(char* out, size_t size) const {
+    if (version == 1) return strlcpy(out, cardUID, size);
+    return uid.toDecimal(out, size);
+  }
+
+  bool getUid(CardUid& out) const {
+    if (version == 1) return CardUid::parseDecimal(cardUID, out);
+    out = uid;
+    return !out.isEmpty();
+  }
+};
+
+#define OFFLINE_REC_EMPTY 0xFF    // 已擦除/写入中
+#define OFFLINE_REC_WRITTEN 0xFE  // 已写入，等待同步
+#define OFFLINE_REC_ACKED 0xFC    // 服务器已确认
+#define OFFLINE_REC_VERSION 2       // v2：二进制UID（仍可读取v1记录）
+#define OFFLINE_REC_MIN_VERSION 1
+
+#define OFFLINE_SEQ_RESERVE_BLOCK 64  // 交易序号每64笔写一次NVS（重启后跳到下一块）
+
+// =================== 离线同步配置 ===================
+#define OFFLINE_SYNC_CHUNK_SIZE 10          // 每批记录数（只补交易记录的合并为一次PostgREST数组插入，补扣逐条请求）
+#define OFFLINE_SYNC_INTERVAL_MS 2000       // 两批之间的间隔
+#define OFFLINE_SYNC_RETRY_MS 30000         // 失败后首次重试间隔（之后指数退避）
+#define OFFLINE_SYNC_MAX_BACKOFF_MS 600000  // 最大退避时间：10分钟
+#define OFFLINE_SYNC_JITTER_MS 15000        // WiFi恢复后随机延迟上限（错开多台终端）
+
+// =================== 离线消费策略 ===================
+// 断网时凭本地卡片缓存授权，每张卡累计扣费不超过上限（可用串口命令修改，0=禁止）
+#define OFFLINE_SPEND_CAP_DEFAULT 20.0
+
+// =================== 先刷卡流程 ===================
+// 开启后欢迎页/选套餐页也接受刷卡：刷卡后立即在后台查询卡片，顾客选套餐期间查询完成，
+// 确认套餐时直接授权（串口命令 flow tap / flow select 切换，存NVS）
+#define TAP_FIRST_DEFAULT false
+#define TAP_FIRST_PREFETCH_MAX_AGE_MS 30000   // 查询结果超过此时间视为过期，确认时重新联网
+
+// =================== 渲染任务配置 ===================
+// OLED绘制和I2C发送在独立任务中按固定帧率执行，loop()只发布视图模型
+#define RENDER_TASK_CORE 0          // 与loop()（核心1）分开
+#define RENDER_TASK_STACK_SIZE 4096
+#define RENDER_TASK_PRIORITY 2      // 高于网络任务，TLS握手时动画不卡顿
+#define RENDER_FRAME_MS 50          // 20fps
+
+// 屏幕类型
+enum ScreenId {
+  SCREEN_NONE,
+  SCREEN_WELCOME,
+  SCREEN_PACKAGES,
+  SCREEN_CARD_SCAN,
+  SCREEN_VIP_SCAN,
+  SCREEN_VIP_INFO,
+  SCREEN_PROGRESS,   // 文字 + 进度条（Verifying/Processing/Ready/Paid!）
+  SCREEN_WASH,
+  SCREEN_COMPLETE,
+  SCREEN_ERROR
+};
+
+// 视图模型：loop()填写后整体发布，渲染任务只读取发布时的副本
+struct ViewModel {
+  uint32_t version;          // 每次发布+1
+  SystemState state;
+  ScreenId screen;
+  int selectedPackage;
+  char message[40];          // SCREEN_PROGRESS / SCREEN_ERROR 文字
+  float progress;            // 0.0 ~ 1.0
+  int pulsesSent;
+  int pulsesTotal;
+  int remainingMin;
+  int remainingSec;
+  char cardNumber[20];       // 卡片信息（VIP信息/完成页）
+  float balance;
+  bool cardActive;
+  bool nfcStruggling;        // 连续读卡失败，提示调整卡片
+  bool cardTapped;           // 先刷卡：选套餐页已刷卡
+};
+
+// =================== 网络任务配置 ===================
+// 所有Supabase请求都在独立的FreeRTOS任务中执行（loop()运行在核心1）
+#define NET_TASK_CORE 0            // 网络任务运行核心
+#define NET_TASK_STACK_SIZE 8192   // 网络任务栈大小（HTTPS需要较大栈）
+#define NET_TASK_PRIORITY 1        // 与loop()相同优先级
+#define NET_QUEUE_BASE_LENGTH 6    // 请求队列长度 = 基础 + 每个洗车位（有界，满时拒绝新请求）
+#define NET_QUEUE_PER_BAY 2
+#define NET_JSON_POOL_SIZE 8192    // 网络任务JSON内存池（最大用量：离线同步一批交易记录的数组upsert + 返回的幂等键；补扣/在线请求约1KB）
+
+// 网络请求类型
+enum NetJobType {
+  NET_JOB_CARD_LOOKUP,    // 查询卡片信息
+  NET_JOB_CHARGE,         // 扣费 + 记录交易
+  NET_JOB_HEALTH_UPLOAD,  // 上传健康度日志
+  NET_JOB_SYNC_OFFLINE    // 同步一批离线交易
 };
 
-#define MAX_OFFLINE_QUEUE 50  // 最多缓存50笔交易
+// 网络请求结果状态
+enum NetJobStatus {
+  NET_JOB_NONE,      // 无此请求
+  NET_JOB_PENDING,   // 排队或执行中
+  NET_JOB_DONE       // 已完成，结果可读取
+};
+
+// 网络请求（通过队列按值传递，不能包含String）
+struct NetJob {
+  uint32_t ticket;
+  NetJobType type;
+  uint8_t bay;           // 发起请求的洗车位（前台结果槽位、交易的机器ID）
+  CardUid uid;
+  float amount;
+  float balanceBefore;
+  char packageName[24];
+  bool cacheAuthorized;  // 已凭本地缓存授权（后台扣费，先刷新服务器余额）
+  bool offlineAuthorized; // 断网时凭缓存授权（计入离线累计，服务器结清后扣除）
+  bool directDebit;      // 未查询卡片，直接扣费（由服务器检查余额）
+};
+
+// 单次请求扣费结果（jc_debit_card）
+struct DebitResult {
+  bool ok;              // 扣费成功（含重复请求）
+  bool duplicate;       // 该幂等键已处理过（ok=false时为已记为未收款）
+  float balanceBefore;
+  float balanceAfter;
+  char reason[16];      // 失败原因：not_found / inactive / insufficient / uncollected（该幂等键已记为未收款）
+};
+
+// 网络请求结果（由网络任务写入，loop()轮询读取）
+struct NetResult {
+  uint32_t ticket = 0;
+  NetJobType type = NET_JOB_CARD_LOOKUP;
+  bool success = false;
+  CardInfo cardInfo;
+  char reason[16] = "";   // 服务器拒绝扣费的原因（见 DebitResult）
+};
 
 // =================== 系统状态结构 ===================
 struct SystemStatus {
@@ -277,15 +546,21 @@ struct SystemStatus {
   bool nfcWorking = false;
   bool displayWorking = false;
   uint32_t freeHeapMin = UINT32_MAX;
+  uint32_t maxAllocHeapMin = UINT32_MAX;   // 最大空闲块的最低值
   unsigned long maxLoopTime = 0;
   unsigned long totalTransactions = 0;
   float totalRevenue = 0.0;
+  unsigned long uncollectedCharges = 0;    // 服务器拒绝扣费的已提供服务（CHARGE_UNCOLLECTED）
 
   void updateMemoryStats() {
     uint32_t freeHeap = ESP.getFreeHeap();
     if (freeHeap < freeHeapMin) {
       freeHeapMin = freeHeap;
     }
+    uint32_t maxAlloc = ESP.getMaxAllocHeap();
+    if (maxAlloc < maxAllocHeapMin) {
+      maxAllocHeapMin = maxAlloc;
+    }
   }
 };
 
@@ -297,6 +572,8 @@ struct HealthMetrics {
   // 内存状态
   uint32_t freeHeap = 0;
   uint32_t minFreeHeap = UINT32_MAX;
+  uint32_t maxAllocHeap = 0;               // 最大空闲块（能分配的最大连续内存）
+  uint32_t minMaxAllocHeap = UINT32_MAX;
 
   // WiFi 状态
   bool wifiConnected = false;
@@ -320,8 +597,7 @@ struct HealthMetrics {
   int transactionsLastHour = 0;
   unsigned long lastTransactionTime = 0;
 
-  // 系统状态
-  String currentState = "";
+  // 系统状态（当前状态在生成日志时从各洗车位读取）
   unsigned long loopExecutionTimeMs = 0;
   int watchdogResetCount = 0;
 
@@ -330,6 +606,10 @@ struct HealthMetrics {
   int errorCountLast30Min = 0;
   unsigned long lastErrorTime = 0;
 
+  // 复位诊断（上次运行的最后几条日志，上传一次后清空）
+  int resetReason = 0;
+  String postMortemLog = "";
+
   // 更新方法
   void update() {
     uptimeSeconds = millis() / 1000;
@@ -337,6 +617,10 @@ struct HealthMetrics {
     if (freeHeap < minFreeHeap) {
       minFreeHeap = freeHeap;
     }
+    maxAllocHeap = ESP.getMaxAllocHeap();
+    if (maxAllocHeap < minMaxAllocHeap) {
+      minMaxAllocHeap = maxAllocHeap;
+    }
   }
 
   // 计算NFC成功率
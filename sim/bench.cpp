@@ -0,0 +1,535 @@
+/*
+ * bench.cpp - 主机仿真基准：回放刷卡/选套餐/洗车会话，统计延迟、loop耗时和堆高水位
+ *
+ * 每个会话：欢迎页按OK → 按SELECT选套餐 → 按OK → 刷卡（500ms后移开）→ 等待脉冲输出 → 回到欢迎页
+ * VIP查询会话：选择VIP Info → 刷卡 → 查看信息 → 按OK返回
+ *
+ * 输出：
+ * - 刷卡到第一个脉冲上升沿、刷卡到"Paid!"的延迟分位数（虚拟时间）
+ * - loop() 每次迭代的耗时分布（虚拟时间，不含末尾的休眠；及主机CPU时间），按状态分组
+ * - 固件堆高水位、最小空闲堆；模拟服务器和 SupabaseClient 的统计
+ * - --outage：中间三分之一的会话断网（缓存/离线授权），恢复后等待离线日志同步完成，
+ *   核对服务器上每张卡的余额 = 初始余额 - 显示"Paid!"的套餐金额；
+ *   断网期间服务器停用一张卡，此后该卡显示"Paid!"的交易应记为未收款（CHARGE_UNCOLLECTED）
+ *
+ * 用法见 sim/README.md
+ *
+ * 版本: v1.0
+ */
+
+#include <Arduino.h>
+#include <algorithm>
+#include <cmath>
+#include <ctime>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "sim.h"
+#include "mock_supabase.h"
+#include "config.h"
+#include "SupabaseClient.h"
+#include "LoopProfiler.h"
+#include "OfflineLog.h"
+#include "Bay.h"
+
+// 固件全局变量（GoldSky_Lite.ino）
+extern Bay bays[MAX_BAYS];  // 仿真只启用洗车位1
+extern SupabaseClient supabase;
+extern LoopProfiler loopProfiler;
+extern OfflineLog offlineLog;
+void setup();
+void loop();
+
+// =================== 参数 ===================
+static struct {
+  uint32_t sessions = 1000;
+  uint32_t seed = 1;
+  uint32_t cards = 50;
+  double vipRate = 0.1;        // VIP查询会话比例
+  double unknownRate = 0.02;   // 刷未登记卡片的比例
+  double cpuScale = 0;
+  bool serial = false;
+  bool tapFirst = false;       // 先刷卡流程（flow tap）
+  bool outage = false;         // 中间三分之一的会话断网，结束后核对服务器余额
+  const char* dumpDir = nullptr;
+  mock::Options server;
+} opts;
+
+static void usage() {
+  printf("用法: bench [选项]\n"
+         "  --sessions N        会话数（默认1000）\n"
+         "  --seed N            随机种子（默认1）\n"
+         "  --cards N           模拟服务器中的卡片数（默认50）\n"
+         "  --vip-rate R        VIP查询会话比例（默认0.1）\n"
+         "  --unknown-rate R    刷未登记卡片的比例（默认0.02）\n"
+         "  --latency-ms N      请求往返延迟（默认80）\n"
+         "  --jitter-ms N       延迟抖动（默认40）\n"
+         "  --handshake-ms N    TLS握手耗时（默认600）\n"
+         "  --error-rate R      返回503的概率\n"
+         "  --drop-rate R       响应丢失/握手失败的概率\n"
+         "  --timeout-rate R    服务器不应答的概率\n"
+         "  --keepalive-ms N    服务器空闲连接保持时间（默认60000）\n"
+         "  --no-rpc            关闭 jc_debit_card（测试三步扣费）\n"
+         "  --tap-first         先刷卡流程：欢迎页刷卡，选套餐期间后台查询\n"
+         "  --outage            中间三分之一的会话断网，恢复同步后核对服务器余额\n"
+         "  --chunked           响应使用chunked编码\n"
+         "  --cpu-scale X       主机CPU耗时×X计入虚拟时间（默认0：计算不耗时）\n"
+         "  --dump-oled DIR     每个会话的刷卡页和完成页保存为PBM\n"
+         "  --serial            打印固件串口输出\n");
+}
+
+static bool parseArgs(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+    auto takes = [&](const char* name) {
+      if (arg != name) return false;
+      if (value == nullptr) {
+        fprintf(stderr, "%s 缺少参数\n", name);
+        exit(2);
+      }
+      i++;
+      return true;
+    };
+
+    if (takes("--sessions")) opts.sessions = atoi(value);
+    else if (takes("--seed")) opts.seed = atoi(value);
+    else if (takes("--cards")) opts.cards = std::max(1, atoi(value));
+    else if (takes("--vip-rate")) opts.vipRate = atof(value);
+    else if (takes("--unknown-rate")) opts.unknownRate = atof(value);
+    else if (takes("--latency-ms")) opts.server.latencyMs = atoi(value);
+    else if (takes("--jitter-ms")) opts.server.jitterMs = atoi(value);
+    else if (takes("--handshake-ms")) opts.server.handshakeMs = atoi(value);
+    else if (takes("--error-rate")) opts.server.errorRate = atof(value);
+    else if (takes("--drop-rate")) opts.server.dropRate = atof(value);
+    else if (takes("--timeout-rate")) opts.server.timeoutRate = atof(value);
+    else if (takes("--keepalive-ms")) opts.server.keepAliveMs = atoi(value);
+    else if (takes("--cpu-scale")) opts.cpuScale = atof(value);
+    else if (takes("--dump-oled")) opts.dumpDir = value;
+    else if (arg == "--no-rpc") opts.server.rpc = false;
+    else if (arg == "--chunked") opts.server.chunked = true;
+    else if (arg == "--serial") opts.serial = true;
+    else if (arg == "--tap-first") opts.tapFirst = true;
+    else if (arg == "--outage") opts.outage = true;
+    else {
+      usage();
+      return false;
+    }
+  }
+  return true;
+}
+
+// =================== 统计 ===================
+struct Samples {
+  std::vector<uint32_t> values;
+
+  void add(uint32_t value) {
+    sim::Untracked guard;   // 统计数据不计入固件堆
+    values.push_back(value);
+  }
+
+  uint32_t percentile(double p) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    size_t index = (size_t)(p / 100.0 * (values.size() - 1) + 0.5);
+    return values[index];
+  }
+
+  void print(const char* name, const char* unit, double divisor) {
+    if (values.empty()) {
+      printf("  %-22s (无样本)\n", name);
+      return;
+    }
+    printf("  %-22s n=%-7zu p50=%8.2f p90=%8.2f p99=%8.2f max=%8.2f %s\n", name, values.size(),
+           percentile(50) / divisor, percentile(90) / divisor, percentile(99) / divisor,
+           percentile(100) / divisor, unit);
+  }
+};
+
+static const char* STATE_NAMES[STATE_COUNT] = {
+  "WELCOME", "SELECT_PACKAGE", "CARD_SCAN", "SYSTEM_READY", "PROCESSING",
+  "COMPLETE", "VIP_QUERY", "VIP_DISPLAY", "ERROR", "MESSAGE"
+};
+
+static Samples tapToPulse;          // 微秒
+static Samples tapToPaid;           // 微秒
+static Samples loopVirtual;         // 微秒（不含末尾休眠）
+static Samples loopCpu;             // 纳秒（主机）
+static Samples loopVirtualByState[STATE_COUNT];
+
+static struct {
+  uint32_t started = 0;
+  uint32_t washed = 0;              // 收到脉冲并回到欢迎页
+  uint32_t vipShown = 0;
+  uint32_t declined = 0;            // 错误提示页（余额不足/无效卡/交易失败）
+  uint32_t stuck = 0;               // 等待超时（状态机没有按预期前进）
+  uint32_t loops = 0;
+  uint32_t offlineSessions = 0;     // 断网期间的会话
+  uint32_t offlinePaid = 0;         // 断网期间显示"Paid!"
+} results;
+
+static const double CARD_INITIAL_CREDIT = 5000;
+static std::map<std::string, double> charged;   // 卡片 → 显示"Paid!"的套餐金额合计
+static bool wifiDown = false;
+static std::string revokedCard;                 // 断网期间在服务器上停用的卡片
+static uint32_t revokedPaid = 0;                // 停用后该卡显示"Paid!"的次数（应为未收款）
+
+// --outage 结束时的核对结果
+static struct {
+  bool synced = false;              // 离线日志已同步完成
+  uint32_t pending = 0;
+  uint32_t mismatched = 0;          // 服务器余额与预期不符的卡片
+  uint32_t uncollected = 0;         // 服务器上的未收款记录
+  double expectedTotal = 0;
+  double serverTotal = 0;
+} resync;
+
+static size_t minFreeHeap = SIZE_MAX;
+static volatile uint64_t firstPulseUs = 0;   // 本会话第一个脉冲上升沿
+static bool benchDone = false;
+
+static void onPin(int pin, int level, uint64_t atUs) {
+  if (pin == PULSE_OUT && level == HIGH && firstPulseUs == 0) firstPulseUs = atUs;
+}
+
+// =================== 固件任务 ===================
+static void loopTask(void* arg) {
+  (void)arg;
+  sim::Task* self = sim::currentTask();
+  setup();
+  for (;;) {
+    SystemState state = bays[0].state;
+    uint64_t startUs = sim::nowUs();
+    uint64_t startCpu = sim::taskCpuNs(self);
+    uint64_t sleepBeforeUs = loopProfiler.get(PROF_SLEEP).totalUs;
+    loop();
+    uint64_t elapsedUs = sim::nowUs() - startUs;
+    uint64_t sleptUs = loopProfiler.get(PROF_SLEEP).totalUs - sleepBeforeUs;
+    uint64_t busyUs = elapsedUs > sleptUs ? elapsedUs - sleptUs : 0;   // 去掉loop末尾的休眠
+    loopVirtual.add((uint32_t)busyUs);
+    loopVirtualByState[state].add((uint32_t)busyUs);
+    loopCpu.add((uint32_t)(sim::taskCpuNs(self) - startCpu));
+    results.loops++;
+
+    size_t freeHeap = ESP.getFreeHeap();
+    if (freeHeap < minFreeHeap) minFreeHeap = freeHeap;
+  }
+}
+
+// =================== 会话脚本 ===================
+static std::mt19937 rng;
+
+static double uniform() {
+  return std::uniform_real_distribution<double>(0, 1)(rng);
+}
+
+static bool waitState(SystemState state, uint32_t timeoutMs) {
+  return sim::waitFor([state]() { return bays[0].state == state; }, (uint64_t)timeoutMs * 1000);
+}
+
+// 按下并松开按钮（保持时间超过固件的50ms消抖）
+static void press(int pin) {
+  sim::setPin(pin, HIGH);
+  sim::sleepUs(200000);
+  sim::setPin(pin, LOW);
+  sim::sleepUs(200000);
+}
+
+static void cardBytes(uint32_t index, uint8_t uid[4]) {
+  uint32_t value = 0x10000000u + index * 7919u;
+  uid[0] = value >> 24;
+  uid[1] = value >> 16;
+  uid[2] = value >> 8;
+  uid[3] = value;
+}
+
+static std::string cardKey(const uint8_t uid[4]) {
+  uint32_t value = ((uint32_t)uid[0] << 24) | ((uint32_t)uid[1] << 16) | ((uint32_t)uid[2] << 8) | uid[3];
+  return std::to_string(value);
+}
+
+static void dumpScreen(uint32_t session, const char* name) {
+  if (opts.dumpDir == nullptr) return;
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%05u_%s.pbm", opts.dumpDir, session, name);
+  sim::dumpOled(path);
+}
+
+static void runSession(uint32_t session) {
+  results.started++;
+  bool vip = uniform() < opts.vipRate;
+  int package = vip ? PACKAGE_COUNT - 1 : (int)(rng() % (PACKAGE_COUNT - 1));
+
+  uint8_t uid[4];
+  cardBytes(uniform() < opts.unknownRate ? opts.cards + 1 + rng() % 1000 : rng() % opts.cards, uid);
+  if (wifiDown) results.offlineSessions++;
+
+  if (!waitState(STATE_WELCOME, 60000)) {
+    results.stuck++;
+    return;
+  }
+  sim::sleepUs(300000 + rng() % 700000);    // 顾客走到机器前
+
+  auto isAnswered = [vip]() {
+    return bays[0].state == STATE_MESSAGE || bays[0].state == STATE_WELCOME ||
+           (vip && bays[0].state == STATE_VIP_DISPLAY);
+  };
+  bool answered;
+  uint64_t tapUs;
+  uint64_t answeredUs;
+
+  if (opts.tapFirst) {
+    // 先刷卡：欢迎页刷卡 → 选套餐 → 按OK；耗时从按下OK（顾客最后一个操作）开始计
+    sim::placeCard(uid, sizeof(uid));
+    bool selecting = waitState(STATE_SELECT_PACKAGE, 2000);
+    sim::sleepUs(500000);
+    sim::removeCard();
+    if (!selecting) {
+      results.stuck++;
+      return;
+    }
+    for (int i = 0; i < package; i++) press(BTN_SELECT);
+
+    firstPulseUs = 0;
+    tapUs = sim::nowUs();
+    sim::setPin(BTN_OK, HIGH);
+    answered = sim::waitFor(isAnswered, 30000000);
+    answeredUs = sim::nowUs();
+    uint64_t heldUs = answeredUs - tapUs;
+    if (heldUs < 200000) sim::sleepUs(200000 - heldUs);
+    sim::setPin(BTN_OK, LOW);
+  } else {
+    press(BTN_OK);
+    if (!waitState(STATE_SELECT_PACKAGE, 2000)) {
+      results.stuck++;
+      return;
+    }
+    for (int i = 0; i < package; i++) press(BTN_SELECT);
+    press(BTN_OK);
+    if (!waitState(vip ? STATE_VIP_QUERY : STATE_CARD_SCAN, 2000)) {
+      results.stuck++;
+      return;
+    }
+    sim::sleepUs(500000 + rng() % 1000000);   // 掏卡
+
+    // 刷卡：卡片在天线上停留500ms
+    firstPulseUs = 0;
+    tapUs = sim::nowUs();
+    sim::placeCard(uid, sizeof(uid));
+    answered = sim::waitFor(isAnswered, 30000000);
+    answeredUs = sim::nowUs();
+    if (answeredUs - tapUs < 500000) sim::sleepUs(500000 - (answeredUs - tapUs));
+    sim::removeCard();
+  }
+  dumpScreen(session, "tap");
+
+  if (!answered) {
+    results.stuck++;
+    return;
+  }
+
+  if (vip) {
+    if (bays[0].state == STATE_VIP_DISPLAY) {
+      results.vipShown++;
+      sim::sleepUs(1500000);
+      press(BTN_OK);
+    } else {
+      results.declined++;
+    }
+    return;
+  }
+
+  if (bays[0].state != STATE_MESSAGE || bays[0].messageIsError) {
+    results.declined++;
+    return;
+  }
+  tapToPaid.add((uint32_t)(answeredUs - tapUs));
+  {
+    sim::Untracked guard;
+    std::string key = cardKey(uid);
+    if (key == revokedCard) {
+      revokedPaid++;
+    } else {
+      charged[key] += PACKAGES[package].price;
+    }
+  }
+  if (wifiDown) results.offlinePaid++;
+
+  if (!sim::waitFor([]() { return firstPulseUs != 0; }, 10000000)) {
+    results.stuck++;
+    return;
+  }
+  tapToPulse.add((uint32_t)(firstPulseUs - tapUs));
+  if (!waitState(STATE_COMPLETE, 60000)) {
+    results.stuck++;
+    return;
+  }
+  dumpScreen(session, "complete");
+  results.washed++;
+}
+
+// 断网期间在服务器上停用卡片（终端缓存中仍为正常）
+static void revokeCard(uint32_t index) {
+  sim::Untracked guard;
+  uint8_t uid[4];
+  cardBytes(index, uid);
+  revokedCard = cardKey(uid);
+  mock::Card card = *mock::server().findCard(revokedCard);
+  card.active = false;
+  mock::server().addCard(revokedCard, card);
+}
+
+// 等待离线日志同步完成，核对服务器余额
+static void checkResync() {
+  sim::setWifiAvailable(true);
+  wifiDown = false;
+  resync.synced = sim::waitFor([]() { return offlineLog.pendingCount() == 0; }, 1800ULL * 1000000);
+  sim::sleepUs(5000000);   // 最后一批确认后的缓存更新
+  resync.pending = offlineLog.pendingCount();
+  resync.uncollected = mock::server().getStats().uncollectedRows;
+
+  sim::Untracked guard;
+  for (uint32_t i = 0; i < opts.cards; i++) {
+    uint8_t uid[4];
+    cardBytes(i, uid);
+    std::string key = cardKey(uid);
+    const mock::Card* card = mock::server().findCard(key);
+    double expected = CARD_INITIAL_CREDIT - charged[key];
+    resync.expectedTotal += expected;
+    resync.serverTotal += card->credit;
+    if (std::fabs(card->credit - expected) > 0.005) {
+      if (resync.mismatched < 5) {
+        fprintf(stderr, "bench: 卡片 %s 服务器余额 %.2f，预期 %.2f\n", key.c_str(), card->credit, expected);
+      }
+      resync.mismatched++;
+    }
+  }
+}
+
+static void benchTask(void* arg) {
+  (void)arg;
+  // 等待setup()完成、loop()开始运行且WiFi已连接
+  sim::waitFor([]() { return results.loops > 0 && sim::wifiConnected(); }, 120000000);
+  if (opts.tapFirst) sim::serialInput("flow tap");
+  sim::sleepUs(1000000);
+  sim::resetHeapPeak();
+
+  for (uint32_t session = 0; session < opts.sessions; session++) {
+    if (opts.outage && session == opts.sessions / 3) {
+      sim::setWifiAvailable(false);
+      wifiDown = true;
+      revokeCard(0);
+    } else if (opts.outage && session == opts.sessions * 2 / 3) {
+      sim::setWifiAvailable(true);
+      wifiDown = false;
+    }
+    runSession(session);
+    if ((session + 1) % 100 == 0) {
+      fprintf(stderr, "bench: %u/%u 会话\n", session + 1, opts.sessions);
+    }
+  }
+  waitState(STATE_WELCOME, 60000);
+  if (opts.outage) checkResync();
+  benchDone = true;
+}
+
+// =================== 报告 ===================
+static void report(double hostSeconds) {
+  const mock::Stats& server = mock::server().getStats();
+  const SupabaseStats& client = supabase.getStats();
+  sim::HeapStats heap = sim::heapStats();
+
+  printf("\n=================== GS-Touch 会话基准 ===================\n");
+  printf("会话: %u（洗车 %u / VIP查询 %u / 拒绝 %u / 卡住 %u），%s\n", results.started, results.washed,
+         results.vipShown, results.declined, results.stuck, opts.tapFirst ? "先刷卡" : "先选套餐");
+  printf("虚拟时间: %.1f s，主机耗时: %.2f s，loop迭代: %u\n", sim::nowUs() / 1e6, hostSeconds, results.loops);
+  printf("服务器: 延迟 %u+%u ms，握手 %u ms，503 %.3f，丢失 %.3f，超时 %.3f%s%s\n",
+         opts.server.latencyMs, opts.server.jitterMs, opts.server.handshakeMs, opts.server.errorRate,
+         opts.server.dropRate, opts.server.timeoutRate, opts.server.rpc ? "" : "，无RPC",
+         opts.server.chunked ? "，chunked" : "");
+
+  printf("\n[延迟]\n");
+  // 先刷卡流程从确认套餐（按OK）开始计，即刷卡后顾客实际等待的时间
+  tapToPaid.print(opts.tapFirst ? "确认 → Paid!" : "刷卡 → Paid!", "ms", 1000.0);
+  tapToPulse.print(opts.tapFirst ? "确认 → 第一个脉冲" : "刷卡 → 第一个脉冲", "ms", 1000.0);
+
+  printf("\n[loop耗时]（虚拟时间不含末尾休眠；CPU为主机时间）\n");
+  loopVirtual.print("全部（虚拟）", "ms", 1000.0);
+  loopCpu.print("全部（主机CPU）", "us", 1000.0);
+  for (int state = 0; state < STATE_COUNT; state++) {
+    if (loopVirtualByState[state].values.empty()) continue;
+    loopVirtualByState[state].print(STATE_NAMES[state], "ms", 1000.0);
+  }
+
+  if (opts.outage) {
+    printf("\n[断网与重新同步]\n");
+    printf("  断网会话 %u（Paid! %u），离线日志%s（剩余 %u 笔）\n", results.offlineSessions,
+           results.offlinePaid, resync.synced ? "已同步" : "同步超时", resync.pending);
+    printf("  服务器余额合计 %.2f，预期 %.2f，不符的卡片 %u\n", resync.serverTotal, resync.expectedTotal,
+           resync.mismatched);
+    printf("  停用卡片 %s：停用后 Paid! %u 次，未收款记录 %u\n", revokedCard.c_str(), revokedPaid,
+           resync.uncollected);
+  }
+
+  printf("\n[堆]\n");
+  printf("  当前 %zu B，高水位 %zu B，最小空闲 %zu B，分配 %u 次 / 释放 %u 次\n", heap.current, heap.peak,
+         minFreeHeap == SIZE_MAX ? (size_t)ESP.getFreeHeap() : minFreeHeap, heap.allocs, heap.frees);
+
+  printf("\n[模拟服务器]\n");
+  printf("  握手 %u，查卡 %u，更新余额 %u，交易POST %u（%u行，重复 %u），扣费RPC %u（重复 %u），健康日志 %u\n",
+         server.handshakes, server.cardLookups, server.cardPatches, server.transactionPosts,
+         server.transactionRows, server.duplicateRows, server.debitCalls, server.debitDuplicates,
+         server.healthPosts);
+  printf("  401 %u，404 %u，注入503 %u，注入丢失 %u，注入超时 %u\n", server.unauthorized, server.notFound,
+         server.injectedErrors, server.injectedDrops, server.injectedTimeouts);
+
+  printf("\n[SupabaseClient]\n");
+  printf("  握手 %u（失败 %u，平均 %u ms，最大 %u ms），请求 %u（失败 %u，平均 %u ms，最大 %u ms），复用 %u\n",
+         client.handshakeCount, client.handshakeFailCount, client.avgHandshakeMs(), client.handshakeMaxMs,
+         client.requestCount, client.requestFailCount, client.avgRequestMs(), client.requestMaxMs,
+         client.reusedCount);
+  printf("  最大请求体 %u B，JSON错误 %u\n", client.bodyMaxBytes, client.jsonErrorCount);
+}
+
+static void onFirmwareRestart() {
+  fprintf(stderr, "bench: 固件在 %.1f s 时请求重启（会话 %u）\n", sim::nowUs() / 1e6, results.started);
+}
+
+int main(int argc, char** argv) {
+  if (!parseArgs(argc, argv)) return 2;
+
+  rng.seed(opts.seed);
+  mock::server().configure(opts.server);
+  mock::server().seed(opts.seed);
+  randomSeed(opts.seed);
+  for (uint32_t i = 0; i < opts.cards; i++) {
+    uint8_t uid[4];
+    cardBytes(i, uid);
+    mock::Card card;
+    card.displayNumber = "8800" + std::to_string(1000 + i);
+    card.name = "Member " + std::to_string(i);
+    card.credit = CARD_INITIAL_CREDIT;
+    card.memberType = i % 8;
+    card.active = i % 25 != 24;   // 少量停用卡片
+    mock::server().addCard(cardKey(uid), card);
+  }
+
+  sim::setCpuScale(opts.cpuScale);
+  sim::setSerialEcho(opts.serial);
+  sim::onPinChange(onPin);
+  sim::onRestart(onFirmwareRestart);
+
+  sim::createTask("loopTask", loopTask, nullptr, 1, 8192);
+  sim::createTask("bench", benchTask, nullptr, 20, 4096);
+
+  timespec start, end;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  sim::run([]() { return benchDone; });
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  report((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9);
+  bool resyncOk = !opts.outage ||
+                  (resync.synced && resync.mismatched == 0 && resync.uncollected == revokedPaid);
+  return results.stuck == 0 && resyncOk ? 0 : 1;
+}
@@ -0,0 +1,141 @@
+#!/usr/bin/env python3
+"""
+gen_sketch.py - 按 Arduino IDE 的方式把 .ino 合并为一个 C++ 文件（主机仿真用）
+
+与 arduino-cli 预处理一致：
+- 主 .ino 在前，其余 .ino 按文件名排序追加
+- 开头加 #include <Arduino.h>
+- 所有顶层函数的原型插在第一个函数定义之前
+- 用 #line 指向原文件，编译错误显示 .ino 中的行号
+
+用法: gen_sketch.py <sketch目录> <主.ino> <输出.cpp>
+
+版本: v1.0
+"""
+
+import os
+import re
+import sys
+
+KEYWORDS = {"if", "for", "while", "switch", "return", "else", "do", "sizeof", "catch"}
+NON_FUNCTION_HEADS = ("struct ", "class ", "enum ", "union ", "namespace ", "typedef ")
+
+
+def strip_code(text):
+    """把注释、字符串和字符常量替换为空格（保留换行和位置），便于数括号"""
+    out = []
+    i = 0
+    n = len(text)
+    while i < n:
+        c = text[i]
+        nxt = text[i + 1] if i + 1 < n else ""
+        if c == "/" and nxt == "/":
+            while i < n and text[i] != "\n":
+                out.append(" ")
+                i += 1
+        elif c == "/" and nxt == "*":
+            while i < n and not (text[i] == "*" and i + 1 < n and text[i + 1] == "/"):
+                out.append("\n" if text[i] == "\n" else " ")
+                i += 1
+            out.append("  ")
+            i += 2
+        elif c in "\"'":
+            quote = c
+            out.append(" ")
+            i += 1
+            while i < n and text[i] != quote:
+                if text[i] == "\\":
+                    out.append(" ")
+                    i += 1
+                out.append("\n" if i < n and text[i] == "\n" else " ")
+                i += 1
+            out.append(" ")
+            i += 1
+        else:
+            out.append(c)
+            i += 1
+    return "".join(out)
+
+
+def find_functions(text):
+    """返回 [(签名起始偏移, 原型)]：大括号深度为0处的函数定义"""
+    code = strip_code(text)
+    # 预处理行不参与签名
+    code = re.sub(r"^[ \t]*#[^\n]*", lambda m: " " * len(m.group(0)), code, flags=re.M)
+
+    functions = []
+    depth = 0
+    head_start = 0  # 上一个 ; { } 之后
+    for i, c in enumerate(code):
+        if c == "{":
+            if depth == 0:
+                head = code[head_start:i]
+                proto = parse_signature(head)
+                if proto:
+                    offset = head_start + (len(head) - len(head.lstrip()))
+                    functions.append((offset, proto))
+            depth += 1
+            head_start = i + 1
+        elif c == "}":
+            depth -= 1
+            head_start = i + 1
+        elif c == ";" and depth == 0:
+            head_start = i + 1
+    return functions
+
+
+def parse_signature(head):
+    sig = " ".join(head.split())
+    if not sig or "=" in sig.split("(")[0] or sig.startswith(NON_FUNCTION_HEADS):
+        return None
+    m = re.match(r"^(.*?)\b([A-Za-z_]\w*)\s*\((.*)\)\s*(const)?$", sig)
+    if not m or not m.group(1).strip() or m.group(2) in KEYWORDS:
+        return None
+    if "::" in m.group(1) or m.group(1).strip().endswith("::"):
+        return None  # 类外定义的成员函数
+    return sig + ";"
+
+
+def main():
+    if len(sys.argv) != 4:
+        print(__doc__)
+        sys.exit(1)
+    sketch_dir, main_ino, output = sys.argv[1:]
+    others = sorted(f for f in os.listdir(sketch_dir) if f.endswith(".ino") and f != main_ino)
+
+    parts = []
+    for name in [main_ino] + others:
+        path = os.path.abspath(os.path.join(sketch_dir, name))
+        with open(path, encoding="utf-8") as f:
+            parts.append((path, f.read()))
+
+    # 第一个函数定义（必然在主 .ino 中）之前插入全部原型
+    prototypes = []
+    first = None
+    for index, (path, text) in enumerate(parts):
+        for offset, proto in find_functions(text):
+            prototypes.append(proto)
+            if first is None:
+                first = (index, offset)
+
+    out = ["#include <Arduino.h>\n"]
+    for index, (path, text) in enumerate(parts):
+        out.append('#line 1 "%s"\n' % path)
+        if first is not None and first[0] == index:
+            offset = text.rfind("\n", 0, first[1]) + 1
+            line = text.count("\n", 0, offset) + 1
+            out.append(text[:offset])
+            out.append("\n".join(prototypes) + "\n")
+            out.append('#line %d "%s"\n' % (line, path))
+            out.append(text[offset:])
+        else:
+            out.append(text)
+        if not text.endswith("\n"):
+            out.append("\n")
+
+    with open(output, "w", encoding="utf-8") as f:
+        f.write("".join(out))
+
+
+if __name__ == "__main__":
+    main()
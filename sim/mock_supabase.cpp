@@ -0,0 +1,322 @@
+/*
+ * mock_supabase.cpp - 进程内的 Supabase REST 模拟服务器
+ *
+ * 请求体只解析终端实际发送的平面JSON（对象或对象数组），不依赖ArduinoJson，
+ * 避免模拟服务器与被测固件共用同一个解析器
+ *
+ * 版本: v1.0
+ */
+
+#include "mock_supabase.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+namespace mock {
+
+Server& server() {
+  static Server instance;
+  return instance;
+}
+
+// =================== 平面JSON ===================
+// 取出对象中某个字段的原始值（字符串去掉引号），找不到时返回false
+static bool jsonField(const std::string& object, const char* key, std::string& out) {
+  std::string pattern = std::string("\"") + key + "\"";
+  size_t pos = object.find(pattern);
+  if (pos == std::string::npos) return false;
+  pos = object.find(':', pos + pattern.size());
+  if (pos == std::string::npos) return false;
+  pos++;
+  while (pos < object.size() && isspace((unsigned char)object[pos])) pos++;
+  if (pos >= object.size()) return false;
+
+  if (object[pos] == '"') {
+    size_t end = pos + 1;
+    out.clear();
+    while (end < object.size() && object[end] != '"') {
+      if (object[end] == '\\' && end + 1 < object.size()) end++;
+      out += object[end++];
+    }
+    return end < object.size();
+  }
+
+  size_t end = pos;
+  while (end < object.size() && object[end] != ',' && object[end] != '}' && !isspace((unsigned char)object[end])) {
+    end++;
+  }
+  out = object.substr(pos, end - pos);
+  return true;
+}
+
+static double jsonNumber(const std::string& object, const char* key, double def) {
+  std::string value;
+  if (!jsonField(object, key, value)) return def;
+  char* end = nullptr;
+  double number = strtod(value.c_str(), &end);
+  return end == value.c_str() ? def : number;
+}
+
+// 顶层对象数组拆成单个对象（或单个对象本身）
+static std::vector<std::string> jsonObjects(const std::string& body) {
+  std::vector<std::string> objects;
+  int depth = 0;
+  bool inString = false;
+  size_t start = 0;
+  for (size_t i = 0; i < body.size(); i++) {
+    char c = body[i];
+    if (inString) {
+      if (c == '\\') i++;
+      else if (c == '"') inString = false;
+      continue;
+    }
+    if (c == '"') {
+      inString = true;
+    } else if (c == '{') {
+      if (depth++ == 0) start = i;
+    } else if (c == '}') {
+      if (--depth == 0) objects.push_back(body.substr(start, i - start + 1));
+    }
+  }
+  return objects;
+}
+
+static std::string jsonEscape(const std::string& text) {
+  std::string out;
+  for (char c : text) {
+    if (c == '"' || c == '\\') out += '\\';
+    out += c;
+  }
+  return out;
+}
+
+static std::string queryValue(const std::string& path, const char* name) {
+  std::string pattern = std::string(name) + "=";
+  size_t pos = path.find('?');
+  while (pos != std::string::npos) {
+    pos++;
+    if (path.compare(pos, pattern.size(), pattern) == 0) {
+      size_t end = path.find('&', pos);
+      return path.substr(pos + pattern.size(), end == std::string::npos ? std::string::npos : end - pos - pattern.size());
+    }
+    pos = path.find('&', pos);
+  }
+  return "";
+}
+
+static bool hasHeader(const std::string& headers, const char* name) {
+  std::string pattern = std::string(name) + ":";
+  return headers.find(pattern) != std::string::npos;
+}
+
+static std::string money(double value) {
+  char text[32];
+  snprintf(text, sizeof(text), "%.2f", value);
+  return text;
+}
+
+// =================== 服务器 ===================
+const Card* Server::findCard(const std::string& uid) const {
+  auto it = cards.find(uid);
+  return it == cards.end() ? nullptr : &it->second;
+}
+
+uint32_t Server::latencyUs() {
+  uint32_t jitter = options.jitterMs > 0 ? rng() % (options.jitterMs * 1000 + 1) : 0;
+  return options.latencyMs * 1000 + jitter;
+}
+
+uint32_t Server::handshake(bool& ok) {
+  std::uniform_real_distribution<double> uniform(0, 1);
+  ok = uniform(rng) >= options.dropRate;
+  if (ok) stats.handshakes++;
+  uint32_t jitter = options.jitterMs > 0 ? rng() % (options.jitterMs * 1000 + 1) : 0;
+  return options.handshakeMs * 1000 + jitter;
+}
+
+Response Server::handle(const std::string& method, const std::string& path,
+                        const std::string& headers, const std::string& body) {
+  Response response;
+  std::uniform_real_distribution<double> uniform(0, 1);
+  double roll = uniform(rng);
+  uint32_t latency = latencyUs();
+  response.latencyUs = latency;
+
+  if (roll < options.timeoutRate) {
+    stats.injectedTimeouts++;
+    response.fault = FAULT_TIMEOUT;
+    return response;  // 服务器没有收到/处理请求
+  }
+  roll -= options.timeoutRate;
+  if (roll < options.errorRate) {
+    stats.injectedErrors++;
+    response.status = 503;
+    response.body = "{\"message\":\"Service Unavailable\"}";
+    return response;
+  }
+  roll -= options.errorRate;
+  bool drop = roll < options.dropRate;
+
+  if (!hasHeader(headers, "apikey")) {
+    stats.unauthorized++;
+    response.status = 401;
+    response.body = "{\"message\":\"No API key found in request\"}";
+  } else if (path.compare(0, 25, "/rest/v1/jc_vip_cards?car") == 0) {
+    std::string uid = queryValue(path, "card_uid");
+    if (uid.compare(0, 3, "eq.") == 0) uid = uid.substr(3);
+    response = method == "PATCH" ? patchCard(uid, body) : getCard(uid);
+  } else if (path.compare(0, 30, "/rest/v1/jc_transaction_histor") == 0 && method == "POST") {
+    std::string prefer;
+    size_t pos = headers.find("Prefer:");
+    if (pos != std::string::npos) prefer = headers.substr(pos, headers.find('\n', pos) - pos);
+    response = postTransactions(body, prefer);
+  } else if (path == "/rest/v1/rpc/jc_debit_card" && method == "POST" && options.rpc) {
+    response = debitCard(body);
+  } else if (path == "/rest/v1/system_health_logs" && method == "POST") {
+    stats.healthPosts++;
+    response.status = 201;
+  } else {
+    stats.notFound++;
+    response.status = 404;
+    response.body = "{\"code\":\"PGRST202\",\"message\":\"Not found\"}";
+  }
+
+  response.latencyUs = latency;
+  if (drop) {
+    stats.injectedDrops++;
+    response.fault = FAULT_DROP;  // 已处理，但响应丢失
+  }
+  return response;
+}
+
+Response Server::getCard(const std::string& uid) {
+  Response response;
+  stats.cardLookups++;
+  response.status = 200;
+  const Card* card = findCard(uid);
+  if (card == nullptr) {
+    response.body = "[]";
+    return response;
+  }
+  response.body = "[{\"display_card_number\":\"" + jsonEscape(card->displayNumber) +
+                  "\",\"cardholder_name\":\"" + jsonEscape(card->name) +
+                  "\",\"card_credit\":" + money(card->credit) +
+                  ",\"member_type\":" + std::to_string(card->memberType) +
+                  ",\"is_active\":" + (card->active ? "true" : "false") +
+                  ",\"updated_at\":\"2025-11-07T12:00:00.000000+00:00\"}]";
+  return response;
+}
+
+Response Server::patchCard(const std::string& uid, const std::string& body) {
+  Response response;
+  stats.cardPatches++;
+  auto it = cards.find(uid);
+  if (it != cards.end()) {
+    it->second.credit = jsonNumber(body, "card_credit", it->second.credit);
+  }
+  response.status = 204;
+  return response;
+}
+
+// 写入一行交易，返回 1=新记录 0=幂等键已存在 -1=缺少字段
+int Server::insertTransaction(const std::string& row) {
+  std::string key;
+  if (!jsonField(row, "idempotency_key", key)) return -1;
+  if (idempotencyKeys.count(key)) {
+    stats.duplicateRows++;
+    return 0;
+  }
+  idempotencyKeys.insert(key);
+  balanceBefore[key] = jsonNumber(row, "balance_before", 0);
+  stats.transactionRows++;
+  std::string type;
+  if (jsonField(row, "transaction_type", type) && type == "CHARGE_UNCOLLECTED") {
+    uncollectedKeys.insert(key);
+    stats.uncollectedRows++;
+  }
+  return 1;
+}
+
+Response Server::postTransactions(const std::string& body, const std::string& prefer) {
+  Response response;
+  stats.transactionPosts++;
+  bool representation = prefer.find("return=representation") != std::string::npos;
+  bool ignoreDuplicates = prefer.find("resolution=ignore-duplicates") != std::string::npos;
+
+  std::string keys;
+  for (const std::string& row : jsonObjects(body)) {
+    int inserted = insertTransaction(row);
+    if (inserted < 0) {
+      response.status = 400;
+      response.body = "{\"message\":\"null value in column \\\"idempotency_key\\\"\"}";
+      return response;
+    }
+    if (inserted == 0 && ignoreDuplicates) continue;  // ON CONFLICT DO NOTHING：不返回已存在的行
+    std::string key;
+    jsonField(row, "idempotency_key", key);
+    if (!keys.empty()) keys += ",";
+    keys += "{\"idempotency_key\":\"" + jsonEscape(key) + "\"}";
+  }
+
+  response.status = 201;
+  if (representation) response.body = "[" + keys + "]";
+  return response;
+}
+
+Response Server::debitCard(const std::string& body) {
+  Response response;
+  stats.debitCalls++;
+  response.status = 200;
+
+  std::string uid, key, package, machine;
+  jsonField(body, "p_card_uid", uid);
+  jsonField(body, "p_machine_id", machine);
+  jsonField(body, "p_package", package);
+  double amount = jsonNumber(body, "p_amount", 0);
+  if (amount <= 0 || !jsonField(body, "p_idempotency_key", key)) {
+    response.body = "{\"ok\":false,\"reason\":\"invalid_request\"}";
+    return response;
+  }
+
+  auto it = cards.find(uid);
+  if (it == cards.end()) {
+    response.body = "{\"ok\":false,\"reason\":\"not_found\"}";
+    return response;
+  }
+  Card& card = it->second;
+
+  if (idempotencyKeys.count(key)) {
+    stats.debitDuplicates++;
+    if (uncollectedKeys.count(key)) {
+      // 同一幂等键已记为未收款：不是已扣费
+      response.body = "{\"ok\":false,\"duplicate\":true,\"reason\":\"uncollected\",\"balance\":" +
+                      money(card.credit) + "}";
+      return response;
+    }
+    response.body = "{\"ok\":true,\"duplicate\":true,\"balance_before\":" + money(balanceBefore[key]) +
+                    ",\"balance_after\":" + money(card.credit) + "}";
+    return response;
+  }
+
+  if (!card.active) {
+    response.body = "{\"ok\":false,\"reason\":\"inactive\",\"balance\":" + money(card.credit) + "}";
+    return response;
+  }
+  if (card.credit < amount) {
+    response.body = "{\"ok\":false,\"reason\":\"insufficient\",\"balance\":" + money(card.credit) + "}";
+    return response;
+  }
+
+  double before = card.credit;
+  card.credit -= amount;
+  idempotencyKeys.insert(key);
+  balanceBefore[key] = before;
+  stats.transactionRows++;
+  response.body = "{\"ok\":true,\"duplicate\":false,\"balance_before\":" + money(before) +
+                  ",\"balance_after\":" + money(card.credit) + "}";
+  return response;
+}
+
+}  // namespace mock
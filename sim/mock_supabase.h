@@ -0,0 +1,122 @@
+/*
+ * mock_supabase.h - 进程内的 Supabase REST 模拟服务器（主机仿真用）
+ *
+ * 路径和语义与 supabase/mock（PostgreSQL + PostgREST）一致：
+ * - GET/PATCH /rest/v1/jc_vip_cards?card_uid=eq.<uid>
+ * - POST /rest/v1/jc_transaction_history（单条或批量，按 idempotency_key 去重，
+ *   return=representation 时返回写入的幂等键；resolution=ignore-duplicates 时只返回新写入的行）
+ * - POST /rest/v1/rpc/jc_debit_card（同 supabase/002_debit_card_rpc.sql；可关闭以测试三步扣费）
+ * - POST /rest/v1/system_health_logs
+ *
+ * 故障注入（每个请求按概率抽取，随机数可复现）：
+ * - 延迟：latency + [0, jitter] 毫秒
+ * - 5xx：返回503
+ * - 断开：服务器已处理请求，但响应丢失（HTTPC_ERROR_CONNECTION_LOST，用于测试幂等重试）
+ * - 超时：服务器不应答（HTTPC_ERROR_READ_TIMEOUT）
+ * - keep-alive：连接空闲超过 keepAliveMs 后由服务器关闭
+ *
+ * 版本: v1.0
+ */
+
+#ifndef MOCK_SUPABASE_H
+#define MOCK_SUPABASE_H
+
+#include <stdint.h>
+#include <map>
+#include <random>
+#include <set>
+#include <string>
+
+namespace mock {
+
+struct Options {
+  uint32_t latencyMs = 80;         // 请求往返
+  uint32_t jitterMs = 40;
+  uint32_t handshakeMs = 600;      // TLS握手
+  double errorRate = 0;            // 返回503的概率
+  double dropRate = 0;             // 响应丢失的概率
+  double timeoutRate = 0;          // 不应答的概率
+  uint32_t keepAliveMs = 60000;    // 空闲连接保持时间
+  bool chunked = false;            // 响应使用chunked编码
+  bool rpc = true;                 // false：jc_debit_card 返回404
+};
+
+struct Card {
+  std::string displayNumber;
+  std::string name;
+  double credit = 0;
+  int memberType = 0;
+  bool active = true;
+};
+
+enum Fault {
+  FAULT_NONE,
+  FAULT_DROP,
+  FAULT_TIMEOUT
+};
+
+struct Response {
+  int status = 0;
+  std::string body;
+  uint32_t latencyUs = 0;
+  Fault fault = FAULT_NONE;
+};
+
+struct Stats {
+  uint32_t handshakes = 0;
+  uint32_t cardLookups = 0;
+  uint32_t cardPatches = 0;
+  uint32_t transactionPosts = 0;
+  uint32_t transactionRows = 0;
+  uint32_t duplicateRows = 0;      // 幂等键已存在的交易行
+  uint32_t uncollectedRows = 0;    // CHARGE_UNCOLLECTED（服务器拒绝扣费的已提供服务）
+  uint32_t debitCalls = 0;
+  uint32_t debitDuplicates = 0;
+  uint32_t healthPosts = 0;
+  uint32_t unauthorized = 0;
+  uint32_t notFound = 0;
+  uint32_t injectedErrors = 0;
+  uint32_t injectedDrops = 0;
+  uint32_t injectedTimeouts = 0;
+};
+
+class Server {
+private:
+  Options options;
+  std::mt19937 rng{1};
+  std::map<std::string, Card> cards;          // 十进制UID → 卡片
+  std::set<std::string> idempotencyKeys;
+  std::map<std::string, double> balanceBefore; // 幂等键 → 扣费前余额
+  std::set<std::string> uncollectedKeys;       // transaction_type = CHARGE_UNCOLLECTED 的幂等键
+  Stats stats;
+
+  uint32_t latencyUs();
+  int insertTransaction(const std::string& row);
+  Response getCard(const std::string& uid);
+  Response patchCard(const std::string& uid, const std::string& body);
+  Response postTransactions(const std::string& body, const std::string& prefer);
+  Response debitCard(const std::string& body);
+
+public:
+  void configure(const Options& options) { this->options = options; }
+  const Options& getOptions() const { return options; }
+  void seed(uint32_t seed) { rng.seed(seed); }
+
+  void addCard(const std::string& uid, const Card& card) { cards[uid] = card; }
+  const Card* findCard(const std::string& uid) const;
+
+  // 握手耗时（微秒）；ok=false 表示握手失败
+  uint32_t handshake(bool& ok);
+
+  // 处理一个请求（headers 为 "Name: value" 行）
+  Response handle(const std::string& method, const std::string& path,
+                  const std::string& headers, const std::string& body);
+
+  const Stats& getStats() const { return stats; }
+};
+
+Server& server();
+
+}  // namespace mock
+
+#endif // MOCK_SUPABASE_H
@@ -0,0 +1,108 @@
+/*
+ * Arduino.h - ESP32 Arduino 核心（主机仿真）
+ *
+ * 时间函数使用虚拟时钟，GPIO/LEDC 写入仿真引脚，FreeRTOS 与 esp_* 接口见对应头文件
+ *
+ * 版本: v1.0
+ */
+
+#ifndef SIM_ARDUINO_H
+#define SIM_ARDUINO_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <math.h>
+#include <ctype.h>
+#include <algorithm>
+#include <cmath>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_system.h"
+#include "WString.h"
+#include "Stream.h"
+
+typedef uint8_t byte;
+typedef bool boolean;
+typedef uint16_t word;
+
+// 与ESP32核心一致：min/max为std模板（参数类型必须相同）
+using std::min;
+using std::max;
+using std::abs;
+
+#define constrain(x, low, high) ((x) < (low) ? (low) : ((x) > (high) ? (high) : (x)))
+
+#define HIGH 0x1
+#define LOW 0x0
+#define INPUT 0x01
+#define OUTPUT 0x03
+#define INPUT_PULLUP 0x05
+#define INPUT_PULLDOWN 0x09
+#define RISING 0x01
+#define FALLING 0x02
+#define CHANGE 0x03
+
+#define DEC 10
+#define HEX 16
+#define OCT 8
+#define BIN 2
+
+#define IRAM_ATTR
+#define RTC_NOINIT_ATTR
+#define RTC_DATA_ATTR
+#define PROGMEM
+#define F(text) (text)
+
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char* dst, const char* src, size_t size);
+size_t strlcat(char* dst, const char* src, size_t size);
+#endif
+
+// =================== 时间（虚拟时钟）===================
+unsigned long millis();
+unsigned long micros();
+void delay(uint32_t ms);
+void delayMicroseconds(uint32_t us);
+void yield();
+
+// =================== GPIO ===================
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t level);
+int digitalRead(uint8_t pin);
+void attachInterrupt(uint8_t pin, void (*isr)(), int mode);
+void attachInterruptArg(uint8_t pin, void (*isr)(void*), void* arg, int mode);
+void detachInterrupt(uint8_t pin);
+#define digitalPinToInterrupt(pin) (pin)
+
+// =================== LEDC（蜂鸣器）===================
+bool ledcAttach(uint8_t pin, uint32_t freq, uint8_t resolution);
+uint32_t ledcSetup(uint8_t channel, uint32_t freq, uint8_t resolution);
+void ledcAttachPin(uint8_t pin, uint8_t channel);
+uint32_t ledcWriteTone(uint8_t pinOrChannel, uint32_t freq);
+bool ledcWrite(uint8_t pinOrChannel, uint32_t duty);
+
+// =================== 随机数（可复现）===================
+long random(long max);
+long random(long min, long max);
+void randomSeed(unsigned long seed);
+
+// =================== ESP ===================
+class EspClass {
+public:
+  uint32_t getHeapSize();
+  uint32_t getFreeHeap();
+  uint32_t getMinFreeHeap();
+  uint32_t getMaxAllocHeap();
+  uint32_t getCpuFreqMHz() { return 240; }
+  uint32_t getCycleCount() { return (uint32_t)(micros() * 240); }  // 按虚拟时钟
+  uint64_t getEfuseMac() { return 0x0000A1B2C3D4E5F6ULL; }
+  const char* getSdkVersion() { return "sim"; }
+  void restart();
+};
+
+extern EspClass ESP;
+
+#endif // SIM_ARDUINO_H
@@ -0,0 +1,75 @@
+/*
+ * HTTPClient.h - HTTP客户端（主机仿真：请求交给进程内的 mock_supabase 处理）
+ *
+ * 与ESP32 HTTPClient一致的行为：
+ * - begin(client, url) 使用调用方的连接；setReuse(true) 时 end() 不关闭连接
+ * - 复用连接前丢弃上一个响应未读完的数据
+ * - 响应体留在连接中，由 getStreamPtr()/getString() 读取（chunked编码时 getSize() 返回-1）
+ *
+ * 版本: v1.0
+ */
+
+#ifndef SIM_HTTP_CLIENT_H
+#define SIM_HTTP_CLIENT_H
+
+#include <Arduino.h>
+#include <WiFiClient.h>
+#include <string>
+#include <vector>
+
+#define HTTPC_ERROR_CONNECTION_REFUSED (-1)
+#define HTTPC_ERROR_SEND_HEADER_FAILED (-2)
+#define HTTPC_ERROR_SEND_PAYLOAD_FAILED (-3)
+#define HTTPC_ERROR_NOT_CONNECTED (-4)
+#define HTTPC_ERROR_CONNECTION_LOST (-5)
+#define HTTPC_ERROR_NO_STREAM (-6)
+#define HTTPC_ERROR_NO_HTTP_SERVER (-7)
+#define HTTPC_ERROR_TOO_LESS_RAM (-8)
+#define HTTPC_ERROR_ENCODING (-9)
+#define HTTPC_ERROR_STREAM_WRITE (-10)
+#define HTTPC_ERROR_READ_TIMEOUT (-11)
+
+#define HTTP_CODE_OK 200
+#define HTTP_CODE_CREATED 201
+#define HTTP_CODE_NO_CONTENT 204
+#define HTTP_CODE_NOT_FOUND 404
+
+class HTTPClient {
+private:
+  WiFiClient* client = NULL;
+  std::string host;
+  std::string path;
+  uint16_t port = 443;
+  bool reuse = true;
+  uint16_t timeoutMs = 5000;
+  std::vector<std::pair<std::string, std::string>> requestHeaders;
+  std::vector<std::string> wantedHeaders;
+  std::vector<std::pair<std::string, std::string>> responseHeaders;
+  int size = -1;
+  bool chunked = false;
+
+public:
+  bool begin(WiFiClient& client, const String& url);
+  void end();
+  void setReuse(bool enable) { reuse = enable; }
+  void setTimeout(uint16_t ms) { timeoutMs = ms; }
+  void setConnectTimeout(int32_t ms) { (void)ms; }
+  void addHeader(const String& name, const String& value);
+  void collectHeaders(const char* names[], size_t count);
+  String header(const char* name);
+
+  int sendRequest(const char* method, uint8_t* payload = NULL, size_t length = 0);
+  int sendRequest(const char* method, const String& payload);
+  int GET() { return sendRequest("GET"); }
+  int POST(const String& payload) { return sendRequest("POST", payload); }
+  int PATCH(const String& payload) { return sendRequest("PATCH", payload); }
+
+  int getSize() { return size; }
+  WiFiClient* getStreamPtr() { return client; }
+  WiFiClient& getStream() { return *client; }
+  String getString();
+  bool connected() { return client != NULL && client->connected(); }
+  static String errorToString(int error);
+};
+
+#endif // SIM_HTTP_CLIENT_H
@@ -0,0 +1,79 @@
+/*
+ * MFRC522.h - RC522读卡器（主机仿真：卡片由 sim::placeCard()/removeCard() 放入和移开）
+ *
+ * 耗时与真实芯片一致：
+ * - PICC_IsNewCardPresent：无卡时等待芯片定时器超时（PCD_Init设置为25ms），有卡时约1ms
+ * - PICC_ReadCardSerial：防冲突 + 选卡约3ms
+ * - PICC_HaltA后卡片不再应答REQA，直到移开
+ *
+ * 版本: v1.0
+ */
+
+#ifndef SIM_MFRC522_H
+#define SIM_MFRC522_H
+
+#include <Arduino.h>
+
+#define SIM_NFC_REQA_TIMEOUT_US 25000
+#define SIM_NFC_REQA_US 1000
+#define SIM_NFC_SELECT_US 3000
+#define SIM_NFC_REGISTER_US 20     // 单次寄存器读写（SPI）
+
+class MFRC522 {
+public:
+  enum PCD_Register : uint8_t {
+    CommandReg = 0x01 << 1,
+    ComIEnReg = 0x02 << 1,
+    ComIrqReg = 0x04 << 1,
+    ErrorReg = 0x06 << 1,
+    FIFODataReg = 0x09 << 1,
+    BitFramingReg = 0x0D << 1,
+    TxControlReg = 0x14 << 1,
+    RFCfgReg = 0x26 << 1,
+    VersionReg = 0x37 << 1,
+  };
+
+  enum PCD_Command : uint8_t {
+    PCD_Idle = 0x00,
+    PCD_Transceive = 0x0C,
+    PCD_SoftReset = 0x0F,
+  };
+
+  enum PICC_Command : uint8_t {
+    PICC_CMD_REQA = 0x26,
+  };
+
+  enum PCD_RxGain : uint8_t {
+    RxGain_min = 0x00 << 4,
+    RxGain_avg = 0x04 << 4,
+    RxGain_max = 0x07 << 4,
+  };
+
+  struct Uid {
+    uint8_t size;
+    uint8_t uidByte[10];
+    uint8_t sak;
+  };
+
+  Uid uid;
+
+  MFRC522(uint8_t chipSelectPin = 10, uint8_t resetPin = 9) { (void)chipSelectPin; (void)resetPin; }
+
+  void PCD_Init();
+  void PCD_Init(uint8_t chipSelectPin, uint8_t resetPin) { (void)chipSelectPin; (void)resetPin; PCD_Init(); }
+  uint8_t PCD_ReadRegister(PCD_Register reg);
+  void PCD_WriteRegister(PCD_Register reg, uint8_t value);
+  void PCD_AntennaOn();
+  void PCD_AntennaOff();
+  void PCD_SetAntennaGain(uint8_t mask) { registers[RFCfgReg] = (registers[RFCfgReg] & ~0x70) | (mask & 0x70); }
+  void PCD_StopCrypto1() {}
+
+  bool PICC_IsNewCardPresent();
+  bool PICC_ReadCardSerial();
+  uint8_t PICC_HaltA();
+
+private:
+  uint8_t registers[0x80] = {0};
+};
+
+#endif // SIM_MFRC522_H
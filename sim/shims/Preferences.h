@@ -0,0 +1,69 @@
+/*
+ * Preferences.h - NVS（主机仿真：内存中的键值存储，进程内"重启"后保留）
+ *
+ * 每次写入按 SIM_NVS_WRITE_US 阻塞调用任务（NVS写Flash的耗时）
+ *
+ * 版本: v1.0
+ */
+
+#ifndef SIM_PREFERENCES_H
+#define SIM_PREFERENCES_H
+
+#include <Arduino.h>
+
+#define SIM_NVS_WRITE_US 2000
+
+class Preferences {
+private:
+  char ns[16] = "";
+  bool opened = false;
+  bool readOnly = false;
+
+  size_t putRaw(const char* key, uint8_t type, const void* data, size_t size);
+  size_t getRaw(const char* key, uint8_t type, void* out, size_t size);
+
+public:
+  bool begin(const char* name, bool readOnly = false, const char* partition = NULL);
+  void end();
+  bool clear();
+  bool remove(const char* key);
+  bool isKey(const char* key);
+
+  size_t putChar(const char* key, int8_t value) { return putRaw(key, 1, &value, sizeof(value)); }
+  size_t putUChar(const char* key, uint8_t value) { return putRaw(key, 2, &value, sizeof(value)); }
+  size_t putShort(const char* key, int16_t value) { return putRaw(key, 3, &value, sizeof(value)); }
+  size_t putUShort(const char* key, uint16_t value) { return putRaw(key, 4, &value, sizeof(value)); }
+  size_t putInt(const char* key, int32_t value) { return putRaw(key, 5, &value, sizeof(value)); }
+  size_t putUInt(const char* key, uint32_t value) { return putRaw(key, 6, &value, sizeof(value)); }
+  size_t putLong(const char* key, int32_t value) { return putInt(key, value); }
+  size_t putULong(const char* key, uint32_t value) { return putUInt(key, value); }
+  size_t putLong64(const char* key, int64_t value) { return putRaw(key, 7, &value, sizeof(value)); }
+  size_t putULong64(const char* key, uint64_t value) { return putRaw(key, 8, &value, sizeof(value)); }
+  size_t putFloat(const char* key, float value) { return putRaw(key, 9, &value, sizeof(value)); }
+  size_t putDouble(const char* key, double value) { return putRaw(key, 10, &value, sizeof(value)); }
+  size_t putBool(const char* key, bool value) { return putUChar(key, value ? 1 : 0); }
+  size_t putString(const char* key, const char* value);
+  size_t putString(const char* key, const String& value) { return putString(key, value.c_str()); }
+  size_t putBytes(const char* key, const void* value, size_t size) { return putRaw(key, 12, value, size); }
+
+  int8_t getChar(const char* key, int8_t def = 0) { getRaw(key, 1, &def, sizeof(def)); return def; }
+  uint8_t getUChar(const char* key, uint8_t def = 0) { getRaw(key, 2, &def, sizeof(def)); return def; }
+  int16_t getShort(const char* key, int16_t def = 0) { getRaw(key, 3, &def, sizeof(def)); return def; }
+  uint16_t getUShort(const char* key, uint16_t def = 0) { getRaw(key, 4, &def, sizeof(def)); return def; }
+  int32_t getInt(const char* key, int32_t def = 0) { getRaw(key, 5, &def, sizeof(def)); return def; }
+  uint32_t getUInt(const char* key, uint32_t def = 0) { getRaw(key, 6, &def, sizeof(def)); return def; }
+  int32_t getLong(const char* key, int32_t def = 0) { return getInt(key, def); }
+  uint32_t getULong(const char* key, uint32_t def = 0) { return getUInt(key, def); }
+  int64_t getLong64(const char* key, int64_t def = 0) { getRaw(key, 7, &def, sizeof(def)); return def; }
+  uint64_t getULong64(const char* key, uint64_t def = 0) { getRaw(key, 8, &def, sizeof(def)); return def; }
+  float getFloat(const char* key, float def = NAN) { getRaw(key, 9, &def, sizeof(def)); return def; }
+  double getDouble(const char* key, double def = NAN) { getRaw(key, 10, &def, sizeof(def)); return def; }
+  bool getBool(const char* key, bool def = false) { return getUChar(key, def ? 1 : 0) != 0; }
+  String getString(const char* key, const String& def = String());
+  size_t getString(const char* key, char* value, size_t maxLen);
+  size_t getBytesLength(const char* key);
+  size_t getBytes(const char* key, void* buf, size_t maxLen);
+  size_t freeEntries() { return 500; }
+};
+
+#endif // SIM_PREFERENCES_H
@@ -0,0 +1,22 @@
+/*
+ * SPI.h - SPI（主机仿真：空操作，MFRC522读写由 MFRC522.h 仿真）
+ *
+ * 版本: v1.0
+ */
+
+#ifndef SIM_SPI_H
+#define SIM_SPI_H
+
+#include <Arduino.h>
+
+class SPIClass {
+public:
+  void begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1, int8_t ss = -1) {
+    (void)sck; (void)miso; (void)mosi; (void)ss;
+  }
+  void end() {}
+};
+
+extern SPIClass SPI;
+
+#endif // SIM_SPI_H
@@ -0,0 +1,75 @@
+/*
+ * Stream.h - Arduino Print / Stream / HardwareSerial（主机仿真）
+ *
+ * 版本: v1.0
+ */
+
+#ifndef SIM_STREAM_H
+#define SIM_STREAM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "WString.h"
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* data, size_t size);
+  size_t write(const char* text) { return text ? write((const uint8_t*)text, strlen(text)) : 0; }
+  virtual void flush() {}
+
+  size_t print(const String& text) { return write((const uint8_t*)text.c_str(), text.length()); }
+  size_t print(const char* text) { return write(text); }
+  size_t print(char c) { return write((uint8_t)c); }
+  size_t print(unsigned char value, int base = 10) { return print(String(value, base)); }
+  size_t print(int value, int base = 10) { return print(String(value, base)); }
+  size_t print(unsigned int value, int base = 10) { return print(String(value, base)); }
+  size_t print(long value, int base = 10) { return print(String(value, base)); }
+  size_t print(unsigned long value, int base = 10) { return print(String(value, base)); }
+  size_t print(double value, int decimals = 2) { return print(String(value, decimals)); }
+
+  size_t println() { return write("\r\n"); }
+  template <typename T>
+  size_t println(const T& value) { return print(value) + println(); }
+  template <typename T>
+  size_t println(const T& value, int format) { return print(value, format) + println(); }
+
+  size_t printf(const char* format, ...) __attribute__((format(printf, 2, 3)));
+};
+
+class Stream : public Print {
+protected:
+  unsigned long timeoutMs = 1000;
+
+public:
+  virtual int available() = 0;
+  virtual int read() = 0;
+  virtual int peek() = 0;
+
+  void setTimeout(unsigned long ms) { timeoutMs = ms; }
+  size_t readBytes(char* out, size_t size);
+  size_t readBytes(uint8_t* out, size_t size) { return readBytes((char*)out, size); }
+  String readString();
+  String readStringUntil(char terminator);
+};
+
+// 串口：输出写入缓冲区（可选回显到stdout），输入来自 sim::serialInput()
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long baud) { (void)baud; }
+  void end() {}
+  operator bool() const { return true; }
+
+  size_t write(uint8_t c) override;
+  size_t write(const uint8_t* data, size_t size) override;
+  using Print::write;
+  int available() override;
+  int read() override;
+  int peek() override;
+  int availableForWrite() { return 128; }
+};
+
+extern HardwareSerial Serial;
+
+#endif // SIM_STREAM_H
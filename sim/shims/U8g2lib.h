@@ -0,0 +1,113 @@
+/*
+ * U8g2lib.h - SSD1309 128x64 OLED（主机仿真）
+ *
+ * - 缓冲区与U8g2相同：128x64全缓冲，8行一页的纵向字节（图块格式），旋转在绘图时处理
+ * - sendBuffer/updateDisplay/updateDisplayArea 把图块复制到面板内存，
+ *   并按 SIM_I2C_US_PER_BYTE 阻塞调用任务（I2C传输耗时）
+ * - 字体只模拟字宽/上下伸，字形为3x5点阵近似（见 sim_display.cpp），
+ *   像素输出用于检查布局和帧差分，不与真实字体逐像素一致
+ *
+ * 版本: v1.0
+ */
+
+#ifndef SIM_U8G2LIB_H
+#define SIM_U8G2LIB_H
+
+#include <Arduino.h>
+
+#define U8X8_PIN_NONE 255
+
+#define U8G2_DRAW_UPPER_RIGHT 0x01
+#define U8G2_DRAW_UPPER_LEFT 0x02
+#define U8G2_DRAW_LOWER_LEFT 0x04
+#define U8G2_DRAW_LOWER_RIGHT 0x08
+#define U8G2_DRAW_ALL (U8G2_DRAW_UPPER_RIGHT | U8G2_DRAW_UPPER_LEFT | U8G2_DRAW_LOWER_LEFT | U8G2_DRAW_LOWER_RIGHT)
+
+struct u8g2_cb_t {
+  bool rotate180;
+};
+
+extern const u8g2_cb_t u8g2_cb_r0;
+extern const u8g2_cb_t u8g2_cb_r2;
+#define U8G2_R0 (&u8g2_cb_r0)
+#define U8G2_R2 (&u8g2_cb_r2)
+
+// 字体：{字宽, 上伸, 下伸}
+extern const uint8_t u8g2_font_6x10_tf[];
+extern const uint8_t u8g2_font_helvR08_tf[];
+extern const uint8_t u8g2_font_helvB08_tf[];
+extern const uint8_t u8g2_font_helvB10_tf[];
+
+class U8G2 : public Print {
+public:
+  static const int WIDTH = 128;
+  static const int HEIGHT = 64;
+  static const int TILE_WIDTH = WIDTH / 8;
+  static const int TILE_HEIGHT = HEIGHT / 8;
+
+  explicit U8G2(const u8g2_cb_t* rotation) : rotate180(rotation->rotate180) {}
+
+  bool begin();
+  void enableUTF8Print() {}
+  void setBusClock(uint32_t clock) { (void)clock; }
+
+  // 缓冲区
+  void clearBuffer() { memset(buffer, 0, sizeof(buffer)); }
+  uint8_t* getBufferPtr() { return buffer; }
+  uint8_t getBufferTileWidth() { return TILE_WIDTH; }
+  uint8_t getBufferTileHeight() { return TILE_HEIGHT; }
+  int getDisplayWidth() { return WIDTH; }
+  int getDisplayHeight() { return HEIGHT; }
+
+  // 发送到面板
+  void sendBuffer();
+  void updateDisplay() { sendBuffer(); }
+  void updateDisplayArea(uint8_t tx, uint8_t ty, uint8_t tw, uint8_t th);
+
+  // 字体
+  void setFont(const uint8_t* font) { this->font = font; }
+  int getStrWidth(const char* text);
+  int getUTF8Width(const char* text) { return getStrWidth(text); }
+  int8_t getAscent() { return font ? (int8_t)font[1] : 0; }
+  int8_t getDescent() { return font ? -(int8_t)font[2] : 0; }
+  int drawStr(int x, int y, const char* text);
+  int drawUTF8(int x, int y, const char* text) { return drawStr(x, y, text); }
+
+  // 图形
+  void setDrawColor(uint8_t color) { drawColor = color; }
+  void drawPixel(int x, int y);
+  void drawHLine(int x, int y, int w);
+  void drawVLine(int x, int y, int h);
+  void drawLine(int x0, int y0, int x1, int y1);
+  void drawBox(int x, int y, int w, int h);
+  void drawFrame(int x, int y, int w, int h);
+  void drawRFrame(int x, int y, int w, int h, int r);
+  void drawRBox(int x, int y, int w, int h, int r);
+  void drawCircle(int x0, int y0, int r, uint8_t option = U8G2_DRAW_ALL);
+  void drawDisc(int x0, int y0, int r, uint8_t option = U8G2_DRAW_ALL);
+  void drawEllipse(int x0, int y0, int rx, int ry, uint8_t option = U8G2_DRAW_ALL);
+
+  size_t write(uint8_t c) override { (void)c; return 1; }
+  using Print::write;
+
+private:
+  uint8_t buffer[WIDTH * HEIGHT / 8] = {0};
+  bool rotate180;
+  const uint8_t* font = NULL;
+  uint8_t drawColor = 1;
+
+  void sendTiles(uint8_t tx, uint8_t ty, uint8_t tw, uint8_t th);
+  void circleQuadrants(int x0, int y0, int dx, int dy, uint8_t option, bool fill);
+  void drawGlyph(int x, int y, uint32_t codepoint);
+};
+
+class U8G2_SSD1309_128X64_NONAME0_F_HW_I2C : public U8G2 {
+public:
+  U8G2_SSD1309_128X64_NONAME0_F_HW_I2C(const u8g2_cb_t* rotation, uint8_t reset = U8X8_PIN_NONE,
+                                       uint8_t clock = U8X8_PIN_NONE, uint8_t data = U8X8_PIN_NONE)
+    : U8G2(rotation) {
+    (void)reset; (void)clock; (void)data;
+  }
+};
+
+#endif // SIM_U8G2LIB_H
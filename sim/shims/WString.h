@@ -0,0 +1,133 @@
+/*
+ * WString.h - Arduino String（主机仿真）
+ *
+ * 与 Arduino 核心相同：缓冲区用 malloc/realloc 分配，因此拼接字符串产生的堆分配
+ * 会计入仿真堆统计（见 sim_core.cpp）
+ *
+ * 版本: v1.0
+ */
+
+#ifndef SIM_WSTRING_H
+#define SIM_WSTRING_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+class String {
+private:
+  char* buffer = nullptr;
+  unsigned int capacity = 0;
+  unsigned int len = 0;
+
+  bool reserveInternal(unsigned int size);
+  void copy(const char* text, unsigned int length);
+  void initNumber(const char* format, ...) __attribute__((format(printf, 2, 3)));
+  void initInteger(unsigned long long value, bool negative, unsigned char base);
+
+public:
+  String(const char* text = "");
+  String(const char* text, unsigned int length);
+  String(const String& other);
+  String(String&& other) noexcept;
+  explicit String(char c);
+  explicit String(unsigned char value, unsigned char base = 10);
+  explicit String(int value, unsigned char base = 10);
+  explicit String(unsigned int value, unsigned char base = 10);
+  explicit String(long value, unsigned char base = 10);
+  explicit String(unsigned long value, unsigned char base = 10);
+  explicit String(long long value, unsigned char base = 10);
+  explicit String(unsigned long long value, unsigned char base = 10);
+  explicit String(float value, unsigned int decimals = 2);
+  explicit String(double value, unsigned int decimals = 2);
+  ~String();
+
+  String& operator=(const String& other);
+  String& operator=(String&& other) noexcept;
+  String& operator=(const char* text);
+
+  bool reserve(unsigned int size) { return reserveInternal(size); }
+  unsigned int length() const { return len; }
+  bool isEmpty() const { return len == 0; }
+  const char* c_str() const { return buffer ? buffer : ""; }
+
+  // 拼接
+  bool concat(const char* text, unsigned int length);
+  bool concat(const String& other) { return concat(other.c_str(), other.len); }
+  bool concat(const char* text) { return text ? concat(text, strlen(text)) : false; }
+  bool concat(char c) { return concat(&c, 1); }
+  bool concat(unsigned char value) { return concat(String(value)); }
+  bool concat(int value) { return concat(String(value)); }
+  bool concat(unsigned int value) { return concat(String(value)); }
+  bool concat(long value) { return concat(String(value)); }
+  bool concat(unsigned long value) { return concat(String(value)); }
+  bool concat(long long value) { return concat(String(value)); }
+  bool concat(unsigned long long value) { return concat(String(value)); }
+  bool concat(float value) { return concat(String(value)); }
+  bool concat(double value) { return concat(String(value)); }
+
+  template <typename T>
+  String& operator+=(const T& value) {
+    concat(value);
+    return *this;
+  }
+
+  // 比较
+  int compareTo(const String& other) const { return strcmp(c_str(), other.c_str()); }
+  bool equals(const String& other) const { return len == other.len && compareTo(other) == 0; }
+  bool equals(const char* text) const { return strcmp(c_str(), text ? text : "") == 0; }
+  bool equalsIgnoreCase(const String& other) const;
+  bool operator==(const String& other) const { return equals(other); }
+  bool operator==(const char* text) const { return equals(text); }
+  bool operator!=(const String& other) const { return !equals(other); }
+  bool operator!=(const char* text) const { return !equals(text); }
+  bool operator<(const String& other) const { return compareTo(other) < 0; }
+  bool startsWith(const String& prefix) const;
+  bool startsWith(const String& prefix, unsigned int offset) const;
+  bool endsWith(const String& suffix) const;
+
+  // 字符访问
+  char charAt(unsigned int index) const { return index < len ? buffer[index] : 0; }
+  char operator[](unsigned int index) const { return charAt(index); }
+  char& operator[](unsigned int index);
+  void setCharAt(unsigned int index, char c) { if (index < len) buffer[index] = c; }
+  void getBytes(unsigned char* out, unsigned int size, unsigned int index = 0) const;
+  void toCharArray(char* out, unsigned int size, unsigned int index = 0) const {
+    getBytes((unsigned char*)out, size, index);
+  }
+
+  // 查找
+  int indexOf(char c, unsigned int from = 0) const;
+  int indexOf(const String& text, unsigned int from = 0) const;
+  int lastIndexOf(char c) const;
+  int lastIndexOf(const String& text) const;
+  String substring(unsigned int from) const { return substring(from, len); }
+  String substring(unsigned int from, unsigned int to) const;
+
+  // 修改
+  void replace(char find, char with);
+  void replace(const String& find, const String& with);
+  void remove(unsigned int index) { remove(index, (unsigned int)-1); }
+  void remove(unsigned int index, unsigned int count);
+  void toLowerCase();
+  void toUpperCase();
+  void trim();
+
+  // 转换
+  long toInt() const { return atol(c_str()); }
+  float toFloat() const { return (float)atof(c_str()); }
+  double toDouble() const { return atof(c_str()); }
+};
+
+String operator+(const String& a, const String& b);
+String operator+(const String& a, const char* b);
+String operator+(const char* a, const String& b);
+String operator+(const String& a, char b);
+String operator+(const String& a, int b);
+String operator+(const String& a, unsigned int b);
+String operator+(const String& a, long b);
+String operator+(const String& a, unsigned long b);
+String operator+(const String& a, float b);
+String operator+(const String& a, double b);
+
+#endif // SIM_WSTRING_H
@@ -0,0 +1,97 @@
+/*
+ * WiFi.h - WiFi（主机仿真：扫描+关联+DHCP 共 SIM_WIFI_CONNECT_MS，指定BSSID/信道跳过扫描，
+ *          静态IP跳过DHCP；sim::setWifiAvailable(false) 模拟断网，事件由 onEvent 回调通知）
+ *
+ * 版本: v1.0
+ */
+
+#ifndef SIM_WIFI_H
+#define SIM_WIFI_H
+
+#include <Arduino.h>
+#include <functional>
+#include "WiFiClient.h"
+
+#define SIM_WIFI_SCAN_MS 1000      // 全信道扫描
+#define SIM_WIFI_ASSOC_MS 200      // 认证+关联+四次握手
+#define SIM_WIFI_DHCP_MS 300       // DHCP获取地址
+#define SIM_WIFI_CONNECT_MS (SIM_WIFI_SCAN_MS + SIM_WIFI_ASSOC_MS + SIM_WIFI_DHCP_MS)
+
+typedef enum {
+  WL_IDLE_STATUS = 0,
+  WL_NO_SSID_AVAIL = 1,
+  WL_SCAN_COMPLETED = 2,
+  WL_CONNECTED = 3,
+  WL_CONNECT_FAILED = 4,
+  WL_CONNECTION_LOST = 5,
+  WL_DISCONNECTED = 6,
+} wl_status_t;
+
+typedef enum {
+  WIFI_OFF = 0,
+  WIFI_STA = 1,
+  WIFI_AP = 2,
+  WIFI_AP_STA = 3,
+} wifi_mode_t;
+
+typedef enum {
+  ARDUINO_EVENT_WIFI_STA_CONNECTED = 4,
+  ARDUINO_EVENT_WIFI_STA_DISCONNECTED = 5,
+  ARDUINO_EVENT_WIFI_STA_GOT_IP = 7,
+  ARDUINO_EVENT_WIFI_STA_LOST_IP = 8,
+} arduino_event_id_t;
+
+typedef union {
+  struct {
+    uint8_t reason;
+  } wifi_sta_disconnected;
+} arduino_event_info_t;
+
+typedef std::function<void(arduino_event_id_t event, arduino_event_info_t info)> WiFiEventFuncCb;
+
+// 与ESP32一致：uint32_t 形式的第一个字节为最低位
+class IPAddress {
+private:
+  uint8_t bytes[4];
+
+public:
+  IPAddress(uint8_t a = 0, uint8_t b = 0, uint8_t c = 0, uint8_t d = 0) : bytes{a, b, c, d} {}
+  IPAddress(uint32_t address)
+      : bytes{(uint8_t)address, (uint8_t)(address >> 8), (uint8_t)(address >> 16), (uint8_t)(address >> 24)} {}
+  operator uint32_t() const {
+    return bytes[0] | (uint32_t)bytes[1] << 8 | (uint32_t)bytes[2] << 16 | (uint32_t)bytes[3] << 24;
+  }
+  uint8_t operator[](int index) const { return bytes[index]; }
+  String toString() const;
+};
+
+#define INADDR_NONE IPAddress((uint32_t)0)
+
+class WiFiClass {
+public:
+  bool mode(wifi_mode_t mode);
+  wl_status_t begin(const char* ssid, const char* password = NULL, int32_t channel = 0,
+                    const uint8_t* bssid = NULL, bool connect = true);
+  bool config(IPAddress localIp, IPAddress gateway, IPAddress subnet, IPAddress dns1 = IPAddress());
+  int onEvent(WiFiEventFuncCb callback);
+  wl_status_t status();
+  bool isConnected() { return status() == WL_CONNECTED; }
+  bool disconnect(bool wifiOff = false, bool eraseAp = false);
+  bool reconnect();
+  bool setAutoReconnect(bool enable);
+  bool setSleep(bool enable) { (void)enable; return true; }
+  IPAddress localIP();
+  IPAddress gatewayIP();
+  IPAddress subnetMask();
+  IPAddress dnsIP(uint8_t index = 0);
+  uint8_t* BSSID();
+  int32_t channel();
+  int8_t RSSI();
+  String SSID();
+  uint8_t* macAddress(uint8_t* mac);
+  String macAddress();
+};
+
+extern WiFiClass WiFi;
+
+#endif // SIM_WIFI_H
@@ -0,0 +1,40 @@
+/*
+ * WiFiClient.h - TCP连接（主机仿真：数据由 HTTPClient 与 mock_supabase 交换，见 sim_net.cpp）
+ *
+ * 版本: v1.0
+ */
+
+#ifndef SIM_WIFI_CLIENT_H
+#define SIM_WIFI_CLIENT_H
+
+#include <Arduino.h>
+#include <string>
+
+class WiFiClient : public Stream {
+protected:
+  bool open = false;
+  uint64_t lastActivityUs = 0;
+  uint32_t epoch = 0;             // 建立连接时的WiFi连接序号（WiFi断开后连接失效）
+  std::string rx;                 // 已收到、尚未读取的数据
+  size_t rxPos = 0;
+
+public:
+  virtual ~WiFiClient() {}
+
+  virtual int connect(const char* host, uint16_t port);
+  virtual uint8_t connected();
+  virtual void stop();
+
+  size_t write(uint8_t c) override { (void)c; return 1; }
+  size_t write(const uint8_t* data, size_t size) override { (void)data; return size; }
+  using Print::write;
+  int available() override;
+  int read() override;
+  int peek() override;
+
+  // 仿真：服务器发来的数据
+  void simReceive(const char* data, size_t size);
+  void simDiscardInput();
+};
+
+#endif // SIM_WIFI_CLIENT_H
@@ -0,0 +1,20 @@
+/*
+ * WiFiClientSecure.h - TLS连接（主机仿真：握手耗时和失败由 mock_supabase 决定）
+ *
+ * 版本: v1.0
+ */
+
+#ifndef SIM_WIFI_CLIENT_SECURE_H
+#define SIM_WIFI_CLIENT_SECURE_H
+
+#include "WiFiClient.h"
+
+class WiFiClientSecure : public WiFiClient {
+public:
+  void setInsecure() {}
+  void setCACert(const char* cert) { (void)cert; }
+  void setHandshakeTimeout(unsigned long seconds) { (void)seconds; }
+  int connect(const char* host, uint16_t port) override;
+};
+
+#endif // SIM_WIFI_CLIENT_SECURE_H
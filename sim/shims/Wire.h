@@ -0,0 +1,28 @@
+/*
+ * Wire.h - I2C（主机仿真：只有OLED(0x3C)应答）
+ *
+ * 版本: v1.0
+ */
+
+#ifndef SIM_WIRE_H
+#define SIM_WIRE_H
+
+#include <Arduino.h>
+
+#define SIM_OLED_I2C_ADDRESS 0x3C
+
+class TwoWire {
+private:
+  uint8_t address = 0;
+
+public:
+  bool begin(int sda = -1, int scl = -1, uint32_t frequency = 0);
+  bool setClock(uint32_t frequency) { (void)frequency; return true; }
+  void beginTransmission(uint8_t addr) { address = addr; }
+  uint8_t endTransmission(bool sendStop = true);
+  size_t write(uint8_t data) { (void)data; return 1; }
+};
+
+extern TwoWire Wire;
+
+#endif // SIM_WIRE_H
@@ -0,0 +1,17 @@
+/*
+ * driver/gpio.h - GPIO驱动（主机仿真：写入仿真引脚）
+ *
+ * 版本: v1.0
+ */
+
+#ifndef SIM_DRIVER_GPIO_H
+#define SIM_DRIVER_GPIO_H
+
+#include "esp_system.h"
+
+typedef int gpio_num_t;
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level);
+int gpio_get_level(gpio_num_t pin);
+
+#endif // SIM_DRIVER_GPIO_H
@@ -0,0 +1,14 @@
+/*
+ * esp_arduino_version.h - 仿真按 ESP32 Arduino 3.x 接口编译（ledcAttach/ledcWriteTone按引脚）
+ *
+ * 版本: v1.0
+ */
+
+#ifndef SIM_ESP_ARDUINO_VERSION_H
+#define SIM_ESP_ARDUINO_VERSION_H
+
+#define ESP_ARDUINO_VERSION_MAJOR 3
+#define ESP_ARDUINO_VERSION_MINOR 0
+#define ESP_ARDUINO_VERSION_PATCH 0
+
+#endif // SIM_ESP_ARDUINO_VERSION_H
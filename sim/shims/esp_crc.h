@@ -0,0 +1,14 @@
+/*
+ * esp_crc.h - ROM CRC32（主机仿真，与ESP32 ROM的 esp_crc32_le 结果一致）
+ *
+ * 版本: v1.0
+ */
+
+#ifndef SIM_ESP_CRC_H
+#define SIM_ESP_CRC_H
+
+#include <stdint.h>
+
+uint32_t esp_crc32_le(uint32_t crc, const uint8_t* data, uint32_t length);
+
+#endif // SIM_ESP_CRC_H
@@ -0,0 +1,21 @@
+/*
+ * esp_heap_caps.h - ESP-IDF 堆接口（主机仿真：分配不会失败，回调只登记不调用）
+ *
+ * 版本: v1.0
+ */
+
+#ifndef SIM_ESP_HEAP_CAPS_H
+#define SIM_ESP_HEAP_CAPS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "esp_system.h"
+
+typedef void (*esp_alloc_failed_hook_t)(size_t size, uint32_t caps, const char* function_name);
+
+inline esp_err_t heap_caps_register_failed_alloc_callback(esp_alloc_failed_hook_t callback) {
+  (void)callback;
+  return ESP_OK;
+}
+
+#endif // SIM_ESP_HEAP_CAPS_H
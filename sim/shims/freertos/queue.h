@@ -0,0 +1,5 @@
+// freertos/queue.h - 见 FreeRTOS.h
+#ifndef SIM_FREERTOS_QUEUE_H
+#define SIM_FREERTOS_QUEUE_H
+#include "FreeRTOS.h"
+#endif
@@ -0,0 +1,5 @@
+// freertos/semphr.h - 见 FreeRTOS.h
+#ifndef SIM_FREERTOS_SEMPHR_H
+#define SIM_FREERTOS_SEMPHR_H
+#include "FreeRTOS.h"
+#endif
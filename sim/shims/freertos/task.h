@@ -0,0 +1,5 @@
+// freertos/task.h - 见 FreeRTOS.h
+#ifndef SIM_FREERTOS_TASK_H
+#define SIM_FREERTOS_TASK_H
+#include "FreeRTOS.h"
+#endif
@@ -0,0 +1,113 @@
+/*
+ * sim.h - 主机仿真运行时（虚拟时钟 + 协作式任务调度 + 虚拟外设）
+ *
+ * 功能：
+ * - 虚拟时钟：millis()/micros()/esp_timer 只在任务阻塞（delay、队列等待、I2C/HTTP传输）时前进，
+ *   同一随机种子的运行结果完全可复现；--cpu-scale 时按主机CPU耗时×倍率推进（模拟较慢的CPU）
+ * - 任务：每个FreeRTOS任务是一个协程（ucontext），同一时刻只运行一个，阻塞时切换，
+ *   优先级高的先运行；esp_timer 回调在任务之间按到期时间执行
+ * - 外设：GPIO电平、刷卡（MFRC522）、OLED面板帧缓冲、内存NVS、txlog分区、WiFi
+ * - 堆：统计固件分配（String/new/malloc + 任务栈），ESP.getFreeHeap() 按 SIM_HEAP_SIZE 计算
+ *
+ * 说明：只在主机仿真中编译（见 sim/Makefile），固件代码不包含本文件
+ *
+ * 版本: v1.0
+ */
+
+#ifndef SIM_H
+#define SIM_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <functional>
+
+#define SIM_HEAP_SIZE (320 * 1024)       // ESP32-S3 内部DRAM可用堆（不含WiFi/TLS协议栈）
+#define SIM_TASK_HOST_STACK (256 * 1024) // 协程在主机上的栈（与固件申请的栈大小无关）
+#define SIM_OLED_WIDTH 128
+#define SIM_OLED_HEIGHT 64
+#define SIM_I2C_US_PER_BYTE 100          // I2C 100kHz：每字节约100us（9位 + 间隔）
+#define SIM_UART_US_PER_BYTE 87          // 115200波特：每字节约87us
+#define SIM_UART_FIFO_BYTES 128          // 串口发送FIFO，写满后阻塞调用任务
+#define SIM_FLASH_ERASE_US 45000         // Flash擦除一个扇区（4KB）
+#define SIM_FLASH_WRITE_US_PER_PAGE 500  // Flash写入一页（256字节）
+
+namespace sim {
+
+// =================== 虚拟时钟 ===================
+uint64_t nowUs();
+void setCpuScale(double scale);          // 0 = 计算不耗时（默认，结果可复现）
+
+// =================== 任务调度 ===================
+struct Task;
+typedef void (*TaskFn)(void*);
+
+Task* createTask(const char* name, TaskFn fn, void* arg, int priority, uint32_t stackBytes);
+Task* currentTask();
+const char* taskName(Task* task);
+uint64_t taskCpuNs(Task* task);          // 该任务累计占用的主机CPU时间
+
+void sleepUs(uint64_t us);               // 当前任务阻塞（虚拟时间）
+// 阻塞直到 ready() 为真或超时（timeoutUs = UINT64_MAX 时一直等待），返回是否就绪
+bool waitFor(const std::function<bool()>& ready, uint64_t timeoutUs);
+
+// 运行调度器，直到 done() 为真（每次任务切换后检查）或没有可运行的任务
+void run(const std::function<bool()>& done);
+
+// =================== 定时器（esp_timer）===================
+struct Timer;
+Timer* timerCreate(void (*callback)(void*), void* arg);
+void timerStart(Timer* timer, uint64_t delayUs, uint64_t periodUs);  // periodUs = 0 单次
+bool timerStop(Timer* timer);                                        // 未运行时返回false
+bool timerActive(Timer* timer);
+void timerDelete(Timer* timer);
+
+// =================== 堆统计 ===================
+struct HeapStats {
+  size_t current;       // 固件当前占用
+  size_t peak;          // 峰值（高水位）
+  uint32_t allocs;
+  uint32_t frees;
+};
+HeapStats heapStats();
+void resetHeapPeak();
+
+// 作用域内的分配不计入固件堆（仿真器/驱动程序自身的内存）
+class Untracked {
+public:
+  Untracked();
+  ~Untracked();
+};
+
+// =================== GPIO ===================
+void setPin(int pin, int level);         // 外部驱动输入引脚（按钮）
+int pinLevel(int pin);
+// 引脚电平变化回调（固件 digitalWrite/gpio_set_level 时调用）
+void onPinChange(void (*callback)(int pin, int level, uint64_t atUs));
+
+// =================== 刷卡（MFRC522）===================
+void placeCard(const uint8_t* uid, uint8_t size);
+void removeCard();
+bool cardInField();
+
+// =================== WiFi ===================
+void setWifiAvailable(bool available);   // false：断开并拒绝连接（模拟断网）
+void setWifiChannel(int channel);        // AP换信道（路由器重启）：断开，缓存的信道失效
+bool wifiConnected();
+
+// =================== OLED ===================
+// 面板当前显示内容（只包含已发送到面板的图块），逻辑坐标（已按R2旋转还原）
+bool oledPixel(int x, int y);
+bool dumpOled(const char* path);         // PBM（P1）格式
+uint32_t oledBytesSent();
+
+// =================== 串口 ===================
+void serialInput(const char* line);      // 模拟串口命令（末尾自动加换行）
+void setSerialEcho(bool echo);           // true：串口输出打印到stdout
+
+// =================== 重启 ===================
+// 固件调用 ESP.restart() 时执行（默认打印并退出进程）
+void onRestart(void (*callback)());
+
+}  // namespace sim
+
+#endif // SIM_H
@@ -0,0 +1,685 @@
+/*
+ * sim_arduino.cpp - Arduino核心与ESP-IDF接口（主机仿真）
+ *
+ * 包含：String、Print/Stream、串口、时间、GPIO/LEDC、随机数、ESP、esp_timer、
+ * esp_crc32_le、txlog等数据分区（内存中的NOR Flash：擦除为0xFF，写入只能把1变成0）
+ *
+ * 版本: v1.0
+ */
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <esp_crc.h>
+#include <esp_partition.h>
+#include <driver/gpio.h>
+#include "sim_internal.h"
+
+#include <deque>
+#include <random>
+#include <string>
+#include <vector>
+
+// =================== String ===================
+bool String::reserveInternal(unsigned int size) {
+  if (buffer != nullptr && capacity >= size) return true;
+  char* grown = (char*)realloc(buffer, size + 1);
+  if (grown == nullptr) return false;
+  if (buffer == nullptr) grown[0] = '\0';
+  buffer = grown;
+  capacity = size;
+  return true;
+}
+
+void String::copy(const char* text, unsigned int length) {
+  if (!reserveInternal(length)) {
+    len = 0;
+    return;
+  }
+  memmove(buffer, text, length);
+  buffer[length] = '\0';
+  len = length;
+}
+
+void String::initNumber(const char* format, ...) {
+  char text[64];
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(text, sizeof(text), format, args);
+  va_end(args);
+  copy(text, n < 0 ? 0 : (unsigned int)min(n, (int)sizeof(text) - 1));
+}
+
+void String::initInteger(unsigned long long value, bool negative, unsigned char base) {
+  char text[72];
+  int pos = sizeof(text) - 1;
+  text[pos] = '\0';
+  if (base < 2 || base > 36) base = 10;
+  do {
+    int digit = (int)(value % base);
+    text[--pos] = (char)(digit < 10 ? '0' + digit : 'a' + digit - 10);
+    value /= base;
+  } while (value > 0);
+  if (negative) text[--pos] = '-';
+  copy(text + pos, sizeof(text) - 1 - pos);
+}
+
+String::String(const char* text) { copy(text ? text : "", text ? strlen(text) : 0); }
+String::String(const char* text, unsigned int length) { copy(text, length); }
+String::String(const String& other) { copy(other.c_str(), other.len); }
+String::String(String&& other) noexcept
+  : buffer(other.buffer), capacity(other.capacity), len(other.len) {
+  other.buffer = nullptr;
+  other.capacity = 0;
+  other.len = 0;
+}
+String::String(char c) { copy(&c, 1); }
+String::String(unsigned char value, unsigned char base) { initInteger(value, false, base); }
+String::String(int value, unsigned char base) {
+  if (base == 10) initInteger(value < 0 ? -(long long)value : value, value < 0, base);
+  else initInteger((unsigned int)value, false, base);
+}
+String::String(unsigned int value, unsigned char base) { initInteger(value, false, base); }
+String::String(long value, unsigned char base) {
+  if (base == 10) initInteger(value < 0 ? -(long long)value : value, value < 0, base);
+  else initInteger((unsigned long)value, false, base);
+}
+String::String(unsigned long value, unsigned char base) { initInteger(value, false, base); }
+String::String(long long value, unsigned char base) {
+  if (base == 10) initInteger(value < 0 ? 0ULL - (unsigned long long)value : value, value < 0, base);
+  else initInteger((unsigned long long)value, false, base);
+}
+String::String(unsigned long long value, unsigned char base) { initInteger(value, false, base); }
+String::String(float value, unsigned int decimals) { initNumber("%.*f", (int)decimals, (double)value); }
+String::String(double value, unsigned int decimals) { initNumber("%.*f", (int)decimals, value); }
+
+String::~String() {
+  free(buffer);
+}
+
+String& String::operator=(const String& other) {
+  if (this != &other) copy(other.c_str(), other.len);
+  return *this;
+}
+
+String& String::operator=(String&& other) noexcept {
+  if (this != &other) {
+    free(buffer);
+    buffer = other.buffer;
+    capacity = other.capacity;
+    len = other.len;
+    other.buffer = nullptr;
+    other.capacity = 0;
+    other.len = 0;
+  }
+  return *this;
+}
+
+String& String::operator=(const char* text) {
+  copy(text ? text : "", text ? strlen(text) : 0);
+  return *this;
+}
+
+bool String::concat(const char* text, unsigned int length) {
+  if (text == nullptr) return false;
+  if (length == 0) return true;
+  // text可能指向自身缓冲区：先记录偏移
+  bool self = buffer != nullptr && text >= buffer && text < buffer + len;
+  size_t offset = self ? text - buffer : 0;
+  if (!reserveInternal(len + length)) return false;
+  memmove(buffer + len, self ? buffer + offset : text, length);
+  len += length;
+  buffer[len] = '\0';
+  return true;
+}
+
+bool String::equalsIgnoreCase(const String& other) const {
+  return len == other.len && strcasecmp(c_str(), other.c_str()) == 0;
+}
+
+bool String::startsWith(const String& prefix) const {
+  return prefix.len <= len && strncmp(c_str(), prefix.c_str(), prefix.len) == 0;
+}
+
+bool String::startsWith(const String& prefix, unsigned int offset) const {
+  return offset + prefix.len <= len && strncmp(c_str() + offset, prefix.c_str(), prefix.len) == 0;
+}
+
+bool String::endsWith(const String& suffix) const {
+  return suffix.len <= len && strcmp(c_str() + len - suffix.len, suffix.c_str()) == 0;
+}
+
+char& String::operator[](unsigned int index) {
+  static char dummy;
+  if (index >= len) {
+    dummy = 0;
+    return dummy;
+  }
+  return buffer[index];
+}
+
+void String::getBytes(unsigned char* out, unsigned int size, unsigned int index) const {
+  if (size == 0 || out == nullptr) return;
+  if (index >= len) {
+    out[0] = 0;
+    return;
+  }
+  unsigned int n = min(size - 1, len - index);
+  memcpy(out, buffer + index, n);
+  out[n] = 0;
+}
+
+int String::indexOf(char c, unsigned int from) const {
+  if (from >= len) return -1;
+  const char* p = strchr(buffer + from, c);
+  return p ? (int)(p - buffer) : -1;
+}
+
+int String::indexOf(const String& text, unsigned int from) const {
+  if (from >= len) return -1;
+  const char* p = strstr(buffer + from, text.c_str());
+  return p ? (int)(p - buffer) : -1;
+}
+
+int String::lastIndexOf(char c) const {
+  if (len == 0) return -1;
+  const char* p = strrchr(buffer, c);
+  return p ? (int)(p - buffer) : -1;
+}
+
+int String::lastIndexOf(const String& text) const {
+  if (text.len == 0 || text.len > len) return -1;
+  for (int i = (int)(len - text.len); i >= 0; i--) {
+    if (strncmp(buffer + i, text.c_str(), text.len) == 0) return i;
+  }
+  return -1;
+}
+
+String String::substring(unsigned int from, unsigned int to) const {
+  if (from > to) std::swap(from, to);
+  if (from >= len) return String();
+  if (to > len) to = len;
+  return String(buffer + from, to - from);
+}
+
+void String::replace(char find, char with) {
+  for (unsigned int i = 0; i < len; i++) {
+    if (buffer[i] == find) buffer[i] = with;
+  }
+}
+
+void String::replace(const String& find, const String& with) {
+  if (len == 0 || find.len == 0) return;
+  String result;
+  unsigned int i = 0;
+  while (i < len) {
+    if (strncmp(buffer + i, find.c_str(), find.len) == 0) {
+      result.concat(with);
+      i += find.len;
+    } else {
+      result.concat(buffer[i]);
+      i++;
+    }
+  }
+  *this = std::move(result);
+}
+
+void String::remove(unsigned int index, unsigned int count) {
+  if (index >= len) return;
+  if (count > len - index) count = len - index;
+  memmove(buffer + index, buffer + index + count, len - index - count + 1);
+  len -= count;
+}
+
+void String::toLowerCase() {
+  for (unsigned int i = 0; i < len; i++) buffer[i] = (char)tolower((unsigned char)buffer[i]);
+}
+
+void String::toUpperCase() {
+  for (unsigned int i = 0; i < len; i++) buffer[i] = (char)toupper((unsigned char)buffer[i]);
+}
+
+void String::trim() {
+  if (len == 0) return;
+  unsigned int start = 0;
+  while (start < len && isspace((unsigned char)buffer[start])) start++;
+  unsigned int end = len;
+  while (end > start && isspace((unsigned char)buffer[end - 1])) end--;
+  memmove(buffer, buffer + start, end - start);
+  len = end - start;
+  buffer[len] = '\0';
+}
+
+String operator+(const String& a, const String& b) { String s(a); s.concat(b); return s; }
+String operator+(const String& a, const char* b) { String s(a); s.concat(b); return s; }
+String operator+(const char* a, const String& b) { String s(a); s.concat(b); return s; }
+String operator+(const String& a, char b) { String s(a); s.concat(b); return s; }
+String operator+(const String& a, int b) { String s(a); s.concat(b); return s; }
+String operator+(const String& a, unsigned int b) { String s(a); s.concat(b); return s; }
+String operator+(const String& a, long b) { String s(a); s.concat(b); return s; }
+String operator+(const String& a, unsigned long b) { String s(a); s.concat(b); return s; }
+String operator+(const String& a, float b) { String s(a); s.concat(b); return s; }
+String operator+(const String& a, double b) { String s(a); s.concat(b); return s; }
+
+#if !defined(__GLIBC__) || !__GLIBC_PREREQ(2, 38)
+size_t strlcpy(char* dst, const char* src, size_t size) {
+  size_t n = strlen(src);
+  if (size > 0) {
+    size_t copyLen = n < size - 1 ? n : size - 1;
+    memcpy(dst, src, copyLen);
+    dst[copyLen] = '\0';
+  }
+  return n;
+}
+
+size_t strlcat(char* dst, const char* src, size_t size) {
+  size_t used = strnlen(dst, size);
+  if (used == size) return size + strlen(src);
+  return used + strlcpy(dst + used, src, size - used);
+}
+#endif
+
+// =================== Print / Stream ===================
+size_t Print::write(const uint8_t* data, size_t size) {
+  size_t n = 0;
+  while (size--) n += write(*data++);
+  return n;
+}
+
+size_t Print::printf(const char* format, ...) {
+  char small[128];
+  va_list args;
+  va_start(args, format);
+  int n = vsnprintf(small, sizeof(small), format, args);
+  va_end(args);
+  if (n < 0) return 0;
+  if ((size_t)n < sizeof(small)) return write((const uint8_t*)small, n);
+
+  // 与ESP32核心相同：超过栈上缓冲区时临时分配
+  char* text = (char*)malloc(n + 1);
+  if (text == nullptr) return 0;
+  va_start(args, format);
+  vsnprintf(text, n + 1, format, args);
+  va_end(args);
+  size_t written = write((const uint8_t*)text, n);
+  free(text);
+  return written;
+}
+
+// 带超时读取一个字节（等待期间让出CPU）
+static int timedRead(Stream* stream, unsigned long timeoutMs) {
+  unsigned long start = millis();
+  do {
+    int c = stream->read();
+    if (c >= 0) return c;
+    delay(1);
+  } while (millis() - start < timeoutMs);
+  return -1;
+}
+
+size_t Stream::readBytes(char* out, size_t size) {
+  size_t n = 0;
+  while (n < size) {
+    int c = timedRead(this, timeoutMs);
+    if (c < 0) break;
+    out[n++] = (char)c;
+  }
+  return n;
+}
+
+String Stream::readString() {
+  String text;
+  int c;
+  while ((c = timedRead(this, timeoutMs)) >= 0) text += (char)c;
+  return text;
+}
+
+String Stream::readStringUntil(char terminator) {
+  String text;
+  int c;
+  while ((c = timedRead(this, timeoutMs)) >= 0 && c != terminator) text += (char)c;
+  return text;
+}
+
+// =================== 串口 ===================
+HardwareSerial Serial;
+
+static bool serialEcho = false;
+static std::deque<char> serialRx;
+static uint64_t serialTxDrainedAt = 0;   // 发送FIFO清空的时间
+
+void sim::serialInput(const char* line) {
+  sim::Untracked guard;
+  for (const char* p = line; *p; p++) serialRx.push_back(*p);
+  serialRx.push_back('\n');
+}
+
+void sim::setSerialEcho(bool echo) {
+  serialEcho = echo;
+}
+
+size_t HardwareSerial::write(uint8_t c) {
+  return write(&c, 1);
+}
+
+// 按波特率排空FIFO：FIFO放不下时阻塞调用任务（与未设置发送缓冲区的ESP32串口一致）
+size_t HardwareSerial::write(const uint8_t* data, size_t size) {
+  if (serialEcho) fwrite(data, 1, size, stdout);
+
+  uint64_t now = sim::nowUs();
+  if (serialTxDrainedAt < now) serialTxDrainedAt = now;
+  serialTxDrainedAt += (uint64_t)size * SIM_UART_US_PER_BYTE;
+  uint64_t backlog = serialTxDrainedAt - now;
+  uint64_t fifoUs = (uint64_t)SIM_UART_FIFO_BYTES * SIM_UART_US_PER_BYTE;
+  if (backlog > fifoUs) sim::chargeUs(backlog - fifoUs);
+  return size;
+}
+
+int HardwareSerial::available() {
+  return (int)serialRx.size();
+}
+
+int HardwareSerial::read() {
+  if (serialRx.empty()) return -1;
+  char c = serialRx.front();
+  serialRx.pop_front();
+  return (uint8_t)c;
+}
+
+int HardwareSerial::peek() {
+  return serialRx.empty() ? -1 : (uint8_t)serialRx.front();
+}
+
+// =================== 时间 ===================
+unsigned long millis() {
+  return (unsigned long)(sim::nowUs() / 1000);
+}
+
+unsigned long micros() {
+  return (unsigned long)sim::nowUs();
+}
+
+void delay(uint32_t ms) {
+  sim::sleepUs((uint64_t)ms * 1000);
+}
+
+// 忙等：推进时钟但不让出CPU（与ESP32相同）
+void delayMicroseconds(uint32_t us) {
+  sim::chargeUs(us);
+}
+
+void yield() {
+  sim::sleepUs(0);
+}
+
+int64_t esp_timer_get_time() {
+  return (int64_t)sim::nowUs();
+}
+
+// =================== GPIO ===================
+void pinMode(uint8_t pin, uint8_t mode) {
+  if (mode == INPUT_PULLUP && sim::pinLevel(pin) == 0) sim::setPin(pin, 1);
+}
+
+void digitalWrite(uint8_t pin, uint8_t level) {
+  sim::writePin(pin, level);
+}
+
+int digitalRead(uint8_t pin) {
+  return sim::pinLevel(pin);
+}
+
+static void callPlainIsr(void* arg) {
+  ((void (*)())arg)();
+}
+
+void attachInterrupt(uint8_t pin, void (*isr)(), int mode) {
+  sim::attachPinIsr(pin, callPlainIsr, (void*)isr, mode);
+}
+
+void attachInterruptArg(uint8_t pin, void (*isr)(void*), void* arg, int mode) {
+  sim::attachPinIsr(pin, isr, arg, mode);
+}
+
+void detachInterrupt(uint8_t pin) {
+  sim::detachPinIsr(pin);
+}
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level) {
+  sim::writePin(pin, level);
+  return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t pin) {
+  return sim::pinLevel(pin);
+}
+
+// =================== LEDC（v3接口按引脚，蜂鸣器响时引脚记为高电平）===================
+bool ledcAttach(uint8_t pin, uint32_t freq, uint8_t resolution) {
+  (void)pin; (void)freq; (void)resolution;
+  return true;
+}
+
+uint32_t ledcSetup(uint8_t channel, uint32_t freq, uint8_t resolution) {
+  (void)channel; (void)resolution;
+  return freq;
+}
+
+void ledcAttachPin(uint8_t pin, uint8_t channel) {
+  (void)pin; (void)channel;
+}
+
+uint32_t ledcWriteTone(uint8_t pinOrChannel, uint32_t freq) {
+  sim::writePin(pinOrChannel, freq > 0);
+  return freq;
+}
+
+bool ledcWrite(uint8_t pinOrChannel, uint32_t duty) {
+  sim::writePin(pinOrChannel, duty > 0);
+  return true;
+}
+
+// =================== 随机数 ===================
+static std::mt19937& rng() {
+  static std::mt19937 generator(1);
+  return generator;
+}
+
+long random(long max) {
+  if (max <= 0) return 0;
+  return (long)(rng()() % (uint32_t)max);
+}
+
+long random(long min, long max) {
+  if (min >= max) return min;
+  return min + random(max - min);
+}
+
+void randomSeed(unsigned long seed) {
+  rng().seed((uint32_t)seed);
+}
+
+// =================== ESP ===================
+EspClass ESP;
+
+static void (*restartCallback)() = nullptr;
+
+uint32_t EspClass::getHeapSize() {
+  return SIM_HEAP_SIZE;
+}
+
+uint32_t EspClass::getFreeHeap() {
+  size_t used = sim::heapStats().current;
+  return used >= SIM_HEAP_SIZE ? 0 : (uint32_t)(SIM_HEAP_SIZE - used);
+}
+
+uint32_t EspClass::getMinFreeHeap() {
+  size_t peak = sim::heapStats().peak;
+  return peak >= SIM_HEAP_SIZE ? 0 : (uint32_t)(SIM_HEAP_SIZE - peak);
+}
+
+uint32_t EspClass::getMaxAllocHeap() {
+  return getFreeHeap();  // 不模拟碎片
+}
+
+void EspClass::restart() {
+  sim::restart();
+}
+
+void sim::onRestart(void (*callback)()) {
+  restartCallback = callback;
+}
+
+void sim::restart() {
+  fflush(stdout);
+  if (restartCallback != nullptr) restartCallback();
+  fprintf(stderr, "sim: 固件调用了 ESP.restart()，仿真结束\n");
+  exit(3);
+}
+
+esp_reset_reason_t esp_reset_reason() {
+  return ESP_RST_POWERON;
+}
+
+void esp_restart() {
+  sim::restart();
+}
+
+// =================== esp_timer ===================
+struct SimEspTimer {
+  sim::Timer* timer;
+};
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle) {
+  if (args == nullptr || args->callback == nullptr || handle == nullptr) return ESP_ERR_INVALID_ARG;
+  SimEspTimer* t = (SimEspTimer*)malloc(sizeof(SimEspTimer));   // 与ESP-IDF相同：计入堆
+  if (t == nullptr) return ESP_ERR_NO_MEM;
+  t->timer = sim::timerCreate(args->callback, args->arg);
+  *handle = t;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs) {
+  if (sim::timerActive(timer->timer)) return ESP_ERR_INVALID_STATE;
+  sim::timerStart(timer->timer, timeoutUs, 0);
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t periodUs) {
+  if (sim::timerActive(timer->timer)) return ESP_ERR_INVALID_STATE;
+  sim::timerStart(timer->timer, periodUs, periodUs);
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer) {
+  return sim::timerStop(timer->timer) ? ESP_OK : ESP_ERR_INVALID_STATE;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer) {
+  if (sim::timerActive(timer->timer)) return ESP_ERR_INVALID_STATE;
+  sim::timerDelete(timer->timer);
+  free(timer);
+  return ESP_OK;
+}
+
+// =================== CRC32（与ROM中的 esp_crc32_le 相同）===================
+uint32_t esp_crc32_le(uint32_t crc, const uint8_t* data, uint32_t length) {
+  crc = ~crc;
+  while (length--) {
+    crc ^= *data++;
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
+
+// =================== 数据分区（按 partitions.csv）===================
+#ifndef SIM_PARTITIONS_CSV
+#define SIM_PARTITIONS_CSV "../partitions.csv"
+#endif
+
+struct SimPartition {
+  esp_partition_t info;
+  std::vector<uint8_t> flash;
+};
+
+static std::vector<SimPartition*>& partitions() {
+  static std::vector<SimPartition*> list;
+  static bool loaded = false;
+  if (loaded) return list;
+  loaded = true;
+
+  sim::Untracked guard;
+  FILE* file = fopen(SIM_PARTITIONS_CSV, "r");
+  if (file == nullptr) {
+    fprintf(stderr, "sim: 无法打开分区表 %s\n", SIM_PARTITIONS_CSV);
+    return list;
+  }
+
+  char line[256];
+  while (fgets(line, sizeof(line), file)) {
+    if (line[0] == '#' || line[0] == '\n') continue;
+    char name[32], type[16], subtype[16], offset[24], size[24];
+    if (sscanf(line, " %31[^, ] , %15[^, ] , %15[^, ] , %23[^, ] , %23[^, \n]",
+               name, type, subtype, offset, size) != 5) {
+      continue;
+    }
+    if (strcmp(type, "data") != 0) continue;
+
+    SimPartition* part = new SimPartition();
+    part->info.type = ESP_PARTITION_TYPE_DATA;
+    part->info.subtype = (uint8_t)strtoul(subtype, nullptr, 0);
+    part->info.address = (uint32_t)strtoul(offset, nullptr, 0);
+    part->info.size = (uint32_t)strtoul(size, nullptr, 0);
+    part->info.erase_size = 4096;
+    strlcpy(part->info.label, name, sizeof(part->info.label));
+    part->info.encrypted = false;
+    part->flash.assign(part->info.size, 0xFF);
+    list.push_back(part);
+  }
+  fclose(file);
+  return list;
+}
+
+static SimPartition* findPartition(const esp_partition_t* info) {
+  for (SimPartition* part : partitions()) {
+    if (&part->info == info) return part;
+  }
+  return nullptr;
+}
+
+const esp_partition_t* esp_partition_find_first(esp_partition_type_t type,
+                                                esp_partition_subtype_t subtype, const char* label) {
+  for (SimPartition* part : partitions()) {
+    if (part->info.type != type) continue;
+    if (subtype != ESP_PARTITION_SUBTYPE_ANY && part->info.subtype != (uint8_t)subtype) continue;
+    if (label != nullptr && strcmp(part->info.label, label) != 0) continue;
+    return &part->info;
+  }
+  return nullptr;
+}
+
+esp_err_t esp_partition_read(const esp_partition_t* info, size_t offset, void* dst, size_t size) {
+  SimPartition* part = findPartition(info);
+  if (part == nullptr || offset + size > info->size) return ESP_ERR_INVALID_ARG;
+  memcpy(dst, part->flash.data() + offset, size);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_write(const esp_partition_t* info, size_t offset, const void* src, size_t size) {
+  SimPartition* part = findPartition(info);
+  if (part == nullptr || offset + size > info->size) return ESP_ERR_INVALID_ARG;
+  const uint8_t* bytes = (const uint8_t*)src;
+  for (size_t i = 0; i < size; i++) part->flash[offset + i] &= bytes[i];  // NOR：只能1→0
+  sim::chargeUs((uint64_t)((size + 255) / 256) * SIM_FLASH_WRITE_US_PER_PAGE);
+  return ESP_OK;
+}
+
+esp_err_t esp_partition_erase_range(const esp_partition_t* info, size_t offset, size_t size) {
+  SimPartition* part = findPartition(info);
+  if (part == nullptr || offset + size > info->size) return ESP_ERR_INVALID_ARG;
+  if (offset % info->erase_size != 0 || size % info->erase_size != 0) return ESP_ERR_INVALID_SIZE;
+  memset(part->flash.data() + offset, 0xFF, size);
+  sim::chargeUs((uint64_t)(size / info->erase_size) * SIM_FLASH_ERASE_US);
+  return ESP_OK;
+}
@@ -0,0 +1,455 @@
+/*
+ * sim_core.cpp - 虚拟时钟、协程任务调度、esp_timer、堆统计、GPIO
+ *
+ * 调度规则（单线程，结果可复现）：
+ * - 每次选择可运行任务中优先级最高的一个（同优先级轮流），运行到它阻塞为止
+ * - 没有可运行任务时，把时钟推进到最早的唤醒/定时器时间
+ * - 定时器回调在任务切换之间执行（对应 esp_timer 任务，优先级高于所有应用任务）
+ *
+ * 版本: v1.0
+ */
+
+#include "sim_internal.h"
+
+#include <ucontext.h>
+#include <sys/mman.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <vector>
+
+namespace sim {
+
+// =================== 任务 ===================
+struct Task {
+  char name[16];
+  TaskFn fn;
+  void* arg;
+  int priority;
+  ucontext_t ctx;
+  void* stack;
+  bool finished;
+  uint64_t wakeAt;                 // 超时时间（UINT64_MAX = 无超时）
+  std::function<bool()> ready;     // 等待条件（为空时只按时间唤醒）
+  bool readyHit;                   // 本次因条件满足而唤醒
+  uint64_t cpuNs;
+  uint64_t lastRun;                // 同优先级轮流
+  int untracked;                   // Untracked 嵌套深度
+  uint32_t stackBytes;             // 固件申请的栈（计入堆）
+};
+
+struct Timer {
+  void (*callback)(void*);
+  void* arg;
+  uint64_t dueAt;
+  uint64_t periodUs;
+  uint64_t seq;                    // 同一时间到期时按启动顺序执行
+  bool active;
+};
+
+static std::vector<Task*> tasks;
+static std::vector<Timer*> timers;
+static Task* current = nullptr;
+static ucontext_t schedulerCtx;
+static uint64_t clockUs = 0;
+static uint64_t runCounter = 0;
+static uint64_t timerSeq = 0;
+static double cpuScale = 0;
+static std::chrono::steady_clock::time_point sliceStart;
+static int schedulerUntracked = 1;        // 调度器上下文（main、定时器回调）默认不计入固件堆
+
+static void heapTrackStack(uint32_t bytes);
+
+// =================== 虚拟时钟 ===================
+uint64_t nowUs() {
+  if (current != nullptr && cpuScale > 0) {
+    auto elapsed = std::chrono::steady_clock::now() - sliceStart;
+    uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    return clockUs + (uint64_t)(ns * cpuScale / 1000);
+  }
+  return clockUs;
+}
+
+void setCpuScale(double scale) {
+  cpuScale = scale;
+}
+
+// =================== 任务调度 ===================
+static void taskEntry() {
+  Task* task = current;
+  task->fn(task->arg);
+  exitTask();                      // FreeRTOS任务不应返回；返回后不再调度
+}
+
+void exitTask() {
+  Task* task = current;
+  task->finished = true;
+  swapcontext(&task->ctx, &schedulerCtx);
+  abort();                         // 已结束的任务不会再被调度
+}
+
+Task* createTask(const char* name, TaskFn fn, void* arg, int priority, uint32_t stackBytes) {
+  Untracked guard;
+  Task* task = new Task();
+  strncpy(task->name, name, sizeof(task->name) - 1);
+  task->fn = fn;
+  task->arg = arg;
+  task->priority = priority;
+  task->finished = false;
+  task->wakeAt = clockUs;
+  task->readyHit = false;
+  task->cpuNs = 0;
+  task->lastRun = 0;
+  task->untracked = 0;
+  task->stackBytes = stackBytes;
+
+  // 协程栈用mmap分配，不计入固件堆；固件申请的栈大小单独计入（FreeRTOS从堆分配任务栈）
+  task->stack = mmap(nullptr, SIM_TASK_HOST_STACK, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (task->stack == MAP_FAILED) {
+    fprintf(stderr, "sim: 无法分配任务栈 (%s)\n", name);
+    abort();
+  }
+  getcontext(&task->ctx);
+  task->ctx.uc_stack.ss_sp = task->stack;
+  task->ctx.uc_stack.ss_size = SIM_TASK_HOST_STACK;
+  task->ctx.uc_link = &schedulerCtx;
+  makecontext(&task->ctx, taskEntry, 0);
+
+  heapTrackStack(stackBytes);
+  tasks.push_back(task);
+  return task;
+}
+
+Task* currentTask() {
+  return current;
+}
+
+const char* taskName(Task* task) {
+  return task ? task->name : "scheduler";
+}
+
+uint64_t taskCpuNs(Task* task) {
+  if (task == nullptr) return 0;
+  uint64_t ns = task->cpuNs;
+  if (task == current) {
+    ns += std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - sliceStart).count();
+  }
+  return ns;
+}
+
+// 当前任务让出CPU，回到调度器
+static void block() {
+  if (current == nullptr) {
+    fprintf(stderr, "sim: 在任务之外调用了阻塞函数\n");
+    abort();
+  }
+  swapcontext(&current->ctx, &schedulerCtx);
+}
+
+void sleepUs(uint64_t us) {
+  Task* task = current;
+  uint64_t now = nowUs();
+  task->ready = nullptr;
+  task->wakeAt = now + us;
+  block();
+}
+
+bool waitFor(const std::function<bool()>& ready, uint64_t timeoutUs) {
+  if (ready()) return true;
+  if (timeoutUs == 0) return false;
+
+  Task* task = current;
+  uint64_t now = nowUs();
+  task->ready = ready;
+  task->readyHit = false;
+  task->wakeAt = timeoutUs == UINT64_MAX ? UINT64_MAX : now + timeoutUs;
+  block();
+  task->ready = nullptr;
+  return task->readyHit;
+}
+
+static void runTask(Task* task) {
+  current = task;
+  task->lastRun = ++runCounter;
+  sliceStart = std::chrono::steady_clock::now();
+  swapcontext(&schedulerCtx, &task->ctx);
+
+  uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  std::chrono::steady_clock::now() - sliceStart).count();
+  task->cpuNs += ns;
+  if (cpuScale > 0) clockUs += (uint64_t)(ns * cpuScale / 1000);
+  current = nullptr;
+}
+
+static void fireDueTimers() {
+  for (;;) {
+    Timer* next = nullptr;
+    for (Timer* t : timers) {
+      if (!t->active || t->dueAt > clockUs) continue;
+      if (next == nullptr || t->dueAt < next->dueAt ||
+          (t->dueAt == next->dueAt && t->seq < next->seq)) {
+        next = t;
+      }
+    }
+    if (next == nullptr) return;
+
+    if (next->periodUs > 0) {
+      next->dueAt += next->periodUs;
+    } else {
+      next->active = false;
+    }
+    next->callback(next->arg);
+  }
+}
+
+void run(const std::function<bool()>& done) {
+  while (!done()) {
+    fireDueTimers();
+
+    // 可运行：时间已到，或等待条件已满足
+    Task* best = nullptr;
+    for (Task* t : tasks) {
+      if (t->finished) continue;
+      bool runnable = t->wakeAt <= clockUs;
+      if (t->ready && t->ready()) {
+        t->readyHit = true;
+        runnable = true;
+      }
+      if (!runnable) continue;
+      if (best == nullptr || t->priority > best->priority ||
+          (t->priority == best->priority && t->lastRun < best->lastRun)) {
+        best = t;
+      }
+    }
+
+    if (best != nullptr) {
+      runTask(best);
+      continue;
+    }
+
+    // 没有可运行任务：推进到下一个事件
+    uint64_t next = UINT64_MAX;
+    for (Task* t : tasks) {
+      if (!t->finished && t->wakeAt < next) next = t->wakeAt;
+    }
+    for (Timer* t : timers) {
+      if (t->active && t->dueAt < next) next = t->dueAt;
+    }
+    if (next == UINT64_MAX) {
+      fprintf(stderr, "sim: 所有任务都在无限期等待，调度器停止\n");
+      return;
+    }
+    clockUs = next;
+  }
+}
+
+// =================== 定时器 ===================
+Timer* timerCreate(void (*callback)(void*), void* arg) {
+  Untracked guard;
+  Timer* timer = new Timer();
+  timer->callback = callback;
+  timer->arg = arg;
+  timer->active = false;
+  timers.push_back(timer);
+  return timer;
+}
+
+void timerStart(Timer* timer, uint64_t delayUs, uint64_t periodUs) {
+  timer->dueAt = nowUs() + delayUs;
+  timer->periodUs = periodUs;
+  timer->seq = ++timerSeq;
+  timer->active = true;
+}
+
+bool timerStop(Timer* timer) {
+  bool wasActive = timer->active;
+  timer->active = false;
+  return wasActive;
+}
+
+bool timerActive(Timer* timer) {
+  return timer->active;
+}
+
+void timerDelete(Timer* timer) {
+  Untracked guard;
+  for (size_t i = 0; i < timers.size(); i++) {
+    if (timers[i] == timer) {
+      timers.erase(timers.begin() + i);
+      break;
+    }
+  }
+  delete timer;
+}
+
+// =================== 堆统计 ===================
+// 每个分配前加16字节头，记录大小和是否计入固件堆
+struct BlockHeader {
+  uint32_t magic;
+  uint32_t tracked;
+  size_t size;
+};
+
+static const uint32_t BLOCK_MAGIC = 0x5348454D;  // "MEHS"
+static HeapStats heap = {0, 0, 0, 0};
+
+static int& untrackedDepth() {
+  return current ? current->untracked : schedulerUntracked;
+}
+
+Untracked::Untracked() { untrackedDepth()++; }
+Untracked::~Untracked() { untrackedDepth()--; }
+
+static void heapAdd(size_t size) {
+  heap.current += size;
+  heap.allocs++;
+  if (heap.current > heap.peak) heap.peak = heap.current;
+}
+
+static void heapTrackStack(uint32_t bytes) {
+  heapAdd(bytes);
+}
+
+HeapStats heapStats() {
+  return heap;
+}
+
+void resetHeapPeak() {
+  heap.peak = heap.current;
+}
+
+}  // namespace sim
+
+// =================== 分配函数（链接时 --wrap=malloc 等）===================
+extern "C" {
+void* __real_malloc(size_t size);
+void __real_free(void* p);
+
+void* __wrap_malloc(size_t size) {
+  sim::BlockHeader* h = (sim::BlockHeader*)__real_malloc(sizeof(sim::BlockHeader) + size);
+  if (h == nullptr) return nullptr;
+  h->magic = sim::BLOCK_MAGIC;
+  h->size = size;
+  h->tracked = sim::untrackedDepth() == 0;
+  if (h->tracked) sim::heapAdd(size);
+  return h + 1;
+}
+
+void __wrap_free(void* p) {
+  if (p == nullptr) return;
+  sim::BlockHeader* h = (sim::BlockHeader*)p - 1;
+  if (h->magic != sim::BLOCK_MAGIC) {
+    fprintf(stderr, "sim: free() 的指针不是由仿真堆分配的\n");
+    abort();
+  }
+  if (h->tracked) {
+    sim::heap.current -= h->size;
+    sim::heap.frees++;
+  }
+  h->magic = 0;
+  __real_free(h);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+  void* p = __wrap_malloc(count * size);
+  if (p != nullptr) memset(p, 0, count * size);
+  return p;
+}
+
+void* __wrap_realloc(void* p, size_t size) {
+  if (p == nullptr) return __wrap_malloc(size);
+  sim::BlockHeader* h = (sim::BlockHeader*)p - 1;
+  void* q = __wrap_malloc(size);
+  if (q == nullptr) return nullptr;
+  memcpy(q, p, h->size < size ? h->size : size);
+  __wrap_free(p);
+  return q;
+}
+}
+
+void* operator new(size_t size) {
+  void* p = __wrap_malloc(size);
+  if (p == nullptr) throw std::bad_alloc();
+  return p;
+}
+
+void* operator new[](size_t size) {
+  return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+  return __wrap_malloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+  return __wrap_malloc(size);
+}
+
+void operator delete(void* p) noexcept { __wrap_free(p); }
+void operator delete[](void* p) noexcept { __wrap_free(p); }
+void operator delete(void* p, size_t) noexcept { __wrap_free(p); }
+void operator delete[](void* p, size_t) noexcept { __wrap_free(p); }
+
+// =================== GPIO ===================
+namespace sim {
+
+static const int PIN_COUNT = 64;
+static int pinLevels[PIN_COUNT];
+static void (*pinChangeCallback)(int, int, uint64_t) = nullptr;
+
+struct PinIsr {
+  void (*fn)(void*);
+  void* arg;
+  int mode;
+};
+static PinIsr pinIsrs[PIN_COUNT];
+
+void setPin(int pin, int level) {
+  if (pin < 0 || pin >= PIN_COUNT) return;
+  int old = pinLevels[pin];
+  pinLevels[pin] = level ? 1 : 0;
+  if (old == pinLevels[pin] || pinIsrs[pin].fn == nullptr) return;
+
+  // 中断模式：1=上升沿 2=下降沿 3=双边沿（与Arduino RISING/FALLING/CHANGE一致）
+  bool rising = pinLevels[pin] == 1;
+  int mode = pinIsrs[pin].mode;
+  if (mode == 3 || (mode == 1 && rising) || (mode == 2 && !rising)) {
+    pinIsrs[pin].fn(pinIsrs[pin].arg);
+  }
+}
+
+int pinLevel(int pin) {
+  if (pin < 0 || pin >= PIN_COUNT) return 0;
+  return pinLevels[pin];
+}
+
+void onPinChange(void (*callback)(int pin, int level, uint64_t atUs)) {
+  pinChangeCallback = callback;
+}
+
+// 固件输出（digitalWrite/gpio_set_level）
+void writePin(int pin, int level) {
+  if (pin < 0 || pin >= PIN_COUNT) return;
+  level = level ? 1 : 0;
+  if (pinLevels[pin] == level) return;
+  pinLevels[pin] = level;
+  if (pinChangeCallback) pinChangeCallback(pin, level, nowUs());
+}
+
+void attachPinIsr(int pin, void (*fn)(void*), void* arg, int mode) {
+  if (pin < 0 || pin >= PIN_COUNT) return;
+  pinIsrs[pin].fn = fn;
+  pinIsrs[pin].arg = arg;
+  pinIsrs[pin].mode = mode;
+}
+
+void detachPinIsr(int pin) {
+  if (pin < 0 || pin >= PIN_COUNT) return;
+  pinIsrs[pin].fn = nullptr;
+}
+
+}  // namespace sim
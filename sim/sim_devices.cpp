@@ -0,0 +1,498 @@
+/*
+ * sim_devices.cpp - 虚拟外设：RC522读卡器、SSD1309 OLED、NVS、I2C/SPI总线
+ *
+ * 版本: v1.0
+ */
+
+#include <Arduino.h>
+#include <MFRC522.h>
+#include <U8g2lib.h>
+#include <Preferences.h>
+#include <Wire.h>
+#include <SPI.h>
+#include "sim_internal.h"
+
+#include <map>
+#include <string>
+#include <vector>
+
+// =================== 刷卡 ===================
+static struct {
+  bool present;
+  bool halted;          // PICC_HaltA后不再应答REQA，移开后恢复
+  uint8_t uid[10];
+  uint8_t size;
+} card = {};
+
+void sim::placeCard(const uint8_t* uid, uint8_t size) {
+  if (size > sizeof(card.uid)) size = sizeof(card.uid);
+  memcpy(card.uid, uid, size);
+  card.size = size;
+  card.present = true;
+  card.halted = false;
+}
+
+void sim::removeCard() {
+  card.present = false;
+  card.halted = false;
+}
+
+bool sim::cardInField() {
+  return card.present;
+}
+
+// =================== MFRC522 ===================
+void MFRC522::PCD_Init() {
+  memset(registers, 0, sizeof(registers));
+  registers[VersionReg] = 0x92;      // MFRC522 v2.0
+  registers[TxControlReg] = 0x80;
+  registers[RFCfgReg] = 0x48;
+  registers[CommandReg] = 0x20;
+  memset(&uid, 0, sizeof(uid));
+  sim::chargeUs(50000);              // 软复位等待振荡器启动
+  PCD_AntennaOn();                   // 与库相同：初始化结束时打开天线
+}
+
+uint8_t MFRC522::PCD_ReadRegister(PCD_Register reg) {
+  sim::chargeUs(SIM_NFC_REGISTER_US);
+  return registers[reg & 0x7F];
+}
+
+void MFRC522::PCD_WriteRegister(PCD_Register reg, uint8_t value) {
+  sim::chargeUs(SIM_NFC_REGISTER_US);
+  if (reg == VersionReg) return;     // 只读
+  if (reg == CommandReg) value = (registers[CommandReg] & 0xF0) | (value & 0x0F);
+  registers[reg & 0x7F] = value;
+}
+
+void MFRC522::PCD_AntennaOn() {
+  uint8_t value = PCD_ReadRegister(TxControlReg);
+  if ((value & 0x03) != 0x03) PCD_WriteRegister(TxControlReg, value | 0x03);
+}
+
+void MFRC522::PCD_AntennaOff() {
+  PCD_WriteRegister(TxControlReg, PCD_ReadRegister(TxControlReg) & ~0x03);
+}
+
+// 天线关闭或没有可应答的卡片时，等待芯片定时器超时
+static bool cardAnswers(uint8_t txControl) {
+  return card.present && !card.halted && (txControl & 0x03) == 0x03;
+}
+
+bool MFRC522::PICC_IsNewCardPresent() {
+  if (!cardAnswers(registers[TxControlReg])) {
+    sim::chargeUs(SIM_NFC_REQA_TIMEOUT_US);
+    return false;
+  }
+  sim::chargeUs(SIM_NFC_REQA_US);
+  return true;
+}
+
+bool MFRC522::PICC_ReadCardSerial() {
+  if (!cardAnswers(registers[TxControlReg])) {
+    sim::chargeUs(SIM_NFC_REQA_TIMEOUT_US);
+    return false;
+  }
+  sim::chargeUs(SIM_NFC_SELECT_US);
+  uid.size = card.size;
+  memcpy(uid.uidByte, card.uid, card.size);
+  uid.sak = 0x08;
+  return true;
+}
+
+uint8_t MFRC522::PICC_HaltA() {
+  sim::chargeUs(SIM_NFC_REQA_US);
+  card.halted = true;
+  return 0;
+}
+
+// =================== OLED ===================
+const u8g2_cb_t u8g2_cb_r0 = {false};
+const u8g2_cb_t u8g2_cb_r2 = {true};
+
+// {字宽, 上伸, 下伸}（近似U8g2字体的平均字宽和字高）
+const uint8_t u8g2_font_6x10_tf[] = {6, 7, 2};
+const uint8_t u8g2_font_helvR08_tf[] = {5, 8, 2};
+const uint8_t u8g2_font_helvB08_tf[] = {6, 8, 2};
+const uint8_t u8g2_font_helvB10_tf[] = {7, 10, 3};
+
+// 面板显存（原生图块格式，与U8g2缓冲区相同）
+static uint8_t panel[SIM_OLED_WIDTH * SIM_OLED_HEIGHT / 8];
+static bool panelRotated = false;
+static uint32_t panelBytesSent = 0;
+
+// 3x5点阵：每个字符5行，每行3位（小写按大写绘制，其他字符画方框）
+static const struct {
+  char c;
+  const char* rows;
+} GLYPHS[] = {
+  {'0', "111101101101111"}, {'1', "010110010010111"}, {'2', "111001111100111"},
+  {'3', "111001111001111"}, {'4', "101101111001001"}, {'5', "111100111001111"},
+  {'6', "111100111101111"}, {'7', "111001010010010"}, {'8', "111101111101111"},
+  {'9', "111101111001111"}, {'A', "010101111101101"}, {'B', "110101110101110"},
+  {'C', "011100100100011"}, {'D', "110101101101110"}, {'E', "111100110100111"},
+  {'F', "111100110100100"}, {'G', "011100101101011"}, {'H', "101101111101101"},
+  {'I', "111010010010111"}, {'J', "001001001101010"}, {'K', "101101110101101"},
+  {'L', "100100100100111"}, {'M', "101111111101101"}, {'N', "110101101101101"},
+  {'O', "010101101101010"}, {'P', "110101110100100"}, {'Q', "010101101110011"},
+  {'R', "110101110101101"}, {'S', "011100010001110"}, {'T', "111010010010010"},
+  {'U', "101101101101111"}, {'V', "101101101101010"}, {'W', "101101111111101"},
+  {'X', "101101010101101"}, {'Y', "101101010010010"}, {'Z', "111001010100111"},
+  {' ', "000000000000000"}, {'.', "000000000000010"}, {',', "000000000010100"},
+  {':', "000010000010000"}, {'!', "010010010000010"}, {'?', "110001010000010"},
+  {'-', "000000111000000"}, {'+', "000010111010000"}, {'$', "011110010011110"},
+  {'%', "101001010100101"}, {'/', "001001010100100"}, {'(', "001010010010001"},
+  {')', "100010010010100"}, {'=', "000111000111000"}, {'|', "010010010010010"},
+  {'*', "101010101000000"}, {'#', "101111101111101"}, {'\'', "010010000000000"},
+  {'"', "101101000000000"}, {'<', "001010100010001"}, {'>', "100010001010100"},
+  {'_', "000000000000111"}, {'&', "010101010101011"},
+};
+
+static const char* glyphRows(uint32_t codepoint) {
+  if (codepoint < 128) {
+    char c = (char)toupper((int)codepoint);
+    for (const auto& glyph : GLYPHS) {
+      if (glyph.c == c) return glyph.rows;
+    }
+  }
+  return "111101101101111";  // 未知字符
+}
+
+// 解码一个UTF-8字符，返回字节数
+static int decodeUtf8(const char* text, uint32_t& codepoint) {
+  uint8_t c = (uint8_t)text[0];
+  int n = c < 0x80 ? 1 : (c >> 5) == 0x06 ? 2 : (c >> 4) == 0x0E ? 3 : (c >> 3) == 0x1E ? 4 : 1;
+  codepoint = n == 1 ? c : c & (0x3F >> (n - 1));
+  for (int i = 1; i < n; i++) {
+    if ((text[i] & 0xC0) != 0x80) return i;
+    codepoint = (codepoint << 6) | (text[i] & 0x3F);
+  }
+  return n;
+}
+
+bool U8G2::begin() {
+  panelRotated = rotate180;
+  memset(panel, 0, sizeof(panel));
+  sim::chargeUs(30 * SIM_I2C_US_PER_BYTE);  // 初始化命令序列
+  return true;
+}
+
+void U8G2::sendTiles(uint8_t tx, uint8_t ty, uint8_t tw, uint8_t th) {
+  uint32_t bytes = 0;
+  for (int row = ty; row < ty + th && row < TILE_HEIGHT; row++) {
+    for (int col = tx; col < tx + tw && col < TILE_WIDTH; col++) {
+      memcpy(panel + row * WIDTH + col * 8, buffer + row * WIDTH + col * 8, 8);
+      bytes += 8;
+    }
+  }
+  panelBytesSent += bytes;
+  sim::chargeUs((uint64_t)bytes * SIM_I2C_US_PER_BYTE);
+}
+
+void U8G2::sendBuffer() {
+  sendTiles(0, 0, TILE_WIDTH, TILE_HEIGHT);
+}
+
+void U8G2::updateDisplayArea(uint8_t tx, uint8_t ty, uint8_t tw, uint8_t th) {
+  sendTiles(tx, ty, tw, th);
+}
+
+void U8G2::drawPixel(int x, int y) {
+  if (x < 0 || y < 0 || x >= WIDTH || y >= HEIGHT) return;
+  if (rotate180) {
+    x = WIDTH - 1 - x;
+    y = HEIGHT - 1 - y;
+  }
+  uint8_t& byte = buffer[(y / 8) * WIDTH + x];
+  uint8_t mask = 1 << (y % 8);
+  if (drawColor == 0) byte &= ~mask;
+  else if (drawColor == 2) byte ^= mask;
+  else byte |= mask;
+}
+
+void U8G2::drawHLine(int x, int y, int w) {
+  for (int i = 0; i < w; i++) drawPixel(x + i, y);
+}
+
+void U8G2::drawVLine(int x, int y, int h) {
+  for (int i = 0; i < h; i++) drawPixel(x, y + i);
+}
+
+void U8G2::drawLine(int x0, int y0, int x1, int y1) {
+  int dx = abs(x1 - x0), sx = x0 < x1 ? 1 : -1;
+  int dy = -abs(y1 - y0), sy = y0 < y1 ? 1 : -1;
+  int err = dx + dy;
+  for (;;) {
+    drawPixel(x0, y0);
+    if (x0 == x1 && y0 == y1) break;
+    int e2 = 2 * err;
+    if (e2 >= dy) { err += dy; x0 += sx; }
+    if (e2 <= dx) { err += dx; y0 += sy; }
+  }
+}
+
+void U8G2::drawBox(int x, int y, int w, int h) {
+  for (int i = 0; i < h; i++) drawHLine(x, y + i, w);
+}
+
+void U8G2::drawFrame(int x, int y, int w, int h) {
+  if (w <= 0 || h <= 0) return;
+  drawHLine(x, y, w);
+  drawHLine(x, y + h - 1, w);
+  drawVLine(x, y + 1, h - 2);
+  drawVLine(x + w - 1, y + 1, h - 2);
+}
+
+// 四个象限的对称点（fill时画到圆心的水平线）
+void U8G2::circleQuadrants(int x0, int y0, int dx, int dy, uint8_t option, bool fill) {
+  if (fill) {
+    if (option & U8G2_DRAW_UPPER_RIGHT) drawHLine(x0, y0 - dy, dx + 1);
+    if (option & U8G2_DRAW_UPPER_LEFT) drawHLine(x0 - dx, y0 - dy, dx + 1);
+    if (option & U8G2_DRAW_LOWER_LEFT) drawHLine(x0 - dx, y0 + dy, dx + 1);
+    if (option & U8G2_DRAW_LOWER_RIGHT) drawHLine(x0, y0 + dy, dx + 1);
+    return;
+  }
+  if (option & U8G2_DRAW_UPPER_RIGHT) drawPixel(x0 + dx, y0 - dy);
+  if (option & U8G2_DRAW_UPPER_LEFT) drawPixel(x0 - dx, y0 - dy);
+  if (option & U8G2_DRAW_LOWER_LEFT) drawPixel(x0 - dx, y0 + dy);
+  if (option & U8G2_DRAW_LOWER_RIGHT) drawPixel(x0 + dx, y0 + dy);
+}
+
+void U8G2::drawCircle(int x0, int y0, int r, uint8_t option) {
+  int x = r, y = 0, err = 1 - r;
+  while (x >= y) {
+    circleQuadrants(x0, y0, x, y, option, false);
+    circleQuadrants(x0, y0, y, x, option, false);
+    y++;
+    if (err < 0) {
+      err += 2 * y + 1;
+    } else {
+      x--;
+      err += 2 * (y - x) + 1;
+    }
+  }
+}
+
+void U8G2::drawDisc(int x0, int y0, int r, uint8_t option) {
+  int x = r, y = 0, err = 1 - r;
+  while (x >= y) {
+    circleQuadrants(x0, y0, x, y, option, true);
+    circleQuadrants(x0, y0, y, x, option, true);
+    y++;
+    if (err < 0) {
+      err += 2 * y + 1;
+    } else {
+      x--;
+      err += 2 * (y - x) + 1;
+    }
+  }
+}
+
+void U8G2::drawEllipse(int x0, int y0, int rx, int ry, uint8_t option) {
+  // 按列和按行各扫描一次，避免陡峭处断线
+  for (int dx = 0; dx <= rx; dx++) {
+    int dy = (int)lround(ry * sqrt(1.0 - (double)dx * dx / ((double)rx * rx)));
+    circleQuadrants(x0, y0, dx, dy, option, false);
+  }
+  for (int dy = 0; dy <= ry; dy++) {
+    int dx = (int)lround(rx * sqrt(1.0 - (double)dy * dy / ((double)ry * ry)));
+    circleQuadrants(x0, y0, dx, dy, option, false);
+  }
+}
+
+void U8G2::drawRFrame(int x, int y, int w, int h, int r) {
+  if (w < 2 * (r + 1) || h < 2 * (r + 1)) {
+    drawFrame(x, y, w, h);
+    return;
+  }
+  drawHLine(x + r, y, w - 2 * r);
+  drawHLine(x + r, y + h - 1, w - 2 * r);
+  drawVLine(x, y + r, h - 2 * r);
+  drawVLine(x + w - 1, y + r, h - 2 * r);
+  drawCircle(x + r, y + r, r, U8G2_DRAW_UPPER_LEFT);
+  drawCircle(x + w - 1 - r, y + r, r, U8G2_DRAW_UPPER_RIGHT);
+  drawCircle(x + r, y + h - 1 - r, r, U8G2_DRAW_LOWER_LEFT);
+  drawCircle(x + w - 1 - r, y + h - 1 - r, r, U8G2_DRAW_LOWER_RIGHT);
+}
+
+void U8G2::drawRBox(int x, int y, int w, int h, int r) {
+  (void)r;
+  drawBox(x, y, w, h);
+}
+
+int U8G2::getStrWidth(const char* text) {
+  if (font == NULL || text == NULL) return 0;
+  int count = 0;
+  uint32_t codepoint;
+  for (const char* p = text; *p; p += decodeUtf8(p, codepoint)) count++;
+  return count * font[0];
+}
+
+// 3x5点阵按字体大小放大，底边对齐基线
+void U8G2::drawGlyph(int x, int y, uint32_t codepoint) {
+  int scaleX = max(1, (font[0] - 1) / 3);
+  int scaleY = max(1, font[1] / 5);
+  int top = y - 5 * scaleY;
+  const char* rows = glyphRows(codepoint);
+  for (int row = 0; row < 5; row++) {
+    for (int col = 0; col < 3; col++) {
+      if (rows[row * 3 + col] == '1') drawBox(x + col * scaleX, top + row * scaleY, scaleX, scaleY);
+    }
+  }
+}
+
+int U8G2::drawStr(int x, int y, const char* text) {
+  if (font == NULL || text == NULL) return 0;
+  int start = x;
+  uint32_t codepoint;
+  for (const char* p = text; *p; ) {
+    p += decodeUtf8(p, codepoint);
+    if (x + font[0] > 0 && x < WIDTH) drawGlyph(x, y, codepoint);
+    x += font[0];
+  }
+  return x - start;
+}
+
+bool sim::oledPixel(int x, int y) {
+  if (x < 0 || y < 0 || x >= SIM_OLED_WIDTH || y >= SIM_OLED_HEIGHT) return false;
+  if (panelRotated) {
+    x = SIM_OLED_WIDTH - 1 - x;
+    y = SIM_OLED_HEIGHT - 1 - y;
+  }
+  return (panel[(y / 8) * SIM_OLED_WIDTH + x] >> (y % 8)) & 1;
+}
+
+bool sim::dumpOled(const char* path) {
+  FILE* file = fopen(path, "w");
+  if (file == nullptr) return false;
+  fprintf(file, "P1\n%d %d\n", SIM_OLED_WIDTH, SIM_OLED_HEIGHT);
+  for (int y = 0; y < SIM_OLED_HEIGHT; y++) {
+    for (int x = 0; x < SIM_OLED_WIDTH; x++) {
+      fputc(oledPixel(x, y) ? '1' : '0', file);
+    }
+    fputc('\n', file);
+  }
+  fclose(file);
+  return true;
+}
+
+uint32_t sim::oledBytesSent() {
+  return panelBytesSent;
+}
+
+// =================== I2C / SPI ===================
+TwoWire Wire;
+SPIClass SPI;
+
+bool TwoWire::begin(int sda, int scl, uint32_t frequency) {
+  (void)sda; (void)scl; (void)frequency;
+  return true;
+}
+
+uint8_t TwoWire::endTransmission(bool sendStop) {
+  (void)sendStop;
+  sim::chargeUs(SIM_I2C_US_PER_BYTE);      // 地址字节
+  return address == SIM_OLED_I2C_ADDRESS ? 0 : 2;  // 2 = 地址无应答
+}
+
+// =================== NVS ===================
+// 命名空间 → 键 → {类型, 数据}；进程内"重启"后保留
+struct NvsEntry {
+  uint8_t type;
+  std::vector<uint8_t> data;
+};
+
+static std::map<std::string, std::map<std::string, NvsEntry>>& nvs() {
+  static std::map<std::string, std::map<std::string, NvsEntry>> store;
+  return store;
+}
+
+static const uint8_t NVS_TYPE_STRING = 11;
+
+bool Preferences::begin(const char* name, bool readOnly, const char* partition) {
+  (void)partition;
+  if (opened || name == NULL || strlen(name) > 15) return false;
+  strlcpy(ns, name, sizeof(ns));
+  this->readOnly = readOnly;
+  opened = true;
+  return true;
+}
+
+void Preferences::end() {
+  opened = false;
+}
+
+bool Preferences::clear() {
+  if (!opened || readOnly) return false;
+  sim::Untracked guard;
+  nvs()[ns].clear();
+  sim::chargeUs(SIM_NVS_WRITE_US);
+  return true;
+}
+
+bool Preferences::remove(const char* key) {
+  if (!opened || readOnly) return false;
+  sim::Untracked guard;
+  bool removed = nvs()[ns].erase(key) > 0;
+  if (removed) sim::chargeUs(SIM_NVS_WRITE_US);
+  return removed;
+}
+
+bool Preferences::isKey(const char* key) {
+  if (!opened) return false;
+  sim::Untracked guard;
+  return nvs()[ns].count(key) > 0;
+}
+
+size_t Preferences::putRaw(const char* key, uint8_t type, const void* data, size_t size) {
+  if (!opened || readOnly || key == NULL || strlen(key) > 15) return 0;
+  {
+    sim::Untracked guard;
+    NvsEntry& entry = nvs()[ns][key];
+    const uint8_t* bytes = (const uint8_t*)data;
+    bool same = entry.type == type && entry.data.size() == size &&
+                memcmp(entry.data.data(), bytes, size) == 0;
+    if (same) return size;  // 与NVS相同：值未变化时不写Flash
+    entry.type = type;
+    entry.data.assign(bytes, bytes + size);
+  }
+  sim::chargeUs(SIM_NVS_WRITE_US);
+  return size;
+}
+
+size_t Preferences::getRaw(const char* key, uint8_t type, void* out, size_t size) {
+  if (!opened || key == NULL) return 0;
+  sim::Untracked guard;
+  auto& entries = nvs()[ns];
+  auto it = entries.find(key);
+  if (it == entries.end() || it->second.type != type || it->second.data.size() > size) return 0;
+  memcpy(out, it->second.data.data(), it->second.data.size());
+  return it->second.data.size();
+}
+
+size_t Preferences::putString(const char* key, const char* value) {
+  return putRaw(key, NVS_TYPE_STRING, value, strlen(value) + 1) > 0 ? strlen(value) : 0;
+}
+
+String Preferences::getString(const char* key, const String& def) {
+  char text[512];
+  if (getRaw(key, NVS_TYPE_STRING, text, sizeof(text)) == 0) return def;
+  return String(text);
+}
+
+size_t Preferences::getString(const char* key, char* value, size_t maxLen) {
+  size_t n = getRaw(key, NVS_TYPE_STRING, value, maxLen);
+  return n > 0 ? n - 1 : 0;
+}
+
+size_t Preferences::getBytesLength(const char* key) {
+  if (!opened || key == NULL) return 0;
+  sim::Untracked guard;
+  auto& entries = nvs()[ns];
+  auto it = entries.find(key);
+  return it == entries.end() ? 0 : it->second.data.size();
+}
+
+size_t Preferences::getBytes(const char* key, void* buf, size_t maxLen) {
+  return getRaw(key, 12, buf, maxLen);
+}
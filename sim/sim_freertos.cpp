@@ -0,0 +1,229 @@
+/*
+ * sim_freertos.cpp - FreeRTOS 仿真（基于 sim_core 的协程调度）
+ *
+ * 1 tick = 1 ms（与 ESP32 Arduino 默认 CONFIG_FREERTOS_HZ=1000 一致）
+ *
+ * 版本: v1.0
+ */
+
+#include "freertos/FreeRTOS.h"
+#include "sim_internal.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <vector>
+
+struct SimQueue {
+  UBaseType_t length;
+  UBaseType_t itemSize;
+  std::deque<std::vector<uint8_t>> items;
+  void* storage;      // 与FreeRTOS相同大小的堆分配（只用于堆统计）
+};
+
+struct SimSemaphore {
+  bool isMutex;
+  UBaseType_t count;
+  UBaseType_t maxCount;
+};
+
+static uint64_t ticksToUs(TickType_t ticks) {
+  return ticks == portMAX_DELAY ? UINT64_MAX : (uint64_t)ticks * 1000;
+}
+
+// =================== 任务 ===================
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t fn, const char* name, uint32_t stackBytes,
+                                   void* arg, UBaseType_t priority, TaskHandle_t* handle,
+                                   BaseType_t core) {
+  (void)core;  // 单线程仿真：不区分核心
+  sim::Task* task = sim::createTask(name, fn, arg, (int)priority, stackBytes);
+  if (handle != NULL) *handle = task;
+  return pdPASS;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t fn, const char* name, uint32_t stackBytes, void* arg,
+                       UBaseType_t priority, TaskHandle_t* handle) {
+  return xTaskCreatePinnedToCore(fn, name, stackBytes, arg, priority, handle, tskNO_AFFINITY);
+}
+
+void vTaskDelete(TaskHandle_t task) {
+  if (task != NULL && task != sim::currentTask()) {
+    fprintf(stderr, "sim: vTaskDelete 只支持删除当前任务\n");
+    abort();
+  }
+  sim::exitTask();
+}
+
+void vTaskDelay(TickType_t ticks) {
+  sim::sleepUs(ticksToUs(ticks));
+}
+
+BaseType_t xTaskDelayUntil(TickType_t* previousWake, TickType_t period) {
+  TickType_t wake = *previousWake + period;
+  TickType_t now = xTaskGetTickCount();
+  *previousWake = wake;
+  if ((int32_t)(wake - now) <= 0) {
+    sim::sleepUs(0);  // 已经过期：仍让出CPU
+    return pdFALSE;
+  }
+  sim::sleepUs((uint64_t)(wake - now) * 1000 - sim::nowUs() % 1000);
+  return pdTRUE;
+}
+
+void vTaskDelayUntil(TickType_t* previousWake, TickType_t period) {
+  xTaskDelayUntil(previousWake, period);
+}
+
+TickType_t xTaskGetTickCount() {
+  return (TickType_t)(sim::nowUs() / 1000);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle() {
+  return sim::currentTask();
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t task) {
+  (void)task;
+  return 0;  // 主机栈与固件栈大小无关，不统计
+}
+
+void taskYIELD() {
+  sim::sleepUs(0);
+}
+
+// =================== 任务通知 ===================
+static std::map<TaskHandle_t, uint32_t>& notifyCounts() {
+  static std::map<TaskHandle_t, uint32_t> counts;
+  return counts;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+  TaskHandle_t self = sim::currentTask();
+  sim::waitFor([self]() { return notifyCounts()[self] > 0; }, ticksToUs(ticks));
+
+  sim::Untracked guard;
+  uint32_t& count = notifyCounts()[self];
+  uint32_t value = count;
+  if (value > 0) count = clearOnExit ? 0 : value - 1;
+  return value;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task) {
+  sim::Untracked guard;
+  notifyCounts()[task]++;
+  return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higherPriorityTaskWoken) {
+  xTaskNotifyGive(task);
+  if (higherPriorityTaskWoken != NULL) *higherPriorityTaskWoken = pdFALSE;
+}
+
+// =================== 队列 ===================
+// 队列存储计入固件堆（FreeRTOS创建队列时一次分配 length × itemSize）
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t itemSize) {
+  SimQueue* queue;
+  {
+    sim::Untracked guard;
+    queue = new SimQueue();
+  }
+  queue->length = length;
+  queue->itemSize = itemSize;
+  queue->storage = malloc((size_t)length * itemSize);
+  return queue;
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks) {
+  if (!sim::waitFor([queue]() { return queue->items.size() < queue->length; }, ticksToUs(ticks))) {
+    return pdFALSE;
+  }
+  sim::Untracked guard;
+  const uint8_t* bytes = (const uint8_t*)item;
+  queue->items.emplace_back(bytes, bytes + queue->itemSize);
+  return pdTRUE;
+}
+
+BaseType_t xQueueSendToBack(QueueHandle_t queue, const void* item, TickType_t ticks) {
+  return xQueueSend(queue, item, ticks);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* woken) {
+  if (woken != NULL) *woken = pdFALSE;
+  if (queue->items.size() >= queue->length) return pdFALSE;
+  sim::Untracked guard;
+  const uint8_t* bytes = (const uint8_t*)item;
+  queue->items.emplace_back(bytes, bytes + queue->itemSize);
+  return pdTRUE;
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks) {
+  if (!sim::waitFor([queue]() { return !queue->items.empty(); }, ticksToUs(ticks))) {
+    return pdFALSE;
+  }
+  sim::Untracked guard;
+  memcpy(item, queue->items.front().data(), queue->itemSize);
+  queue->items.pop_front();
+  return pdTRUE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue) {
+  return (UBaseType_t)queue->items.size();
+}
+
+UBaseType_t uxQueueSpacesAvailable(QueueHandle_t queue) {
+  return queue->length - (UBaseType_t)queue->items.size();
+}
+
+BaseType_t xQueueReset(QueueHandle_t queue) {
+  sim::Untracked guard;
+  queue->items.clear();
+  return pdPASS;
+}
+
+// =================== 信号量 ===================
+static SemaphoreHandle_t createSemaphore(bool isMutex, UBaseType_t maxCount, UBaseType_t initial) {
+  sim::Untracked guard;
+  SimSemaphore* sem = new SimSemaphore();
+  sem->isMutex = isMutex;
+  sem->maxCount = maxCount;
+  sem->count = initial;
+  return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateMutex() {
+  return createSemaphore(true, 1, 1);
+}
+
+SemaphoreHandle_t xSemaphoreCreateBinary() {
+  return createSemaphore(false, 1, 0);
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t maxCount, UBaseType_t initialCount) {
+  return createSemaphore(false, maxCount, initialCount);
+}
+
+void vSemaphoreDelete(SemaphoreHandle_t sem) {
+  sim::Untracked guard;
+  delete sem;
+}
+
+BaseType_t xSemaphoreTake(SemaphoreHandle_t sem, TickType_t ticks) {
+  if (!sim::waitFor([sem]() { return sem->count > 0; }, ticksToUs(ticks))) {
+    return pdFALSE;
+  }
+  sem->count--;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGive(SemaphoreHandle_t sem) {
+  if (sem->count >= sem->maxCount) return pdFALSE;
+  sem->count++;
+  return pdTRUE;
+}
+
+BaseType_t xSemaphoreGiveFromISR(SemaphoreHandle_t sem, BaseType_t* woken) {
+  if (woken != NULL) *woken = pdFALSE;
+  return xSemaphoreGive(sem);
+}
@@ -0,0 +1,32 @@
+/*
+ * sim_internal.h - 仿真各模块之间的内部接口（不给基准测试程序使用）
+ *
+ * 版本: v1.0
+ */
+
+#ifndef SIM_INTERNAL_H
+#define SIM_INTERNAL_H
+
+#include "sim.h"
+
+namespace sim {
+
+// GPIO（sim_core.cpp）
+void writePin(int pin, int level);                                   // 固件输出
+void attachPinIsr(int pin, void (*fn)(void*), void* arg, int mode);  // mode: 1=上升沿 2=下降沿 3=双边沿
+void detachPinIsr(int pin);
+
+// 结束当前任务（vTaskDelete(NULL)），不再返回
+[[noreturn]] void exitTask();
+
+// 只在任务中阻塞（启动前/定时器回调中调用时不计时）
+inline void chargeUs(uint64_t us) {
+  if (currentTask() != nullptr) sleepUs(us);
+}
+
+// 重启（sim_arduino.cpp）
+void restart();
+
+}  // namespace sim
+
+#endif // SIM_INTERNAL_H
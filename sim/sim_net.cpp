@@ -0,0 +1,456 @@
+/*
+ * sim_net.cpp - WiFi、TLS连接和HTTPClient（主机仿真，服务器为 mock_supabase）
+ *
+ * - WiFi：begin() 后 扫描+关联+DHCP 连接成功（指定BSSID/信道跳过扫描，WiFi.config() 静态IP跳过DHCP）；
+ *   sim::setWifiAvailable(false) 时断开，已建立的TLS连接随之失效；开启自动重连时恢复后自动重连，
+ *   否则由固件重新 begin()；连接/断开通过 onEvent 回调通知（sys_evt 任务）
+ * - 握手、请求往返和超时都在调用任务中阻塞相应的虚拟时间
+ * - 协议栈自身的缓冲区（接收数据、请求头）不计入固件堆
+ *
+ * 版本: v1.0
+ */
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiClientSecure.h>
+#include <HTTPClient.h>
+#include "mock_supabase.h"
+#include "sim_internal.h"
+
+// =================== WiFi ===================
+WiFiClass WiFi;
+
+#define SIM_WIFI_EVENT_POLL_US 10000   // 事件任务检查连接状态的间隔
+
+static const uint8_t SIM_AP_BSSID[6] = {0x24, 0x0A, 0xC4, 0x10, 0x20, 0x30};
+
+static struct {
+  bool available = true;
+  bool begun = false;
+  bool attemptOk = true;    // 本次连接能否成功（AP可用且指定的BSSID/信道正确）
+  bool autoReconnect = true;
+  uint64_t connectAt = 0;
+  uint64_t failAt = 0;      // 连接失败的时刻（0=没有待通知的失败）
+  uint32_t epoch = 0;       // 每次断开+1，之前建立的连接失效
+  int apChannel = 6;
+  uint32_t staticIp = 0;    // WiFi.config() 设置的地址（0=DHCP）
+  uint32_t staticGateway = 0;
+  uint32_t staticSubnet = 0;
+  uint32_t staticDns = 0;
+  WiFiEventFuncCb callback;
+  sim::Task* eventTask = nullptr;
+} wifi;
+
+static void wifiDrop() {
+  wifi.epoch++;
+}
+
+static uint64_t wifiConnectUs(bool scan) {
+  return ((scan ? SIM_WIFI_SCAN_MS : 0) + SIM_WIFI_ASSOC_MS + (wifi.staticIp != 0 ? 0 : SIM_WIFI_DHCP_MS)) * 1000ULL;
+}
+
+static void wifiEmit(arduino_event_id_t event, uint8_t reason) {
+  if (!wifi.callback) return;
+  arduino_event_info_t info = {};
+  info.wifi_sta_disconnected.reason = reason;
+  wifi.callback(event, info);
+}
+
+// 事件任务（对应ESP32的系统事件任务）：连接状态变化时调用 onEvent 回调
+static void wifiEventTask(void*) {
+  bool wasConnected = sim::wifiConnected();
+  for (;;) {
+    sim::sleepUs(SIM_WIFI_EVENT_POLL_US);
+    bool connected = sim::wifiConnected();
+    if (connected && !wasConnected) {
+      wifiEmit(ARDUINO_EVENT_WIFI_STA_CONNECTED, 0);
+      wifiEmit(ARDUINO_EVENT_WIFI_STA_GOT_IP, 0);
+    } else if (!connected && wasConnected) {
+      wifiEmit(ARDUINO_EVENT_WIFI_STA_DISCONNECTED, wifi.available ? 8 : 200);   // ASSOC_LEAVE / BEACON_TIMEOUT
+    } else if (wifi.failAt != 0 && sim::nowUs() >= wifi.failAt) {
+      wifi.failAt = 0;
+      if (!wifi.autoReconnect) wifi.begun = false;
+      wifiEmit(ARDUINO_EVENT_WIFI_STA_DISCONNECTED, 201);   // NO_AP_FOUND
+    }
+    wasConnected = connected;
+  }
+}
+
+static void wifiStartAttempt(bool scan) {
+  wifi.begun = true;
+  wifi.attemptOk = wifi.available;
+  wifi.connectAt = sim::nowUs() + wifiConnectUs(scan);
+  wifi.failAt = wifi.attemptOk ? 0 : sim::nowUs() + (scan ? SIM_WIFI_SCAN_MS : SIM_WIFI_ASSOC_MS) * 1000ULL;
+}
+
+void sim::setWifiAvailable(bool available) {
+  if (available == wifi.available) return;
+  wifi.available = available;
+  if (!available) {
+    wifiDrop();
+    if (!wifi.autoReconnect) wifi.begun = false;
+  } else if (wifi.begun && wifi.autoReconnect) {
+    wifiStartAttempt(true);
+  }
+}
+
+void sim::setWifiChannel(int channel) {
+  if (channel == wifi.apChannel) return;
+  bool wasUp = sim::wifiConnected();
+  wifi.apChannel = channel;
+  if (wasUp) {
+    // AP重启到新信道：当前连接断开
+    sim::setWifiAvailable(false);
+    sim::setWifiAvailable(true);
+  }
+}
+
+bool sim::wifiConnected() {
+  return wifi.begun && wifi.attemptOk && wifi.available && sim::nowUs() >= wifi.connectAt;
+}
+
+String IPAddress::toString() const {
+  char text[16];
+  snprintf(text, sizeof(text), "%u.%u.%u.%u", bytes[0], bytes[1], bytes[2], bytes[3]);
+  return String(text);
+}
+
+bool WiFiClass::mode(wifi_mode_t mode) {
+  (void)mode;
+  return true;
+}
+
+wl_status_t WiFiClass::begin(const char* ssid, const char* password, int32_t channel,
+                             const uint8_t* bssid, bool connect) {
+  (void)ssid; (void)password;
+  if (!connect || (wifi.begun && sim::wifiConnected())) return status();
+
+  bool targeted = channel > 0 && bssid != NULL;
+  wifiStartAttempt(!targeted);
+  if (targeted && (channel != wifi.apChannel || memcmp(bssid, SIM_AP_BSSID, sizeof(SIM_AP_BSSID)) != 0)) {
+    // 指定的AP/信道上没有回应
+    wifi.attemptOk = false;
+    wifi.failAt = sim::nowUs() + SIM_WIFI_ASSOC_MS * 1000ULL;
+  }
+  return status();
+}
+
+bool WiFiClass::config(IPAddress localIp, IPAddress gateway, IPAddress subnet, IPAddress dns1) {
+  wifi.staticIp = localIp;
+  wifi.staticGateway = gateway;
+  wifi.staticSubnet = subnet;
+  wifi.staticDns = dns1;
+  return true;
+}
+
+int WiFiClass::onEvent(WiFiEventFuncCb callback) {
+  wifi.callback = callback;
+  if (wifi.eventTask == nullptr) {
+    wifi.eventTask = sim::createTask("sys_evt", wifiEventTask, nullptr, 20, 4096);
+  }
+  return 0;
+}
+
+bool WiFiClass::setAutoReconnect(bool enable) {
+  wifi.autoReconnect = enable;
+  return true;
+}
+
+wl_status_t WiFiClass::status() {
+  if (!wifi.begun) return WL_IDLE_STATUS;
+  if (!wifi.available) return WL_NO_SSID_AVAIL;
+  return sim::wifiConnected() ? WL_CONNECTED : WL_DISCONNECTED;
+}
+
+bool WiFiClass::disconnect(bool wifiOff, bool eraseAp) {
+  (void)wifiOff; (void)eraseAp;
+  if (wifi.begun) wifiDrop();
+  wifi.begun = false;
+  wifi.failAt = 0;
+  return true;
+}
+
+bool WiFiClass::reconnect() {
+  wifiDrop();
+  wifiStartAttempt(true);
+  return true;
+}
+
+IPAddress WiFiClass::localIP() {
+  if (!sim::wifiConnected()) return IPAddress();
+  return wifi.staticIp != 0 ? IPAddress(wifi.staticIp) : IPAddress(192, 168, 1, 50);
+}
+
+IPAddress WiFiClass::gatewayIP() {
+  if (!sim::wifiConnected()) return IPAddress();
+  return wifi.staticIp != 0 ? IPAddress(wifi.staticGateway) : IPAddress(192, 168, 1, 1);
+}
+
+IPAddress WiFiClass::subnetMask() {
+  if (!sim::wifiConnected()) return IPAddress();
+  return wifi.staticIp != 0 ? IPAddress(wifi.staticSubnet) : IPAddress(255, 255, 255, 0);
+}
+
+IPAddress WiFiClass::dnsIP(uint8_t index) {
+  (void)index;
+  if (!sim::wifiConnected()) return IPAddress();
+  return wifi.staticIp != 0 ? IPAddress(wifi.staticDns) : IPAddress(192, 168, 1, 1);
+}
+
+uint8_t* WiFiClass::BSSID() {
+  static uint8_t bssid[6];
+  if (!sim::wifiConnected()) return NULL;
+  memcpy(bssid, SIM_AP_BSSID, sizeof(bssid));
+  return bssid;
+}
+
+int32_t WiFiClass::channel() {
+  return sim::wifiConnected() ? wifi.apChannel : 0;
+}
+
+int8_t WiFiClass::RSSI() {
+  return sim::wifiConnected() ? -58 : 0;
+}
+
+String WiFiClass::SSID() {
+  return String("sim");
+}
+
+uint8_t* WiFiClass::macAddress(uint8_t* mac) {
+  static const uint8_t MAC[6] = {0xA1, 0xB2, 0xC3, 0xD4, 0xE5, 0xF6};
+  memcpy(mac, MAC, sizeof(MAC));
+  return mac;
+}
+
+String WiFiClass::macAddress() {
+  uint8_t mac[6];
+  macAddress(mac);
+  char text[18];
+  snprintf(text, sizeof(text), "%02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+  return String(text);
+}
+
+// =================== TCP / TLS 连接 ===================
+int WiFiClient::connect(const char* host, uint16_t port) {
+  (void)host; (void)port;
+  stop();
+  if (!sim::wifiConnected()) return 0;
+  sim::chargeUs((uint64_t)mock::server().getOptions().latencyMs * 1000);  // TCP握手
+  open = sim::wifiConnected();
+  lastActivityUs = sim::nowUs();
+  epoch = wifi.epoch;
+  return open ? 1 : 0;
+}
+
+int WiFiClientSecure::connect(const char* host, uint16_t port) {
+  (void)host; (void)port;
+  stop();
+  if (!sim::wifiConnected()) return 0;
+
+  bool ok;
+  uint32_t handshakeUs;
+  {
+    sim::Untracked guard;
+    handshakeUs = mock::server().handshake(ok);
+  }
+  sim::chargeUs(handshakeUs);
+  open = ok && sim::wifiConnected();
+  lastActivityUs = sim::nowUs();
+  epoch = wifi.epoch;
+  return open ? 1 : 0;
+}
+
+// 服务器关闭空闲连接、WiFi断开后连接失效（未读完的数据仍可读取）
+uint8_t WiFiClient::connected() {
+  if (!open) return available() > 0;
+  uint64_t idleUs = sim::nowUs() - lastActivityUs;
+  if (epoch != wifi.epoch || idleUs > (uint64_t)mock::server().getOptions().keepAliveMs * 1000) {
+    open = false;
+  }
+  return open || available() > 0;
+}
+
+void WiFiClient::stop() {
+  open = false;
+  simDiscardInput();
+}
+
+int WiFiClient::available() {
+  return (int)(rx.size() - rxPos);
+}
+
+int WiFiClient::read() {
+  if (rxPos >= rx.size()) return -1;
+  return (uint8_t)rx[rxPos++];
+}
+
+int WiFiClient::peek() {
+  if (rxPos >= rx.size()) return -1;
+  return (uint8_t)rx[rxPos];
+}
+
+void WiFiClient::simReceive(const char* data, size_t size) {
+  sim::Untracked guard;
+  rx.append(data, size);
+  lastActivityUs = sim::nowUs();
+}
+
+void WiFiClient::simDiscardInput() {
+  sim::Untracked guard;
+  rx.clear();
+  rx.shrink_to_fit();
+  rxPos = 0;
+}
+
+// =================== HTTPClient ===================
+static const size_t CHUNK_SIZE = 256;   // chunked响应每块大小
+
+bool HTTPClient::begin(WiFiClient& client, const String& url) {
+  sim::Untracked guard;
+  this->client = &client;
+  std::string text = url.c_str();
+  port = 443;
+  size_t schemeEnd = text.find("://");
+  if (schemeEnd != std::string::npos) {
+    if (text.compare(0, schemeEnd, "http") == 0) port = 80;
+    text = text.substr(schemeEnd + 3);
+  }
+  size_t pathStart = text.find('/');
+  host = text.substr(0, pathStart);
+  path = pathStart == std::string::npos ? "/" : text.substr(pathStart);
+  size_t colon = host.find(':');
+  if (colon != std::string::npos) {
+    port = (uint16_t)atoi(host.c_str() + colon + 1);
+    host = host.substr(0, colon);
+  }
+  requestHeaders.clear();
+  responseHeaders.clear();
+  size = -1;
+  chunked = false;
+  return true;
+}
+
+void HTTPClient::end() {
+  if (client != NULL) {
+    client->simDiscardInput();   // 与ESP32相同：丢弃未读完的响应，连接才能复用
+    if (!reuse) client->stop();
+  }
+  sim::Untracked guard;
+  requestHeaders.clear();
+  responseHeaders.clear();
+}
+
+void HTTPClient::addHeader(const String& name, const String& value) {
+  sim::Untracked guard;
+  requestHeaders.emplace_back(name.c_str(), value.c_str());
+}
+
+void HTTPClient::collectHeaders(const char* names[], size_t count) {
+  sim::Untracked guard;
+  wantedHeaders.clear();
+  for (size_t i = 0; i < count; i++) wantedHeaders.emplace_back(names[i]);
+}
+
+String HTTPClient::header(const char* name) {
+  for (const auto& entry : responseHeaders) {
+    if (strcasecmp(entry.first.c_str(), name) == 0) return String(entry.second.c_str());
+  }
+  return String();
+}
+
+int HTTPClient::sendRequest(const char* method, const String& payload) {
+  return sendRequest(method, (uint8_t*)payload.c_str(), payload.length());
+}
+
+int HTTPClient::sendRequest(const char* method, uint8_t* payload, size_t length) {
+  if (client == NULL) return HTTPC_ERROR_NOT_CONNECTED;
+  if (!client->connected() && !client->connect(host.c_str(), port)) {
+    return HTTPC_ERROR_CONNECTION_REFUSED;
+  }
+  client->simDiscardInput();
+
+  mock::Response response;
+  {
+    sim::Untracked guard;
+    std::string headers;
+    for (const auto& entry : requestHeaders) headers += entry.first + ": " + entry.second + "\n";
+    std::string body = payload != NULL ? std::string((const char*)payload, length) : std::string();
+    response = mock::server().handle(method, path, headers, body);
+  }
+
+  if (response.fault == mock::FAULT_TIMEOUT) {
+    sim::chargeUs((uint64_t)timeoutMs * 1000);
+    client->stop();
+    return HTTPC_ERROR_READ_TIMEOUT;
+  }
+
+  sim::chargeUs(response.latencyUs);
+  if (response.fault == mock::FAULT_DROP || !client->connected()) {
+    client->stop();
+    return HTTPC_ERROR_CONNECTION_LOST;
+  }
+
+  sim::Untracked guard;
+  chunked = mock::server().getOptions().chunked;
+  responseHeaders.clear();
+  for (const std::string& name : wantedHeaders) {
+    if (chunked && strcasecmp(name.c_str(), "Transfer-Encoding") == 0) {
+      responseHeaders.emplace_back(name, "chunked");
+    } else if (!chunked && strcasecmp(name.c_str(), "Content-Length") == 0) {
+      responseHeaders.emplace_back(name, std::to_string(response.body.size()));
+    }
+  }
+
+  if (chunked) {
+    size = -1;
+    for (size_t pos = 0; pos < response.body.size(); pos += CHUNK_SIZE) {
+      size_t n = std::min(CHUNK_SIZE, response.body.size() - pos);
+      char line[16];
+      int lineLength = snprintf(line, sizeof(line), "%zx\r\n", n);
+      client->simReceive(line, lineLength);
+      client->simReceive(response.body.data() + pos, n);
+      client->simReceive("\r\n", 2);
+    }
+    client->simReceive("0\r\n\r\n", 5);
+  } else {
+    size = (int)response.body.size();
+    client->simReceive(response.body.data(), response.body.size());
+  }
+  return response.status;
+}
+
+String HTTPClient::errorToString(int error) {
+  switch (error) {
+    case HTTPC_ERROR_CONNECTION_REFUSED: return String("connection refused");
+    case HTTPC_ERROR_NOT_CONNECTED: return String("not connected");
+    case HTTPC_ERROR_CONNECTION_LOST: return String("connection lost");
+    case HTTPC_ERROR_READ_TIMEOUT: return String("read Timeout");
+    default: return String();
+  }
+}
+
+// 读出整个响应体（chunked时解码）
+String HTTPClient::getString() {
+  String text;
+  if (client == NULL) return text;
+  if (!chunked) {
+    int remaining = size;
+    while (remaining != 0 && client->available() > 0) {
+      text += (char)client->read();
+      if (remaining > 0) remaining--;
+    }
+    return text;
+  }
+
+  for (;;) {
+    String line = client->readStringUntil('\n');
+    long chunk = strtol(line.c_str(), NULL, 16);
+    if (chunk <= 0) {
+      client->readStringUntil('\n');  // 结尾空行
+      break;
+    }
+    for (long i = 0; i < chunk && client->available() > 0; i++) text += (char)client->read();
+    client->readStringUntil('\n');    // 块尾CRLF
+  }
+  return text;
+}
@@ -0,0 +1,14 @@
+-- =============================================================
+-- 交易幂等键（离线队列分批重放）
+--
+-- 终端为每笔交易生成唯一的 idempotency_key（<芯片MAC>-<序号>），
+-- 在线POST和离线批量重放都使用 on_conflict=idempotency_key 的upsert，
+-- 同一笔交易无论重试多少次都只会有一行记录。
+-- =============================================================
+
+ALTER TABLE jc_transaction_history
+  ADD COLUMN IF NOT EXISTS idempotency_key VARCHAR(40);
+
+-- 旧记录为NULL，不参与唯一性约束
+CREATE UNIQUE INDEX IF NOT EXISTS uq_transaction_idempotency_key
+  ON jc_transaction_history(idempotency_key);
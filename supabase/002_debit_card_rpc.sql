@@ -0,0 +1,130 @@
+-- =============================================================
+-- 单次请求扣费（PostgREST RPC）
+--
+-- POST /rest/v1/rpc/jc_debit_card
+-- 在一个事务内完成：锁定卡片 → 检查状态和余额 → 扣费 → 写交易记录，
+-- 返回扣费前后余额。原来的 查询 + PATCH(绝对余额) + POST 三次请求
+-- 合并为一次，多台终端同时扣同一张卡也不会互相覆盖余额。
+--
+-- 幂等：同一个 idempotency_key 重复调用不会重复扣费，
+-- 返回 duplicate=true 和当前余额（终端网络超时后可以安全重试）。
+-- 该幂等键已记为未收款（CHARGE_UNCOLLECTED，见下文）时返回
+-- ok=false、reason='uncollected'，终端按未收款结清，不当作已扣费。
+--
+-- card_uid：7/10字节UID的十进制值最多25位，超出BIGINT范围，
+-- 两张表的 card_uid 改为 NUMERIC(25,0)（引用 jc_vip_cards.card_uid 的外键列需同样修改）。
+--
+-- 依赖：001_transaction_idempotency.sql
+-- =============================================================
+
+-- 重复执行时先删除依赖 card_uid 的视图和旧版函数（参数为BIGINT）
+DROP VIEW IF EXISTS jc_uncollected_charges;
+DROP FUNCTION IF EXISTS jc_debit_card(BIGINT, NUMERIC, TEXT, TEXT, TEXT);
+
+ALTER TABLE jc_vip_cards ALTER COLUMN card_uid TYPE NUMERIC(25,0);
+ALTER TABLE jc_transaction_history ALTER COLUMN card_uid TYPE NUMERIC(25,0);
+
+CREATE OR REPLACE FUNCTION jc_debit_card(
+  p_card_uid NUMERIC,
+  p_amount NUMERIC,
+  p_machine_id TEXT,
+  p_package TEXT,
+  p_idempotency_key TEXT
+) RETURNS JSON
+LANGUAGE plpgsql
+AS $$
+DECLARE
+  v_credit NUMERIC;
+  v_active BOOLEAN;
+  v_before NUMERIC;
+  v_type TEXT;
+BEGIN
+  IF p_amount IS NULL OR p_amount <= 0 OR p_idempotency_key IS NULL THEN
+    RETURN json_build_object('ok', false, 'reason', 'invalid_request');
+  END IF;
+
+  -- 锁定卡片行：同一张卡的并发扣费按顺序执行
+  SELECT card_credit, is_active INTO v_credit, v_active
+    FROM jc_vip_cards
+   WHERE card_uid = p_card_uid
+     FOR UPDATE;
+
+  IF NOT FOUND THEN
+    RETURN json_build_object('ok', false, 'reason', 'not_found');
+  END IF;
+
+  -- 已处理过的请求（终端重试）：不再扣费
+  SELECT balance_before, transaction_type INTO v_before, v_type
+    FROM jc_transaction_history
+   WHERE idempotency_key = p_idempotency_key;
+
+  IF FOUND THEN
+    IF v_type = 'CHARGE' THEN
+      RETURN json_build_object('ok', true, 'duplicate', true,
+                               'balance_before', v_before, 'balance_after', v_credit);
+    END IF;
+    -- 同一幂等键已记为未收款：余额没有扣除，不能当作已扣费
+    RETURN json_build_object('ok', false, 'duplicate', true, 'reason', 'uncollected', 'balance', v_credit);
+  END IF;
+
+  IF NOT COALESCE(v_active, false) THEN
+    RETURN json_build_object('ok', false, 'reason', 'inactive', 'balance', v_credit);
+  END IF;
+
+  IF v_credit < p_amount THEN
+    RETURN json_build_object('ok', false, 'reason', 'insufficient', 'balance', v_credit);
+  END IF;
+
+  UPDATE jc_vip_cards
+     SET card_credit = card_credit - p_amount,
+         updated_at = NOW()
+   WHERE card_uid = p_card_uid;
+
+  INSERT INTO jc_transaction_history
+    (machine_id, card_uid, transaction_type, third_party_reference,
+     transaction_amount, balance_before, idempotency_key)
+  VALUES
+    (p_machine_id, p_card_uid, 'CHARGE', p_package,
+     -p_amount, v_credit, p_idempotency_key);
+
+  RETURN json_build_object('ok', true, 'duplicate', false,
+                           'balance_before', v_credit, 'balance_after', v_credit - p_amount);
+END;
+$$;
+
+GRANT EXECUTE ON FUNCTION jc_debit_card(NUMERIC, NUMERIC, TEXT, TEXT, TEXT) TO anon, authenticated;
+
+-- =============================================================
+-- 未收款交易（对账）
+--
+-- 终端凭本地卡片缓存授权后服务已经开始（在线缓存授权或断网授权），
+-- 但 jc_debit_card 拒绝扣费（卡片已停用/余额不足/已删除）时，终端写入
+-- transaction_type = 'CHARGE_UNCOLLECTED' 的交易记录：
+--   - card_credit 没有扣除，不是营收（统计营收只计 'CHARGE'）
+--   - transaction_amount 为应收金额（负数），幂等键与原扣费请求相同
+-- 在线扣费结果未知（超时/5xx）的交易不会写这种记录，而是由终端
+-- 通过 jc_debit_card 用同一幂等键重试。
+-- =============================================================
+
+CREATE INDEX IF NOT EXISTS idx_transaction_uncollected
+  ON jc_transaction_history(created_at)
+  WHERE transaction_type = 'CHARGE_UNCOLLECTED';
+
+-- 对账视图：未收款交易及卡片当前状态（含持卡人信息，只供管理端查询，不授权给终端使用的 anon）
+CREATE OR REPLACE VIEW jc_uncollected_charges AS
+SELECT
+  t.id,
+  t.created_at,
+  t.machine_id,
+  t.card_uid,
+  c.display_card_number,
+  c.cardholder_name,
+  t.third_party_reference AS package,
+  -t.transaction_amount AS amount_due,
+  t.balance_before,
+  c.card_credit AS current_credit,
+  c.is_active,
+  t.idempotency_key
+FROM jc_transaction_history t
+LEFT JOIN jc_vip_cards c ON c.card_uid = t.card_uid
+WHERE t.transaction_type = 'CHARGE_UNCOLLECTED';
@@ -0,0 +1,14 @@
+-- =============================================================
+-- 健康度日志：复位诊断
+--
+-- 终端的日志环形缓冲区位于RTC_NOINIT内存，看门狗/异常/软件复位后保留。
+-- 启动后的第一条健康度日志带上复位原因和复位前的最后几条日志，
+-- 用于排查现场死机（以前只能看到 uptime 归零）。
+--
+-- reset_reason: esp_reset_reason_t（1=上电, 3=软件复位, 4=异常, 5/6/7=看门狗 ...）
+-- post_mortem_log: 复位前的最后 LOG_POST_MORTEM_LINES 条日志，只在软复位后上传一次
+-- =============================================================
+
+ALTER TABLE system_health_logs
+  ADD COLUMN IF NOT EXISTS reset_reason INTEGER,
+  ADD COLUMN IF NOT EXISTS post_mortem_log TEXT;
@@ -0,0 +1,26 @@
+-- =============================================================
+-- 健康度日志：交易路径耗时直方图
+--
+-- 终端按阶段统计刷卡→洗车的耗时（LatencyTrace.h），每次上传健康度日志时
+-- 带上本周期（上次上传以来）的直方图，上传后清零。
+-- 用于区分"刷卡没反应"的原因：射频、网络还是服务器。
+--
+-- latency_histograms 格式（只包含有样本的阶段，时间单位毫秒）：
+--   {"card_get": {"n": 12, "p50": 95.2, "p95": 180.4, "p99": 230.0, "max": 241.7,
+--                 "b": [0, 0, 0, 0, 0, 0, 0, 3, 9]}, ...}
+--
+-- 阶段: nfc_detect, nfc_uid, card_get, balance_patch, tx_post, debit_rpc,
+--       tap_to_result, tap_to_pulse
+-- b: 各桶计数（省略末尾的0），桶上界(ms):
+--   0.5, 1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000, 10000, 20000, >20000
+-- 各周期的 b 可以直接相加，得到任意时间段的分位数
+-- =============================================================
+
+ALTER TABLE system_health_logs
+  ADD COLUMN IF NOT EXISTS latency_histograms JSONB;
+
+-- 示例：最近24小时各终端查卡请求的p95
+-- SELECT device_id, MAX((latency_histograms->'card_get'->>'p95')::numeric) AS card_get_p95_ms
+-- FROM system_health_logs
+-- WHERE timestamp > NOW() - INTERVAL '24 hours' AND latency_histograms ? 'card_get'
+-- GROUP BY device_id;
@@ -0,0 +1,81 @@
+-- =============================================================
+-- 健康度日志：每分钟采样记录
+--
+-- 终端每分钟采样一条记录（HealthSampler.h），每次上传健康度日志时带上
+-- 未上传的记录（一般为一个周期30条，积压时最多60条）。上传失败或断网时
+-- 记录保存在终端NVS中，下次上传（包括重启后）补传。
+--
+-- samples 格式（按列存放，前5列为差分编码：第一个值为原值，之后为与前一个的差）：
+--   {"v": 1, "n": 30, "now_m": 1234, "now_b": 7,
+--    "m": [1204, 1, 1, ...],        -- 启动后第几分钟（差分）
+--    "b": [7, 0, 0, ...],           -- 启动序号（差分）
+--    "heap": [182, 0, -1, ...],     -- 剩余堆 KB（差分）
+--    "min_heap": [150, 0, 0, ...],  -- 启动以来最低剩余堆 KB（差分）
+--    "rssi": [-61, 1, -2, ...],     -- WiFi信号 dBm，未连接为0（差分）
+--    "loop_ms": [...],              -- 本分钟loop最长耗时
+--    "tx": [...], "nfc_ok": [...], "nfc_fail": [...], "err": [...],  -- 本分钟计数
+--    "offline": [...],              -- 离线交易积压
+--    "st": [...],                   -- 状态编号（config.h SystemState）
+--    "f": [...]}                    -- 1=WiFi 2=NFC 4=OLED
+--
+-- 采样时间：终端没有时钟。与本条日志同一次启动（b = now_b）的记录，
+--   时间 = timestamp - (now_m - m) 分钟；之前启动的记录为NULL
+--   （可用同一 device_id、同一启动序号的其他日志推算）
+-- =============================================================
+
+ALTER TABLE system_health_logs
+  ADD COLUMN IF NOT EXISTS samples JSONB;
+
+-- 展开为每分钟一行（差分列累加还原）
+CREATE OR REPLACE VIEW system_health_samples AS
+SELECT
+  l.id AS log_id,
+  l.device_id,
+  s.i AS sample_index,
+  SUM(s.m) OVER w AS uptime_minute,
+  SUM(s.b) OVER w AS boot,
+  CASE WHEN SUM(s.b) OVER w = (l.samples->>'now_b')::int
+       THEN l.timestamp - make_interval(mins => (l.samples->>'now_m')::int - (SUM(s.m) OVER w)::int)
+  END AS sampled_at,
+  SUM(s.heap) OVER w AS free_heap_kb,
+  SUM(s.min_heap) OVER w AS min_free_heap_kb,
+  SUM(s.rssi) OVER w AS wifi_rssi,
+  s.loop_ms,
+  s.tx AS transactions,
+  s.nfc_ok,
+  s.nfc_fail,
+  s.err AS errors,
+  s.offline AS offline_pending,
+  s.st AS state,
+  (s.f & 1) <> 0 AS wifi_connected,
+  (s.f & 2) <> 0 AS nfc_working,
+  (s.f & 4) <> 0 AS oled_working
+FROM system_health_logs l
+CROSS JOIN LATERAL (
+  SELECT
+    i,
+    (l.samples->'m'->>(i - 1))::int AS m,
+    (l.samples->'b'->>(i - 1))::int AS b,
+    (l.samples->'heap'->>(i - 1))::int AS heap,
+    (l.samples->'min_heap'->>(i - 1))::int AS min_heap,
+    (l.samples->'rssi'->>(i - 1))::int AS rssi,
+    (l.samples->'loop_ms'->>(i - 1))::int AS loop_ms,
+    (l.samples->'tx'->>(i - 1))::int AS tx,
+    (l.samples->'nfc_ok'->>(i - 1))::int AS nfc_ok,
+    (l.samples->'nfc_fail'->>(i - 1))::int AS nfc_fail,
+    (l.samples->'err'->>(i - 1))::int AS err,
+    (l.samples->'offline'->>(i - 1))::int AS offline,
+    (l.samples->'st'->>(i - 1))::int AS st,
+    (l.samples->'f'->>(i - 1))::int AS f
+  FROM generate_series(1, COALESCE((l.samples->>'n')::int, 0)) AS i
+) s
+WHERE l.samples IS NOT NULL
+WINDOW w AS (PARTITION BY l.id ORDER BY s.i);
+
+GRANT SELECT ON system_health_samples TO anon, authenticated;
+
+-- 示例：某终端最近6小时每分钟的堆内存和信号
+-- SELECT sampled_at, free_heap_kb, wifi_rssi, loop_ms, transactions, errors
+-- FROM system_health_samples
+-- WHERE device_id = 'YOUR_DEVICE_ID' AND sampled_at > NOW() - INTERVAL '6 hours'
+-- ORDER BY sampled_at;
@@ -0,0 +1,33 @@
+-- =============================================================
+-- 健康度日志：启动耗时
+--
+-- 终端启动时OLED和NFC由初始化任务并行初始化，WiFi在后台连接，
+-- 启动后的第一条健康度日志（WiFi连接后立即发送）带上各阶段耗时（BootProfile.h）。
+-- 用于发现启动变慢的终端（I2C总线故障时扫描总线、OLED重试、WiFi连接慢……）。
+--
+-- boot_report 格式（时间单位毫秒，均为启动后的时刻/时长）：
+--   {"ready_ms": 420,
+--    "stages": {"core": [0, 35, 1], "oled": [36, 240, 1], "nfc": [36, 120, 1], ...}}
+--
+-- ready_ms: 进入欢迎界面（可以刷卡）的时刻
+-- stages: 每个阶段 [开始, 耗时, 状态]，状态 1=成功 0=失败 -1=上传时尚未完成
+--   core     串口、日志任务、GPIO、脉冲/声光定时器
+--   oled     I2C + OLED（初始化任务，与nfc并行）
+--   nfc      SPI + MFRC522（初始化任务）
+--   config   NVS + 配置管理器
+--   storage  离线交易日志、卡片缓存、健康度分钟记录
+--   net      Supabase客户端 + 网络任务
+--   ui       界面资源 + 渲染任务
+--   wifi     WiFi.begin → 获取IP（后台，进入欢迎界面后仍可能在进行）
+-- =============================================================
+
+ALTER TABLE system_health_logs
+  ADD COLUMN IF NOT EXISTS boot_report JSONB;
+
+-- 示例：最近7天各终端的启动耗时（每次启动一行）
+-- SELECT device_id, timestamp, reset_reason,
+--        (boot_report->>'ready_ms')::int AS ready_ms,
+--        (boot_report->'stages'->'wifi'->>1)::int AS wifi_ms
+-- FROM system_health_logs
+-- WHERE timestamp > NOW() - INTERVAL '7 days' AND boot_report IS NOT NULL
+-- ORDER BY ready_ms DESC;
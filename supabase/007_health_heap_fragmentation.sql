@@ -0,0 +1,82 @@
+-- =============================================================
+-- 健康度日志：堆碎片
+--
+-- 分配失败取决于最大空闲块（连续内存），不只是剩余总量。碎片化的终端
+-- 剩余堆看起来正常，但TLS重新握手（约16KB连续内存）会失败，表现为
+-- "在线但所有请求失败"。终端记录最大空闲块和碎片率（HeapMonitor.h）：
+--   max_alloc_heap        上传时的最大空闲块（字节）
+--   min_max_alloc_heap    启动以来最大空闲块的最低值
+--   heap_frag_percent     上传时的碎片率 = 100 - 最大空闲块 * 100 / 剩余堆
+--   max_heap_frag_percent 启动以来每分钟健康检查时的最高碎片率
+--   heap_alloc_failures   启动以来的分配失败次数
+--
+-- 每分钟记录（samples）升级为 v2：增加 blk 列（最大空闲块 KB，差分编码，
+-- 位于 min_heap 之后）。v1 记录没有 blk，视图中为 NULL。
+-- =============================================================
+
+ALTER TABLE system_health_logs
+  ADD COLUMN IF NOT EXISTS max_alloc_heap BIGINT,
+  ADD COLUMN IF NOT EXISTS min_max_alloc_heap BIGINT,
+  ADD COLUMN IF NOT EXISTS heap_frag_percent SMALLINT,
+  ADD COLUMN IF NOT EXISTS max_heap_frag_percent SMALLINT,
+  ADD COLUMN IF NOT EXISTS heap_alloc_failures INTEGER;
+
+-- 每分钟记录视图：末尾增加 max_block_kb（其余列与 005 相同）
+CREATE OR REPLACE VIEW system_health_samples AS
+SELECT
+  l.id AS log_id,
+  l.device_id,
+  s.i AS sample_index,
+  SUM(s.m) OVER w AS uptime_minute,
+  SUM(s.b) OVER w AS boot,
+  CASE WHEN SUM(s.b) OVER w = (l.samples->>'now_b')::int
+       THEN l.timestamp - make_interval(mins => (l.samples->>'now_m')::int - (SUM(s.m) OVER w)::int)
+  END AS sampled_at,
+  SUM(s.heap) OVER w AS free_heap_kb,
+  SUM(s.min_heap) OVER w AS min_free_heap_kb,
+  SUM(s.rssi) OVER w AS wifi_rssi,
+  s.loop_ms,
+  s.tx AS transactions,
+  s.nfc_ok,
+  s.nfc_fail,
+  s.err AS errors,
+  s.offline AS offline_pending,
+  s.st AS state,
+  (s.f & 1) <> 0 AS wifi_connected,
+  (s.f & 2) <> 0 AS nfc_working,
+  (s.f & 4) <> 0 AS oled_working,
+  SUM(s.blk) OVER w AS max_block_kb
+FROM system_health_logs l
+CROSS JOIN LATERAL (
+  SELECT
+    i,
+    (l.samples->'m'->>(i - 1))::int AS m,
+    (l.samples->'b'->>(i - 1))::int AS b,
+    (l.samples->'heap'->>(i - 1))::int AS heap,
+    (l.samples->'min_heap'->>(i - 1))::int AS min_heap,
+    (l.samples->'blk'->>(i - 1))::int AS blk,
+    (l.samples->'rssi'->>(i - 1))::int AS rssi,
+    (l.samples->'loop_ms'->>(i - 1))::int AS loop_ms,
+    (l.samples->'tx'->>(i - 1))::int AS tx,
+    (l.samples->'nfc_ok'->>(i - 1))::int AS nfc_ok,
+    (l.samples->'nfc_fail'->>(i - 1))::int AS nfc_fail,
+    (l.samples->'err'->>(i - 1))::int AS err,
+    (l.samples->'offline'->>(i - 1))::int AS offline,
+    (l.samples->'st'->>(i - 1))::int AS st,
+    (l.samples->'f'->>(i - 1))::int AS f
+  FROM generate_series(1, COALESCE((l.samples->>'n')::int, 0)) AS i
+) s
+WHERE l.samples IS NOT NULL
+WINDOW w AS (PARTITION BY l.id ORDER BY s.i);
+
+GRANT SELECT ON system_health_samples TO anon, authenticated;
+
+-- 示例：最近7天最大空闲块持续下降的终端（碎片化，长期运行后可能需要排查）
+-- SELECT device_id,
+--        MIN(min_max_alloc_heap) / 1024 AS min_block_kb,
+--        MAX(max_heap_frag_percent) AS max_frag_percent,
+--        MAX(heap_alloc_failures) AS alloc_failures
+-- FROM system_health_logs
+-- WHERE timestamp > NOW() - INTERVAL '7 days' AND max_alloc_heap IS NOT NULL
+-- GROUP BY device_id
+-- ORDER BY min_block_kb;
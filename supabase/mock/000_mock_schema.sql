@@ -0,0 +1,85 @@
+-- =============================================================
+-- 本地模拟服务器数据库（仅用于测试，不要在Supabase上执行）
+--
+-- 只包含终端用到的表和列，结构与线上一致。
+-- docker compose 启动时按文件名顺序执行：
+--   000_mock_schema.sql → 001_transaction_idempotency.sql → 002_debit_card_rpc.sql
+-- =============================================================
+
+-- PostgREST 角色（Supabase 中已存在）
+CREATE ROLE anon NOLOGIN;
+CREATE ROLE authenticated NOLOGIN;
+CREATE ROLE authenticator LOGIN PASSWORD 'mock' NOINHERIT;
+GRANT anon TO authenticator;
+GRANT authenticated TO authenticator;
+
+-- 会员卡
+CREATE TABLE jc_vip_cards (
+  card_uid NUMERIC(25,0) PRIMARY KEY,
+  display_card_number VARCHAR(20),
+  cardholder_name VARCHAR(100),
+  card_credit DECIMAL(10,2) NOT NULL DEFAULT 0,
+  member_type INTEGER DEFAULT 0,
+  is_active BOOLEAN DEFAULT true,
+  updated_at TIMESTAMP WITH TIME ZONE DEFAULT NOW()
+);
+
+-- 交易记录
+CREATE TABLE jc_transaction_history (
+  id BIGSERIAL PRIMARY KEY,
+  machine_id VARCHAR(20),
+  card_uid NUMERIC(25,0),
+  transaction_type VARCHAR(20),
+  third_party_reference VARCHAR(50),
+  transaction_amount DECIMAL(10,2),
+  balance_before DECIMAL(10,2),
+  created_at TIMESTAMP WITH TIME ZONE DEFAULT NOW()
+);
+
+-- 健康度日志（见 HEALTH_MONITOR_README.md，去掉了 devices 外键）
+CREATE TABLE system_health_logs (
+  id BIGSERIAL PRIMARY KEY,
+  device_id VARCHAR(50) NOT NULL,
+  timestamp TIMESTAMP WITH TIME ZONE DEFAULT NOW(),
+  uptime_seconds BIGINT,
+  uptime_hours DECIMAL(10,2),
+  free_heap BIGINT,
+  min_free_heap BIGINT,
+  heap_usage_percent DECIMAL(5,2),
+  wifi_connected BOOLEAN,
+  wifi_rssi INTEGER,
+  wifi_reconnect_count INTEGER,
+  nfc_initialized BOOLEAN,
+  nfc_firmware_version VARCHAR(10),
+  nfc_last_read_success BOOLEAN,
+  nfc_read_success_count INTEGER,
+  nfc_read_fail_count INTEGER,
+  nfc_success_rate DECIMAL(5,2),
+  nfc_last_active_time TIMESTAMP,
+  nfc_idle_minutes INTEGER,
+  oled_working BOOLEAN,
+  i2c_error_count INTEGER,
+  total_transactions INTEGER,
+  transactions_last_hour INTEGER,
+  last_transaction_time TIMESTAMP,
+  current_state VARCHAR(30),
+  loop_execution_time_ms INTEGER,
+  watchdog_reset_count INTEGER,
+  last_error TEXT,
+  error_count_last_30min INTEGER,
+  reset_reason INTEGER,
+  post_mortem_log TEXT,
+  latency_histograms JSONB,
+  samples JSONB,
+  boot_report JSONB
+);
+
+GRANT USAGE ON SCHEMA public TO anon, authenticated;
+GRANT SELECT, INSERT, UPDATE ON ALL TABLES IN SCHEMA public TO anon, authenticated;
+GRANT USAGE ON ALL SEQUENCES IN SCHEMA public TO anon, authenticated;
+
+-- 测试卡片
+INSERT INTO jc_vip_cards (card_uid, display_card_number, cardholder_name, card_credit, member_type, is_active) VALUES
+  (2345408116, 'JC-VIP-8116', 'Test User',     76.00, 1, true),
+  (1210711100, 'JC-VIP-1100', 'Low Balance',    3.00, 0, true),
+  (1000000001, 'JC-VIP-0001', 'Inactive Card', 50.00, 0, false);